@@ -0,0 +1,96 @@
+
+////////////////////////////////////////////////////////////////////////////////
+///@file cmd_stats.cpp
+///
+///@brief Measures command reply latency and prints per-command statistics.
+///
+/// Repeatedly runs a few common commands and dumps the latency histogram
+/// summary, nack counts, and timeouts for each one. Use the results to choose
+/// an appropriate base reply timeout for a given device and link.
+///
+////////////////////////////////////////////////////////////////////////////////
+
+#include "example_utils.hpp"
+
+#include <mip/definitions/commands_base.hpp>
+#include <mip/definitions/commands_3dm.hpp>
+#include <mip/definitions/data_sensor.hpp>
+
+#include <stdexcept>
+#include <cstdlib>
+#include <stdio.h>
+
+
+void printStats(const mip::CmdStats<>& stats)
+{
+    printf("Cmd        Replies  Nacks  Timeouts    Min    p50    p90    p99    Max   Mean\n");
+
+    for(size_t i=0; i<stats.count(); i++)
+    {
+        const mip::CmdStats<>::Entry& entry = stats[i];
+
+        printf("0x%02X,0x%02X %8u %6u %9u %6u %6u %6u %6u %6u %6.1f\n",
+            entry.descriptor_set, entry.field_descriptor,
+            entry.num_acks + entry.num_nacks, entry.num_nacks, entry.num_timeouts,
+            (unsigned int)entry.min_latency,
+            (unsigned int)mip::C::mip_cmd_stats_entry_percentile(&entry, 50),
+            (unsigned int)mip::C::mip_cmd_stats_entry_percentile(&entry, 90),
+            (unsigned int)mip::C::mip_cmd_stats_entry_percentile(&entry, 99),
+            (unsigned int)entry.max_latency,
+            mip::C::mip_cmd_stats_entry_mean(&entry)
+        );
+
+        for(unsigned int code=1; code<MIP_CMD_STATS_NUM_NACK_CODES; code++)
+        {
+            if( entry.nack_counts[code] > 0 )
+                printf("           %u x %s\n", entry.nack_counts[code], mip::CmdResult(mip::C::mip_cmd_result(code)).name());
+        }
+    }
+
+    if( stats.numUntracked() > 0 )
+        printf("(%u replies to other commands were not tracked)\n", stats.numUntracked());
+}
+
+
+int main(int argc, const char* argv[])
+{
+    try
+    {
+        std::unique_ptr<ExampleUtils> utils = handleCommonArgs(argc, argv, 4);
+        std::unique_ptr<mip::DeviceInterface>& device = utils->device;
+
+        const unsigned int iterations = (argc > 3) ? std::strtoul(argv[3], nullptr, 10) : 100;
+
+        mip::CmdStats<> stats(&getCurrentTimestamp);
+        device->cmdQueue().setStats(&stats);
+
+        printf("Running %u iterations...\n", iterations);
+
+        for(unsigned int i=0; i<iterations; i++)
+        {
+            mip::commands_base::ping(*device);
+
+            mip::commands_base::BaseDeviceInfo info;
+            mip::commands_base::getDeviceInfo(*device, &info);
+
+            uint16_t rate;
+            mip::commands_3dm::getBaseRate(*device, mip::data_sensor::DESCRIPTOR_SET, &rate);
+        }
+
+        device->cmdQueue().setStats(nullptr);
+
+        printStats(stats);
+    }
+    catch(const std::underflow_error& ex)
+    {
+        fprintf(stderr, "Usage: %s <portname> <baudrate> [iterations]\nUsage: %s <hostname> <port> [iterations]\n", argv[0], argv[0]);
+        return 1;
+    }
+    catch(const std::exception& ex)
+    {
+        fprintf(stderr, "Error: %s\n", ex.what());
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,123 @@
+////////////////////////////////////////////////////////////////////////////////
+///@file serial_latency.cpp
+///
+///@brief Measures end-to-end command latency over a serial port with the
+///       default and low latency port settings.
+///
+/// Each mode pings the device repeatedly, timing each round trip from just
+/// before the command is sent until the reply has been parsed. The modes
+/// are run in order: default settings, low latency mode, and (if a busy
+/// poll time is given) low latency mode with busy polling. The differences
+/// are largest with USB-serial adapters, whose drivers otherwise batch
+/// received data for several milliseconds.
+///
+////////////////////////////////////////////////////////////////////////////////
+
+#include "example_utils.hpp"
+
+#include <mip/platform/serial_connection.hpp>
+#include <mip/definitions/commands_base.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <stdexcept>
+#include <vector>
+#include <stdio.h>
+
+
+void runPings(const char* name, mip::DeviceInterface& device, unsigned int iterations)
+{
+    using namespace std::chrono;
+
+    std::vector<uint32_t> latencies;
+    latencies.reserve(iterations);
+
+    unsigned int failures = 0;
+
+    // Warm up, e.g. so that the device is definitely not streaming.
+    mip::commands_base::ping(device);
+
+    for(unsigned int i=0; i<iterations; i++)
+    {
+        const auto start = steady_clock::now();
+        const mip::CmdResult result = mip::commands_base::ping(device);
+        const auto end = steady_clock::now();
+
+        if( result == mip::CmdResult::ACK_OK )
+            latencies.push_back(uint32_t(duration_cast<microseconds>(end - start).count()));
+        else
+            failures++;
+    }
+
+    if( latencies.empty() )
+    {
+        printf("%-24s all %u pings failed\n", name, failures);
+        return;
+    }
+
+    std::sort(latencies.begin(), latencies.end());
+
+    uint64_t sum = 0;
+    for(uint32_t latency : latencies)
+        sum += latency;
+
+    auto percentile = [&](unsigned int p) { return latencies[(latencies.size() - 1) * p / 100]; };
+
+    printf("%-24s %7u %7u %7u %7u %7u %7.1f %8u\n", name,
+        latencies.front(), percentile(50), percentile(90), percentile(99), latencies.back(),
+        double(sum) / latencies.size(), failures
+    );
+}
+
+
+int main(int argc, const char* argv[])
+{
+    if( argc < 3 || argc > 5 )
+    {
+        fprintf(stderr, "Usage: %s <portname> <baudrate> [iterations] [busy_poll_us]\n", argv[0]);
+        return 1;
+    }
+
+    try
+    {
+        const uint32_t baudrate = std::strtoul(argv[2], nullptr, 10);
+        if( baudrate == 0 )
+            throw std::runtime_error("Serial baud rate must be a decimal integer greater than 0.");
+
+        const unsigned int iterations = (argc > 3) ? std::strtoul(argv[3], nullptr, 10) : 1000;
+        const uint32_t     busyPollUs = (argc > 4) ? std::strtoul(argv[4], nullptr, 10) : 0;
+
+        mip::platform::SerialConnection connection(argv[1], baudrate);
+
+        uint8_t buffer[1024];
+        mip::DeviceInterface device(&connection, buffer, sizeof(buffer), mip::C::mip_timeout_from_baudrate(baudrate), 500);
+
+        printf("Round trip latency of %u pings (microseconds):\n\n", iterations);
+        printf("%-24s %7s %7s %7s %7s %7s %7s %8s\n", "Mode", "Min", "p50", "p90", "p99", "Max", "Mean", "Failures");
+
+        runPings("Default", device, iterations);
+
+        // Equivalent to connection.enableLowLatencyMode(), but reports whether
+        // the driver supports its low latency mode.
+        const bool driverLowLatency = connection.setLowLatency(true);
+
+        if( !connection.setReadTiming(1, 0) )
+            throw std::runtime_error("Unable to set the port read timing.");
+
+        runPings(driverLowLatency ? "Low latency" : "Low latency (no driver)", device, iterations);
+
+        if( busyPollUs > 0 )
+        {
+            connection.setBusyPoll(busyPollUs);
+            runPings("Low latency+busy poll", device, iterations);
+        }
+    }
+    catch(const std::exception& ex)
+    {
+        fprintf(stderr, "Error: %s\n", ex.what());
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,191 @@
+////////////////////////////////////////////////////////////////////////////////
+///@file uring_syscalls.cpp
+///
+///@brief Measures how many system calls UringReactor makes per packet
+///       received.
+///
+/// Devices are read with a UringReactor for a number of seconds, counting
+/// the data packets parsed and the io_uring_enter calls made. Real devices
+/// must already be streaming data. Alternatively, devices streaming at a
+/// fixed rate are simulated on pseudo-terminals. Their packets are spread
+/// evenly over each period, as unsynchronized devices would send them, or
+/// with "burst" all sent at once, as devices sharing a clock or PPS would.
+///
+/// The reactor saves the most when packets from several devices arrive
+/// together, since their reads complete in the same wait.
+///
+////////////////////////////////////////////////////////////////////////////////
+
+#include "example_utils.hpp"
+
+#include <mip/platform/serial_connection.hpp>
+#include <mip/platform/uring_reactor.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+#include <stdio.h>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+
+struct Device
+{
+    std::unique_ptr<mip::platform::SerialConnection> connection;
+    std::unique_ptr<mip::DeviceInterface>            device;
+    mip::DispatchHandler                             handler;
+    uint64_t                                         numPackets = 0;
+    int                                              master     = -1;  ///< Simulated device end of the pty.
+    uint8_t                                          buffer[1024];
+};
+
+void countPacket(void* userData, const mip::Packet& packet, mip::Timestamp timestamp)
+{
+    (void)packet;
+    (void)timestamp;
+
+    (*static_cast<uint64_t*>(userData))++;
+}
+
+void open(Device& device, const std::string& portName, uint32_t baudrate)
+{
+    device.connection.reset(new mip::platform::SerialConnection(portName, baudrate));
+    device.device.reset(new mip::DeviceInterface(device.connection.get(), device.buffer, sizeof(device.buffer), mip::C::mip_timeout_from_baudrate(baudrate), 500));
+    device.device->registerPacketCallback<&countPacket>(device.handler, mip::Dispatcher::ANY_DATA_SET, false, &device.numPackets);
+}
+
+void openSimulated(Device& device)
+{
+    device.master = posix_openpt(O_RDWR | O_NOCTTY);
+
+    if( device.master < 0 || grantpt(device.master) != 0 || unlockpt(device.master) != 0 )
+        throw std::runtime_error("Unable to open a pseudo-terminal.");
+
+    open(device, ptsname(device.master), 921600);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+///@brief Writes an IMU data packet to each simulated device at the given rate.
+///
+///@param burst If true, every device sends at the same time.
+///
+void simulate(std::vector<Device>& devices, unsigned int rateHz, bool burst, const std::atomic<bool>& stop)
+{
+    using namespace std::chrono;
+
+    // Scaled accel, gyro and mag, a typical IMU data packet.
+    uint8_t buffer[mip::PACKET_LENGTH_MAX];
+    mip::Packet packet(buffer, sizeof(buffer), 0x80);
+
+    const uint8_t payload[12] = {};
+    packet.addField(0x04, payload, sizeof(payload));
+    packet.addField(0x05, payload, sizeof(payload));
+    packet.addField(0x06, payload, sizeof(payload));
+    packet.finalize();
+
+    const auto period = duration_cast<steady_clock::duration>(seconds(1)) / rateHz;
+    const auto offset = burst ? period : period / int(devices.size());
+
+    auto due = steady_clock::now();
+
+    while( !stop )
+    {
+        for(size_t i=0; i<devices.size(); i++)
+        {
+            if( !burst || i == 0 )
+            {
+                std::this_thread::sleep_until(due);
+                due += offset;
+            }
+
+            ssize_t written = write(devices[i].master, packet.pointer(), packet.totalLength());
+            (void)written;
+        }
+    }
+}
+
+
+int main(int argc, const char* argv[])
+{
+    const bool simulated = (argc == 5 || argc == 6) && std::string(argv[2]) == "simulate";
+    const bool burst     = simulated && argc == 6 && std::string(argv[5]) == "burst";
+
+    if( simulated ? (argc == 6 && !burst) : (argc < 4 || argc % 2 != 0) )
+    {
+        fprintf(stderr, "Usage: %s <seconds> <portname> <baudrate> [<portname> <baudrate>]...\n", argv[0]);
+        fprintf(stderr, "       %s <seconds> simulate <num_devices> <rate_hz> [burst]\n", argv[0]);
+        return 1;
+    }
+
+    try
+    {
+        const unsigned int seconds = std::strtoul(argv[1], nullptr, 10);
+
+        std::vector<Device> devices(simulated ? std::strtoul(argv[3], nullptr, 10) : (argc - 2) / 2);
+        const unsigned int rateHz = simulated ? std::strtoul(argv[4], nullptr, 10) : 0;
+
+        if( devices.empty() || (simulated && rateHz == 0) )
+            throw std::runtime_error("At least one device and a nonzero rate are required.");
+
+        mip::platform::UringReactor reactor(unsigned(devices.size()) + 8);
+
+        for(size_t i=0; i<devices.size(); i++)
+        {
+            if( simulated )
+                openSimulated(devices[i]);
+            else
+                open(devices[i], argv[2 + 2*i], std::strtoul(argv[3 + 2*i], nullptr, 10));
+
+            if( !reactor.add(*devices[i].device) )
+                throw std::runtime_error("Unable to add a device to the reactor.");
+        }
+
+        std::atomic<bool> stop(false);
+        std::thread simulator;
+        if( simulated )
+            simulator = std::thread(&simulate, std::ref(devices), rateHz, burst, std::cref(stop));
+
+        const auto end = std::chrono::steady_clock::now() + std::chrono::seconds(seconds);
+        while( std::chrono::steady_clock::now() < end )
+        {
+            if( reactor.runOnce(100) < 0 )
+                throw std::runtime_error("The reactor failed.");
+        }
+
+        stop = true;
+        if( simulator.joinable() )
+            simulator.join();
+
+        uint64_t numPackets = 0;
+        for(const Device& device : devices)
+            numPackets += device.numPackets;
+
+        const uint64_t numSystemCalls = reactor.numSystemCalls();
+
+        printf("Devices:              %u\n", unsigned(devices.size()));
+        printf("Data packets:         %llu (%.1f/s)\n", (unsigned long long)numPackets, double(numPackets) / seconds);
+        printf("System calls:         %llu (%.1f/s)\n", (unsigned long long)numSystemCalls, double(numSystemCalls) / seconds);
+
+        if( numSystemCalls > 0 )
+            printf("Packets/system call:  %.2f\n", double(numPackets) / numSystemCalls);
+
+        for(Device& device : devices)
+        {
+            if( device.master >= 0 )
+                close(device.master);
+        }
+    }
+    catch(const std::exception& ex)
+    {
+        fprintf(stderr, "Error: %s\n", ex.what());
+        return 1;
+    }
+
+    return 0;
+}
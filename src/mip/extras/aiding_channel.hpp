@@ -0,0 +1,233 @@
+#pragma once
+
+#include "../mip_device.hpp"
+
+#include <array>
+
+namespace mip
+{
+namespace extras
+{
+
+////////////////////////////////////////////////////////////////////////////////
+///@addtogroup mip_extras
+///@{
+
+////////////////////////////////////////////////////////////////////////////////
+///@brief Sends high-rate commands (e.g. external aiding measurements) without
+///       waiting for the device to reply.
+///
+/// Commands such as commands_filter::ExternalGnssUpdate,
+/// commands_filter::ExternalHeadingUpdateWithTime,
+/// commands_filter::SpeedMeasurement, or commands_filter::CommandedZupt are
+/// serialized into a preallocated transmit buffer and sent immediately. Each
+/// one is tracked by a slot from a fixed pool; the replies are matched by the
+/// device's command queue as they arrive and tallied the next time send() or
+/// update() is called. Failures (nacks, timeouts, send errors, and commands
+/// dropped because every slot was in use) are reported through the counters
+/// in Stats and the optional failure callback.
+///
+/// Because other commands may be outstanding at the same time, the aiding
+/// channel never holds up or is held up by regular blocking commands.
+///
+///@note The channel must be used from the thread which updates the device,
+///      since it queues commands directly. From other threads, use a
+///      CommandRing instead.
+///
+///@tparam MaxInFlight Maximum number of commands awaiting a reply. Commands
+///        sent while all slots are in use are dropped and counted.
+///
+template<size_t MaxInFlight=16>
+class AidingChannel
+{
+public:
+    ///@brief Counters describing the health of the aiding link.
+    struct Stats
+    {
+        uint32_t sent       = 0;  ///< Commands written to the device.
+        uint32_t acked      = 0;  ///< Commands the device acknowledged.
+        uint32_t nacked     = 0;  ///< Commands the device rejected (see nackCounts).
+        uint32_t timedOut   = 0;  ///< Commands with no reply before the timeout.
+        uint32_t dropped    = 0;  ///< Commands not sent because all slots were in use.
+        uint32_t sendErrors = 0;  ///< Commands which could not be written to the connection.
+
+        uint32_t nackCounts[C::MIP_NACK_COMMAND_TIMEOUT+1] = {0};  ///< Number of nacks by reply code.
+
+        uint32_t inFlight() const { return sent - acked - nacked - timedOut; }
+    };
+
+    ///@brief Called for each command which did not complete with an ACK.
+    ///
+    ///@param userData        The pointer passed to setFailureCallback.
+    ///@param descriptorSet   Descriptor set of the failed command.
+    ///@param fieldDescriptor Field descriptor of the failed command.
+    ///@param result          Nack code or status (e.g. CmdResult::STATUS_TIMEDOUT).
+    ///
+    using FailureCallback = void (*)(void* userData, uint8_t descriptorSet, uint8_t fieldDescriptor, CmdResult result);
+
+    AidingChannel(C::mip_interface& device) : mDevice(device) {}
+    ~AidingChannel() { cancel(); }
+
+    AidingChannel(const AidingChannel&) = delete;
+    AidingChannel& operator=(const AidingChannel&) = delete;
+
+    template<class Cmd>
+    bool send(const Cmd& cmd, Timeout additionalTime=0);
+
+    void update();
+    void cancel();
+
+    void setFailureCallback(FailureCallback callback, void* userData) { mCallback = callback; mCallbackData = userData; }
+
+    const Stats& stats() const { return mStats; }
+    void resetStats() { const uint32_t inFlight = mStats.inFlight(); mStats = Stats(); mStats.sent = inFlight; }
+
+private:
+    struct Slot
+    {
+        C::mip_pending_cmd pending;
+        bool               inUse = false;
+    };
+
+    Slot* findFreeSlot();
+    void reportFailure(uint8_t descriptorSet, uint8_t fieldDescriptor, CmdResult result);
+
+    C::mip_interface& mDevice;
+
+    std::array<Slot, MaxInFlight> mSlots;
+    uint8_t mTxBuffer[PACKET_LENGTH_MAX];
+
+    Stats mStats;
+
+    FailureCallback mCallback     = nullptr;
+    void*           mCallbackData = nullptr;
+};
+
+
+////////////////////////////////////////////////////////////////////////////////
+///@brief Sends a command without waiting for the reply.
+///
+///@param cmd
+///       The command to send. It is serialized immediately and need not
+///       outlive this call.
+///@param additionalTime
+///       Extra time to wait for the reply on top of the base reply timeout.
+///
+///@returns True if the command was sent.
+///@returns False if it was dropped (no free slot) or could not be written.
+///         The failure callback is invoked in either case.
+///
+template<size_t MaxInFlight>
+template<class Cmd>
+bool AidingChannel<MaxInFlight>::send(const Cmd& cmd, Timeout additionalTime)
+{
+    update();
+
+    Slot* slot = findFreeSlot();
+    if( !slot )
+    {
+        mStats.dropped++;
+        reportFailure(Cmd::DESCRIPTOR_SET, Cmd::FIELD_DESCRIPTOR, CmdResult::STATUS_CANCELLED);
+        return false;
+    }
+
+    Packet packet = Packet::createFromField(mTxBuffer, sizeof(mTxBuffer), cmd);
+
+    C::mip_pending_cmd_init_with_timeout(&slot->pending, Cmd::DESCRIPTOR_SET, Cmd::FIELD_DESCRIPTOR, additionalTime);
+
+    if( !C::mip_interface_start_command_packet(&mDevice, &packet, &slot->pending) )
+    {
+        mStats.sendErrors++;
+        reportFailure(Cmd::DESCRIPTOR_SET, Cmd::FIELD_DESCRIPTOR, CmdResult::STATUS_ERROR);
+        return false;
+    }
+
+    slot->inUse = true;
+    mStats.sent++;
+    return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+///@brief Tallies replies which have arrived since the last call.
+///
+/// This is called automatically by send(). Call it after updating the device
+/// to get timely statistics when no commands are being sent.
+///
+template<size_t MaxInFlight>
+void AidingChannel<MaxInFlight>::update()
+{
+    for(Slot& slot : mSlots)
+    {
+        if( !slot.inUse )
+            continue;
+
+        const CmdResult result = C::mip_pending_cmd_status(&slot.pending);
+        if( !result.isFinished() )
+            continue;
+
+        slot.inUse = false;
+
+        if( result == CmdResult::ACK_OK )
+        {
+            mStats.acked++;
+            continue;
+        }
+
+        if( result.isReplyCode() )
+        {
+            mStats.nacked++;
+            if( size_t(result.value) < sizeof(mStats.nackCounts)/sizeof(mStats.nackCounts[0]) )
+                mStats.nackCounts[result.value]++;
+        }
+        else
+            mStats.timedOut++;  // Also covers commands cleared from the queue due to connection errors.
+
+        reportFailure(slot.pending._descriptor_set, slot.pending._field_descriptor, result);
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+///@brief Stops waiting for replies to any commands still in flight.
+///
+/// Outstanding commands are removed from the device's command queue and are
+/// not counted as acked or failed.
+///
+template<size_t MaxInFlight>
+void AidingChannel<MaxInFlight>::cancel()
+{
+    update();
+
+    for(Slot& slot : mSlots)
+    {
+        if( !slot.inUse )
+            continue;
+
+        C::mip_cmd_queue_dequeue(C::mip_interface_cmd_queue(&mDevice), &slot.pending);
+        slot.inUse = false;
+        mStats.sent--;
+    }
+}
+
+template<size_t MaxInFlight>
+typename AidingChannel<MaxInFlight>::Slot* AidingChannel<MaxInFlight>::findFreeSlot()
+{
+    for(Slot& slot : mSlots)
+    {
+        if( !slot.inUse )
+            return &slot;
+    }
+    return nullptr;
+}
+
+template<size_t MaxInFlight>
+void AidingChannel<MaxInFlight>::reportFailure(uint8_t descriptorSet, uint8_t fieldDescriptor, CmdResult result)
+{
+    if( mCallback )
+        mCallback(mCallbackData, descriptorSet, fieldDescriptor, result);
+}
+
+///@}
+////////////////////////////////////////////////////////////////////////////////
+
+} // namespace extras
+} // namespace mip
@@ -0,0 +1,124 @@
+#include "baudrate_upgrade.hpp"
+
+#include "../definitions/commands_base.hpp"
+#include "../definitions/commands_3dm.hpp"
+
+#include <algorithm>
+#include <functional>
+#include <vector>
+
+namespace mip
+{
+namespace extras
+{
+
+////////////////////////////////////////////////////////////////////////////////
+///@brief Switches the device and host to the highest baud rate both support.
+///
+/// For each candidate faster than the current rate, from fastest to slowest:
+/// the host rate is checked, the device is told to switch (UartBaudrate, or
+/// CommSpeed if a port is given), the connection is switched after the device
+/// acknowledges, and the link is confirmed with a ping. If the ping fails,
+/// the device is told to go back to the old rate and the host follows, after
+/// which the next candidate is tried. Rates the device NACKs are skipped.
+///
+/// The new rate is not saved on the device. Commands must not be in progress
+/// from other threads while this runs.
+///
+///@param device
+///       Device to upgrade. Its connection must implement baudrate() and
+///       setBaudrate(), as SerialConnection does.
+///@param candidates
+///       Rates to try, or NULL to use 921600, 460800 and 230400. On Linux, the
+///       serial connection supports standard rates up to 4000000.
+///@param count
+///       Number of candidates.
+///@param port
+///       0 to use the 3DM UartBaudrate command (the port the host is connected
+///       to). Otherwise, the port number for the base CommSpeed command.
+///
+///@returns The baud rate in use afterward, which is unchanged if no faster
+///         rate worked. Returns 0 if the connection doesn't support changing
+///         the baud rate, or if communication could not be restored after a
+///         failed attempt.
+///
+uint32_t upgradeBaudrate(DeviceInterface& device, const uint32_t* candidates, size_t count, uint8_t port)
+{
+    static const uint32_t DEFAULT_CANDIDATES[] = { 921600, 460800, 230400 };
+
+    if( !candidates )
+    {
+        candidates = DEFAULT_CANDIDATES;
+        count      = sizeof(DEFAULT_CANDIDATES) / sizeof(DEFAULT_CANDIDATES[0]);
+    }
+
+    const uint32_t oldBaud = device.connection()->baudrate();
+    if( oldBaud == 0 )
+        return 0;
+
+    auto writeBaud = [&device, port](uint32_t baud)->CmdResult
+    {
+        return (port == 0) ? commands_3dm::writeUartBaudrate(device, baud) : commands_base::writeCommSpeed(device, port, baud);
+    };
+
+    auto switchHost = [&device](uint32_t baud)->bool
+    {
+        if( !device.connection()->setBaudrate(baud) )
+            return false;
+
+        device.parser().reset();
+        device.parser().setTimeout(C::mip_timeout_from_baudrate(baud));
+        return true;
+    };
+
+    // The first bytes after a switch may be lost, so allow a retry.
+    auto confirm = [&device]()->bool
+    {
+        for(unsigned int attempt=0; attempt<3; attempt++)
+        {
+            if( commands_base::ping(device) == CmdResult::ACK_OK )
+                return true;
+        }
+        return false;
+    };
+
+    // Try the fastest candidates first.
+    std::vector<uint32_t> order(candidates, candidates + count);
+    std::sort(order.begin(), order.end(), std::greater<uint32_t>());
+
+    for(uint32_t baud : order)
+    {
+        if( baud <= oldBaud )
+            break;
+
+        // Check that the host supports the rate before involving the device.
+        if( !switchHost(baud) )
+            continue;
+        if( !switchHost(oldBaud) )
+            return 0;
+
+        const CmdResult result = writeBaud(baud);
+
+        if( result.isReplyCode() && result != CmdResult::ACK_OK )
+            continue;  // NACK - the device doesn't support this rate.
+
+        // The device switches after the ACK. On a timeout it may or may not
+        // have switched, so check the new rate anyway.
+        switchHost(baud);
+
+        if( confirm() )
+            return baud;
+
+        // Roll back. The device may be at either rate.
+        writeBaud(oldBaud);
+        switchHost(oldBaud);
+
+        if( !confirm() )
+            return 0;
+    }
+
+    return oldBaud;
+}
+
+} // namespace extras
+} // namespace mip
@@ -0,0 +1,20 @@
+#pragma once
+
+#include "../mip_device.hpp"
+
+namespace mip
+{
+namespace extras
+{
+
+////////////////////////////////////////////////////////////////////////////////
+///@addtogroup mip_extras
+///@{
+
+uint32_t upgradeBaudrate(DeviceInterface& device, const uint32_t* candidates=nullptr, size_t count=0, uint8_t port=0);
+
+///@}
+////////////////////////////////////////////////////////////////////////////////
+
+} // namespace extras
+} // namespace mip
@@ -0,0 +1,140 @@
+#include "capability_cache.hpp"
+
+#include "../definitions/commands_3dm.hpp"
+#include "../definitions/data_sensor.hpp"
+#include "../definitions/data_gnss.hpp"
+#include "../definitions/data_filter.hpp"
+#include "../definitions/data_system.hpp"
+
+#include <cstring>
+
+namespace mip
+{
+namespace extras
+{
+
+////////////////////////////////////////////////////////////////////////////////
+///@param directory
+///       Directory in which cache files are stored. It must already exist.
+///
+CapabilityCache::CapabilityCache(const std::string& directory) : mDirectory(directory)
+{
+    mCache.enableQuery<
+        commands_base::GetDeviceInfo,
+        commands_base::GetDeviceDescriptors,
+        commands_base::GetExtendedDescriptors,
+        commands_3dm::GetBaseRate
+    >();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+///@brief Identifies the device, loads or creates its cache file, and starts
+///       answering capability queries locally.
+///
+/// Any previously cached entries are discarded.
+///
+///@returns False if the device could not be identified. The cache is still
+///         attached in that case, but empty.
+///
+bool CapabilityCache::attach(C::mip_interface& device)
+{
+    mLoadedFromFile = false;
+    mFilename.clear();
+
+    mCache.clear();
+    mCache.attach(device);
+
+    // The device info is stored in the cache as a side effect.
+    if( commands_base::getDeviceInfo(device, &mDeviceInfo) != CmdResult::ACK_OK )
+        return false;
+
+    mFilename = filenameFor(mDirectory, mDeviceInfo);
+
+    if( mCache.load(mFilename) )
+    {
+        mLoadedFromFile = true;
+        return true;
+    }
+
+    // Unknown device or firmware - query everything once.
+    CommandBatch queries;
+    queries.add(commands_base::GetDeviceDescriptors{});
+    queries.add(commands_base::GetExtendedDescriptors{});
+
+    static const uint8_t DATA_DESCRIPTOR_SETS[] = { data_sensor::DESCRIPTOR_SET, data_gnss::DESCRIPTOR_SET, data_filter::DESCRIPTOR_SET, data_system::DESCRIPTOR_SET };
+
+    for(uint8_t descriptorSet : DATA_DESCRIPTOR_SETS)
+        queries.add(commands_3dm::GetBaseRate{descriptorSet});
+
+    if( !mCache.warmUp(queries) )
+    {
+        // Unsupported queries (NACKs) are fine, but don't save a partial
+        // cache after a timeout or other communication failure.
+        for(const CommandBatch::Command& query : queries)
+        {
+            if( !query.result.isReplyCode() )
+                return true;
+        }
+    }
+
+    // Re-add the device info, which a failed load may have discarded.
+    uint8_t info[C::MIP_FIELD_PAYLOAD_LENGTH_MAX];
+    Serializer serializer(info, sizeof(info));
+    insert(serializer, mDeviceInfo);
+    mCache.store(commands_base::GetDeviceInfo::DESCRIPTOR_SET, commands_base::GetDeviceInfo::FIELD_DESCRIPTOR, nullptr, 0, commands_base::GetDeviceInfo::Response::FIELD_DESCRIPTOR, info, uint8_t(serializer.length()));
+
+    mCache.save(mFilename, &isCapabilityQuery);
+
+    return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+///@brief Returns the cache file path for a device.
+///
+/// Characters in the serial number which are unsafe in file names are
+/// replaced with underscores.
+///
+std::string CapabilityCache::filenameFor(const std::string& directory, const commands_base::BaseDeviceInfo& info)
+{
+    std::string serial(info.serial_number, strnlen(info.serial_number, sizeof(info.serial_number)));
+
+    // Device strings are padded with spaces.
+    while( !serial.empty() && serial.back() == ' ' )
+        serial.pop_back();
+
+    for(char& c : serial)
+    {
+        if( !((c >= '0' && c <= '9') || (c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z') || c == '-' || c == '.') )
+            c = '_';
+    }
+
+    std::string filename = directory;
+    if( !filename.empty() && filename.back() != '/' && filename.back() != '\\' )
+        filename.push_back('/');
+
+    filename += serial + '-' + std::to_string(info.firmware_version) + ".mipcaps";
+
+    return filename;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+///@brief Returns true if a cache entry is one of the capability queries which
+///       are written to the cache file.
+///
+bool CapabilityCache::isCapabilityQuery(const SettingRecord& record)
+{
+    switch( uint16_t(record.descriptorSet << 8 | record.fieldDescriptor) )
+    {
+    case commands_base::GetDeviceInfo::DESCRIPTOR_SET          << 8 | commands_base::GetDeviceInfo::FIELD_DESCRIPTOR:
+    case commands_base::GetDeviceDescriptors::DESCRIPTOR_SET   << 8 | commands_base::GetDeviceDescriptors::FIELD_DESCRIPTOR:
+    case commands_base::GetExtendedDescriptors::DESCRIPTOR_SET << 8 | commands_base::GetExtendedDescriptors::FIELD_DESCRIPTOR:
+    case commands_3dm::GetBaseRate::DESCRIPTOR_SET             << 8 | commands_3dm::GetBaseRate::FIELD_DESCRIPTOR:
+        return true;
+
+    default:
+        return false;
+    }
+}
+
+} // namespace extras
+} // namespace mip
@@ -0,0 +1,80 @@
+#pragma once
+
+#include "settings_cache.hpp"
+
+#include "../definitions/commands_base.hpp"
+
+#include <string>
+
+namespace mip
+{
+namespace extras
+{
+
+////////////////////////////////////////////////////////////////////////////////
+///@addtogroup mip_extras
+///@{
+
+////////////////////////////////////////////////////////////////////////////////
+///@brief Persistent cache of device capability queries, to speed up startup.
+///
+/// When attached, the device is identified with a single getDeviceInfo
+/// command. If a cache file exists for that serial number and firmware
+/// version, it is loaded and the following commands are answered locally
+/// from then on:
+/// - commands_base::getDeviceInfo
+/// - commands_base::getDeviceDescriptors
+/// - commands_base::getExtendedDescriptors
+/// - commands_3dm::getBaseRate, for the sensor, GNSS, filter and system
+///   descriptor sets
+///
+/// Otherwise the queries are run once as a batch and written to a new cache
+/// file. Files are named `<serial>-<firmware>.mipcaps` in the given directory,
+/// so a firmware update automatically causes a refresh. Queries the device
+/// doesn't support are not cached and still go to the device.
+///
+///@code{.cpp}
+/// CapabilityCache capabilities("/var/cache/myapp");
+/// capabilities.attach(device);
+///
+/// // Served locally.
+/// commands_base::getDeviceDescriptors(device, descriptors, 256, &count);
+/// commands_3dm::getBaseRate(device, data_filter::DESCRIPTOR_SET, &rate);
+///@endcode
+///
+/// This uses the device's command hook (see SettingsCache), so it can't be
+/// combined with another hook on the same device. Additional settings can be
+/// cached by enabling them on cache(), but only the capability queries are
+/// written to disk.
+///
+class CapabilityCache
+{
+public:
+    explicit CapabilityCache(const std::string& directory);
+
+    bool attach(C::mip_interface& device);
+    void detach() { mCache.detach(); }
+
+    bool loadedFromFile() const { return mLoadedFromFile; }
+    const std::string& filename() const { return mFilename; }
+    const commands_base::BaseDeviceInfo& deviceInfo() const { return mDeviceInfo; }
+
+    SettingsCache& cache() { return mCache; }
+
+    static std::string filenameFor(const std::string& directory, const commands_base::BaseDeviceInfo& info);
+    static bool isCapabilityQuery(const SettingRecord& record);
+
+private:
+    std::string                   mDirectory;
+    std::string                   mFilename;
+    commands_base::BaseDeviceInfo mDeviceInfo;
+    bool                          mLoadedFromFile = false;
+
+    SettingsCache mCache;
+};
+
+///@}
+////////////////////////////////////////////////////////////////////////////////
+
+} // namespace extras
+} // namespace mip
@@ -0,0 +1,183 @@
+#include "command_batch.hpp"
+
+#include <memory>
+
+namespace mip
+{
+namespace extras
+{
+
+namespace
+{
+    ////////////////////////////////////////////////////////////////////////////
+    ///@brief Number of reply packet payload bytes a command can take up.
+    ///
+    size_t replyFieldsLength(const CommandBatch::Command& command)
+    {
+        // Ack field: echoed command descriptor and error code.
+        size_t length = C::MIP_FIELD_HEADER_LENGTH + 2;
+
+        if( command.responseDescriptor != 0x00 )
+            length += C::MIP_FIELD_HEADER_LENGTH + command.responseLengthMax;
+
+        return length;
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+///@brief Adds a raw command to the batch.
+///
+///@param descriptorSet
+///@param fieldDescriptor
+///@param payload
+///       Command payload, including the function selector if applicable. It
+///       is copied and need not outlive this call.
+///@param payloadLength
+///@param responseDescriptor
+///       Field descriptor of the expected response data, or 0 if none.
+///@param additionalTime
+///       Extra time to wait for the reply on top of the base reply timeout.
+///@param responseLengthMax
+///       Largest expected response payload, used to keep each reply within
+///       one packet. Ignored if there is no response.
+///
+///@returns The index of the command in the batch.
+///
+size_t CommandBatch::add(uint8_t descriptorSet, uint8_t fieldDescriptor, const uint8_t* payload, uint8_t payloadLength, uint8_t responseDescriptor, Timeout additionalTime, uint8_t responseLengthMax)
+{
+    assert(payloadLength <= C::MIP_FIELD_PAYLOAD_LENGTH_MAX);
+
+    mCommands.emplace_back();
+    Command& command = mCommands.back();
+
+    command.descriptorSet      = descriptorSet;
+    command.fieldDescriptor    = fieldDescriptor;
+    command.responseDescriptor = responseDescriptor;
+    command.payloadLength      = payloadLength;
+    command.additionalTime     = additionalTime;
+    command.responseLengthMax  = responseLengthMax;
+
+    std::memcpy(command.payload, payload, payloadLength);
+
+    return mCommands.size() - 1;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+///@brief Sends all commands and waits for them to complete.
+///
+/// Consecutive commands with the same descriptor set are packed into as few
+/// packets as will fit. Every packet is sent before waiting, so the device
+/// can process them back-to-back.
+///
+/// Packing also stops before the expected reply (an ack field per command
+/// plus its response field) would overflow a single packet.
+///
+/// If a packet cannot be sent, its commands and all following ones fail with
+/// CmdResult::STATUS_ERROR. If the device stops updating while waiting, the
+/// outstanding commands fail the same way.
+///
+///@param device
+///
+///@returns True if every command was acknowledged with CmdResult::ACK_OK.
+///
+bool CommandBatch::run(C::mip_interface& device)
+{
+    const size_t count = mCommands.size();
+
+    mNumPackets = 0;
+
+    for(Command& command : mCommands)
+    {
+        command.result = CmdResult::STATUS_ERROR;
+        command.responseLength = 0;
+    }
+
+    std::unique_ptr<C::mip_pending_cmd[]> pending(new C::mip_pending_cmd[count]);
+
+    C::mip_cmd_queue* queue = C::mip_interface_cmd_queue(&device);
+
+    uint8_t buffer[PACKET_LENGTH_MAX];
+
+    // Send everything up front, stopping at the first failure.
+    size_t numSent = 0;
+    while( numSent < count )
+    {
+        Packet packet(buffer, sizeof(buffer), mCommands[numSent].descriptorSet);
+
+        // The device answers every field in a single reply packet, so the
+        // ack and response fields must fit in one as well.
+        size_t last = numSent;
+        size_t replyLength = 0;
+        while( last < count && mCommands[last].descriptorSet == packet.descriptorSet() )
+        {
+            const Command& command = mCommands[last];
+
+            replyLength += replyFieldsLength(command);
+            if( last > numSent && replyLength > C::MIP_PACKET_PAYLOAD_LENGTH_MAX )
+                break;
+
+            if( !packet.addField(command.fieldDescriptor, command.payload, command.payloadLength) )
+                break;
+
+            last++;
+        }
+        assert(last > numSent);  // A single field always fits.
+
+        packet.finalize();
+
+        for(size_t i=numSent; i<last; i++)
+        {
+            Command& command = mCommands[i];
+
+            C::mip_pending_cmd_init_full(&pending[i], command.descriptorSet, command.fieldDescriptor, command.responseDescriptor, command.response, sizeof(command.response), command.additionalTime);
+            C::mip_cmd_queue_enqueue(queue, &pending[i]);
+        }
+
+        if( !C::mip_interface_send_to_device(&device, packet.pointer(), packet.totalLength()) )
+        {
+            for(size_t i=numSent; i<last; i++)
+                C::mip_cmd_queue_dequeue(queue, &pending[i]);
+
+            break;
+        }
+
+        mNumPackets++;
+        numSent = last;
+    }
+
+    // Then collect the replies.
+    const C::mip_command_hook* hook = C::mip_interface_command_hook(&device);
+
+    bool allOk = (numSent == count);
+
+    bool failed = false;
+
+    for(size_t i=0; i<numSent; i++)
+    {
+        Command& command = mCommands[i];
+
+        if( !failed )
+            command.result = C::mip_interface_wait_for_reply(&device, &pending[i]);
+
+        // Once the device can't be updated, nothing else will complete. The
+        // remaining commands must leave the queue before their storage goes.
+        if( command.result == CmdResult::STATUS_ERROR )
+        {
+            failed = true;
+            C::mip_cmd_queue_dequeue(queue, &pending[i]);
+        }
+        else
+            command.responseLength = C::mip_pending_cmd_response_length(&pending[i]);
+
+        if( hook && hook->after )
+            hook->after(hook->user_data, command.descriptorSet, command.fieldDescriptor, command.payload, command.payloadLength, command.responseDescriptor, command.response, command.responseLength, sizeof(command.response), command.result.value);
+
+        if( command.result != CmdResult::ACK_OK )
+            allOk = false;
+    }
+
+    return allOk;
+}
+
+} // namespace extras
+} // namespace mip
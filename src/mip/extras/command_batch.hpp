@@ -0,0 +1,159 @@
+#pragma once
+
+#include "../mip_device.hpp"
+
+#include <vector>
+
+namespace mip
+{
+namespace extras
+{
+
+////////////////////////////////////////////////////////////////////////////////
+///@addtogroup mip_extras
+///@{
+
+////////////////////////////////////////////////////////////////////////////////
+///@brief Runs many commands with as few packets and round trips as possible.
+///
+/// Commands are collected with add() and then run together. Consecutive
+/// commands in the same descriptor set are packed into multi-field packets,
+/// and all packets are sent before waiting for any replies, so a batch of
+/// dozens of reads or writes typically costs a single round trip. Commands
+/// are sent in the order they were added.
+///
+/// After run(), each command's result and response data can be inspected.
+/// Batches are sent as prebuilt packets, so the device's command hook cannot
+/// intercept them; its `after` callback is still invoked for each command so
+/// that observers such as a SettingsCache stay up to date.
+///
+///@code{.cpp}
+/// CommandBatch batch;
+/// batch.add(commands_3dm::UartBaudrate{FunctionSelector::READ});
+/// batch.add(commands_3dm::MessageFormat{FunctionSelector::READ, data_sensor::DESCRIPTOR_SET});
+/// batch.run(device);
+///
+/// commands_3dm::UartBaudrate::Response baud;
+/// if( batch.getResponse(0, baud) )
+///     ...
+///@endcode
+///
+class CommandBatch
+{
+public:
+    ///@brief A command and, after running, its result.
+    struct Command
+    {
+        uint8_t   descriptorSet      = 0;
+        uint8_t   fieldDescriptor    = 0;
+        uint8_t   responseDescriptor = 0;  ///< Expected response field descriptor, or 0 if none.
+        uint8_t   payloadLength      = 0;
+        uint8_t   responseLength     = 0;
+        uint8_t   responseLengthMax  = C::MIP_FIELD_PAYLOAD_LENGTH_MAX;  ///< Expected response size, for packing.
+        CmdResult result             = CmdResult::STATUS_NONE;
+        Timeout   additionalTime     = 0;
+
+        uint8_t   payload[C::MIP_FIELD_PAYLOAD_LENGTH_MAX];
+        uint8_t   response[C::MIP_FIELD_PAYLOAD_LENGTH_MAX];
+    };
+
+    size_t add(uint8_t descriptorSet, uint8_t fieldDescriptor, const uint8_t* payload, uint8_t payloadLength, uint8_t responseDescriptor=0, Timeout additionalTime=0, uint8_t responseLengthMax=C::MIP_FIELD_PAYLOAD_LENGTH_MAX);
+
+    template<class Cmd>
+    size_t add(const Cmd& cmd, Timeout additionalTime=0);
+
+    void clear() { mCommands.clear(); }
+    void reserve(size_t count) { mCommands.reserve(count); }
+
+    size_t size() const { return mCommands.size(); }
+    bool empty() const { return mCommands.empty(); }
+
+    const Command& operator[](size_t index) const { return mCommands[index]; }
+
+    std::vector<Command>::const_iterator begin() const { return mCommands.begin(); }
+    std::vector<Command>::const_iterator end() const { return mCommands.end(); }
+
+    template<class Response>
+    bool getResponse(size_t index, Response& response) const;
+
+    bool run(C::mip_interface& device);
+
+    size_t numPacketsSent() const { return mNumPackets; }
+
+private:
+    std::vector<Command> mCommands;
+    size_t               mNumPackets = 0;
+};
+
+
+namespace detail
+{
+    template<class Cmd, class=void>
+    struct ResponseDescriptorOf { static constexpr uint8_t value = 0x00; };
+
+    template<class Cmd>
+    struct ResponseDescriptorOf<Cmd, decltype(void(Cmd::Response::FIELD_DESCRIPTOR))> { static constexpr uint8_t value = Cmd::Response::FIELD_DESCRIPTOR; };
+
+    // Serialized length of a default response. Exact for fixed-size
+    // responses; only the fixed part of variable-length lists is counted.
+    template<class Cmd, class=void>
+    struct ResponseLengthOf { static uint8_t value() { return 0; } };
+
+    template<class Cmd>
+    struct ResponseLengthOf<Cmd, decltype(void(Cmd::Response::FIELD_DESCRIPTOR))>
+    {
+        static uint8_t value()
+        {
+            uint8_t buffer[C::MIP_FIELD_PAYLOAD_LENGTH_MAX];
+            Serializer serializer(buffer, sizeof(buffer));
+            insert(serializer, typename Cmd::Response{});
+            return uint8_t(serializer.length());
+        }
+    };
+}
+
+////////////////////////////////////////////////////////////////////////////////
+///@brief Adds a command struct to the batch.
+///
+/// The command is serialized immediately. If the command has a Response type,
+/// response data is captured when the device returns it (e.g. for READs).
+/// Variable-length responses are budgeted at their minimum size; use the raw
+/// overload to reserve more room for long lists.
+///
+///@returns The index of the command in the batch.
+///
+template<class Cmd>
+size_t CommandBatch::add(const Cmd& cmd, Timeout additionalTime)
+{
+    uint8_t buffer[C::MIP_FIELD_PAYLOAD_LENGTH_MAX];
+    Serializer serializer(buffer, sizeof(buffer));
+    insert(serializer, cmd);
+    assert(serializer.isOk());
+
+    return add(Cmd::DESCRIPTOR_SET, Cmd::FIELD_DESCRIPTOR, buffer, uint8_t(serializer.length()), detail::ResponseDescriptorOf<Cmd>::value, additionalTime, detail::ResponseLengthOf<Cmd>::value());
+}
+
+////////////////////////////////////////////////////////////////////////////////
+///@brief Deserializes the response data of a command.
+///
+///@returns True if the command was acked and the response was extracted.
+///
+template<class Response>
+bool CommandBatch::getResponse(size_t index, Response& response) const
+{
+    const Command& command = mCommands[index];
+
+    if( command.result != CmdResult::ACK_OK || command.responseDescriptor != Response::FIELD_DESCRIPTOR )
+        return false;
+
+    Serializer serializer(command.response, command.responseLength);
+    extract(serializer, response);
+
+    return serializer.isComplete();
+}
+
+///@}
+////////////////////////////////////////////////////////////////////////////////
+
+} // namespace extras
+} // namespace mip
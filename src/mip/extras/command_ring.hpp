@@ -0,0 +1,410 @@
+#pragma once
+
+#include "../mip_device.hpp"
+
+#include <atomic>
+#include <array>
+#include <condition_variable>
+#include <mutex>
+#include <vector>
+
+namespace mip
+{
+namespace extras
+{
+
+////////////////////////////////////////////////////////////////////////////////
+///@addtogroup mip_extras
+///@{
+
+////////////////////////////////////////////////////////////////////////////////
+///@brief Lock-free multi-producer, single-consumer command submission ring.
+///
+/// Any number of threads may submit pre-serialized command packets along with
+/// a pending command which tracks completion. Submitting never takes a lock;
+/// a producer only contends with other producers on a single atomic counter.
+///
+/// One thread (the "I/O thread") owns the device. It periodically calls
+/// drain(), which sends every submitted packet with a single write and
+/// registers the pending commands with the device's command queue. Because
+/// only the I/O thread touches the command queue, no locking is required
+/// there either. The I/O thread must also be the only thread updating the
+/// device (e.g. by calling DeviceInterface::update in a loop).
+///
+/// The command queue completes commands on the I/O thread without any
+/// synchronization, so other threads must not read the C pending command
+/// directly. Instead, each drain() hands the results of finished commands
+/// back through PendingCommand::status(), which also makes the response data
+/// visible to the submitting thread. waitForReply() sleeps until then.
+///
+/// Typical usage:
+///@code{.cpp}
+/// CommandRing<32> ring;
+///
+/// // I/O thread
+/// while(running)
+/// {
+///     ring.drain(device);
+///     device.update();
+/// }
+///
+/// // Any other thread
+/// CmdResult result = ring.runCommand(commands_base::Ping{});
+///@endcode
+///
+///@tparam Capacity Maximum number of packets waiting to be drained. Must be a
+///        power of 2.
+///
+template<size_t Capacity>
+class CommandRing
+{
+    static_assert(Capacity >= 2 && (Capacity & (Capacity-1)) == 0, "Capacity must be a power of 2.");
+
+public:
+    ////////////////////////////////////////////////////////////////////////////
+    ///@brief A command submitted through the ring.
+    ///
+    /// Initialize `cmd` as usual (e.g. with mip_pending_cmd_init_with_response)
+    /// before submitting a packet. After submission, only status() may be
+    /// used until it's finished; the response may then be read from `cmd`.
+    ///
+    struct PendingCommand
+    {
+        C::mip_pending_cmd cmd;
+
+        CmdResult status() const { return result.load(std::memory_order_acquire); }
+
+    private:
+        friend class CommandRing;
+        std::atomic<C::mip_cmd_result> result{C::MIP_STATUS_NONE};
+    };
+
+    CommandRing();
+
+    CommandRing(const CommandRing&) = delete;
+    CommandRing& operator=(const CommandRing&) = delete;
+
+    bool submit(const C::mip_packet& packet, PendingCommand& pending);
+
+    template<class Cmd>
+    bool submit(PendingCommand& pending, const Cmd& cmd, Timeout additionalTime=0);
+
+    template<class Cmd>
+    CmdResult runCommand(const Cmd& cmd, Timeout additionalTime=0);
+
+    CmdResult waitForReply(const PendingCommand& pending);
+
+    size_t drain(C::mip_interface& device, size_t maxCommands=SIZE_MAX);
+    void collectReplies();
+
+    static constexpr size_t capacity() { return Capacity; }
+
+private:
+    struct Slot
+    {
+        std::atomic<size_t> sequence;
+        PendingCommand*     pending;
+        PacketLength        length;
+        uint8_t             buffer[PACKET_LENGTH_MAX];
+    };
+
+    Slot* claim();
+    void publish(Slot* slot);
+    void finish(PendingCommand& pending, CmdResult result);
+
+    static constexpr size_t TX_BUFFER_SIZE = 2048;
+
+    std::array<Slot, Capacity> mSlots;
+
+    alignas(64) std::atomic<size_t> mEnqueuePos;  // Shared by all producers.
+    alignas(64) size_t mDequeuePos;               // Owned by the I/O thread.
+
+    PendingCommand* mBatch[Capacity];
+    uint8_t         mTxBuffer[TX_BUFFER_SIZE];
+
+    std::vector<PendingCommand*> mInFlight;     // Owned by the I/O thread.
+    std::mutex                   mMutex;        // Guards publication of results to waiters.
+    std::condition_variable      mReplied;
+};
+
+
+template<size_t Capacity>
+CommandRing<Capacity>::CommandRing() : mEnqueuePos(0), mDequeuePos(0)
+{
+    for(size_t i=0; i<Capacity; i++)
+        mSlots[i].sequence.store(i, std::memory_order_relaxed);
+
+    mInFlight.reserve(Capacity);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+///@brief Reserves a slot for writing.
+///
+///@returns A slot owned by the caller until publish() is called, or NULL if the
+///         ring is full.
+///
+template<size_t Capacity>
+typename CommandRing<Capacity>::Slot* CommandRing<Capacity>::claim()
+{
+    size_t pos = mEnqueuePos.load(std::memory_order_relaxed);
+
+    for(;;)
+    {
+        Slot* slot = &mSlots[pos & (Capacity-1)];
+
+        const size_t sequence = slot->sequence.load(std::memory_order_acquire);
+        const ptrdiff_t diff  = ptrdiff_t(sequence) - ptrdiff_t(pos);
+
+        if( diff == 0 )
+        {
+            if( mEnqueuePos.compare_exchange_weak(pos, pos+1, std::memory_order_relaxed) )
+                return slot;
+        }
+        else if( diff < 0 )
+            return nullptr;  // Full - the I/O thread hasn't drained this slot yet.
+        else
+            pos = mEnqueuePos.load(std::memory_order_relaxed);
+    }
+}
+
+template<size_t Capacity>
+void CommandRing<Capacity>::publish(Slot* slot)
+{
+    const size_t pos = size_t(slot - mSlots.data());
+
+    // The sequence was equal to the claimed position; find which lap it was.
+    const size_t sequence = slot->sequence.load(std::memory_order_relaxed);
+    assert((sequence & (Capacity-1)) == pos);
+
+    slot->sequence.store(sequence + 1, std::memory_order_release);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+///@brief Submits a finalized command packet.
+///
+/// May be called from any thread.
+///
+///@param packet
+///       A finalized MIP packet containing exactly one command field. The
+///       packet is copied and need not outlive this call.
+///@param pending
+///       A pending command whose `cmd` was initialized to match the packet.
+///       It must remain valid until its status is finished.
+///
+///@returns True if the packet was queued. The command will complete (with a
+///         reply, timeout, or MIP_STATUS_ERROR if it could not be sent).
+///@returns False if the ring is full. The pending command is not modified.
+///
+template<size_t Capacity>
+bool CommandRing<Capacity>::submit(const C::mip_packet& packet, PendingCommand& pending)
+{
+    const PacketLength length = C::mip_packet_total_length(&packet);
+    assert(length <= PACKET_LENGTH_MAX);
+
+    Slot* slot = claim();
+    if( !slot )
+        return false;
+
+    std::memcpy(slot->buffer, C::mip_packet_pointer(&packet), length);
+    slot->length  = length;
+    slot->pending = &pending;
+
+    pending.result.store(C::MIP_STATUS_PENDING, std::memory_order_relaxed);
+
+    publish(slot);
+    return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+///@brief Serializes a command directly into the ring and submits it.
+///
+///@param pending
+///       The pending command, which will be initialized by this function. It
+///       must remain valid until its status is finished.
+///@param cmd
+///       The command to send.
+///@param additionalTime
+///       Extra time to wait for the reply, on top of the base reply timeout.
+///
+///@returns Same as submit(const C::mip_packet&, C::mip_pending_cmd&).
+///
+template<size_t Capacity>
+template<class Cmd>
+bool CommandRing<Capacity>::submit(PendingCommand& pending, const Cmd& cmd, Timeout additionalTime)
+{
+    Slot* slot = claim();
+    if( !slot )
+        return false;
+
+    Packet packet = Packet::createFromField(slot->buffer, sizeof(slot->buffer), cmd);
+
+    C::mip_pending_cmd_init_with_timeout(&pending.cmd, Cmd::DESCRIPTOR_SET, Cmd::FIELD_DESCRIPTOR, additionalTime);
+
+    slot->length  = packet.totalLength();
+    slot->pending = &pending;
+
+    pending.result.store(C::MIP_STATUS_PENDING, std::memory_order_relaxed);
+
+    publish(slot);
+    return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+///@brief Submits a command and waits for it to complete.
+///
+/// This must not be called from the I/O thread, as it would wait forever.
+///
+///@returns The command result, or MIP_STATUS_ERROR if the ring is full.
+///
+template<size_t Capacity>
+template<class Cmd>
+CmdResult CommandRing<Capacity>::runCommand(const Cmd& cmd, Timeout additionalTime)
+{
+    PendingCommand pending;
+    if( !submit(pending, cmd, additionalTime) )
+        return CmdResult::STATUS_ERROR;
+
+    return waitForReply(pending);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+///@brief Waits for a submitted command to complete.
+///
+/// The I/O thread does all of the work; this sleeps until drain() or
+/// collectReplies() publishes the result.
+///
+template<size_t Capacity>
+CmdResult CommandRing<Capacity>::waitForReply(const PendingCommand& pending)
+{
+    std::unique_lock<std::mutex> lock(mMutex);
+    mReplied.wait(lock, [&pending]{ return pending.status().isFinished(); });
+
+    return pending.status();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+///@brief Publishes the result of a command to the submitting thread.
+///
+/// The release store makes the C pending command, including its response,
+/// visible to a thread which observes the result with status().
+///
+template<size_t Capacity>
+void CommandRing<Capacity>::finish(PendingCommand& pending, CmdResult result)
+{
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        pending.result.store(result.value, std::memory_order_release);
+    }
+    mReplied.notify_all();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+///@brief Publishes the results of commands completed by the command queue.
+///
+/// Must only be called from the I/O thread. drain() calls this first, so
+/// it's only needed if the I/O thread stops draining the ring while
+/// commands are outstanding.
+///
+template<size_t Capacity>
+void CommandRing<Capacity>::collectReplies()
+{
+    for(size_t i=0; i<mInFlight.size(); )
+    {
+        PendingCommand& pending = *mInFlight[i];
+
+        // Written by the command queue on this thread, so reading it is safe.
+        const CmdResult result = C::mip_pending_cmd_status(&pending.cmd);
+
+        if( !result.isFinished() )
+        {
+            i++;
+            continue;
+        }
+
+        mInFlight[i] = mInFlight.back();
+        mInFlight.pop_back();
+
+        finish(pending, result);
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+///@brief Sends all submitted packets and queues their replies.
+///
+/// Must only be called from the I/O thread, i.e. the thread which updates the
+/// device. Packets are copied into one contiguous buffer so that a batch
+/// costs a single write to the connection. The results of commands completed
+/// since the last call are published first (see collectReplies).
+///
+///@param device
+///@param maxCommands
+///       Maximum number of commands to take from the ring. Any others are
+///       left for the next call.
+///
+///@returns The number of commands sent.
+///
+template<size_t Capacity>
+size_t CommandRing<Capacity>::drain(C::mip_interface& device, size_t maxCommands)
+{
+    collectReplies();
+
+    size_t sent = 0;
+    size_t numBatched = 0;
+    size_t txLength = 0;
+
+    auto flush = [&]()
+    {
+        const bool ok = (txLength == 0) || C::mip_interface_send_to_device(&device, mTxBuffer, txLength);
+
+        // Queue the commands after sending; replies can't be processed until
+        // this thread updates the device again.
+        for(size_t i=0; i<numBatched; i++)
+        {
+            if( ok )
+            {
+                C::mip_cmd_queue_enqueue(C::mip_interface_cmd_queue(&device), &mBatch[i]->cmd);
+                mInFlight.push_back(mBatch[i]);
+            }
+            else
+                finish(*mBatch[i], CmdResult::STATUS_ERROR);
+        }
+
+        if( ok )
+            sent += numBatched;
+
+        numBatched = 0;
+        txLength = 0;
+    };
+
+    for(size_t taken=0; taken < maxCommands; taken++)
+    {
+        Slot* slot = &mSlots[mDequeuePos & (Capacity-1)];
+
+        if( slot->sequence.load(std::memory_order_acquire) != mDequeuePos + 1 )
+            break;  // Empty or the producer hasn't finished writing yet.
+
+        if( txLength + slot->length > TX_BUFFER_SIZE )
+            flush();
+
+        std::memcpy(&mTxBuffer[txLength], slot->buffer, slot->length);
+        txLength += slot->length;
+        mBatch[numBatched++] = slot->pending;
+
+        // Release the slot to producers for the next lap.
+        slot->sequence.store(mDequeuePos + Capacity, std::memory_order_release);
+        mDequeuePos++;
+
+        if( numBatched == Capacity )
+            flush();
+    }
+
+    flush();
+
+    return sent;
+}
+
+///@}
+////////////////////////////////////////////////////////////////////////////////
+
+} // namespace extras
+} // namespace mip
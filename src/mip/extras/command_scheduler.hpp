@@ -0,0 +1,228 @@
+#pragma once
+
+#include "command_ring.hpp"
+
+namespace mip
+{
+namespace extras
+{
+
+////////////////////////////////////////////////////////////////////////////////
+///@addtogroup mip_extras
+///@{
+
+////////////////////////////////////////////////////////////////////////////////
+///@brief Scheduling class of a command.
+///
+enum class CommandPriority : uint8_t
+{
+    URGENT = 0,  ///< Sent as soon as possible, ahead of everything else. Never throttled.
+    NORMAL = 1,  ///< Regular commands.
+    BULK   = 2,  ///< Long-running or low-importance commands (e.g. configuration, bias capture).
+};
+
+static constexpr size_t NUM_COMMAND_PRIORITIES = 3;
+
+////////////////////////////////////////////////////////////////////////////////
+///@brief Multi-producer command pipeline with priority classes.
+///
+/// Commands are sorted into one CommandRing per priority class when they are
+/// submitted. The class is looked up by descriptor set, with optional
+/// overrides for individual commands, e.g.:
+///@code{.cpp}
+/// CommandScheduler<32> scheduler;
+/// scheduler.setPriority(commands_base::DESCRIPTOR_SET, CommandPriority::URGENT);  // SetIdle, Resume, ...
+/// scheduler.setPriority(commands_filter::DESCRIPTOR_SET, CommandPriority::URGENT); // Aiding measurements
+/// scheduler.setPriority<commands_filter::Reset>(CommandPriority::BULK);
+/// scheduler.setPriority<commands_3dm::CaptureGyroBias>(CommandPriority::BULK);
+///@endcode
+///
+/// On each drain(), urgent commands are sent first and without limit. Normal
+/// and bulk commands are only sent while fewer than the configured number of
+/// commands of that class are awaiting a reply; the rest stay in their rings.
+/// Since the device processes commands in the order received, this keeps its
+/// input shallow so that an urgent command never waits behind a long backlog
+/// of configuration traffic. Submitted but unsent commands of lower classes
+/// are effectively preempted by urgent ones. Replies are matched by the
+/// command queue per descriptor, so a slow command (e.g. a gyro bias capture
+/// lasting several seconds) does not delay completion of any other command.
+///
+/// Commands already sent cannot be preempted; if the device itself blocks
+/// while executing a command, later commands are answered afterwards.
+///
+/// The priority table and in-flight limits must be configured before any
+/// commands are submitted. Threading requirements are otherwise the same as
+/// CommandRing: any thread may submit, and only the I/O thread may drain.
+///
+///@tparam Capacity Capacity of each priority ring. Must be a power of 2.
+///
+template<size_t Capacity>
+class CommandScheduler
+{
+public:
+    static constexpr size_t UNLIMITED = SIZE_MAX;
+    static constexpr size_t MAX_FIELD_OVERRIDES = 16;
+
+    CommandScheduler();
+
+    CommandScheduler(const CommandScheduler&) = delete;
+    CommandScheduler& operator=(const CommandScheduler&) = delete;
+
+    void setPriority(uint8_t descriptorSet, CommandPriority priority) { mSetPriorities[descriptorSet] = priority; }
+    bool setPriority(uint8_t descriptorSet, uint8_t fieldDescriptor, CommandPriority priority);
+
+    template<class Cmd>
+    bool setPriority(CommandPriority priority) { return setPriority(Cmd::DESCRIPTOR_SET, Cmd::FIELD_DESCRIPTOR, priority); }
+
+    CommandPriority priority(uint8_t descriptorSet, uint8_t fieldDescriptor) const;
+
+    void setMaxInFlight(CommandPriority priority, size_t maxCommands) { mMaxInFlight[size_t(priority)] = maxCommands; }
+    size_t maxInFlight(CommandPriority priority) const { return mMaxInFlight[size_t(priority)]; }
+
+    typedef typename CommandRing<Capacity>::PendingCommand PendingCommand;
+
+    bool submit(const C::mip_packet& packet, PendingCommand& pending);
+
+    template<class Cmd>
+    bool submit(PendingCommand& pending, const Cmd& cmd, Timeout additionalTime=0) { return ring<Cmd>().submit(pending, cmd, additionalTime); }
+
+    template<class Cmd>
+    CmdResult runCommand(const Cmd& cmd, Timeout additionalTime=0) { return ring<Cmd>().runCommand(cmd, additionalTime); }
+
+    CmdResult waitForReply(const PendingCommand& pending);
+
+    size_t drain(C::mip_interface& device);
+
+private:
+    struct FieldOverride
+    {
+        uint8_t         descriptorSet;
+        uint8_t         fieldDescriptor;
+        CommandPriority priority;
+    };
+
+    template<class Cmd>
+    CommandRing<Capacity>& ring() { return mRings[size_t(priority(Cmd::DESCRIPTOR_SET, Cmd::FIELD_DESCRIPTOR))]; }
+
+    CommandRing<Capacity> mRings[NUM_COMMAND_PRIORITIES];
+
+    std::array<CommandPriority, 256> mSetPriorities;
+
+    FieldOverride mOverrides[MAX_FIELD_OVERRIDES];
+    size_t        mNumOverrides = 0;
+
+    size_t mMaxInFlight[NUM_COMMAND_PRIORITIES] = { UNLIMITED, 4, 1 };
+};
+
+
+template<size_t Capacity>
+CommandScheduler<Capacity>::CommandScheduler()
+{
+    mSetPriorities.fill(CommandPriority::NORMAL);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+///@brief Sets the priority of a single command, overriding its descriptor set.
+///
+///@returns False if there are already MAX_FIELD_OVERRIDES overrides.
+///
+template<size_t Capacity>
+bool CommandScheduler<Capacity>::setPriority(uint8_t descriptorSet, uint8_t fieldDescriptor, CommandPriority priority)
+{
+    for(size_t i=0; i<mNumOverrides; i++)
+    {
+        if( mOverrides[i].descriptorSet == descriptorSet && mOverrides[i].fieldDescriptor == fieldDescriptor )
+        {
+            mOverrides[i].priority = priority;
+            return true;
+        }
+    }
+
+    if( mNumOverrides >= MAX_FIELD_OVERRIDES )
+        return false;
+
+    mOverrides[mNumOverrides++] = { descriptorSet, fieldDescriptor, priority };
+    return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+///@brief Determines the scheduling class of a command.
+///
+template<size_t Capacity>
+CommandPriority CommandScheduler<Capacity>::priority(uint8_t descriptorSet, uint8_t fieldDescriptor) const
+{
+    for(size_t i=0; i<mNumOverrides; i++)
+    {
+        if( mOverrides[i].descriptorSet == descriptorSet && mOverrides[i].fieldDescriptor == fieldDescriptor )
+            return mOverrides[i].priority;
+    }
+
+    return mSetPriorities[descriptorSet];
+}
+
+////////////////////////////////////////////////////////////////////////////////
+///@brief Submits a finalized command packet to the ring for its priority.
+///
+/// The priority is determined from the first field in the packet.
+///
+///@copydetails CommandRing::submit(const C::mip_packet&, PendingCommand&)
+///
+template<size_t Capacity>
+bool CommandScheduler<Capacity>::submit(const C::mip_packet& packet, PendingCommand& pending)
+{
+    const C::mip_field field = C::mip_field_first_from_packet(&packet);
+
+    const CommandPriority prio = priority(C::mip_packet_descriptor_set(&packet), C::mip_field_field_descriptor(&field));
+
+    return mRings[size_t(prio)].submit(packet, pending);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+///@brief Waits for a command submitted to any of the rings to complete.
+///
+template<size_t Capacity>
+CmdResult CommandScheduler<Capacity>::waitForReply(const PendingCommand& pending)
+{
+    return mRings[size_t(priority(pending.cmd._descriptor_set, pending.cmd._field_descriptor))].waitForReply(pending);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+///@brief Sends queued commands in priority order, subject to the in-flight
+///       limits.
+///
+/// Must only be called from the I/O thread.
+///
+///@returns The number of commands sent.
+///
+template<size_t Capacity>
+size_t CommandScheduler<Capacity>::drain(C::mip_interface& device)
+{
+    // A ring at its in-flight limit isn't drained below, but its finished
+    // commands must still be handed back.
+    for(CommandRing<Capacity>& ring : mRings)
+        ring.collectReplies();
+
+    size_t inFlight[NUM_COMMAND_PRIORITIES] = {0};
+
+    const C::mip_cmd_queue* queue = C::mip_interface_cmd_queue(&device);
+    for(const C::mip_pending_cmd* pending = C::mip_cmd_queue_first_pending(queue); pending; pending = C::mip_cmd_queue_next_pending(pending))
+        inFlight[size_t(priority(pending->_descriptor_set, pending->_field_descriptor))]++;
+
+    size_t sent = 0;
+
+    for(size_t p=0; p<NUM_COMMAND_PRIORITIES; p++)
+    {
+        if( mMaxInFlight[p] == UNLIMITED )
+            sent += mRings[p].drain(device);
+        else if( inFlight[p] < mMaxInFlight[p] )
+            sent += mRings[p].drain(device, mMaxInFlight[p] - inFlight[p]);
+    }
+
+    return sent;
+}
+
+///@}
+////////////////////////////////////////////////////////////////////////////////
+
+} // namespace extras
+} // namespace mip
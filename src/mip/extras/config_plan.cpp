@@ -0,0 +1,180 @@
+#include "config_plan.hpp"
+
+#include "../definitions/commands_3dm.hpp"
+
+#include <cstring>
+
+namespace mip
+{
+namespace extras
+{
+
+////////////////////////////////////////////////////////////////////////////////
+///@brief Adds or replaces a setting from raw payloads.
+///
+///@param descriptorSet
+///@param fieldDescriptor
+///@param writePayload
+///       Full WRITE payload, starting with the function selector.
+///@param writeLength
+///@param readPayload
+///       READ payload (function selector and key parameters), or NULL if the
+///       setting can't be read.
+///@param readLength
+///@param responseDescriptor
+///       Field descriptor of the READ response.
+///
+void ConfigPlan::setRaw(uint8_t descriptorSet, uint8_t fieldDescriptor, const uint8_t* writePayload, uint8_t writeLength, const uint8_t* readPayload, uint8_t readLength, uint8_t responseDescriptor)
+{
+    Item item;
+    item.descriptorSet      = descriptorSet;
+    item.fieldDescriptor    = fieldDescriptor;
+    item.responseDescriptor = readPayload ? responseDescriptor : 0x00;
+    item.isSetting          = true;
+    item.writePayload.assign(reinterpret_cast<const char*>(writePayload), writeLength);
+    if( readPayload )
+        item.readPayload.assign(reinterpret_cast<const char*>(readPayload), readLength);
+
+    // Replace the same setting (same key parameters) if already in the plan.
+    for(Item& existing : mItems)
+    {
+        if( existing.isSetting && existing.descriptorSet == descriptorSet && existing.fieldDescriptor == fieldDescriptor && !item.readPayload.empty() && existing.readPayload == item.readPayload )
+        {
+            existing = std::move(item);
+            return;
+        }
+    }
+
+    mItems.push_back(std::move(item));
+}
+
+////////////////////////////////////////////////////////////////////////////////
+///@brief Adds a plain command from a raw payload. It is always sent.
+///
+void ConfigPlan::addRaw(uint8_t descriptorSet, uint8_t fieldDescriptor, const uint8_t* payload, uint8_t length)
+{
+    Item item;
+    item.descriptorSet      = descriptorSet;
+    item.fieldDescriptor    = fieldDescriptor;
+    item.responseDescriptor = 0x00;
+    item.isSetting          = false;
+    item.writePayload.assign(reinterpret_cast<const char*>(payload), length);
+
+    mItems.push_back(std::move(item));
+}
+
+////////////////////////////////////////////////////////////////////////////////
+///@brief Brings the device into the planned configuration.
+///
+///@param device
+///@param options
+///@param clock
+///       Optional function returning the current time, used to fill in
+///       Report::duration (e.g. getCurrentTimestamp).
+///
+///@returns A summary of what was done. The status and result of each item
+///         can be inspected through operator[] afterward.
+///
+ConfigPlan::Report ConfigPlan::apply(C::mip_interface& device, const Options& options, Timestamp (*clock)())
+{
+    const Timestamp startTime = clock ? clock() : 0;
+
+    Report report;
+
+    for(Item& item : mItems)
+    {
+        item.status = Status::NOT_RUN;
+        item.result = CmdResult::STATUS_NONE;
+    }
+
+    // Read everything which can be read, in one batch.
+    const size_t NOT_READ = size_t(-1);
+    std::vector<size_t> readIndex(mItems.size(), NOT_READ);
+
+    CommandBatch reads;
+    if( options.diff )
+    {
+        reads.reserve(mItems.size());
+
+        for(size_t i=0; i<mItems.size(); i++)
+        {
+            const Item& item = mItems[i];
+
+            if( item.isSetting && !item.readPayload.empty() )
+                readIndex[i] = reads.add(item.descriptorSet, item.fieldDescriptor, reinterpret_cast<const uint8_t*>(item.readPayload.data()), uint8_t(item.readPayload.size()), item.responseDescriptor);
+        }
+
+        reads.run(device);
+        report.numPackets += reads.numPacketsSent();
+    }
+
+    // Write whatever differs (or can't be compared).
+    CommandBatch writes;
+    std::vector<size_t> writeItems;
+
+    for(size_t i=0; i<mItems.size(); i++)
+    {
+        Item& item = mItems[i];
+
+        if( readIndex[i] != NOT_READ )
+        {
+            const CommandBatch::Command& current = reads[readIndex[i]];
+
+            const uint8_t* desired = reinterpret_cast<const uint8_t*>(item.writePayload.data()) + 1;
+            const size_t desiredLength = item.writePayload.size() - 1;
+
+            if( current.result == CmdResult::ACK_OK && current.responseLength == desiredLength && std::memcmp(current.response, desired, desiredLength) == 0 )
+            {
+                item.status = Status::UNCHANGED;
+                item.result = CmdResult::ACK_OK;
+                report.numUnchanged++;
+                continue;
+            }
+        }
+
+        writes.add(item.descriptorSet, item.fieldDescriptor, reinterpret_cast<const uint8_t*>(item.writePayload.data()), uint8_t(item.writePayload.size()));
+        writeItems.push_back(i);
+    }
+
+    bool settingsWritten = false;
+
+    if( !writes.empty() )
+    {
+        writes.run(device);
+        report.numPackets += writes.numPacketsSent();
+
+        for(size_t j=0; j<writeItems.size(); j++)
+        {
+            Item& item = mItems[writeItems[j]];
+
+            item.result = writes[j].result;
+
+            if( item.result == CmdResult::ACK_OK )
+            {
+                item.status = Status::WRITTEN;
+                report.numWritten++;
+                settingsWritten |= item.isSetting;
+            }
+            else
+            {
+                item.status = Status::FAILED;
+                report.numFailed++;
+            }
+        }
+    }
+
+    if( options.save && settingsWritten && report.numFailed == 0 )
+    {
+        report.saveResult = commands_3dm::saveDeviceSettings(device);
+        report.saved = true;
+        report.numPackets++;
+    }
+
+    if( clock )
+        report.duration = clock() - startTime;
+
+    return report;
+}
+
+} // namespace extras
+} // namespace mip
@@ -0,0 +1,183 @@
+#pragma once
+
+#include "command_batch.hpp"
+
+#include <string>
+#include <vector>
+
+namespace mip
+{
+namespace extras
+{
+
+////////////////////////////////////////////////////////////////////////////////
+///@addtogroup mip_extras
+///@{
+
+////////////////////////////////////////////////////////////////////////////////
+///@brief A desired device configuration which can be compared against a
+///       device and applied with the minimum number of writes.
+///
+/// Each setting is given as a fully-populated command struct, e.g.:
+///@code{.cpp}
+/// ConfigPlan plan;
+///
+/// commands_3dm::MessageFormat format;
+/// format.desc_set = data_filter::DESCRIPTOR_SET;
+/// ...
+/// plan.set(format);
+/// plan.set(commands_filter::AidingMeasurementEnable{FunctionSelector::WRITE, AidingSource::GNSS_POS_VEL, true});
+/// plan.set(commands_3dm::GpioConfig{...});
+///
+/// ConfigPlan::Report report = plan.apply(device);
+///@endcode
+///
+/// apply() reads every setting in a single batch (typically one round trip),
+/// compares each response to the desired value, and then writes only the
+/// settings which differ, again as a batch of multi-field packets. If
+/// anything was written, the configuration is saved with a single
+/// DeviceSettings SAVE.
+///
+/// A setting is considered unchanged when the READ response payload is
+/// byte-for-byte identical to the WRITE payload after the function selector,
+/// which holds for the settings commands in the MIP protocol. If a device
+/// reports an equivalent value with a different encoding, the setting is
+/// simply rewritten.
+///
+/// Settings without a READ function, as well as plain commands added with
+/// add() (e.g. commands_base::Resume), are always sent. Everything that is
+/// sent goes out in plan order.
+///
+class ConfigPlan
+{
+public:
+    ///@brief Outcome of a single item in the plan.
+    enum class Status : uint8_t
+    {
+        NOT_RUN,    ///< apply() was not called or did not get this far.
+        UNCHANGED,  ///< The device already had the desired value.
+        WRITTEN,    ///< The value was written successfully.
+        FAILED,     ///< The write (or command) failed; see Item::result.
+    };
+
+    struct Item
+    {
+        uint8_t     descriptorSet;
+        uint8_t     fieldDescriptor;
+        uint8_t     responseDescriptor;  ///< 0 if the setting can't be read back.
+        bool        isSetting;           ///< False for plain commands added with add().
+        std::string readPayload;         ///< READ payload (function selector + key parameters). Empty if not readable.
+        std::string writePayload;        ///< Full WRITE (or command) payload.
+        Status      status = Status::NOT_RUN;
+        CmdResult   result;
+    };
+
+    ///@brief Options for apply().
+    struct Options
+    {
+        bool diff = true;  ///< Read current values and skip settings which already match.
+        bool save = true;  ///< Save as startup settings if any setting was written and no write failed.
+    };
+
+    ///@brief Summary of an apply() call.
+    struct Report
+    {
+        size_t    numUnchanged = 0;
+        size_t    numWritten   = 0;
+        size_t    numFailed    = 0;
+        size_t    numPackets   = 0;  ///< Total command packets sent, including reads and the save.
+        bool      saved        = false;
+        CmdResult saveResult;
+        Timeout   duration     = 0;  ///< Elapsed time, if a clock was given to apply().
+
+        bool ok() const { return numFailed == 0 && (!saved || saveResult == CmdResult::ACK_OK); }
+    };
+
+    template<class Cmd>
+    void set(const Cmd& setting);
+
+    template<class Cmd>
+    void add(const Cmd& cmd);
+
+    void setRaw(uint8_t descriptorSet, uint8_t fieldDescriptor, const uint8_t* writePayload, uint8_t writeLength, const uint8_t* readPayload, uint8_t readLength, uint8_t responseDescriptor);
+    void addRaw(uint8_t descriptorSet, uint8_t fieldDescriptor, const uint8_t* payload, uint8_t length);
+
+    void clear() { mItems.clear(); }
+
+    size_t size() const { return mItems.size(); }
+    const Item& operator[](size_t index) const { return mItems[index]; }
+
+    std::vector<Item>::const_iterator begin() const { return mItems.begin(); }
+    std::vector<Item>::const_iterator end() const { return mItems.end(); }
+
+    Report apply(C::mip_interface& device, const Options& options, Timestamp (*clock)()=nullptr);
+    Report apply(C::mip_interface& device) { return apply(device, Options()); }
+
+private:
+    template<class Cmd>
+    static std::string serialize(const Cmd& cmd);
+
+    std::vector<Item> mItems;
+};
+
+
+template<class Cmd>
+std::string ConfigPlan::serialize(const Cmd& cmd)
+{
+    uint8_t buffer[C::MIP_FIELD_PAYLOAD_LENGTH_MAX];
+    Serializer serializer(buffer, sizeof(buffer));
+    insert(serializer, cmd);
+    assert(serializer.isOk());
+
+    return std::string(reinterpret_cast<const char*>(buffer), serializer.length());
+}
+
+////////////////////////////////////////////////////////////////////////////////
+///@brief Adds or replaces a desired setting.
+///
+/// The function selector of the setting is ignored. If the plan already
+/// contains the same setting (same command and key parameters), it is
+/// replaced.
+///
+///@param setting A command struct populated with the desired values.
+///
+template<class Cmd>
+void ConfigPlan::set(const Cmd& setting)
+{
+    static_assert(Cmd::HAS_WRITE_FUNCTION, "Settings must have a WRITE function. Use add() for other commands.");
+
+    Cmd cmd = setting;
+
+    cmd.function = FunctionSelector::WRITE;
+    const std::string write = serialize(cmd);
+
+    std::string read;
+    uint8_t responseDescriptor = 0x00;
+
+    if( Cmd::HAS_READ_FUNCTION )
+    {
+        cmd.function = FunctionSelector::READ;
+        read = serialize(cmd);
+        responseDescriptor = detail::ResponseDescriptorOf<Cmd>::value;
+    }
+
+    setRaw(Cmd::DESCRIPTOR_SET, Cmd::FIELD_DESCRIPTOR, reinterpret_cast<const uint8_t*>(write.data()), uint8_t(write.size()), read.empty() ? nullptr : reinterpret_cast<const uint8_t*>(read.data()), uint8_t(read.size()), responseDescriptor);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+///@brief Adds a plain command (e.g. commands_base::Resume) which is always
+///       sent, in plan order.
+///
+template<class Cmd>
+void ConfigPlan::add(const Cmd& cmd)
+{
+    const std::string payload = serialize(cmd);
+
+    addRaw(Cmd::DESCRIPTOR_SET, Cmd::FIELD_DESCRIPTOR, reinterpret_cast<const uint8_t*>(payload.data()), uint8_t(payload.size()));
+}
+
+///@}
+////////////////////////////////////////////////////////////////////////////////
+
+} // namespace extras
+} // namespace mip
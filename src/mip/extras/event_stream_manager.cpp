@@ -0,0 +1,358 @@
+#include "event_stream_manager.hpp"
+
+#include "command_batch.hpp"
+
+#include "../definitions/data_shared.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+namespace mip
+{
+namespace extras
+{
+
+////////////////////////////////////////////////////////////////////////////////
+///@brief Creates an empty event manager.
+///
+///@param firstInstance
+///       Trigger and action instance number for the first event. Event N uses
+///       instance firstInstance+N for both. Instances below this are left
+///       alone so that the application can configure them separately.
+///
+EventStreamManager::EventStreamManager(uint8_t firstInstance) : mFirstInstance(std::max<uint8_t>(firstInstance, 1))
+{
+}
+
+EventStreamManager::~EventStreamManager()
+{
+    // Only the callbacks can be removed here; the device is left configured.
+    if( mDevice )
+    {
+        for(std::unique_ptr<Route>& route : mRoutes)
+            C::mip_dispatcher_remove_handler(C::mip_interface_dispatcher(mDevice), &route->handler);
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+///@brief Adds an event with any type of trigger.
+///
+/// Triggers of type COMBINATION refer to other triggers by instance number,
+/// which is firstInstance plus the event index.
+///
+///@param type          Trigger type.
+///@param parameters    Trigger parameters.
+///@param descriptorSet Data descriptor set of the emitted packets.
+///@param fields        Field descriptors to output. The EventSource field is
+///                     added automatically.
+///@param count         Number of fields. At most MAX_MESSAGE_FIELDS-1.
+///@param decimation    If 0, one packet is emitted each time the trigger
+///                     activates. Otherwise, packets are emitted at this
+///                     decimation of the base rate while it's active.
+///@param handler       Function to receive the packets. May be NULL.
+///@param userData      Passed to the handler.
+///
+///@returns The index of the event.
+///
+size_t EventStreamManager::add(commands_3dm::EventTrigger::Type type, const commands_3dm::EventTrigger::Parameters& parameters, uint8_t descriptorSet, const uint8_t* fields, uint8_t count, uint16_t decimation, Handler handler, void* userData)
+{
+    assert(!isInstalled());
+    assert(count < MAX_MESSAGE_FIELDS);
+
+    count = std::min<uint8_t>(count, MAX_MESSAGE_FIELDS-1);
+
+    Event event;
+    event.triggerType       = type;
+    event.triggerParameters = parameters;
+    event.handler           = handler;
+    event.userData          = userData;
+
+    event.message.desc_set   = descriptorSet;
+    event.message.decimation = decimation;
+    event.message.num_fields = count + 1;
+    if( count > 0 )
+        std::memcpy(event.message.descriptors, fields, count);
+    event.message.descriptors[count] = data_shared::DATA_EVENT_SOURCE;
+
+    mEvents.push_back(event);
+
+    return mEvents.size() - 1;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+///@brief Adds an event which is active while a data quantity is within
+///       [low, high].
+///
+///@param sourceSet   Descriptor set of the quantity to compare.
+///@param sourceField Field descriptor of the quantity to compare.
+///@param paramId     1-based index of the quantity within its field, e.g.
+///                   2 for the Y axis of a vector.
+///@param low
+///@param high
+///
+/// The remaining parameters are as for add().
+///
+size_t EventStreamManager::addWindow(uint8_t sourceSet, uint8_t sourceField, uint8_t paramId, double low, double high, uint8_t descriptorSet, const uint8_t* fields, uint8_t count, uint16_t decimation, Handler handler, void* userData)
+{
+    commands_3dm::EventTrigger::Parameters parameters;
+    parameters.threshold.desc_set   = sourceSet;
+    parameters.threshold.field_desc = sourceField;
+    parameters.threshold.param_id   = paramId;
+    parameters.threshold.type       = commands_3dm::EventTrigger::ThresholdParams::Type::WINDOW;
+    parameters.threshold.low_thres  = low;
+    parameters.threshold.high_thres = high;
+
+    return add(commands_3dm::EventTrigger::Type::THRESHOLD, parameters, descriptorSet, fields, count, decimation, handler, userData);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+///@brief Adds an event which is active while a data quantity is below low or
+///       above high.
+///
+/// This is a window comparison with reversed thresholds. The parameters are
+/// as for addWindow().
+///
+size_t EventStreamManager::addOutside(uint8_t sourceSet, uint8_t sourceField, uint8_t paramId, double low, double high, uint8_t descriptorSet, const uint8_t* fields, uint8_t count, uint16_t decimation, Handler handler, void* userData)
+{
+    return addWindow(sourceSet, sourceField, paramId, high, low, descriptorSet, fields, count, decimation, handler, userData);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+///@brief Checks that the device supports enough triggers and actions of the
+///       required types.
+///
+///@returns False if the device doesn't support events, or there are too
+///         many events for the available instances.
+///
+bool EventStreamManager::checkSupport(C::mip_interface& device)
+{
+    using commands_3dm::GetEventSupport;
+
+    GetEventSupport::Info triggers[126];
+    GetEventSupport::Info actions[126];
+    uint8_t numTriggerTypes = 0;
+    uint8_t numActionTypes  = 0;
+
+    if( commands_3dm::getEventSupport(device, GetEventSupport::Query::TRIGGER_TYPES, &mMaxTriggers, &numTriggerTypes, 126, triggers) != CmdResult::ACK_OK )
+        return false;
+
+    if( commands_3dm::getEventSupport(device, GetEventSupport::Query::ACTION_TYPES, &mMaxActions, &numActionTypes, 126, actions) != CmdResult::ACK_OK )
+        return false;
+
+    const size_t lastInstance = mFirstInstance + mEvents.size() - 1;
+
+    if( lastInstance > mMaxTriggers || lastInstance > mMaxActions )
+        return false;
+
+    // Each type has its own limit, in addition to the total.
+    for(uint8_t i=0; i<numTriggerTypes; i++)
+    {
+        const size_t used = std::count_if(mEvents.begin(), mEvents.end(), [&](const Event& event){ return uint8_t(event.triggerType) == triggers[i].type; });
+
+        if( used > triggers[i].count )
+            return false;
+    }
+
+    for(const Event& event : mEvents)
+    {
+        if( std::none_of(triggers, triggers + numTriggerTypes, [&](const GetEventSupport::Info& info){ return info.type == uint8_t(event.triggerType); }) )
+            return false;
+    }
+
+    const GetEventSupport::Info* message = std::find_if(actions, actions + numActionTypes, [](const GetEventSupport::Info& info){ return info.type == uint8_t(commands_3dm::EventAction::Type::MESSAGE); });
+
+    return message != actions + numActionTypes && mEvents.size() <= message->count;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+///@brief Configures and enables all events on the device.
+///
+/// The device must be a DeviceInterface or otherwise have the dispatcher
+/// updated, since packet callbacks are registered on it. The configuration
+/// commands are sent as one batch.
+///
+///@returns False if already installed, the device lacks capacity (see
+///         checkSupport), or any command failed. Nothing is left installed
+///         in that case, though some instances may have been written.
+///
+bool EventStreamManager::install(C::mip_interface& device)
+{
+    if( isInstalled() || mEvents.empty() || !checkSupport(device) )
+        return false;
+
+    CommandBatch batch;
+
+    for(size_t i=0; i<mEvents.size(); i++)
+    {
+        Event& event = mEvents[i];
+
+        event.trigger = uint8_t(mFirstInstance + i);
+        event.action  = uint8_t(mFirstInstance + i);
+        event.packets = 0;
+
+        commands_3dm::EventTrigger trigger;
+        trigger.function   = FunctionSelector::WRITE;
+        trigger.instance   = event.trigger;
+        trigger.type       = event.triggerType;
+        trigger.parameters = event.triggerParameters;
+        batch.add(trigger);
+
+        commands_3dm::EventAction action;
+        action.function   = FunctionSelector::WRITE;
+        action.instance   = event.action;
+        action.trigger    = event.trigger;
+        action.type       = commands_3dm::EventAction::Type::MESSAGE;
+        action.parameters.message = event.message;
+        batch.add(action);
+    }
+
+    // Enable only after everything is configured.
+    for(const Event& event : mEvents)
+        batch.add(commands_3dm::EventControl{FunctionSelector::WRITE, event.trigger, commands_3dm::EventControl::Mode::ENABLED});
+
+    // Register first so that packets emitted right away aren't missed.
+    mDevice = &device;
+
+    for(const Event& event : mEvents)
+    {
+        const uint8_t descriptorSet = event.message.desc_set;
+
+        if( std::any_of(mRoutes.begin(), mRoutes.end(), [descriptorSet](const std::unique_ptr<Route>& route){ return route->descriptorSet == descriptorSet; }) )
+            continue;
+
+        mRoutes.emplace_back(new Route{this, descriptorSet, {}});
+        C::mip_interface_register_packet_callback(&device, &mRoutes.back()->handler, descriptorSet, false, &EventStreamManager::packetCallback, mRoutes.back().get());
+    }
+
+    if( !batch.run(device) )
+    {
+        uninstall(device);
+        return false;
+    }
+
+    return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+///@brief Disables and clears the triggers and actions, and removes the
+///       packet callbacks.
+///
+///@returns True if all commands succeeded. The callbacks are removed either way.
+///
+bool EventStreamManager::uninstall(C::mip_interface& device)
+{
+    if( !isInstalled() )
+        return false;
+
+    CommandBatch batch;
+
+    for(const Event& event : mEvents)
+        batch.add(commands_3dm::EventControl{FunctionSelector::WRITE, event.trigger, commands_3dm::EventControl::Mode::DISABLED});
+
+    for(const Event& event : mEvents)
+    {
+        commands_3dm::EventAction action;
+        action.function = FunctionSelector::WRITE;
+        action.instance = event.action;
+        action.trigger  = event.trigger;
+        action.type     = commands_3dm::EventAction::Type::NONE;
+        batch.add(action);
+
+        commands_3dm::EventTrigger trigger;
+        trigger.function = FunctionSelector::WRITE;
+        trigger.instance = event.trigger;
+        trigger.type     = commands_3dm::EventTrigger::Type::NONE;
+        batch.add(trigger);
+    }
+
+    const bool ok = batch.run(device);
+
+    for(std::unique_ptr<Route>& route : mRoutes)
+        C::mip_dispatcher_remove_handler(C::mip_interface_dispatcher(mDevice), &route->handler);
+
+    mRoutes.clear();
+    mDevice = nullptr;
+
+    return ok;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+///@brief Reads the status of each event's trigger.
+///
+///@param device
+///@param statusOut
+///       Array of size() entries, receiving whether each trigger is enabled
+///       and currently active.
+///
+CmdResult EventStreamManager::queryStatus(C::mip_interface& device, commands_3dm::GetEventTriggerStatus::Status* statusOut)
+{
+    using commands_3dm::GetEventTriggerStatus;
+
+    const size_t MAX_PER_QUERY = sizeof(GetEventTriggerStatus::requested_instances);
+
+    for(size_t first=0; first < mEvents.size(); first += MAX_PER_QUERY)
+    {
+        const uint8_t count = uint8_t(std::min(mEvents.size() - first, MAX_PER_QUERY));
+
+        uint8_t instances[MAX_PER_QUERY];
+        for(uint8_t i=0; i<count; i++)
+            instances[i] = uint8_t(mFirstInstance + first + i);
+
+        GetEventTriggerStatus::Entry entries[MAX_PER_QUERY];
+        uint8_t numEntries = 0;
+
+        CmdResult result = commands_3dm::getEventTriggerStatus(device, count, instances, &numEntries, count, entries);
+        if( result != CmdResult::ACK_OK )
+            return result;
+
+        if( numEntries != count )
+            return CmdResult::STATUS_ERROR;
+
+        for(uint8_t i=0; i<count; i++)
+            statusOut[first + i] = entries[i].status;
+    }
+
+    return CmdResult::ACK_OK;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+///@brief Routes a packet to its event's handler by the EventSource field.
+///
+void EventStreamManager::handlePacket(const Packet& packet, Timestamp timestamp)
+{
+    for(Field field : packet)
+    {
+        if( field.fieldDescriptor() != data_shared::DATA_EVENT_SOURCE )
+            continue;
+
+        data_shared::EventSource source;
+        if( !field.extract(source) || source.trigger_id < mFirstInstance )
+            return;
+
+        const size_t index = source.trigger_id - mFirstInstance;
+        if( index >= mEvents.size() )
+            return;
+
+        Event& event = mEvents[index];
+
+        // Other actions, configured elsewhere, may use the same trigger.
+        if( event.message.desc_set != packet.descriptorSet() )
+            return;
+
+        event.packets++;
+
+        if( event.handler )
+            event.handler(event.userData, index, packet, timestamp);
+
+        return;
+    }
+}
+
+void EventStreamManager::packetCallback(void* context, const C::mip_packet* packet, Timestamp timestamp)
+{
+    Route* route = static_cast<Route*>(context);
+    route->manager->handlePacket(Packet(packet), timestamp);
+}
+
+} // namespace extras
+} // namespace mip
@@ -0,0 +1,126 @@
+#pragma once
+
+#include "../mip_device.hpp"
+
+#include "../definitions/commands_3dm.hpp"
+
+#include <memory>
+#include <vector>
+
+namespace mip
+{
+namespace extras
+{
+
+////////////////////////////////////////////////////////////////////////////////
+///@addtogroup mip_extras
+///@{
+
+////////////////////////////////////////////////////////////////////////////////
+///@brief Configures event-triggered data output and routes the resulting
+///       packets to handlers.
+///
+/// Each event pairs a trigger (e.g. "roll is outside +/-45 degrees") with a
+/// message action that outputs a set of data fields, either once per
+/// activation or at a decimated rate while the trigger is active. Compared to
+/// continuous streaming, this sends data only when it's of interest.
+///
+/// install() checks the device's capacity with getEventSupport, assigns
+/// trigger and action instances, writes and enables them in a single batch,
+/// and registers packet callbacks. The shared EventSource field is added to
+/// every message automatically; it identifies the trigger which emitted the
+/// packet, so it can be routed to that event's handler. Packets from regular
+/// streaming (trigger ID 0) are ignored.
+///
+///@code{.cpp}
+/// EventStreamManager events;
+///
+/// const uint8_t fields[] = { data_filter::DATA_ATT_EULER_ANGLES };
+/// events.addOutside(data_filter::DESCRIPTOR_SET, data_filter::DATA_ATT_EULER_ANGLES, 1, -0.785, 0.785,
+///                   data_filter::DESCRIPTOR_SET, fields, 1, 0, &handleRollAlarm);
+///
+/// if( !events.install(device) )
+///     ...
+///@endcode
+///
+class EventStreamManager
+{
+public:
+    ///@brief Maximum number of fields in a message action, including the
+    ///       EventSource field added by the manager.
+    static constexpr uint8_t MAX_MESSAGE_FIELDS = 12;
+
+    ///@brief Called (during device updates) for each packet emitted by an event.
+    ///
+    ///@param userData
+    ///@param event     Index of the event, as returned when it was added.
+    ///@param packet    The data packet, including the EventSource field.
+    ///@param timestamp Time the packet was received.
+    ///
+    typedef void (*Handler)(void* userData, size_t event, const Packet& packet, Timestamp timestamp);
+
+    struct Event
+    {
+        commands_3dm::EventTrigger::Type       triggerType;
+        commands_3dm::EventTrigger::Parameters triggerParameters;
+        commands_3dm::EventAction::MessageParams message;
+
+        Handler handler  = nullptr;
+        void*   userData = nullptr;
+
+        uint8_t  trigger = 0;  ///< Trigger instance, assigned by install().
+        uint8_t  action  = 0;  ///< Action instance, assigned by install().
+        uint32_t packets = 0;  ///< Number of packets received.
+    };
+
+    explicit EventStreamManager(uint8_t firstInstance=1);
+    ~EventStreamManager();
+
+    EventStreamManager(const EventStreamManager&) = delete;
+    EventStreamManager& operator=(const EventStreamManager&) = delete;
+
+    size_t add(commands_3dm::EventTrigger::Type type, const commands_3dm::EventTrigger::Parameters& parameters, uint8_t descriptorSet, const uint8_t* fields, uint8_t count, uint16_t decimation, Handler handler, void* userData=nullptr);
+
+    size_t addWindow(uint8_t sourceSet, uint8_t sourceField, uint8_t paramId, double low, double high, uint8_t descriptorSet, const uint8_t* fields, uint8_t count, uint16_t decimation, Handler handler, void* userData=nullptr);
+    size_t addOutside(uint8_t sourceSet, uint8_t sourceField, uint8_t paramId, double low, double high, uint8_t descriptorSet, const uint8_t* fields, uint8_t count, uint16_t decimation, Handler handler, void* userData=nullptr);
+
+    bool checkSupport(C::mip_interface& device);
+    bool install(C::mip_interface& device);
+    bool uninstall(C::mip_interface& device);
+    bool isInstalled() const { return mDevice != nullptr; }
+
+    CmdResult queryStatus(C::mip_interface& device, commands_3dm::GetEventTriggerStatus::Status* statusOut);
+
+    size_t size() const { return mEvents.size(); }
+    const Event& operator[](size_t index) const { return mEvents[index]; }
+
+    uint8_t maxTriggers() const { return mMaxTriggers; }  ///< Trigger instances supported by the device, from checkSupport().
+    uint8_t maxActions() const { return mMaxActions; }    ///< Action instances supported by the device, from checkSupport().
+
+private:
+    struct Route
+    {
+        EventStreamManager*     manager;
+        uint8_t                 descriptorSet;
+        C::mip_dispatch_handler handler;
+    };
+
+    void handlePacket(const Packet& packet, Timestamp timestamp);
+
+    static void packetCallback(void* context, const C::mip_packet* packet, Timestamp timestamp);
+
+    std::vector<Event>                  mEvents;
+    std::vector<std::unique_ptr<Route>> mRoutes;
+
+    C::mip_interface* mDevice = nullptr;
+
+    uint8_t mFirstInstance;
+    uint8_t mMaxTriggers = 0;
+    uint8_t mMaxActions  = 0;
+};
+
+///@}
+////////////////////////////////////////////////////////////////////////////////
+
+} // namespace extras
+} // namespace mip
@@ -0,0 +1,362 @@
+#include "message_format_planner.hpp"
+
+#include "command_batch.hpp"
+
+#include "../definitions/commands_base.hpp"
+#include "../definitions/commands_3dm.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+namespace mip
+{
+namespace extras
+{
+
+////////////////////////////////////////////////////////////////////////////////
+///@brief Adds a data field by descriptor and payload size.
+///
+///@param descriptorSet
+///@param fieldDescriptor
+///@param payloadLength Size of the field data, excluding the field header.
+///@param rate          Target rate in Hz. Must be greater than 0.
+///@param minRate       Lowest acceptable rate in Hz, or 0 to keep the rate.
+///
+void MessageFormatPlanner::addRaw(uint8_t descriptorSet, uint8_t fieldDescriptor, uint8_t payloadLength, float rate, float minRate)
+{
+    assert(rate > 0);
+
+    Field field;
+    field.descriptorSet   = descriptorSet;
+    field.fieldDescriptor = fieldDescriptor;
+    field.payloadLength   = payloadLength;
+    field.requestedRate   = rate;
+    field.minRate         = (minRate > 0) ? std::min(minRate, rate) : rate;
+
+    mFields.push_back(field);
+    mPlanned = false;
+
+    dataSet(descriptorSet);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+///@brief Sets the base rate of a descriptor set, e.g. if already known.
+///
+void MessageFormatPlanner::setBaseRate(uint8_t descriptorSet, uint16_t rate)
+{
+    dataSet(descriptorSet).baseRate = rate;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+///@brief Reads the base rate of each descriptor set used by the added fields.
+///
+///@returns CmdResult::ACK_OK, or the result of the last failed query.
+///
+CmdResult MessageFormatPlanner::queryBaseRates(C::mip_interface& device)
+{
+    CmdResult result = CmdResult::ACK_OK;
+
+    for(DataSet& set : mDataSets)
+    {
+        uint16_t rate = 0;
+        CmdResult tmp = commands_3dm::getBaseRate(device, set.descriptorSet, &rate);
+
+        if( tmp == CmdResult::ACK_OK )
+            set.baseRate = rate;
+        else
+            result = tmp;
+    }
+
+    return result;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+///@brief Reads the current UART baud rate from the device.
+///
+/// Don't call this when connected over USB or TCP; the streamed data does not
+/// go over the UART in that case and the bandwidth check doesn't apply.
+///
+///@param device
+///@param port
+///       0 to use the 3DM UartBaudrate command (main port). Otherwise, the
+///       port number for the base CommSpeed command.
+///
+CmdResult MessageFormatPlanner::queryBaudrate(C::mip_interface& device, uint8_t port)
+{
+    uint32_t baud = 0;
+
+    CmdResult result = (port == 0) ? commands_3dm::readUartBaudrate(device, &baud) : commands_base::readCommSpeed(device, port, &baud);
+
+    if( result == CmdResult::ACK_OK )
+        mBaudrate = baud;
+
+    return result;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+///@brief Predicts the number of packets per second for one descriptor set.
+///
+/// A packet is sent on each base rate tick on which at least one field is
+/// due, so this is the base rate times the fraction of ticks which are a
+/// multiple of any of the decimations.
+///
+float MessageFormatPlanner::predictPacketsPerSecond(uint16_t baseRate, const uint16_t* decimations, size_t count)
+{
+    std::vector<uint64_t> divisors(decimations, decimations + count);
+    std::sort(divisors.begin(), divisors.end());
+    divisors.erase(std::unique(divisors.begin(), divisors.end()), divisors.end());
+
+    // A decimation which is a multiple of another adds no extra packets.
+    std::vector<uint64_t> reduced;
+    for(uint64_t d : divisors)
+    {
+        if( d == 0 )
+            continue;
+
+        if( std::none_of(reduced.begin(), reduced.end(), [d](uint64_t r){ return d % r == 0; }) )
+            reduced.push_back(d);
+    }
+
+    if( reduced.empty() )
+        return 0;
+
+    // Too many to enumerate subsets; use an upper bound.
+    if( reduced.size() > 16 )
+    {
+        float sum = 0;
+        for(uint64_t d : reduced)
+            sum += 1.0f / d;
+
+        return baseRate * std::min(sum, 1.0f);
+    }
+
+    // Inclusion-exclusion over the sets of multiples of each decimation.
+    const uint64_t LCM_LIMIT = uint64_t(1) << 40;  // Terms beyond this are negligible.
+
+    double fraction = 0;
+
+    for(uint32_t subset=1; subset < (uint32_t(1) << reduced.size()); subset++)
+    {
+        uint64_t lcm = 1;
+        int bits = 0;
+
+        for(size_t i=0; i<reduced.size() && lcm < LCM_LIMIT; i++)
+        {
+            if( subset & (uint32_t(1) << i) )
+            {
+                uint64_t a = lcm, b = reduced[i];
+                while( b ) { uint64_t t = a % b; a = b; b = t; }  // gcd
+
+                lcm = lcm / a * reduced[i];
+                bits++;
+            }
+        }
+
+        if( lcm >= LCM_LIMIT )
+            continue;
+
+        fraction += (bits % 2 ? 1.0 : -1.0) / double(lcm);
+    }
+
+    return float(baseRate * fraction);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+///@brief Chooses decimations for all fields and predicts the stream size.
+///
+/// Base rates must be known (see queryBaseRates) for the fields to be
+/// planned. If a baud rate was given, rates are reduced as allowed until the
+/// stream fits within the usable bandwidth.
+///
+///@returns The prediction. The chosen decimations can be inspected with
+///         operator[].
+///
+MessageFormatPlanner::Result MessageFormatPlanner::plan()
+{
+    Result result;
+
+    for(Field& field : mFields)
+    {
+        const uint16_t baseRate = dataSet(field.descriptorSet).baseRate;
+
+        if( baseRate == 0 )
+        {
+            field.decimation = 0;
+            field.actualRate = 0;
+            continue;
+        }
+
+        const float decimation = std::round(baseRate / field.requestedRate);
+
+        field.decimation = uint16_t(std::max(1.0f, std::min(decimation, 65535.0f)));
+        field.actualRate = float(baseRate) / field.decimation;
+    }
+
+    result.capacity = float(mBaudrate) / BITS_PER_BYTE;
+
+    const float usable = result.capacity * (1 - mHeadroom);
+
+    predict(result);
+
+    while( result.capacity > 0 && result.bytesPerSecond > usable )
+    {
+        // Slow down the biggest field which may be slowed down.
+        Field*   biggest = nullptr;
+        uint16_t biggestDecimation = 0;
+        float    biggestSize = 0;
+
+        for(Field& field : mFields)
+        {
+            if( field.decimation == 0 )
+                continue;
+
+            const uint16_t baseRate = dataSet(field.descriptorSet).baseRate;
+
+            // Prefer decimations which give a whole number of Hz.
+            uint32_t next = field.decimation + 1;
+            while( next < baseRate && baseRate % next != 0 )
+                next++;
+
+            if( next > 65535 || float(baseRate) / next < field.minRate )
+                continue;
+
+            const float size = (field.payloadLength + C::MIP_FIELD_HEADER_LENGTH) * field.actualRate;
+
+            if( size > biggestSize )
+            {
+                biggest           = &field;
+                biggestDecimation = uint16_t(next);
+                biggestSize       = size;
+            }
+        }
+
+        if( !biggest )
+            break;
+
+        biggest->decimation = biggestDecimation;
+        biggest->actualRate = float(dataSet(biggest->descriptorSet).baseRate) / biggestDecimation;
+        result.reduced = true;
+
+        predict(result);
+    }
+
+    mPlanned = true;
+
+    result.fits = std::all_of(mFields.begin(), mFields.end(), [](const Field& field){ return field.decimation != 0; });
+
+    if( result.capacity > 0 )
+    {
+        result.utilization = result.bytesPerSecond / result.capacity;
+        result.fits &= (result.bytesPerSecond <= usable);
+    }
+
+    return result;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+///@brief Writes the planned message format for each descriptor set.
+///
+/// The formats are sent as one pipelined batch. Streaming itself is not
+/// enabled; use writeDatastreamControl or resume afterward.
+///
+/// Descriptor sets without any planned field (e.g. because the base rate is
+/// unknown) are not written, so the device keeps its existing format for
+/// them rather than having it cleared.
+///
+///@returns True if every descriptor set was planned and written successfully.
+///         False without writing anything if plan() wasn't called after the
+///         last field was added.
+///
+bool MessageFormatPlanner::apply(C::mip_interface& device) const
+{
+    if( !mPlanned )
+        return false;
+
+    CommandBatch batch;
+    bool allPlanned = true;
+
+    for(const DataSet& set : mDataSets)
+    {
+        std::vector<DescriptorRate> rates;
+
+        for(const Field& field : mFields)
+        {
+            if( field.descriptorSet != set.descriptorSet )
+                continue;
+
+            if( field.decimation == 0 )
+                allPlanned = false;
+            else
+                rates.push_back({field.fieldDescriptor, field.decimation});
+        }
+
+        if( rates.empty() )
+            continue;
+
+        commands_3dm::MessageFormat format;
+        format.function        = FunctionSelector::WRITE;
+        format.desc_set        = set.descriptorSet;
+        format.num_descriptors = uint8_t(rates.size());
+        format.descriptors     = rates.data();
+
+        batch.add(format);
+    }
+
+    if( batch.size() == 0 )
+        return false;
+
+    return batch.run(device) && allPlanned;
+}
+
+MessageFormatPlanner::DataSet& MessageFormatPlanner::dataSet(uint8_t descriptorSet)
+{
+    for(DataSet& set : mDataSets)
+    {
+        if( set.descriptorSet == descriptorSet )
+            return set;
+    }
+
+    mDataSets.emplace_back();
+    mDataSets.back().descriptorSet = descriptorSet;
+
+    return mDataSets.back();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+///@brief Updates the per-set and total stream predictions.
+///
+/// Each packet costs a 4-byte header and 2-byte checksum, and each field a
+/// 2-byte field header in addition to its data.
+///
+void MessageFormatPlanner::predict(Result& result)
+{
+    const unsigned int PACKET_OVERHEAD = C::MIP_HEADER_LENGTH + C::MIP_CHECKSUM_LENGTH;
+    const unsigned int FIELD_OVERHEAD  = C::MIP_FIELD_HEADER_LENGTH;
+
+    result.bytesPerSecond = 0;
+
+    std::vector<uint16_t> decimations;
+
+    for(DataSet& set : mDataSets)
+    {
+        decimations.clear();
+        set.bytesPerSecond = 0;
+
+        for(const Field& field : mFields)
+        {
+            if( field.descriptorSet != set.descriptorSet || field.decimation == 0 )
+                continue;
+
+            decimations.push_back(field.decimation);
+            set.bytesPerSecond += (field.payloadLength + FIELD_OVERHEAD) * field.actualRate;
+        }
+
+        set.packetsPerSecond = predictPacketsPerSecond(set.baseRate, decimations.data(), decimations.size());
+        set.bytesPerSecond  += PACKET_OVERHEAD * set.packetsPerSecond;
+
+        result.bytesPerSecond += set.bytesPerSecond;
+    }
+}
+
+} // namespace extras
+} // namespace mip
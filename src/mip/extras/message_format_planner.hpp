@@ -0,0 +1,143 @@
+#pragma once
+
+#include "../mip_device.hpp"
+
+#include <vector>
+
+namespace mip
+{
+namespace extras
+{
+
+////////////////////////////////////////////////////////////////////////////////
+///@addtogroup mip_extras
+///@{
+
+////////////////////////////////////////////////////////////////////////////////
+///@brief Chooses message formats (decimations) for a set of data fields and
+///       checks that the resulting stream fits within the link bandwidth.
+///
+/// Each desired data field is added with a target rate. plan() converts the
+/// rates to decimations of the device's base rate for each descriptor set and
+/// predicts the stream size in bytes per second, counting packet headers,
+/// field headers and checksums. Fields with the same decimation share
+/// packets, and so do fields whose decimations line up on a common tick.
+///
+/// The prediction is checked against the UART capacity (10 bits per byte for
+/// 8N1 framing) less a safety margin. If it doesn't fit, fields which allow
+/// it (i.e. with a minimum rate below the target) are slowed down, the
+/// largest contributor first, to the next decimation which gives a whole
+/// number of Hz, until the stream fits or nothing more can be reduced.
+///
+///@code{.cpp}
+/// MessageFormatPlanner planner;
+/// planner.add<data_sensor::ScaledAccel>(100);
+/// planner.add<data_sensor::ScaledGyro>(100);
+/// planner.add<data_filter::AttitudeQuaternion>(100, 25);  // Can drop to 25 Hz if necessary.
+///
+/// planner.queryBaseRates(device);
+/// planner.queryBaudrate(device);
+///
+/// MessageFormatPlanner::Result result = planner.plan();
+/// if( result.fits )
+///     planner.apply(device);
+///@endcode
+///
+class MessageFormatPlanner
+{
+public:
+    static constexpr unsigned int BITS_PER_BYTE = 10;  ///< 1 start bit, 8 data bits, 1 stop bit.
+
+    struct Field
+    {
+        uint8_t  descriptorSet;
+        uint8_t  fieldDescriptor;
+        uint8_t  payloadLength;       ///< Size of the field data, excluding the 2-byte field header.
+        float    requestedRate;       ///< Target rate in Hz.
+        float    minRate;             ///< Lowest acceptable rate in Hz. Equal to requestedRate if the rate can't be reduced.
+        uint16_t decimation  = 0;     ///< Chosen decimation, or 0 if not planned yet (or the base rate is unknown).
+        float    actualRate  = 0;     ///< Resulting rate in Hz.
+    };
+
+    struct DataSet
+    {
+        uint8_t  descriptorSet;
+        uint16_t baseRate         = 0;  ///< Base rate in Hz, 0 if unknown.
+        float    packetsPerSecond = 0;
+        float    bytesPerSecond   = 0;
+    };
+
+    struct Result
+    {
+        bool  fits             = false;  ///< True if every field has a decimation and the stream fits the usable bandwidth.
+        bool  reduced          = false;  ///< True if any rate was lowered to make it fit.
+        float bytesPerSecond   = 0;      ///< Predicted total stream size.
+        float capacity         = 0;      ///< Link capacity in bytes per second, or 0 if unlimited/unknown.
+        float utilization      = 0;      ///< bytesPerSecond / capacity.
+    };
+
+    template<class DataField>
+    void add(float rate, float minRate=0);
+
+    void addRaw(uint8_t descriptorSet, uint8_t fieldDescriptor, uint8_t payloadLength, float rate, float minRate=0);
+
+    void setBaseRate(uint8_t descriptorSet, uint16_t rate);
+    CmdResult queryBaseRates(C::mip_interface& device);
+
+    void setBaudrate(uint32_t baud) { mBaudrate = baud; }
+    CmdResult queryBaudrate(C::mip_interface& device, uint8_t port=0);
+
+    ///@brief Sets the fraction of the link capacity to leave unused (default 0.2).
+    void setHeadroom(float fraction) { mHeadroom = fraction; }
+
+    Result plan();
+    bool apply(C::mip_interface& device) const;
+
+    void clear() { mFields.clear(); mDataSets.clear(); mPlanned = false; }
+
+    size_t size() const { return mFields.size(); }
+    const Field& operator[](size_t index) const { return mFields[index]; }
+
+    const std::vector<DataSet>& dataSets() const { return mDataSets; }
+
+    static float predictPacketsPerSecond(uint16_t baseRate, const uint16_t* decimations, size_t count);
+
+private:
+    DataSet& dataSet(uint8_t descriptorSet);
+    void predict(Result& result);
+
+    std::vector<Field>   mFields;
+    std::vector<DataSet> mDataSets;
+
+    uint32_t mBaudrate = 0;
+    float    mHeadroom = 0.2f;
+    bool     mPlanned  = false;  ///< True if plan() ran since the last field was added.
+};
+
+
+////////////////////////////////////////////////////////////////////////////////
+///@brief Adds a data field by type, e.g. `add<data_sensor::ScaledAccel>(100)`.
+///
+/// The field size is determined by serializing a default-constructed field,
+/// which is exact for the fixed-size data fields used in streaming.
+///
+///@param rate    Target rate in Hz.
+///@param minRate Lowest acceptable rate in Hz if the stream doesn't fit. If 0
+///               (the default), the rate will not be reduced.
+///
+template<class DataField>
+void MessageFormatPlanner::add(float rate, float minRate)
+{
+    uint8_t buffer[C::MIP_FIELD_PAYLOAD_LENGTH_MAX];
+    Serializer serializer(buffer, sizeof(buffer));
+    insert(serializer, DataField{});
+    assert(serializer.isOk());
+
+    addRaw(DataField::DESCRIPTOR_SET, DataField::FIELD_DESCRIPTOR, uint8_t(serializer.length()), rate, minRate);
+}
+
+///@}
+////////////////////////////////////////////////////////////////////////////////
+
+} // namespace extras
+} // namespace mip
@@ -0,0 +1,149 @@
+#include "record_file.hpp"
+
+#include <cstring>
+#include <fstream>
+#include <iterator>
+
+namespace mip
+{
+namespace extras
+{
+
+static const size_t HEADER_LENGTH = 4 + 1 + 2;  // Magic, version, record count.
+
+////////////////////////////////////////////////////////////////////////////////
+///@param magic
+///       Four characters identifying the kind of file, e.g. "MIPS".
+///@param version
+///       Version of the file contents. Files with a different version are
+///       rejected.
+///
+RecordFile::RecordFile(const char* magic, uint8_t version) : mVersion(version)
+{
+    std::memcpy(mMagic, magic, sizeof(mMagic));
+}
+
+////////////////////////////////////////////////////////////////////////////////
+///@brief Encodes records, including the file header.
+///
+std::vector<uint8_t> RecordFile::serialize(const std::vector<SettingRecord>& records) const
+{
+    std::vector<uint8_t> data;
+    data.reserve(HEADER_LENGTH + records.size() * 32);
+
+    data.insert(data.end(), std::begin(mMagic), std::end(mMagic));
+    data.push_back(mVersion);
+    data.push_back(uint8_t(records.size() >> 8));
+    data.push_back(uint8_t(records.size()));
+
+    for(const SettingRecord& record : records)
+    {
+        data.push_back(record.descriptorSet);
+        data.push_back(record.fieldDescriptor);
+        data.push_back(record.responseDescriptor);
+        data.push_back(uint8_t(record.key.size()));
+        data.insert(data.end(), record.key.begin(), record.key.end());
+        data.push_back(uint8_t(record.response.size()));
+        data.insert(data.end(), record.response.begin(), record.response.end());
+    }
+
+    return data;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+///@brief Decodes serialize() output.
+///
+///@param data
+///@param length
+///@param records
+///       Replaced with the decoded records.
+///
+///@returns False if the data is not valid. records is left empty in that
+///         case.
+///
+bool RecordFile::deserialize(const uint8_t* data, size_t length, std::vector<SettingRecord>& records) const
+{
+    records.clear();
+
+    if( length < HEADER_LENGTH || std::memcmp(data, mMagic, sizeof(mMagic)) != 0 || data[4] != mVersion )
+        return false;
+
+    const size_t count = size_t(data[5]) << 8 | data[6];
+
+    size_t offset = HEADER_LENGTH;
+
+    for(size_t i=0; i<count; i++)
+    {
+        if( offset + 4 > length )
+            break;
+
+        const uint8_t* header = &data[offset];
+        const uint8_t keyLength = header[3];
+        offset += 4;
+
+        if( offset + keyLength + 1 > length )
+            break;
+
+        const uint8_t* key = &data[offset];
+        const uint8_t responseLength = data[offset + keyLength];
+        offset += keyLength + 1;
+
+        if( offset + responseLength > length )
+            break;
+
+        SettingRecord record;
+        record.descriptorSet      = header[0];
+        record.fieldDescriptor    = header[1];
+        record.responseDescriptor = header[2];
+        record.key.assign(reinterpret_cast<const char*>(key), keyLength);
+        record.response.assign(reinterpret_cast<const char*>(&data[offset]), responseLength);
+
+        records.push_back(std::move(record));
+        offset += responseLength;
+    }
+
+    if( records.size() != count || offset != length )
+    {
+        records.clear();
+        return false;
+    }
+
+    return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+///@brief Writes records to a binary file.
+///
+///@returns True on success.
+///
+bool RecordFile::save(const std::string& filename, const std::vector<SettingRecord>& records) const
+{
+    const std::vector<uint8_t> data = serialize(records);
+
+    std::ofstream file(filename, std::ios::binary | std::ios::trunc);
+    file.write(reinterpret_cast<const char*>(data.data()), data.size());
+
+    return file.good();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+///@brief Reads records from a file written by save().
+///
+///@returns False if the file can't be read or is not valid. records is left
+///         empty in that case.
+///
+bool RecordFile::load(const std::string& filename, std::vector<SettingRecord>& records) const
+{
+    records.clear();
+
+    std::ifstream file(filename, std::ios::binary);
+    if( !file )
+        return false;
+
+    const std::vector<uint8_t> data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+
+    return deserialize(data.data(), data.size(), records);
+}
+
+} // namespace extras
+} // namespace mip
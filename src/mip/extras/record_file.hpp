@@ -0,0 +1,58 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+namespace mip
+{
+namespace extras
+{
+
+////////////////////////////////////////////////////////////////////////////////
+///@addtogroup mip_extras
+///@{
+
+////////////////////////////////////////////////////////////////////////////////
+///@brief A command response stored by SettingsCache or SettingsSnapshot.
+///
+struct SettingRecord
+{
+    uint8_t     descriptorSet;
+    uint8_t     fieldDescriptor;
+    uint8_t     responseDescriptor;
+    std::string key;       ///< Parameters identifying the value, e.g. the READ parameters after the function selector.
+    std::string response;  ///< Raw response payload.
+};
+
+////////////////////////////////////////////////////////////////////////////////
+///@brief Compact binary encoding of a list of SettingRecords.
+///
+/// The format is a 4-byte magic identifying the kind of file, a version byte
+/// and a big-endian 16-bit record count, followed by each record as:
+/// descriptor set, field descriptor, response descriptor, key length, key,
+/// response length, response.
+///
+class RecordFile
+{
+public:
+    RecordFile(const char* magic, uint8_t version);
+
+    std::vector<uint8_t> serialize(const std::vector<SettingRecord>& records) const;
+    bool deserialize(const uint8_t* data, size_t length, std::vector<SettingRecord>& records) const;
+
+    bool save(const std::string& filename, const std::vector<SettingRecord>& records) const;
+    bool load(const std::string& filename, std::vector<SettingRecord>& records) const;
+
+private:
+    uint8_t mMagic[4];
+    uint8_t mVersion;
+};
+
+///@}
+////////////////////////////////////////////////////////////////////////////////
+
+} // namespace extras
+} // namespace mip
@@ -0,0 +1,218 @@
+#include "resilient_connection.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <stdexcept>
+#include <thread>
+
+namespace mip
+{
+namespace extras
+{
+
+////////////////////////////////////////////////////////////////////////////////
+///@brief Creates a resilient connection, initially disconnected.
+///
+/// Call connect() to open the first connection, or let the first update do
+/// it, in which case it's handled like a reconnection (including the resume
+/// plan and event).
+///
+///@param connect  Function which opens a new connection.
+///@param userData Passed to connect.
+///@param clock    Function returning the current time in milliseconds, e.g.
+///                getCurrentTimestamp. Used for backoff and gap timing.
+///
+ResilientConnection::ResilientConnection(ConnectFunction connect, void* userData, Timestamp (*clock)()) :
+    mConnect(connect), mConnectUserData(userData), mClock(clock)
+{
+    mGap.lostTime = mClock();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+///@brief Opens the connection if it isn't already open.
+///
+/// Unlike a reconnection during an update, the resume plan is not applied
+/// and no event is sent.
+///
+///@returns True if the connection is open.
+///
+bool ResilientConnection::connect()
+{
+    if( mConnection )
+        return true;
+
+    if( !open() )
+        return false;
+
+    mBackoff = 0;
+    return true;
+}
+
+bool ResilientConnection::recvFromDevice(uint8_t* buffer, size_t max_length, size_t* length_out, Timestamp* timestamp)
+{
+    if( mConnection && mConnection->recvFromDevice(buffer, max_length, length_out, timestamp) )
+        return true;
+
+    return recover(length_out, timestamp);
+}
+
+bool ResilientConnection::recvFromDeviceV(const byte_ring_iov* segments, unsigned int count, size_t* length_out, Timestamp* timestamp)
+{
+    if( mConnection && mConnection->recvFromDeviceV(segments, count, length_out, timestamp) )
+        return true;
+
+    return recover(length_out, timestamp);
+}
+
+bool ResilientConnection::sendToDevice(const uint8_t* data, size_t length)
+{
+    return mConnection && mConnection->sendToDevice(data, length);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+///@brief Sets the read timeout of the current and all future connections.
+///
+/// While disconnected, this also limits how long an update waits before
+/// returning when the next connection attempt isn't due yet.
+///
+bool ResilientConnection::setReadTimeout(Timeout timeout)
+{
+    mReadTimeout    = timeout;
+    mHasReadTimeout = true;
+
+    if( mConnection )
+        mConnection->setReadTimeout(timeout);
+
+    return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+///@brief Handles a failed or missing connection during an update.
+///
+/// Attempts to reconnect if the backoff time has passed. Otherwise, waits up
+/// to the read timeout, like a read with no data would.
+///
+///@returns True, so that the update continues as if no data was received.
+///
+bool ResilientConnection::recover(size_t* length_out, Timestamp* timestamp)
+{
+    *length_out = 0;
+
+    if( mConnection )
+        connectionLost();
+
+    // While applying the resume plan, the new connection failed too. Let the
+    // remaining commands fail; the next update tries again.
+    if( mResuming )
+    {
+        *timestamp = mClock();
+        return true;
+    }
+
+    const Timestamp now = mClock();
+    const int remaining = int(mNextAttempt - now);
+
+    if( remaining > 0 )
+        std::this_thread::sleep_for(std::chrono::milliseconds(std::min<Timeout>(Timeout(remaining), mReadTimeout)));
+    else
+        tryReconnect();
+
+    *timestamp = mClock();
+    return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+///@brief Closes a failed connection and notifies the application.
+///
+void ResilientConnection::connectionLost()
+{
+    mConnection.reset();
+
+    // Nothing further will arrive for the outstanding commands.
+    if( mDevice )
+        C::mip_cmd_queue_clear(C::mip_interface_cmd_queue(mDevice));
+
+    mGap = Gap();
+    mGap.lostTime = mClock();
+
+    // Try again right away, in case the device is immediately available.
+    mBackoff     = 0;
+    mNextAttempt = mGap.lostTime;
+
+    if( mEventCallback )
+        mEventCallback(mEventUserData, Event::DISCONNECTED, mGap);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+///@brief Opens a new connection and resets the parser.
+///
+bool ResilientConnection::open()
+{
+    std::unique_ptr<Connection> connection;
+    try
+    {
+        connection = mConnect(mConnectUserData);
+    }
+    catch(const std::exception&)
+    {
+    }
+
+    if( !connection )
+        return false;
+
+    mConnection = std::move(connection);
+
+    if( mHasReadTimeout )
+        mConnection->setReadTimeout(mReadTimeout);
+
+    // Discard any partial packet received before the connection was lost.
+    if( mDevice )
+        C::mip_parser_reset(C::mip_interface_parser(mDevice));
+
+    return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+///@brief Makes one reconnection attempt, then restores streaming.
+///
+///@returns True if the connection was reopened.
+///
+bool ResilientConnection::tryReconnect()
+{
+    mGap.attempts++;
+
+    if( !open() )
+    {
+        mBackoff     = (mBackoff == 0) ? mInitialBackoff : std::min<Timeout>(mBackoff * 2, mMaxBackoff);
+        mNextAttempt = mClock() + mBackoff;
+        return false;
+    }
+
+    mGap.restoredTime = mClock();
+    mGap.resumeOk     = true;
+
+    if( mDevice && mResumePlan )
+    {
+        mResuming = true;
+        const ConfigPlan::Report report = mResumePlan->apply(*mDevice, mResumeOptions);
+        mResuming = false;
+
+        // Lost again while resuming; connectionLost has already started over.
+        if( !mConnection )
+            return false;
+
+        mGap.resumeOk = report.ok();
+    }
+
+    mGap.resumedTime = mClock();
+    mBackoff = 0;
+    mNumReconnects++;
+
+    if( mEventCallback )
+        mEventCallback(mEventUserData, Event::RECONNECTED, mGap);
+
+    return true;
+}
+
+} // namespace extras
+} // namespace mip
@@ -0,0 +1,153 @@
+#pragma once
+
+#include "config_plan.hpp"
+
+#include <memory>
+
+namespace mip
+{
+namespace extras
+{
+
+////////////////////////////////////////////////////////////////////////////////
+///@addtogroup mip_extras
+///@{
+
+////////////////////////////////////////////////////////////////////////////////
+///@brief A connection which reopens itself when the link is lost.
+///
+/// The actual connection (e.g. a platform::TcpConnection) is created by a
+/// user-supplied function. When receiving fails, for example because a TCP
+/// peer went away or a USB-serial adapter re-enumerated, the connection is
+/// closed and outstanding commands fail. Instead of reporting the failure
+/// to DeviceInterface::update, subsequent updates try to open a new
+/// connection, waiting longer after each failed attempt (exponential
+/// backoff) up to a limit.
+///
+/// Once a new connection is open, the parser is reset so that no partial
+/// packet from the old connection is combined with new data. Then the
+/// resume plan, if any, is applied to restore streaming. This is typically
+/// the message formats, DatastreamControl, and a final Resume command, in
+/// case the device was power cycled. Finally, the event callback receives a
+/// RECONNECTED event describing the gap in the data.
+///
+///@code{.cpp}
+/// std::unique_ptr<Connection> connect(void*) { return std::unique_ptr<Connection>(new platform::TcpConnection("192.168.1.10", 2000)); }
+///
+/// ResilientConnection connection(&connect, nullptr, &getCurrentTimestamp);
+/// DeviceInterface device(&connection, buffer, sizeof(buffer), 1000, 2000);
+/// connection.attach(device);
+///
+/// ConfigPlan resume;
+/// resume.set(filterFormat);
+/// resume.set(commands_3dm::DatastreamControl{FunctionSelector::WRITE, data_filter::DESCRIPTOR_SET, true});
+/// resume.add(commands_base::Resume{});
+/// connection.setResumePlan(&resume);
+///
+/// while(running)
+///     device.update();  // Keeps going across disconnections.
+///@endcode
+///
+/// The resume plan is run from within DeviceInterface::update, using
+/// blocking commands. Therefore the device's update function must read from
+/// the connection even when called in blocking mode, as the default one
+/// does.
+///
+class ResilientConnection : public Connection
+{
+public:
+    ///@brief Opens a connection to the device.
+    ///
+    ///@returns The new connection, or null if it could not be opened.
+    ///         Exceptions derived from std::exception are also treated as
+    ///         a failed attempt.
+    ///
+    typedef std::unique_ptr<Connection> (*ConnectFunction)(void* userData);
+
+    enum class Event
+    {
+        DISCONNECTED,  ///< The connection was lost. Only Gap::lostTime is valid.
+        RECONNECTED,   ///< A new connection is open and the resume plan (if any) was applied.
+    };
+
+    ///@brief Describes a period without a working connection.
+    struct Gap
+    {
+        Timestamp lostTime     = 0;  ///< When the connection was found to be lost.
+        Timestamp restoredTime = 0;  ///< When the new connection was opened.
+        Timestamp resumedTime  = 0;  ///< When the resume plan finished.
+        uint32_t  attempts     = 0;  ///< Connection attempts, including the successful one.
+        bool      resumeOk     = true;  ///< False if any command in the resume plan failed.
+
+        Timeout duration() const { return Timeout(resumedTime - lostTime); }
+    };
+
+    typedef void (*EventCallback)(void* userData, Event event, const Gap& gap);
+
+    ResilientConnection(ConnectFunction connect, void* userData, Timestamp (*clock)());
+
+    ResilientConnection(const ResilientConnection&) = delete;
+    ResilientConnection& operator=(const ResilientConnection&) = delete;
+
+    void attach(DeviceInterface& device) { mDevice = &device; }
+
+    void setResumePlan(ConfigPlan* plan, const ConfigPlan::Options& options=ResumeOptions()) { mResumePlan = plan; mResumeOptions = options; }
+    void setEventCallback(EventCallback callback, void* userData) { mEventCallback = callback; mEventUserData = userData; }
+    void setBackoff(Timeout initial, Timeout maximum) { mInitialBackoff = initial; mMaxBackoff = maximum; }
+
+    bool connect();
+
+    bool isConnected() const { return mConnection != nullptr; }
+    Connection* connection() const { return mConnection.get(); }
+
+    const Gap& lastGap() const { return mGap; }
+    uint32_t numReconnects() const { return mNumReconnects; }
+
+    bool recvFromDevice(uint8_t* buffer, size_t max_length, size_t* length_out, Timestamp* timestamp) final;
+    bool recvFromDeviceV(const byte_ring_iov* segments, unsigned int count, size_t* length_out, Timestamp* timestamp) final;
+    bool sendToDevice(const uint8_t* data, size_t length) final;
+
+    uint32_t baudrate() const final { return mConnection ? mConnection->baudrate() : 0; }
+    bool setBaudrate(uint32_t baudrate) final { return mConnection && mConnection->setBaudrate(baudrate); }
+    bool setReadTimeout(Timeout timeout) final;
+
+    ///@brief Options used for the resume plan by default: write everything
+    ///       without reading first, and don't save.
+    static ConfigPlan::Options ResumeOptions() { ConfigPlan::Options options; options.diff = false; options.save = false; return options; }
+
+private:
+    bool recover(size_t* length_out, Timestamp* timestamp);
+    void connectionLost();
+    bool open();
+    bool tryReconnect();
+
+    ConnectFunction mConnect;
+    void*           mConnectUserData;
+    Timestamp     (*mClock)();
+
+    std::unique_ptr<Connection> mConnection;
+    DeviceInterface*            mDevice = nullptr;
+
+    ConfigPlan*         mResumePlan = nullptr;
+    ConfigPlan::Options mResumeOptions;
+
+    EventCallback mEventCallback = nullptr;
+    void*         mEventUserData = nullptr;
+
+    Timeout   mInitialBackoff = 100;
+    Timeout   mMaxBackoff     = 5000;
+    Timeout   mBackoff        = 0;
+    Timestamp mNextAttempt    = 0;
+    Timeout   mReadTimeout    = 10;
+    bool      mHasReadTimeout = false;
+    bool      mResuming       = false;
+
+    Gap      mGap;
+    uint32_t mNumReconnects = 0;
+};
+
+///@}
+////////////////////////////////////////////////////////////////////////////////
+
+} // namespace extras
+} // namespace mip
@@ -0,0 +1,483 @@
+#include "settings_cache.hpp"
+
+#include "../definitions/commands_base.hpp"
+#include "../definitions/commands_3dm.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+namespace mip
+{
+namespace extras
+{
+
+SettingsCache::SettingsCache()
+{
+    mHook.before    = &SettingsCache::beforeCommand;
+    mHook.after     = &SettingsCache::afterCommand;
+    mHook.user_data = this;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+///@brief Installs the cache as the device's command hook.
+///
+/// Replaces any existing hook. The cache must stay attached (or be detached)
+/// for as long as the device exists.
+///
+void SettingsCache::attach(C::mip_interface& device)
+{
+    detach();
+
+    std::lock_guard<std::mutex> lock(mMutex);
+
+    mDevice = &device;
+    C::mip_interface_set_command_hook(mDevice, &mHook);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+///@brief Removes the cache from the device, if attached.
+///
+/// Cached entries are kept, but may become stale while detached.
+///
+void SettingsCache::detach()
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+
+    if( mDevice && C::mip_interface_command_hook(mDevice) == &mHook )
+        C::mip_interface_set_command_hook(mDevice, nullptr);
+
+    mDevice = nullptr;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+///@brief Enables caching of a setting command (one with a function selector).
+///
+void SettingsCache::enable(uint8_t descriptorSet, uint8_t fieldDescriptor)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+
+    mKinds[uint16_t(descriptorSet << 8 | fieldDescriptor)] = Kind::SETTING;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+///@brief Enables caching of a command without a function selector whose
+///       response does not change while the device is connected.
+///
+void SettingsCache::enableQuery(uint8_t descriptorSet, uint8_t fieldDescriptor)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+
+    mKinds[uint16_t(descriptorSet << 8 | fieldDescriptor)] = Kind::QUERY;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+///@brief Fills the cache by running a batch of READ (or query) commands on the
+///       attached device.
+///
+/// Commands are packed into as few packets as possible, so warming up many
+/// settings costs about one round trip. Responses to enabled commands are
+/// stored; commands which fail are simply not cached.
+///
+///@param reads Batch of commands to run. Results can be inspected afterward.
+///
+///@returns True if every command succeeded.
+///
+bool SettingsCache::warmUp(CommandBatch& reads)
+{
+    C::mip_interface* device;
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        device = mDevice;
+    }
+
+    assert(device);  // Must be attached first.
+    if( !device )
+        return false;
+
+    // Responses are stored by the after-command hook.
+    return reads.run(*device);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+///@brief Looks up a cached response.
+///
+///@param descriptorSet
+///@param fieldDescriptor
+///@param key
+///       For settings, the READ parameters following the function selector.
+///       For queries, the full command payload.
+///@param keyLength
+///@param responseDescriptor
+///       Expected response field descriptor.
+///@param responseOut
+///       Buffer to receive the response data.
+///@param responseLengthInout
+///       On input, the size of responseOut. On output, the response length.
+///
+///@returns True if a matching entry was found.
+///
+bool SettingsCache::lookup(uint8_t descriptorSet, uint8_t fieldDescriptor, const uint8_t* key, uint8_t keyLength, uint8_t responseDescriptor, uint8_t* responseOut, uint8_t* responseLengthInout)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+
+    return lookupLocked(makeKey(descriptorSet, fieldDescriptor, key, keyLength), responseDescriptor, responseOut, responseLengthInout);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+///@brief Adds or replaces a cached response.
+///
+/// Normally entries are stored automatically. This may be used to preload the
+/// cache, e.g. from a file.
+///
+void SettingsCache::store(uint8_t descriptorSet, uint8_t fieldDescriptor, const uint8_t* key, uint8_t keyLength, uint8_t responseDescriptor, const uint8_t* response, uint8_t responseLength)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+
+    Entry& entry = mEntries[makeKey(descriptorSet, fieldDescriptor, key, keyLength)];
+
+    entry.responseDescriptor = responseDescriptor;
+    entry.response.assign(reinterpret_cast<const char*>(response), responseLength);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+///@brief Removes all entries for a command, regardless of parameters.
+///
+void SettingsCache::invalidate(uint8_t descriptorSet, uint8_t fieldDescriptor)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+
+    invalidateLocked(descriptorSet, fieldDescriptor);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+///@brief Removes all setting entries, keeping query entries.
+///
+void SettingsCache::invalidateSettings()
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+
+    invalidateSettingsLocked();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+///@brief Removes all entries and resets the hit/miss counters.
+///
+void SettingsCache::clear()
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+
+    mEntries.clear();
+    mHits   = 0;
+    mMisses = 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+///@brief Returns the number of cached entries.
+///
+size_t SettingsCache::size() const
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+
+    return mEntries.size();
+}
+
+static const RecordFile FILE_FORMAT("MIPC", 2);
+
+////////////////////////////////////////////////////////////////////////////////
+///@brief Returns a copy of the cached entries.
+///
+/// The record key holds the parameters only; the descriptor set and field
+/// descriptor are stored in their own members.
+///
+std::vector<SettingRecord> SettingsCache::records() const
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+
+    std::vector<SettingRecord> records;
+    records.reserve(mEntries.size());
+
+    for(const auto& entry : mEntries)
+    {
+        SettingRecord record;
+        record.descriptorSet      = uint8_t(entry.first[0]);
+        record.fieldDescriptor    = uint8_t(entry.first[1]);
+        record.responseDescriptor = entry.second.responseDescriptor;
+        record.key                = entry.first.substr(2);
+        record.response           = entry.second.response;
+
+        records.push_back(std::move(record));
+    }
+
+    return records;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+///@brief Replaces the cached entries, e.g. with records() from another cache.
+///
+void SettingsCache::setRecords(const std::vector<SettingRecord>& records)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+
+    mEntries.clear();
+
+    for(const SettingRecord& record : records)
+    {
+        Entry& entry = mEntries[makeKey(record.descriptorSet, record.fieldDescriptor, reinterpret_cast<const uint8_t*>(record.key.data()), uint8_t(record.key.size()))];
+
+        entry.responseDescriptor = record.responseDescriptor;
+        entry.response           = record.response;
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+///@brief Encodes the cached entries in a compact binary form.
+///
+/// See RecordFile for the format. The file magic is "MIPC".
+///
+std::vector<uint8_t> SettingsCache::serialize() const
+{
+    return FILE_FORMAT.serialize(records());
+}
+
+////////////////////////////////////////////////////////////////////////////////
+///@brief Replaces the cached entries with ones decoded from serialize()
+///       output.
+///
+///@returns False if the data is not valid. The cache is left empty in that
+///         case.
+///
+bool SettingsCache::deserialize(const uint8_t* data, size_t length)
+{
+    std::vector<SettingRecord> records;
+    const bool ok = FILE_FORMAT.deserialize(data, length, records);
+
+    setRecords(records);
+
+    return ok;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+///@brief Writes the cached entries to a binary file.
+///
+///@param filename
+///@param filter
+///       If not NULL, only entries for which this returns true are written.
+///
+///@returns True on success.
+///
+bool SettingsCache::save(const std::string& filename, bool (*filter)(const SettingRecord& record)) const
+{
+    std::vector<SettingRecord> entries = records();
+
+    if( filter )
+        entries.erase(std::remove_if(entries.begin(), entries.end(), [filter](const SettingRecord& record) { return !filter(record); }), entries.end());
+
+    return FILE_FORMAT.save(filename, entries);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+///@brief Replaces the cached entries with those from a file written by save().
+///
+///@returns False if the file can't be read or is not valid. The cache is left
+///         empty in that case.
+///
+bool SettingsCache::load(const std::string& filename)
+{
+    std::vector<SettingRecord> records;
+    const bool ok = FILE_FORMAT.load(filename, records);
+
+    setRecords(records);
+
+    return ok;
+}
+
+SettingsCache::Kind SettingsCache::kindOf(uint8_t descriptorSet, uint8_t fieldDescriptor) const
+{
+    auto iter = mKinds.find(uint16_t(descriptorSet << 8 | fieldDescriptor));
+
+    return (iter != mKinds.end()) ? iter->second : Kind::NONE;
+}
+
+std::string SettingsCache::makeKey(uint8_t descriptorSet, uint8_t fieldDescriptor, const uint8_t* params, uint8_t length)
+{
+    std::string key;
+    key.reserve(2 + length);
+
+    key.push_back(char(descriptorSet));
+    key.push_back(char(fieldDescriptor));
+    key.append(reinterpret_cast<const char*>(params), length);
+
+    return key;
+}
+
+bool SettingsCache::lookupLocked(const std::string& key, uint8_t responseDescriptor, uint8_t* responseOut, uint8_t* responseLengthInout)
+{
+    auto iter = mEntries.find(key);
+
+    if( iter == mEntries.end() || iter->second.responseDescriptor != responseDescriptor )
+    {
+        mMisses++;
+        return false;
+    }
+
+    const std::string& response = iter->second.response;
+
+    uint8_t length = uint8_t(response.size());
+    if( responseLengthInout )
+    {
+        if( length > *responseLengthInout )
+            length = *responseLengthInout;
+
+        *responseLengthInout = length;
+    }
+    else
+        length = 0;
+
+    if( length > 0 )
+        std::memcpy(responseOut, response.data(), length);
+
+    mHits++;
+    return true;
+}
+
+void SettingsCache::invalidateLocked(uint8_t descriptorSet, uint8_t fieldDescriptor)
+{
+    // All keys for a command share the same 2-byte prefix, so they are contiguous.
+    const std::string prefix = makeKey(descriptorSet, fieldDescriptor, nullptr, 0);
+
+    auto iter = mEntries.lower_bound(prefix);
+    while( iter != mEntries.end() && iter->first.compare(0, prefix.size(), prefix) == 0 )
+        iter = mEntries.erase(iter);
+}
+
+void SettingsCache::invalidateSettingsLocked()
+{
+    for(auto iter = mEntries.begin(); iter != mEntries.end(); )
+    {
+        if( kindOf(uint8_t(iter->first[0]), uint8_t(iter->first[1])) == Kind::SETTING )
+            iter = mEntries.erase(iter);
+        else
+            ++iter;
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+///@brief Returns true if the command reloads every setting on the device.
+///
+static bool reloadsAllSettings(uint8_t descriptorSet, uint8_t fieldDescriptor, const uint8_t* payload, uint8_t payloadLength)
+{
+    if( descriptorSet == commands_base::SoftReset::DESCRIPTOR_SET && fieldDescriptor == commands_base::SoftReset::FIELD_DESCRIPTOR )
+        return true;
+
+    if( descriptorSet == commands_3dm::DeviceSettings::DESCRIPTOR_SET && fieldDescriptor == commands_3dm::DeviceSettings::FIELD_DESCRIPTOR && payloadLength >= 1 )
+        return payload[0] == uint8_t(FunctionSelector::LOAD) || payload[0] == uint8_t(FunctionSelector::RESET);
+
+    return false;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+///@brief Determines what a command means for the cache.
+///
+///@param keyOut
+///       Set to the cache key if the result is Action::CACHE.
+///
+SettingsCache::Action SettingsCache::classify(uint8_t descriptorSet, uint8_t fieldDescriptor, const uint8_t* payload, uint8_t payloadLength, std::string* keyOut) const
+{
+    if( reloadsAllSettings(descriptorSet, fieldDescriptor, payload, payloadLength) )
+        return Action::INVALIDATE_ALL;
+
+    switch( kindOf(descriptorSet, fieldDescriptor) )
+    {
+    case Kind::SETTING:
+        if( payloadLength < 1 || payload[0] == uint8_t(FunctionSelector::SAVE) )
+            return Action::NONE;
+
+        if( payload[0] != uint8_t(FunctionSelector::READ) )
+            return Action::INVALIDATE;
+
+        *keyOut = makeKey(descriptorSet, fieldDescriptor, payload+1, payloadLength-1);
+        return Action::CACHE;
+
+    case Kind::QUERY:
+        *keyOut = makeKey(descriptorSet, fieldDescriptor, payload, payloadLength);
+        return Action::CACHE;
+
+    default:
+        return Action::NONE;
+    }
+}
+
+bool SettingsCache::beforeCommand(void* userData, uint8_t descriptorSet, uint8_t fieldDescriptor, const uint8_t* payload, uint8_t payloadLength, uint8_t responseDescriptor, uint8_t* responseBuffer, uint8_t* responseLengthInout, C::mip_cmd_result* resultOut)
+{
+    SettingsCache* cache = static_cast<SettingsCache*>(userData);
+
+    std::lock_guard<std::mutex> lock(cache->mMutex);
+
+    std::string key;
+
+    switch( cache->classify(descriptorSet, fieldDescriptor, payload, payloadLength, &key) )
+    {
+    case Action::INVALIDATE_ALL:
+        cache->invalidateSettingsLocked();
+        return false;
+
+    case Action::INVALIDATE:
+        // Drop the entries before sending, in case the change takes effect
+        // even though the command fails or times out.
+        cache->invalidateLocked(descriptorSet, fieldDescriptor);
+        return false;
+
+    case Action::CACHE:
+        break;
+
+    default:
+        return false;
+    }
+
+    if( !cache->lookupLocked(key, responseDescriptor, responseBuffer, responseLengthInout) )
+        return false;
+
+    *resultOut = C::MIP_ACK_OK;
+    return true;
+}
+
+void SettingsCache::afterCommand(void* userData, uint8_t descriptorSet, uint8_t fieldDescriptor, const uint8_t* payload, uint8_t payloadLength, uint8_t responseDescriptor, const uint8_t* response, uint8_t responseLength, uint8_t responseBufferSize, C::mip_cmd_result result)
+{
+    SettingsCache* cache = static_cast<SettingsCache*>(userData);
+
+    std::lock_guard<std::mutex> lock(cache->mMutex);
+
+    std::string key;
+
+    switch( cache->classify(descriptorSet, fieldDescriptor, payload, payloadLength, &key) )
+    {
+    case Action::INVALIDATE_ALL:
+        cache->invalidateSettingsLocked();
+        return;
+
+    case Action::INVALIDATE:
+        cache->invalidateLocked(descriptorSet, fieldDescriptor);
+        return;
+
+    case Action::CACHE:
+        break;
+
+    default:
+        return;
+    }
+
+    // Only cache complete, successful replies. A response which filled a
+    // short buffer may have been cut off.
+    if( result != C::MIP_ACK_OK || responseDescriptor == 0x00 || responseLength == 0 )
+        return;
+    if( responseLength >= responseBufferSize && responseBufferSize < C::MIP_FIELD_PAYLOAD_LENGTH_MAX )
+        return;
+
+    Entry& entry = cache->mEntries[key];
+
+    entry.responseDescriptor = responseDescriptor;
+    entry.response.assign(reinterpret_cast<const char*>(response), responseLength);
+}
+
+} // namespace extras
+} // namespace mip
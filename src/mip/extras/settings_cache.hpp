@@ -0,0 +1,157 @@
+#pragma once
+
+#include "command_batch.hpp"
+#include "record_file.hpp"
+
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace mip
+{
+namespace extras
+{
+
+////////////////////////////////////////////////////////////////////////////////
+///@addtogroup mip_extras
+///@{
+
+////////////////////////////////////////////////////////////////////////////////
+///@brief Opt-in cache for device settings, to avoid repeated round trips for
+///       reads of values which haven't changed.
+///
+/// Once attached to a device, READs of enabled setting commands are answered
+/// from the cache when possible. Entries are keyed by descriptor set, field
+/// descriptor and the parameters following the function selector (e.g. the
+/// data descriptor set for MessageFormat), so each distinct READ is cached
+/// separately. Responses are stored after a successful READ from the device.
+///
+/// Entries for a command are invalidated whenever it is sent with the WRITE,
+/// LOAD or RESET (default) function, whether or not it succeeds. All settings
+/// are invalidated by DeviceSettings LOAD/RESET and by a device SoftReset.
+///
+/// "Query" commands without a function selector whose results never change
+/// while connected (e.g. getDeviceInfo or getDeviceDescriptors) may also be
+/// enabled; these are keyed by their full payload and are only removed by
+/// clear().
+///
+///@code{.cpp}
+/// SettingsCache cache;
+/// cache.enable<commands_3dm::MessageFormat, commands_3dm::UartBaudrate, commands_3dm::Sensor2VehicleTransformEuler>();
+/// cache.enableQuery<commands_base::GetDeviceInfo>();
+/// cache.attach(device);
+///
+/// // Fill the cache with one round trip.
+/// CommandBatch batch;
+/// batch.add(commands_3dm::UartBaudrate{FunctionSelector::READ});
+/// batch.add(commands_3dm::MessageFormat{FunctionSelector::READ, data_sensor::DESCRIPTOR_SET});
+/// cache.warmUp(batch);
+///
+/// commands_3dm::readUartBaudrate(device, &baud);  // Served locally.
+///@endcode
+///
+/// The cache contents can be saved to a file and loaded again later, e.g. to
+/// skip queries at startup. Only load a file saved from the same device (and
+/// firmware version); see CapabilityCache.
+///
+/// The cache is not aware of settings changed by other means, such as another
+/// program connected to the same device, or commands sent as raw packets.
+/// CommandBatch and the generated command functions are accounted for.
+///
+/// All methods are thread-safe.
+///
+class SettingsCache
+{
+public:
+    SettingsCache();
+    ~SettingsCache() { detach(); }
+
+    SettingsCache(const SettingsCache&) = delete;
+    SettingsCache& operator=(const SettingsCache&) = delete;
+
+    void attach(C::mip_interface& device);
+    void detach();
+
+    C::mip_interface* device() const { return mDevice; }
+
+    void enable(uint8_t descriptorSet, uint8_t fieldDescriptor);
+    void enableQuery(uint8_t descriptorSet, uint8_t fieldDescriptor);
+
+    template<class... Cmds>
+    void enable() { int dummy[] = { 0, (enableOne<Cmds>(), 0)... }; (void)dummy; }
+
+    template<class... Cmds>
+    void enableQuery() { int dummy[] = { 0, (enableQuery(Cmds::DESCRIPTOR_SET, Cmds::FIELD_DESCRIPTOR), 0)... }; (void)dummy; }
+
+    bool warmUp(CommandBatch& reads);
+
+    bool lookup(uint8_t descriptorSet, uint8_t fieldDescriptor, const uint8_t* key, uint8_t keyLength, uint8_t responseDescriptor, uint8_t* responseOut, uint8_t* responseLengthInout);
+    void store(uint8_t descriptorSet, uint8_t fieldDescriptor, const uint8_t* key, uint8_t keyLength, uint8_t responseDescriptor, const uint8_t* response, uint8_t responseLength);
+
+    void invalidate(uint8_t descriptorSet, uint8_t fieldDescriptor);
+    void invalidateSettings();
+    void clear();
+
+    std::vector<SettingRecord> records() const;
+    void setRecords(const std::vector<SettingRecord>& records);
+
+    std::vector<uint8_t> serialize() const;
+    bool deserialize(const uint8_t* data, size_t length);
+
+    bool save(const std::string& filename, bool (*filter)(const SettingRecord& record)=nullptr) const;
+    bool load(const std::string& filename);
+
+    size_t size() const;
+    uint32_t hits() const { return mHits; }
+    uint32_t misses() const { return mMisses; }
+
+private:
+    enum class Kind : uint8_t { NONE, SETTING, QUERY };
+
+    ///@brief Effect of a command on the cache.
+    enum class Action : uint8_t
+    {
+        NONE,            ///< Not cached and changes nothing (includes SAVE).
+        CACHE,           ///< A READ or query; served from and stored in the cache.
+        INVALIDATE,      ///< Changes the setting (WRITE, LOAD or RESET).
+        INVALIDATE_ALL,  ///< Reloads every setting.
+    };
+
+    struct Entry
+    {
+        uint8_t     responseDescriptor;
+        std::string response;
+    };
+
+    template<class Cmd>
+    void enableOne() { static_assert(Cmd::HAS_READ_FUNCTION, "Only commands with a READ function can be cached."); enable(Cmd::DESCRIPTOR_SET, Cmd::FIELD_DESCRIPTOR); }
+
+    Kind kindOf(uint8_t descriptorSet, uint8_t fieldDescriptor) const;
+    Action classify(uint8_t descriptorSet, uint8_t fieldDescriptor, const uint8_t* payload, uint8_t payloadLength, std::string* keyOut) const;
+    static std::string makeKey(uint8_t descriptorSet, uint8_t fieldDescriptor, const uint8_t* params, uint8_t length);
+
+    bool lookupLocked(const std::string& key, uint8_t responseDescriptor, uint8_t* responseOut, uint8_t* responseLengthInout);
+    void invalidateLocked(uint8_t descriptorSet, uint8_t fieldDescriptor);
+    void invalidateSettingsLocked();
+
+    static bool beforeCommand(void* cache, uint8_t descriptorSet, uint8_t fieldDescriptor, const uint8_t* payload, uint8_t payloadLength, uint8_t responseDescriptor, uint8_t* responseBuffer, uint8_t* responseLengthInout, C::mip_cmd_result* resultOut);
+    static void afterCommand(void* cache, uint8_t descriptorSet, uint8_t fieldDescriptor, const uint8_t* payload, uint8_t payloadLength, uint8_t responseDescriptor, const uint8_t* response, uint8_t responseLength, uint8_t responseBufferSize, C::mip_cmd_result result);
+
+    mutable std::mutex mMutex;
+
+    C::mip_interface*        mDevice = nullptr;
+    C::mip_command_hook      mHook;
+
+    std::map<uint16_t, Kind>     mKinds;
+    std::map<std::string, Entry> mEntries;
+
+    uint32_t mHits   = 0;
+    uint32_t mMisses = 0;
+};
+
+///@}
+////////////////////////////////////////////////////////////////////////////////
+
+} // namespace extras
+} // namespace mip
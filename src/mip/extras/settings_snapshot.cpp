@@ -0,0 +1,314 @@
+#include "settings_snapshot.hpp"
+
+#include "../definitions/commands_3dm.hpp"
+#include "../definitions/commands_filter.hpp"
+#include "../definitions/commands_gnss.hpp"
+#include "../definitions/data_sensor.hpp"
+#include "../definitions/data_gnss.hpp"
+#include "../definitions/data_filter.hpp"
+#include "../definitions/data_system.hpp"
+
+#include <cstring>
+
+namespace mip
+{
+namespace extras
+{
+
+namespace
+{
+    ////////////////////////////////////////////////////////////////////////////
+    ///@brief Values of a key parameter to read a setting for.
+    ///
+    struct KeyList
+    {
+        const uint8_t* keys;
+        uint8_t        keySize;  ///< Serialized size of one key, in bytes.
+        uint8_t        count;
+    };
+
+    const uint8_t DATA_DESCRIPTOR_SETS[] = { data_sensor::DESCRIPTOR_SET, data_gnss::DESCRIPTOR_SET, data_filter::DESCRIPTOR_SET, data_system::DESCRIPTOR_SET };
+    const uint8_t LOWPASS_TARGETS[]      = { data_sensor::DATA_ACCEL_SCALED, data_sensor::DATA_GYRO_SCALED, data_sensor::DATA_MAG_SCALED, data_sensor::DATA_PRESSURE_SCALED };
+    const uint8_t GPIO_PINS[]            = { 1, 2, 3, 4 };
+    const uint8_t EVENT_INSTANCES[]      = { 1, 2, 3, 4, 5, 6, 7, 8 };
+    const uint8_t SENSOR_RANGE_TYPES[]   = { uint8_t(commands_3dm::SensorRangeType::ACCEL), uint8_t(commands_3dm::SensorRangeType::GYRO), uint8_t(commands_3dm::SensorRangeType::MAG), uint8_t(commands_3dm::SensorRangeType::PRESS) };
+    const uint8_t AIDING_SOURCES[]       = { 0,0, 0,1, 0,2, 0,3, 0,4, 0,5 };  // Big-endian u16 AidingSource values.
+    const uint8_t RECEIVER_IDS[]         = { 1, 2 };
+    const uint8_t SPEED_SOURCES[]        = { 1 };
+
+    const KeyList DATA_DESCRIPTOR_SET_KEYS = { DATA_DESCRIPTOR_SETS, 1, sizeof(DATA_DESCRIPTOR_SETS) };
+    const KeyList LOWPASS_TARGET_KEYS      = { LOWPASS_TARGETS,      1, sizeof(LOWPASS_TARGETS)      };
+    const KeyList GPIO_PIN_KEYS            = { GPIO_PINS,            1, sizeof(GPIO_PINS)            };
+    const KeyList EVENT_INSTANCE_KEYS      = { EVENT_INSTANCES,      1, sizeof(EVENT_INSTANCES)      };
+    const KeyList SENSOR_RANGE_KEYS        = { SENSOR_RANGE_TYPES,   1, sizeof(SENSOR_RANGE_TYPES)   };
+    const KeyList AIDING_SOURCE_KEYS       = { AIDING_SOURCES,       2, sizeof(AIDING_SOURCES) / 2   };
+    const KeyList RECEIVER_ID_KEYS         = { RECEIVER_IDS,         1, sizeof(RECEIVER_IDS)         };
+    const KeyList SPEED_SOURCE_KEYS        = { SPEED_SOURCES,        1, sizeof(SPEED_SOURCES)        };
+
+    struct ReadableSetting
+    {
+        uint8_t        descriptorSet;
+        uint8_t        fieldDescriptor;
+        uint8_t        responseDescriptor;
+        const KeyList* keys;         ///< NULL if the READ takes no parameters.
+        bool           calibration;  ///< Per-unit calibration, only captured on request.
+    };
+
+    template<class Cmd>
+    ReadableSetting setting(const KeyList* keys=nullptr)
+    {
+        static_assert(Cmd::HAS_READ_FUNCTION && Cmd::HAS_WRITE_FUNCTION, "Snapshot settings must be readable and writable.");
+
+        return { Cmd::DESCRIPTOR_SET, Cmd::FIELD_DESCRIPTOR, Cmd::Response::FIELD_DESCRIPTOR, keys, false };
+    }
+
+    template<class Cmd>
+    ReadableSetting calibration()
+    {
+        ReadableSetting result = setting<Cmd>();
+        result.calibration = true;
+        return result;
+    }
+
+    ////////////////////////////////////////////////////////////////////////////
+    ///@brief Every setting captured by a snapshot, in the order it is restored.
+    ///
+    /// Message formats come before DatastreamControl so that streams are
+    /// enabled with the right contents. Settings with several equivalent
+    /// forms (e.g. the sensor-to-vehicle transform as Euler angles,
+    /// quaternion or DCM) are captured in one form only, as the forms are
+    /// aliases of the same device setting.
+    ///
+    const ReadableSetting READABLE_SETTINGS[] = {
+        // 3DM
+        setting<commands_3dm::ImuMessageFormat>(),
+        setting<commands_3dm::GpsMessageFormat>(),
+        setting<commands_3dm::FilterMessageFormat>(),
+        setting<commands_3dm::MessageFormat>(&DATA_DESCRIPTOR_SET_KEYS),
+        setting<commands_3dm::NmeaMessageFormat>(),
+        setting<commands_3dm::GnssSbasSettings>(),
+        setting<commands_3dm::AdvLowpassFilter>(&LOWPASS_TARGET_KEYS),
+        setting<commands_3dm::PpsSource>(),
+        setting<commands_3dm::GpioConfig>(&GPIO_PIN_KEYS),
+        setting<commands_3dm::Odometer>(),
+        setting<commands_3dm::EventTrigger>(&EVENT_INSTANCE_KEYS),
+        setting<commands_3dm::EventAction>(&EVENT_INSTANCE_KEYS),
+        setting<commands_3dm::EventControl>(&EVENT_INSTANCE_KEYS),
+        calibration<commands_3dm::AccelBias>(),
+        calibration<commands_3dm::GyroBias>(),
+        calibration<commands_3dm::MagHardIronOffset>(),
+        calibration<commands_3dm::MagSoftIronMatrix>(),
+        setting<commands_3dm::Sensor2VehicleTransformEuler>(),
+        setting<commands_3dm::ComplementaryFilter>(),
+        setting<commands_3dm::SensorRange>(&SENSOR_RANGE_KEYS),
+
+        // Filter
+        setting<commands_filter::EstimationControl>(),
+        setting<commands_filter::SensorToVehicleRotationEuler>(),
+        setting<commands_filter::SensorToVehicleOffset>(),
+        setting<commands_filter::AntennaOffset>(),
+        setting<commands_filter::GnssSource>(),
+        setting<commands_filter::HeadingSource>(),
+        setting<commands_filter::AutoInitControl>(),
+        setting<commands_filter::AltitudeAiding>(),
+        setting<commands_filter::AutoZupt>(),
+        setting<commands_filter::AutoAngularZupt>(),
+        setting<commands_filter::AidingMeasurementEnable>(&AIDING_SOURCE_KEYS),
+        setting<commands_filter::KinematicConstraint>(),
+        setting<commands_filter::InitializationConfiguration>(),
+        setting<commands_filter::AdaptiveFilterOptions>(),
+        setting<commands_filter::MultiAntennaOffset>(&RECEIVER_ID_KEYS),
+        setting<commands_filter::RelPosConfiguration>(),
+        setting<commands_filter::RefPointLeverArm>(),
+        setting<commands_filter::SpeedLeverArm>(&SPEED_SOURCE_KEYS),
+        setting<commands_filter::WheeledVehicleConstraintControl>(),
+        setting<commands_filter::VerticalGyroConstraintControl>(),
+        setting<commands_filter::GnssAntennaCalControl>(),
+        setting<commands_filter::MagneticDeclinationSource>(),
+
+        // GNSS
+        setting<commands_gnss::SignalConfiguration>(),
+        setting<commands_gnss::RtkDongleConfiguration>(),
+
+        // Streaming is enabled last.
+        setting<commands_3dm::DatastreamControl>(&DATA_DESCRIPTOR_SET_KEYS),
+    };
+
+    const RecordFile FILE_FORMAT("MIPS", 1);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+///@brief Reads all supported settings from the device, replacing the current
+///       contents of the snapshot.
+///
+/// All reads are sent as one batch, so this takes roughly one round trip plus
+/// the time the device needs to process each command.
+///
+///@param device
+///@param includeCalibration
+///       If true, per-unit calibration (AccelBias, GyroBias, MagHardIronOffset
+///       and MagSoftIronMatrix) is captured as well. Leave this false when
+///       cloning onto other units, as each unit has its own calibration.
+///
+///@returns The number of settings captured. Zero usually indicates a
+///         communication problem.
+///
+size_t SettingsSnapshot::capture(C::mip_interface& device, bool includeCalibration)
+{
+    mRecords.clear();
+
+    CommandBatch reads;
+    reads.reserve(128);
+
+    for(const ReadableSetting& setting : READABLE_SETTINGS)
+    {
+        if( setting.calibration && !includeCalibration )
+            continue;
+
+        uint8_t payload[1+2];
+        payload[0] = uint8_t(FunctionSelector::READ);
+
+        if( !setting.keys )
+        {
+            reads.add(setting.descriptorSet, setting.fieldDescriptor, payload, 1, setting.responseDescriptor);
+            continue;
+        }
+
+        const KeyList& keys = *setting.keys;
+
+        for(unsigned int i=0; i<keys.count; i++)
+        {
+            std::memcpy(&payload[1], &keys.keys[i * keys.keySize], keys.keySize);
+
+            reads.add(setting.descriptorSet, setting.fieldDescriptor, payload, uint8_t(1 + keys.keySize), setting.responseDescriptor);
+        }
+    }
+
+    reads.run(device);
+
+    // NACKed reads are settings (or key values) the device doesn't support.
+    for(const CommandBatch::Command& read : reads)
+    {
+        if( read.result == CmdResult::ACK_OK && read.responseLength > 0 )
+            add(read.descriptorSet, read.fieldDescriptor, read.payload+1, uint8_t(read.payloadLength-1), read.responseDescriptor, read.response, read.responseLength);
+    }
+
+    return mRecords.size();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+///@brief Appends a setting to the snapshot.
+///
+///@param descriptorSet
+///@param fieldDescriptor
+///@param key
+///       READ parameters following the function selector (may be NULL if
+///       keyLength is 0).
+///@param keyLength
+///@param responseDescriptor
+///@param response
+///       Response payload, which is also the WRITE payload after the function
+///       selector.
+///@param responseLength
+///
+void SettingsSnapshot::add(uint8_t descriptorSet, uint8_t fieldDescriptor, const uint8_t* key, uint8_t keyLength, uint8_t responseDescriptor, const uint8_t* response, uint8_t responseLength)
+{
+    Record record;
+    record.descriptorSet      = descriptorSet;
+    record.fieldDescriptor    = fieldDescriptor;
+    record.responseDescriptor = responseDescriptor;
+    record.key.assign(reinterpret_cast<const char*>(key), keyLength);
+    record.response.assign(reinterpret_cast<const char*>(response), responseLength);
+
+    mRecords.push_back(std::move(record));
+}
+
+////////////////////////////////////////////////////////////////////////////////
+///@brief Adds every setting in the snapshot to a ConfigPlan.
+///
+/// This allows a snapshot to be combined with other settings or commands
+/// (e.g. a per-unit setting, or commands_base::Resume) and applied together.
+///
+void SettingsSnapshot::toPlan(ConfigPlan& plan) const
+{
+    uint8_t write[C::MIP_FIELD_PAYLOAD_LENGTH_MAX];
+    uint8_t read[C::MIP_FIELD_PAYLOAD_LENGTH_MAX];
+
+    for(const Record& record : mRecords)
+    {
+        if( record.response.size() + 1 > sizeof(write) || record.key.size() + 1 > sizeof(read) )
+            continue;
+
+        write[0] = uint8_t(FunctionSelector::WRITE);
+        std::memcpy(&write[1], record.response.data(), record.response.size());
+
+        read[0] = uint8_t(FunctionSelector::READ);
+        std::memcpy(&read[1], record.key.data(), record.key.size());
+
+        plan.setRaw(record.descriptorSet, record.fieldDescriptor, write, uint8_t(1 + record.response.size()), read, uint8_t(1 + record.key.size()), record.responseDescriptor);
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+///@brief Writes the snapshot to a device.
+///
+/// Equivalent to building a ConfigPlan with toPlan() and applying it.
+///
+///@param device
+///@param options
+///       See ConfigPlan::Options. With diff disabled every setting is written
+///       without reading it first.
+///@param clock
+///       Optional clock used to fill in the report duration.
+///
+ConfigPlan::Report SettingsSnapshot::restore(C::mip_interface& device, const ConfigPlan::Options& options, Timestamp (*clock)()) const
+{
+    ConfigPlan plan;
+    toPlan(plan);
+
+    return plan.apply(device, options, clock);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+///@brief Encodes the snapshot in a compact binary form.
+///
+/// See RecordFile for the format. The file magic is "MIPS".
+///
+std::vector<uint8_t> SettingsSnapshot::serialize() const
+{
+    return FILE_FORMAT.serialize(mRecords);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+///@brief Replaces the snapshot with one decoded from serialize() output.
+///
+///@returns False if the data is not a valid snapshot. The snapshot is left
+///         empty in that case.
+///
+bool SettingsSnapshot::deserialize(const uint8_t* data, size_t length)
+{
+    return FILE_FORMAT.deserialize(data, length, mRecords);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+///@brief Writes the snapshot to a binary file.
+///
+///@returns True on success.
+///
+bool SettingsSnapshot::save(const std::string& filename) const
+{
+    return FILE_FORMAT.save(filename, mRecords);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+///@brief Reads a snapshot written by save().
+///
+///@returns False if the file can't be read or is not a valid snapshot.
+///
+bool SettingsSnapshot::load(const std::string& filename)
+{
+    return FILE_FORMAT.load(filename, mRecords);
+}
+
+} // namespace extras
+} // namespace mip
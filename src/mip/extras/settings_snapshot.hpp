@@ -0,0 +1,93 @@
+#pragma once
+
+#include "config_plan.hpp"
+#include "record_file.hpp"
+
+#include <string>
+#include <vector>
+
+namespace mip
+{
+namespace extras
+{
+
+////////////////////////////////////////////////////////////////////////////////
+///@addtogroup mip_extras
+///@{
+
+////////////////////////////////////////////////////////////////////////////////
+///@brief A binary copy of a device's readable settings, for cloning the
+///       configuration of one device onto others.
+///
+/// capture() reads every setting command in commands_3dm, commands_filter and
+/// commands_gnss which supports FunctionSelector::READ, as a single batch.
+/// Commands taking a key parameter (e.g. MessageFormat, GpioConfig or
+/// EventTrigger) are read for each of the usual key values. Whatever the
+/// device acknowledges is stored as the raw response payload; commands it
+/// doesn't support are skipped.
+///
+/// The snapshot can be written to a file or byte buffer and later restored
+/// onto another device of the same model. restore() writes the settings back
+/// with pipelined multi-field packets via ConfigPlan, so only the settings
+/// which differ are written and the result is saved as the startup settings.
+///
+///@code{.cpp}
+/// SettingsSnapshot snapshot;
+/// snapshot.capture(goldenDevice);
+/// snapshot.save("golden.mipsnap");
+///
+/// ...
+///
+/// SettingsSnapshot snapshot;
+/// if( snapshot.load("golden.mipsnap") )
+///     ConfigPlan::Report report = snapshot.restore(device);
+///@endcode
+///
+/// A few readable commands are not captured because replaying them is not
+/// meaningful or would break the connection: UartBaudrate, GnssTimeAssistance,
+/// GpioState and TareOrientation. Per-unit calibration (accel and gyro bias,
+/// hard and soft iron) is only captured when requested, since it must not be
+/// copied between units.
+///
+/// Restoring relies on the READ response of a setting being identical to its
+/// WRITE parameters, as is the case for the settings captured here.
+///
+class SettingsSnapshot
+{
+public:
+    typedef SettingRecord Record;  ///< The key holds the READ parameters after the function selector, e.g. the descriptor set for MessageFormat.
+
+    size_t capture(C::mip_interface& device, bool includeCalibration=false);
+
+    void add(uint8_t descriptorSet, uint8_t fieldDescriptor, const uint8_t* key, uint8_t keyLength, uint8_t responseDescriptor, const uint8_t* response, uint8_t responseLength);
+
+    void clear() { mRecords.clear(); }
+
+    size_t size() const { return mRecords.size(); }
+    bool empty() const { return mRecords.empty(); }
+
+    const Record& operator[](size_t index) const { return mRecords[index]; }
+
+    std::vector<Record>::const_iterator begin() const { return mRecords.begin(); }
+    std::vector<Record>::const_iterator end() const { return mRecords.end(); }
+
+    void toPlan(ConfigPlan& plan) const;
+
+    ConfigPlan::Report restore(C::mip_interface& device, const ConfigPlan::Options& options, Timestamp (*clock)()=nullptr) const;
+    ConfigPlan::Report restore(C::mip_interface& device) const { return restore(device, ConfigPlan::Options()); }
+
+    std::vector<uint8_t> serialize() const;
+    bool deserialize(const uint8_t* data, size_t length);
+
+    bool save(const std::string& filename) const;
+    bool load(const std::string& filename);
+
+private:
+    std::vector<Record> mRecords;
+};
+
+///@}
+////////////////////////////////////////////////////////////////////////////////
+
+} // namespace extras
+} // namespace mip
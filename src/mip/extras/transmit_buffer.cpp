@@ -0,0 +1,144 @@
+#include "transmit_buffer.hpp"
+
+#include <algorithm>
+
+namespace mip
+{
+namespace extras
+{
+
+////////////////////////////////////////////////////////////////////////////////
+///@brief Creates an empty transmit buffer.
+///
+///@param capacity
+///       Size of the buffer in bytes. At least PACKET_LENGTH_MAX is
+///       recommended, so that any single field fits.
+///
+TransmitBuffer::TransmitBuffer(size_t capacity) : mBuffer(std::max<size_t>(capacity, PACKET_LENGTH_MIN))
+{
+}
+
+////////////////////////////////////////////////////////////////////////////////
+///@brief Finalizes the current packet, so that the next field starts a new
+///       packet even if it has the same descriptor set.
+///
+void TransmitBuffer::endPacket()
+{
+    if( !mPacketOpen )
+        return;
+
+    mPacketOpen = false;
+
+    // An empty packet is simply dropped.
+    if( C::mip_packet_is_empty(&mPacket) )
+        return;
+
+    C::mip_packet_finalize(&mPacket);
+
+    mLength += C::mip_packet_total_length(&mPacket);
+    mNumPackets++;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+///@brief Sends all queued packets with a single write and starts tracking
+///       the replies to the queued commands.
+///
+/// The buffer is empty afterward, whether or not the write succeeded.
+///
+///@returns False if the write failed. The queued commands complete with
+///         MIP_STATUS_ERROR in that case.
+///
+bool TransmitBuffer::flush(C::mip_interface& device)
+{
+    endPacket();
+
+    const bool ok = (mLength == 0) || C::mip_interface_send_to_device(&device, mBuffer.data(), mLength);
+
+    // Queue the commands after sending; replies can't be processed until
+    // this thread updates the device again.
+    for(C::mip_pending_cmd* pending : mPending)
+    {
+        if( ok )
+            C::mip_cmd_queue_enqueue(C::mip_interface_cmd_queue(&device), pending);
+        else
+            pending->_status = C::MIP_STATUS_ERROR;
+    }
+
+    mPending.clear();
+    mLength     = 0;
+    mNumPackets = 0;
+
+    return ok;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+///@brief Discards everything queued without sending it.
+///
+/// Queued commands complete with MIP_STATUS_CANCELLED.
+///
+void TransmitBuffer::clear()
+{
+    for(C::mip_pending_cmd* pending : mPending)
+        pending->_status = C::MIP_STATUS_CANCELLED;
+
+    mPending.clear();
+    mPacketOpen = false;
+    mLength     = 0;
+    mNumPackets = 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+///@brief Allocates a field in the current packet or a new one.
+///
+///@param descriptorSet
+///@param fieldDescriptor
+///@param newPacket
+///       If true, a new packet is started even if the current one could hold
+///       the field.
+///@param payloadOut
+///       Receives the location to serialize the payload to.
+///
+///@returns The maximum payload length, or a negative value if there isn't
+///         room for another field.
+///
+RemainingCount TransmitBuffer::beginField(uint8_t descriptorSet, uint8_t fieldDescriptor, bool newPacket, uint8_t** payloadOut)
+{
+    if( mPacketOpen && (newPacket || C::mip_packet_descriptor_set(&mPacket) != descriptorSet) )
+        endPacket();
+
+    if( mPacketOpen )
+    {
+        const RemainingCount available = C::mip_packet_alloc_field(&mPacket, fieldDescriptor, 0, payloadOut);
+        if( available >= 0 )
+            return available;
+
+        endPacket();
+    }
+
+    const size_t space = std::min<size_t>(mBuffer.size() - mLength, PACKET_LENGTH_MAX);
+    if( space < PACKET_LENGTH_MIN )
+        return -1;
+
+    C::mip_packet_create(&mPacket, &mBuffer[mLength], space, descriptorSet);
+    mPacketOpen = true;
+
+    return C::mip_packet_alloc_field(&mPacket, fieldDescriptor, 0, payloadOut);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+///@brief Completes a field allocated by beginField.
+///
+///@returns False if the payload didn't fit, in which case the field is
+///         removed again.
+///
+bool TransmitBuffer::endField(uint8_t* payload, const Serializer& serializer)
+{
+    if( serializer.isOk() && C::mip_packet_realloc_last_field(&mPacket, payload, uint8_t(serializer.length())) >= 0 )
+        return true;
+
+    C::mip_packet_cancel_last_field(&mPacket, payload);
+    return false;
+}
+
+} // namespace extras
+} // namespace mip
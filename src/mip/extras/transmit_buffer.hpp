@@ -0,0 +1,144 @@
+#pragma once
+
+#include "../mip_device.hpp"
+
+#include <vector>
+
+namespace mip
+{
+namespace extras
+{
+
+////////////////////////////////////////////////////////////////////////////////
+///@addtogroup mip_extras
+///@{
+
+////////////////////////////////////////////////////////////////////////////////
+///@brief Builds outgoing packets in place and sends them with a single write.
+///
+/// Fields are serialized directly into the transmit buffer, with no
+/// intermediate payload buffer or packet copy. Consecutive fields in the same
+/// descriptor set share a packet while they fit; each packet is finalized
+/// with its checksum when the next one is started. flush() then writes every
+/// queued packet to the connection at once and registers the queued commands
+/// with the command queue, so that their replies are tracked as usual.
+///
+/// This suits high-rate aiding inputs and batched configuration, where
+/// many small commands would otherwise each cost a serialization copy, a
+/// packet copy, and a system call.
+///
+/// Queued commands are not sent until flush() is called. The buffer must be
+/// used from the thread which updates the device, since flush() modifies the
+/// command queue. From other threads, use a CommandRing instead.
+///
+///@code{.cpp}
+/// TransmitBuffer tx;
+/// C::mip_pending_cmd pending[2];
+/// tx.addCommand(pending[0], commands_filter::SpeedMeasurement{...});
+/// tx.addCommand(pending[1], commands_filter::ExternalHeadingUpdateWithTime{...});
+/// tx.flush(device);  // One packet, one write.
+///@endcode
+///
+class TransmitBuffer
+{
+public:
+    explicit TransmitBuffer(size_t capacity=2048);
+
+    TransmitBuffer(const TransmitBuffer&) = delete;
+    TransmitBuffer& operator=(const TransmitBuffer&) = delete;
+
+    template<class Field>
+    bool add(const Field& field, uint8_t fieldDescriptor=Field::FIELD_DESCRIPTOR);
+
+    template<class Cmd>
+    bool addCommand(C::mip_pending_cmd& pending, const Cmd& cmd, Timeout additionalTime=0);
+
+    void endPacket();
+
+    bool flush(C::mip_interface& device);
+    void clear();
+
+    size_t size() const { return mLength + (mPacketOpen ? C::mip_packet_total_length(&mPacket) : 0); }  ///< Number of bytes queued.
+    size_t capacity() const { return mBuffer.size(); }
+    bool   empty() const { return size() == 0; }
+
+    size_t numPackets() const { return mNumPackets + (mPacketOpen ? 1 : 0); }  ///< Number of packets queued.
+
+private:
+    RemainingCount beginField(uint8_t descriptorSet, uint8_t fieldDescriptor, bool newPacket, uint8_t** payloadOut);
+    bool endField(uint8_t* payload, const Serializer& serializer);
+
+    std::vector<uint8_t> mBuffer;
+    size_t               mLength     = 0;  ///< Length of the finalized packets.
+    size_t               mNumPackets = 0;  ///< Number of finalized packets.
+
+    C::mip_packet mPacket;                 ///< Packet being built at mBuffer[mLength], if mPacketOpen.
+    bool          mPacketOpen = false;
+
+    std::vector<C::mip_pending_cmd*> mPending;
+};
+
+
+////////////////////////////////////////////////////////////////////////////////
+///@brief Serializes a field into the buffer.
+///
+/// Use this for fields whose replies don't need to be tracked. The field is
+/// appended to the current packet if it has the same descriptor set and
+/// there's room; otherwise a new packet is started.
+///
+///@returns False if there isn't enough space left. Flush and try again.
+///
+template<class Field>
+bool TransmitBuffer::add(const Field& field, uint8_t fieldDescriptor)
+{
+    // If the field doesn't fit in the current packet, try once more in a new one.
+    for(int attempt=0; attempt<2; attempt++)
+    {
+        uint8_t* payload;
+        const RemainingCount available = beginField(Field::DESCRIPTOR_SET, fieldDescriptor, attempt > 0, &payload);
+        if( available < 0 )
+            return false;
+
+        Serializer serializer(payload, size_t(available));
+        insert(serializer, field);
+
+        if( endField(payload, serializer) )
+            return true;
+    }
+
+    return false;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+///@brief Serializes a command into the buffer and tracks its reply.
+///
+///@param pending
+///       Initialized by this function. It must remain valid until its status
+///       is finished, which happens after flush() (with a reply, a timeout,
+///       or MIP_STATUS_ERROR if the write failed) or clear() (with
+///       MIP_STATUS_CANCELLED).
+///@param cmd
+///       The command to send.
+///@param additionalTime
+///       Extra time to wait for the reply, on top of the base reply timeout.
+///
+///@returns False if there isn't enough space left. The pending command is
+///         not used in that case.
+///
+template<class Cmd>
+bool TransmitBuffer::addCommand(C::mip_pending_cmd& pending, const Cmd& cmd, Timeout additionalTime)
+{
+    if( !add(cmd) )
+        return false;
+
+    C::mip_pending_cmd_init_with_timeout(&pending, Cmd::DESCRIPTOR_SET, Cmd::FIELD_DESCRIPTOR, additionalTime);
+    mPending.push_back(&pending);
+
+    return true;
+}
+
+///@}
+////////////////////////////////////////////////////////////////////////////////
+
+} // namespace extras
+} // namespace mip
@@ -1,6 +1,7 @@
 #pragma once
 
 //MIP Core
+#include "mip_cmd_stats.h"
 #include "mip_cmdqueue.h"
 #include "mip_dispatch.h"
 #include "mip_field.h"
@@ -0,0 +1,282 @@
+#include "mip_cmd_stats.h"
+
+#include <string.h>
+#include <assert.h>
+
+
+////////////////////////////////////////////////////////////////////////////////
+///@brief Initializes a command statistics object.
+///
+///@param stats
+///@param entries
+///       Storage for per-command statistics. One entry is used for each
+///       distinct command. Must remain valid for the lifetime of stats.
+///@param max_entries
+///       Number of elements in entries. Commands beyond this limit are only
+///       counted by mip_cmd_stats_num_untracked.
+///@param clock
+///       Function returning the current time, in the same units and time base
+///       as the timestamps given to the command queue. May be NULL.
+///
+void mip_cmd_stats_init(mip_cmd_stats* stats, mip_cmd_stats_entry* entries, uint16_t max_entries, mip_cmd_stats_clock clock)
+{
+    stats->_entries     = entries;
+    stats->_max_entries = max_entries;
+    stats->_clock       = clock;
+
+    mip_cmd_stats_reset(stats);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+///@brief Discards all recorded statistics.
+///
+void mip_cmd_stats_reset(mip_cmd_stats* stats)
+{
+    stats->_num_entries   = 0;
+    stats->_num_untracked = 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+///@brief Returns the number of distinct commands with recorded statistics.
+///
+uint16_t mip_cmd_stats_count(const mip_cmd_stats* stats)
+{
+    return stats->_num_entries;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+///@brief Gets the statistics entry at the given index.
+///
+///@param stats
+///@param index Must be less than mip_cmd_stats_count().
+///
+const mip_cmd_stats_entry* mip_cmd_stats_entry_at(const mip_cmd_stats* stats, uint16_t index)
+{
+    assert(index < stats->_num_entries);
+
+    return &stats->_entries[index];
+}
+
+////////////////////////////////////////////////////////////////////////////////
+///@brief Finds the statistics for a given command.
+///
+///@returns The entry, or NULL if nothing has been recorded for this command.
+///
+const mip_cmd_stats_entry* mip_cmd_stats_find(const mip_cmd_stats* stats, uint8_t descriptor_set, uint8_t field_descriptor)
+{
+    for(uint16_t i=0; i<stats->_num_entries; i++)
+    {
+        const mip_cmd_stats_entry* entry = &stats->_entries[i];
+
+        if( entry->descriptor_set == descriptor_set && entry->field_descriptor == field_descriptor )
+            return entry;
+    }
+
+    return NULL;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+///@brief Returns the number of completed commands which could not be recorded
+///       because the entry table was full.
+///
+uint32_t mip_cmd_stats_num_untracked(const mip_cmd_stats* stats)
+{
+    return stats->_num_untracked;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+///@brief Copies the current statistics.
+///
+/// Statistics are updated from the thread which updates the command queue.
+/// Call this from the same thread (or while updates are paused) to get a
+/// consistent copy which may then be inspected from anywhere.
+///
+///@param stats
+///@param entries_out
+///       Buffer to receive a copy of each entry.
+///@param max_entries
+///       Size of entries_out. Any additional entries are not copied.
+///
+///@returns The number of entries copied.
+///
+uint16_t mip_cmd_stats_snapshot(const mip_cmd_stats* stats, mip_cmd_stats_entry* entries_out, uint16_t max_entries)
+{
+    const uint16_t count = (stats->_num_entries < max_entries) ? stats->_num_entries : max_entries;
+
+    memcpy(entries_out, stats->_entries, count * sizeof(mip_cmd_stats_entry));
+
+    return count;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+///@brief Returns the current time from the clock function, or 0 if none.
+///
+///@internal
+///
+timestamp_type mip_cmd_stats_now(const mip_cmd_stats* stats)
+{
+    return stats->_clock ? stats->_clock() : 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+///@brief Finds or creates the entry for a command.
+///
+///@internal
+///
+///@returns The entry, or NULL if the table is full.
+///
+static mip_cmd_stats_entry* get_entry(mip_cmd_stats* stats, uint8_t descriptor_set, uint8_t field_descriptor)
+{
+    mip_cmd_stats_entry* entry = (mip_cmd_stats_entry*)mip_cmd_stats_find(stats, descriptor_set, field_descriptor);
+    if( entry )
+        return entry;
+
+    if( stats->_num_entries >= stats->_max_entries )
+        return NULL;
+
+    entry = &stats->_entries[stats->_num_entries++];
+
+    memset(entry, 0, sizeof(*entry));
+    entry->descriptor_set   = descriptor_set;
+    entry->field_descriptor = field_descriptor;
+
+    return entry;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+///@brief Records the outcome of a command.
+///
+/// This is called by the command queue when a command completes.
+///
+///@internal
+///
+///@param stats
+///@param descriptor_set
+///@param field_descriptor
+///@param result
+///       MIP_STATUS_TIMEDOUT, or the ack/nack code from the reply.
+///@param latency
+///       Time from sending the command to receiving the reply. Ignored for
+///       timeouts.
+///
+void mip_cmd_stats_record(mip_cmd_stats* stats, uint8_t descriptor_set, uint8_t field_descriptor, enum mip_cmd_result result, timeout_type latency)
+{
+    mip_cmd_stats_entry* entry = get_entry(stats, descriptor_set, field_descriptor);
+    if( !entry )
+    {
+        stats->_num_untracked++;
+        return;
+    }
+
+    if( result == MIP_STATUS_TIMEDOUT )
+    {
+        entry->num_timeouts++;
+        return;
+    }
+
+    if( !mip_cmd_result_is_reply(result) )
+        return;
+
+    if( result == MIP_ACK_OK )
+        entry->num_acks++;
+    else
+    {
+        entry->num_nacks++;
+        entry->nack_counts[ (result < MIP_CMD_STATS_NUM_NACK_CODES) ? result : MIP_CMD_STATS_NUM_NACK_CODES-1 ]++;
+    }
+
+    if( entry->num_acks + entry->num_nacks == 1 || latency < entry->min_latency )
+        entry->min_latency = latency;
+    if( latency > entry->max_latency )
+        entry->max_latency = latency;
+
+    entry->total_latency += latency;
+    entry->histogram[ mip_cmd_stats_bucket_index(latency) ]++;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+///@brief Determines which histogram bucket a latency value falls in.
+///
+/// Values too large for the histogram are placed in the last bucket.
+///
+unsigned int mip_cmd_stats_bucket_index(timeout_type latency)
+{
+    if( latency < 2*MIP_CMD_STATS_SUB_BUCKETS )
+        return (unsigned int)latency;
+
+    // Position of the most significant bit.
+    unsigned int msb = 0;
+    for(timeout_type v = latency; v > 1; v >>= 1)
+        msb++;
+
+    // Each power of 2 is split into SUB_BUCKETS using the bits below the MSB.
+    const unsigned int shift = msb - MIP_CMD_STATS_SUB_BUCKET_BITS;
+    const unsigned int index = (shift + 1) * MIP_CMD_STATS_SUB_BUCKETS + (unsigned int)((latency >> shift) & (MIP_CMD_STATS_SUB_BUCKETS-1));
+
+    return (index < MIP_CMD_STATS_NUM_BUCKETS) ? index : MIP_CMD_STATS_NUM_BUCKETS-1;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+///@brief Returns the smallest latency which falls in the given bucket.
+///
+timeout_type mip_cmd_stats_bucket_lower_bound(unsigned int index)
+{
+    if( index < 2*MIP_CMD_STATS_SUB_BUCKETS )
+        return index;
+
+    const unsigned int shift = index / MIP_CMD_STATS_SUB_BUCKETS - 1;
+    const unsigned int sub   = index % MIP_CMD_STATS_SUB_BUCKETS;
+
+    return (timeout_type)(MIP_CMD_STATS_SUB_BUCKETS + sub) << shift;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+///@brief Estimates a latency percentile from the histogram.
+///
+///@param entry
+///@param percent
+///       Percentile to compute, from 0 to 100 (e.g. 50 for the median or 99.9).
+///
+///@returns The upper bound of the bucket containing the percentile, limited
+///         to the maximum recorded latency. Returns 0 if there are no replies.
+///
+timeout_type mip_cmd_stats_entry_percentile(const mip_cmd_stats_entry* entry, float percent)
+{
+    const uint32_t total = entry->num_acks + entry->num_nacks;
+    if( total == 0 )
+        return 0;
+
+    uint32_t target = (uint32_t)(total * percent / 100.0f + 0.5f);
+    if( target < 1 )
+        target = 1;
+
+    uint32_t count = 0;
+    for(unsigned int i=0; i<MIP_CMD_STATS_NUM_BUCKETS; i++)
+    {
+        count += entry->histogram[i];
+        if( count >= target )
+        {
+            if( i+1 >= MIP_CMD_STATS_NUM_BUCKETS )
+                break;
+
+            const timeout_type upper = mip_cmd_stats_bucket_lower_bound(i+1) - 1;
+            return (upper < entry->max_latency) ? upper : entry->max_latency;
+        }
+    }
+
+    return entry->max_latency;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+///@brief Computes the mean reply latency.
+///
+///@returns The mean latency, or 0 if there are no replies.
+///
+float mip_cmd_stats_entry_mean(const mip_cmd_stats_entry* entry)
+{
+    const uint32_t total = entry->num_acks + entry->num_nacks;
+    if( total == 0 )
+        return 0.0f;
+
+    return (float)entry->total_latency / total;
+}
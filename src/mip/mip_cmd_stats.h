@@ -0,0 +1,112 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "mip_types.h"
+#include "mip_result.h"
+
+#ifdef __cplusplus
+namespace mip {
+namespace C {
+extern "C" {
+#endif
+
+////////////////////////////////////////////////////////////////////////////////
+///@addtogroup mip_c
+///@{
+
+////////////////////////////////////////////////////////////////////////////////
+///@defgroup MipCommandStats_c Mip Command Statistics [C]
+///
+///@brief Optional per-command latency and error statistics.
+///
+/// Attach a mip_cmd_stats object to a command queue with
+/// mip_cmd_queue_set_stats() to record, for each distinct command
+/// (descriptor set + field descriptor), the number of acks, nacks by code,
+/// timeouts, and a histogram of reply latencies. Statistics are off by
+/// default and cost nothing but a NULL check when disabled.
+///
+/// Latencies are measured from the time the command was queued (which is
+/// immediately before it is sent to the device) until the time the reply
+/// packet was received. The former comes from the clock function given to
+/// mip_cmd_stats_init, which must use the same time base as the timestamps
+/// passed to the queue/interface update functions. Without a clock, the time
+/// at which the reply timer started is used instead; this is less accurate as
+/// it depends on how often the device is updated.
+///
+/// The histogram uses log-linear ("HDR-style") buckets: values below
+/// 2*MIP_CMD_STATS_SUB_BUCKETS have exact buckets, and each power of 2 above
+/// that is divided into MIP_CMD_STATS_SUB_BUCKETS equal buckets, giving a
+/// relative error under 1/MIP_CMD_STATS_SUB_BUCKETS across the whole range.
+///
+///@{
+
+#define MIP_CMD_STATS_SUB_BUCKET_BITS 3
+#define MIP_CMD_STATS_SUB_BUCKETS     (1 << MIP_CMD_STATS_SUB_BUCKET_BITS)
+#define MIP_CMD_STATS_NUM_BUCKETS     144  ///< Covers latencies up to 2^20 time units (about 17 minutes in ms).
+#define MIP_CMD_STATS_NUM_NACK_CODES  8    ///< Nack codes at or above this are counted in the last slot.
+
+////////////////////////////////////////////////////////////////////////////////
+///@brief Statistics for one command type.
+///
+typedef struct mip_cmd_stats_entry
+{
+    uint8_t      descriptor_set;                             ///< Command descriptor set.
+    uint8_t      field_descriptor;                           ///< Command field descriptor.
+    uint32_t     num_acks;                                   ///< Number of MIP_ACK_OK replies.
+    uint32_t     num_nacks;                                  ///< Number of nack replies (any code).
+    uint32_t     num_timeouts;                               ///< Number of commands which received no reply in time.
+    uint32_t     nack_counts[MIP_CMD_STATS_NUM_NACK_CODES];  ///< Number of nacks by reply code.
+    timeout_type min_latency;                                ///< Shortest reply latency (valid if num_acks+num_nacks > 0).
+    timeout_type max_latency;                                ///< Longest reply latency.
+    uint64_t     total_latency;                              ///< Sum of all reply latencies, for computing the mean.
+    uint32_t     histogram[MIP_CMD_STATS_NUM_BUCKETS];       ///< Reply count by latency bucket.
+} mip_cmd_stats_entry;
+
+typedef timestamp_type (*mip_cmd_stats_clock)(void);
+
+////////////////////////////////////////////////////////////////////////////////
+///@brief Statistics for all commands sent through a queue.
+///
+///@note This should be considered an "opaque" structure; its members should be
+/// considered an internal implementation detail. Avoid accessing them directly
+/// as they are subject to change in future versions of this software.
+///
+typedef struct mip_cmd_stats
+{
+    mip_cmd_stats_entry* _entries;
+    uint16_t             _max_entries;
+    uint16_t             _num_entries;
+    uint32_t             _num_untracked;
+    mip_cmd_stats_clock  _clock;
+} mip_cmd_stats;
+
+void mip_cmd_stats_init(mip_cmd_stats* stats, mip_cmd_stats_entry* entries, uint16_t max_entries, mip_cmd_stats_clock clock);
+void mip_cmd_stats_reset(mip_cmd_stats* stats);
+
+uint16_t mip_cmd_stats_count(const mip_cmd_stats* stats);
+const mip_cmd_stats_entry* mip_cmd_stats_entry_at(const mip_cmd_stats* stats, uint16_t index);
+const mip_cmd_stats_entry* mip_cmd_stats_find(const mip_cmd_stats* stats, uint8_t descriptor_set, uint8_t field_descriptor);
+uint32_t mip_cmd_stats_num_untracked(const mip_cmd_stats* stats);
+
+uint16_t mip_cmd_stats_snapshot(const mip_cmd_stats* stats, mip_cmd_stats_entry* entries_out, uint16_t max_entries);
+
+timestamp_type mip_cmd_stats_now(const mip_cmd_stats* stats);
+void mip_cmd_stats_record(mip_cmd_stats* stats, uint8_t descriptor_set, uint8_t field_descriptor, enum mip_cmd_result result, timeout_type latency);
+
+unsigned int mip_cmd_stats_bucket_index(timeout_type latency);
+timeout_type mip_cmd_stats_bucket_lower_bound(unsigned int index);
+
+timeout_type mip_cmd_stats_entry_percentile(const mip_cmd_stats_entry* entry, float percent);
+float mip_cmd_stats_entry_mean(const mip_cmd_stats_entry* entry);
+
+///@}
+///@}
+////////////////////////////////////////////////////////////////////////////////
+
+#ifdef __cplusplus
+} // namespace C
+} // namespace mip
+} // extern "C"
+#endif
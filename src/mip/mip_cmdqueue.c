@@ -13,6 +13,9 @@
 #define MIP_INDEX_REPLY_DESCRIPTOR 0
 #define MIP_INDEX_REPLY_ACK_CODE   1
 
+// Send time of a command enqueued while statistics were disabled.
+#define MIP_SEND_TIME_UNSET ((timestamp_type)-1)
+
 
 ////////////////////////////////////////////////////////////////////////////////
 ///@brief Initialize a pending command with no reponse data or additional time.
@@ -172,11 +175,16 @@ void mip_cmd_queue_init(mip_cmd_queue* queue, timeout_type base_reply_timeout)
 {
     queue->_first_pending_cmd = NULL;
     queue->_base_timeout = base_reply_timeout;
+    queue->_stats = NULL;
 }
 
 ////////////////////////////////////////////////////////////////////////////////
 ///@brief Queue a command to wait for replies.
 ///
+/// Multiple commands may be queued at once. Replies are matched to commands in
+/// the order they were queued, so commands should be queued in the same order
+/// as they are sent to the device.
+///
 ///@param queue
 ///@param cmd Listens for replies to this command.
 ///
@@ -185,15 +193,15 @@ void mip_cmd_queue_init(mip_cmd_queue* queue, timeout_type base_reply_timeout)
 ///
 void mip_cmd_queue_enqueue(mip_cmd_queue* queue, mip_pending_cmd* cmd)
 {
-    // For now only one command can be queued at a time.
-    if( queue->_first_pending_cmd )
-    {
-        cmd->_status = MIP_STATUS_CANCELLED;
-        return;
-    }
+    cmd->_next      = NULL;
+    cmd->_send_time = queue->_stats ? mip_cmd_stats_now(queue->_stats) : MIP_SEND_TIME_UNSET;
+    cmd->_status    = MIP_STATUS_PENDING;
 
-    cmd->_status = MIP_STATUS_PENDING;
-    queue->_first_pending_cmd = cmd;
+    mip_pending_cmd** link = &queue->_first_pending_cmd;
+    while( *link )
+        link = &(*link)->_next;
+
+    *link = cmd;
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -206,124 +214,179 @@ void mip_cmd_queue_enqueue(mip_cmd_queue* queue, mip_pending_cmd* cmd)
 ///
 void mip_cmd_queue_dequeue(mip_cmd_queue* queue, mip_pending_cmd* cmd)
 {
-    if( queue->_first_pending_cmd == cmd )
+    for(mip_pending_cmd** link = &queue->_first_pending_cmd; *link; link = &(*link)->_next)
     {
-        queue->_first_pending_cmd = NULL;
-        cmd->_status = MIP_STATUS_CANCELLED;
+        if( *link == cmd )
+        {
+            *link = cmd->_next;
+            cmd->_status = MIP_STATUS_CANCELLED;
+            return;
+        }
     }
 }
 
 ////////////////////////////////////////////////////////////////////////////////
-///@brief Iterate over a packet, checking for replies to the pending command.
+///@brief Starts the reply timer of a command which was just sent.
 ///
 ///@internal
 ///
+///@param queue
 ///@param pending
-///       Pending command which is awaiting replies
-///@param packet
-///@param base_timeout
 ///@param timestamp
 ///
-///@returns The new status of the pending command (the command status field is
-///         not updated). The caller should set pending->_status to this value
-///         after doing any additional processing requiring the pending struct.
-///
-static enum mip_cmd_result process_fields_for_pending_cmd(mip_pending_cmd* pending, const mip_packet* packet, timeout_type base_timeout, timestamp_type timestamp)
+static void start_timeout_if_pending(const mip_cmd_queue* queue, mip_pending_cmd* pending, timestamp_type timestamp)
 {
-    assert( pending->_status != MIP_STATUS_NONE );         // pending->_status must be set to MIP_STATUS_PENDING in mip_cmd_queue_enqueue to get here.
-    assert( !mip_cmd_result_is_finished(pending->_status) );  // Command shouldn't be finished yet - make sure the queue is processed properly.
-
     if( pending->_status == MIP_STATUS_PENDING )
     {
+        // Without a clock, the best estimate of the send time is now.
+        if( queue->_stats && !queue->_stats->_clock )
+            pending->_send_time = timestamp;
+
         // Update the timeout to the timestamp of the timeout time.
-        pending->_timeout_time = timestamp + base_timeout + pending->_extra_timeout;
+        pending->_timeout_time = timestamp + queue->_base_timeout + pending->_extra_timeout;
         pending->_status = MIP_STATUS_WAITING;
     }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+///@brief Finds the oldest waiting command matching an ack/nack reply.
+///
+///@internal
+///
+///@param queue
+///@param descriptor_set
+///@param field_descriptor
+///
+///@returns The link (pointer to the previous _next pointer) of the matching
+///         command, or NULL if no queued command matches.
+///
+static mip_pending_cmd** find_pending_for_reply(mip_cmd_queue* queue, uint8_t descriptor_set, uint8_t field_descriptor)
+{
+    for(mip_pending_cmd** link = &queue->_first_pending_cmd; *link; link = &(*link)->_next)
+    {
+        const mip_pending_cmd* pending = *link;
+
+        if( pending->_status == MIP_STATUS_WAITING && pending->_descriptor_set == descriptor_set && pending->_field_descriptor == field_descriptor )
+            return link;
+    }
+
+    return NULL;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+///@brief Completes a pending command from an ack/nack field.
+///
+///@internal
+///
+///@param pending
+///       Pending command which matches the reply field.
+///@param field
+///       The ack/nack field. If the response field is consumed, this will be
+///       advanced to it so iteration continues with the next reply.
+///@param ack_code
+///       The ack/nack code from the reply field.
+///@param timestamp
+///
+///@returns The new status of the pending command (the command status field is
+///         not updated). The caller should set pending->_status to this value
+///         after removing the command from the queue.
+///
+static enum mip_cmd_result complete_pending_cmd(mip_pending_cmd* pending, mip_field* field, uint8_t ack_code, timestamp_type timestamp)
+{
+    assert( !mip_cmd_result_is_finished(pending->_status) );  // Command shouldn't be finished yet - make sure the queue is processed properly.
 
     // ------+------+------+------+------+------+------+------+------+------------------------
     //  ...  | 0x02 | 0xF1 | cmd1 | nack | 0x02 | 0xF1 | cmd2 |  ack |  response field ...
     // ------+------+------+------+------+------+------+------+------+------------------------
 
-    if( mip_packet_descriptor_set(packet) == pending->_descriptor_set )
+    uint8_t response_length = 0;
+    mip_field response_field;
+
+    // If the command was ACK'd, check if response data is expected.
+    if( pending->_response_descriptor != 0x00 && ack_code == MIP_ACK_OK )
     {
-        mip_field field = {0};
-        while( mip_field_next_in_packet(&field, packet) )
+        // Look ahead one field for response data.
+        response_field = mip_field_next_after(field);
+        if( mip_field_is_valid(&response_field) )
         {
-            // Not an ack/nack reply field, skip it.
-            if( mip_field_field_descriptor(&field) != MIP_REPLY_DESC_GLOBAL_ACK_NACK )
-                continue;
+            const uint8_t response_descriptor = mip_field_field_descriptor(&response_field);
 
-            // Sanity check payload length before accessing it.
-            if( mip_field_payload_length(&field) != 2 )
-                continue;
+            // This is a wildcard to accept any response data descriptor.
+            // Needed when the response descriptor is not known or is wrong.
+            if( pending->_response_descriptor == MIP_REPLY_DESC_GLOBAL_ACK_NACK )
+                pending->_response_descriptor = response_descriptor;
 
-            const uint8_t* const payload = mip_field_payload(&field);
+            // Make sure the response descriptor matches what is expected.
+            if( response_descriptor == pending->_response_descriptor )
+            {
+                // Update the response_size field to reflect the actual size.
+                response_length = mip_field_payload_length(&response_field);
 
-            const uint8_t cmd_descriptor = payload[MIP_INDEX_REPLY_DESCRIPTOR];
-            const uint8_t ack_code       = payload[MIP_INDEX_REPLY_ACK_CODE];
+                // Skip this field when iterating for next ack/nack reply.
+                *field = response_field;
+            }
+        }
+    }
 
-            // Is this the right command reply?
-            if( pending->_field_descriptor != cmd_descriptor )
-                continue;
+    // Limit response data size to lesser of buffer size or actual response length.
+    pending->_response_length = (response_length < pending->_response_buffer_size) ? response_length : pending->_response_buffer_size;
 
-            // Descriptor matches!
+    // Copy response data to the pending buffer (skip if response_field is invalid).
+    if( pending->_response_length > 0 )
+        memcpy(pending->_response_buffer, mip_field_payload(&response_field), pending->_response_length);
 
-            uint8_t response_length = 0;
-            mip_field response_field;
+    pending->_reply_time = timestamp;  // Completion time
 
-            // If the command was ACK'd, check if response data is expected.
-            if( pending->_response_descriptor != 0x00 && ack_code == MIP_ACK_OK )
-            {
-                // Look ahead one field for response data.
-                response_field = mip_field_next_after(&field);
-                if( mip_field_is_valid(&response_field) )
-                {
-                    const uint8_t response_descriptor = mip_field_field_descriptor(&response_field);
-
-                    // This is a wildcard to accept any response data descriptor.
-                    // Needed when the response descriptor is not known or is wrong.
-                    if( pending->_response_descriptor == MIP_REPLY_DESC_GLOBAL_ACK_NACK )
-                        pending->_response_descriptor = response_descriptor;
-
-                    // Make sure the response descriptor matches what is expected.
-                    if( response_descriptor == pending->_response_descriptor )
-                    {
-                        // Update the response_size field to reflect the actual size.
-                        response_length = mip_field_payload_length(&response_field);
-
-                        // Skip this field when iterating for next ack/nack reply.
-                        field = response_field;
-                    }
-                }
-            }
+    return (enum mip_cmd_result)ack_code;
+}
 
-            // Limit response data size to lesser of buffer size or actual response length.
-            pending->_response_length = (response_length < pending->_response_buffer_size) ? response_length : pending->_response_buffer_size;
+////////////////////////////////////////////////////////////////////////////////
+///@brief Marks a command as timed out after it has been removed from the queue.
+///
+///@internal
+///
+///@param queue
+///@param pending
+///@param now
+///
+static void time_out_pending_cmd(mip_cmd_queue* queue, mip_pending_cmd* pending, timestamp_type now)
+{
+    if( queue->_stats && pending->_send_time != MIP_SEND_TIME_UNSET )
+        mip_cmd_stats_record(queue->_stats, pending->_descriptor_set, pending->_field_descriptor, MIP_STATUS_TIMEDOUT, 0);
 
-            // Copy response data to the pending buffer (skip if response_field is invalid).
-            if( pending->_response_length > 0 )
-                memcpy(pending->_response_buffer, mip_field_payload(&response_field), pending->_response_length);
+    // Clear response length and mark when it timed out.
+    pending->_response_length = 0;
+    pending->_reply_time = now;
 
-            // pending->_ack_code   = ack_code;
-            pending->_reply_time = timestamp;  // Completion time
+    // This must be last!
+    pending->_status = MIP_STATUS_TIMEDOUT;
+}
 
-            return (enum mip_cmd_result)ack_code;
-        }
-    }
+////////////////////////////////////////////////////////////////////////////////
+///@brief Removes and times out any commands whose reply deadline has passed.
+///
+///@internal
+///
+///@param queue
+///@param now
+///
+static void expire_pending_cmds(mip_cmd_queue* queue, timestamp_type now)
+{
+    mip_pending_cmd** link = &queue->_first_pending_cmd;
+    while( *link )
+    {
+        mip_pending_cmd* pending = *link;
 
-    // No matching reply descriptors in this packet.
+        if( !mip_pending_cmd_check_timeout(pending, now) )
+        {
+            link = &pending->_next;
+            continue;
+        }
 
-    // Check for timeout
-    if( mip_pending_cmd_check_timeout(pending, timestamp) )
-    {
-        pending->_response_length = 0;
-        // pending->_ack_code        = MIP_NACK_COMMAND_TIMEOUT;
+        *link = pending->_next;
 
-        // Must be last!
-        return MIP_STATUS_TIMEDOUT;
+        time_out_pending_cmd(queue, pending, now);
     }
-
-    return pending->_status;
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -331,6 +394,9 @@ static enum mip_cmd_result process_fields_for_pending_cmd(mip_pending_cmd* pendi
 ///
 /// Call this from the Mip_parser callback, passing the arguments directly.
 ///
+/// Each ack/nack field completes the oldest queued command with the same
+/// descriptors, so a single packet may complete several commands.
+///
 ///@param queue
 ///@param packet The received MIP packet. Assumed to be valid.
 ///@param timestamp The time the packet was received
@@ -342,21 +408,49 @@ void mip_cmd_queue_process_packet(mip_cmd_queue* queue, const mip_packet* packet
     if( descriptor_set >= 0x80 && descriptor_set < 0xF0 )
         return;
 
-    if( queue->_first_pending_cmd )
+    if( !queue->_first_pending_cmd )
+        return;
+
+    for(mip_pending_cmd* pending = queue->_first_pending_cmd; pending; pending = pending->_next)
+        start_timeout_if_pending(queue, pending, timestamp);
+
+    mip_field field = {0};
+    while( mip_field_next_in_packet(&field, packet) )
     {
-        mip_pending_cmd* pending = queue->_first_pending_cmd;
+        // Not an ack/nack reply field, skip it.
+        if( mip_field_field_descriptor(&field) != MIP_REPLY_DESC_GLOBAL_ACK_NACK )
+            continue;
 
-        const enum mip_cmd_result status = process_fields_for_pending_cmd(pending, packet, queue->_base_timeout, timestamp);
+        // Sanity check payload length before accessing it.
+        if( mip_field_payload_length(&field) != 2 )
+            continue;
 
-        if( mip_cmd_result_is_finished(status) )
-        {
-            queue->_first_pending_cmd = queue->_first_pending_cmd->_next;
+        const uint8_t* const payload = mip_field_payload(&field);
 
-            // This must be done last b/c it may trigger the thread which queued the command.
-            // The command could go out of scope or its attributes inspected.
-            pending->_status = status;
-        }
+        const uint8_t cmd_descriptor = payload[MIP_INDEX_REPLY_DESCRIPTOR];
+        const uint8_t ack_code       = payload[MIP_INDEX_REPLY_ACK_CODE];
+
+        mip_pending_cmd** link = find_pending_for_reply(queue, descriptor_set, cmd_descriptor);
+        if( !link )
+            continue;
+
+        mip_pending_cmd* pending = *link;
+
+        const enum mip_cmd_result status = complete_pending_cmd(pending, &field, ack_code, timestamp);
+
+        *link = pending->_next;
+
+        // Commands sent before statistics were enabled have no send time.
+        if( queue->_stats && pending->_send_time != MIP_SEND_TIME_UNSET )
+            mip_cmd_stats_record(queue->_stats, descriptor_set, cmd_descriptor, status, timestamp - pending->_send_time);
+
+        // This must be done last b/c it may trigger the thread which queued the command.
+        // The command could go out of scope or its attributes inspected.
+        pending->_status = status;
     }
+
+    // Check for timeouts of commands which were not answered by this packet.
+    expire_pending_cmds(queue, timestamp);
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -391,28 +485,73 @@ void mip_cmd_queue_clear(mip_cmd_queue* queue)
 ///
 void mip_cmd_queue_update(mip_cmd_queue* queue, timestamp_type now)
 {
-    if( queue->_first_pending_cmd )
+    // Commands which were just queued start their timers now; the rest are
+    // checked for timeouts. A command is never started and expired in the
+    // same call.
+    mip_pending_cmd** link = &queue->_first_pending_cmd;
+    while( *link )
     {
-        mip_pending_cmd* pending = queue->_first_pending_cmd;
+        mip_pending_cmd* pending = *link;
 
         if( pending->_status == MIP_STATUS_PENDING )
         {
-            // Update the timeout to the timestamp of the timeout time.
-            pending->_timeout_time = now + queue->_base_timeout + pending->_extra_timeout;
-            pending->_status = MIP_STATUS_WAITING;
+            start_timeout_if_pending(queue, pending, now);
+            link = &pending->_next;
         }
         else if( mip_pending_cmd_check_timeout(pending, now) )
         {
-            queue->_first_pending_cmd = queue->_first_pending_cmd->_next;
-
-            // Clear response length and mark when it timed out.
-            pending->_response_length = 0;
-            pending->_reply_time = now;
+            *link = pending->_next;
 
-            // This must be last!
-            pending->_status = MIP_STATUS_TIMEDOUT;
+            time_out_pending_cmd(queue, pending, now);
         }
+        else
+        {
+            link = &pending->_next;
+        }
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+///@brief Determines how long the queue can go without an update.
+///
+/// Use this to choose how long to wait for data from the device. A reply
+/// ends the wait as soon as it arrives, so the wait only needs to be short
+/// enough that commands are timed out promptly when no reply comes.
+///
+///@param queue
+///@param now      Current time.
+///@param max_wait Upper limit on the result, e.g. to periodically return
+///                control to the application while idle.
+///
+///@returns The time until the earliest outstanding command times out, 0 if
+///         a command is already overdue, or max_wait if that is sooner. A
+///         command whose timer hasn't started yet is assumed to start now.
+///
+timeout_type mip_cmd_queue_time_until_deadline(const mip_cmd_queue* queue, timestamp_type now, timeout_type max_wait)
+{
+    timeout_type wait = max_wait;
+
+    for(const mip_pending_cmd* pending = queue->_first_pending_cmd; pending; pending = pending->_next)
+    {
+        timestamp_type deadline;
+
+        if( pending->_status == MIP_STATUS_PENDING )
+            deadline = now + queue->_base_timeout + pending->_extra_timeout;
+        else if( pending->_status == MIP_STATUS_WAITING )
+            deadline = pending->_timeout_time;
+        else
+            continue;
+
+        // Commands time out once the time is strictly past the deadline.
+        const int remaining = (int)(deadline - now) + 1;
+        if( remaining <= 0 )
+            return 0;
+
+        if( (timeout_type)remaining < wait )
+            wait = (timeout_type)remaining;
     }
+
+    return wait;
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -437,3 +576,56 @@ timeout_type mip_cmd_queue_base_reply_timeout(const mip_cmd_queue* queue)
 {
     return queue->_base_timeout;
 }
+
+////////////////////////////////////////////////////////////////////////////////
+///@brief Enables or disables command statistics.
+///
+/// This must be called from the same thread context as the update function.
+///
+///@param queue
+///@param stats
+///       An initialized statistics object which will be updated as commands
+///       complete, or NULL to disable statistics. Must remain valid until
+///       statistics are disabled.
+///
+void mip_cmd_queue_set_stats(mip_cmd_queue* queue, mip_cmd_stats* stats)
+{
+    queue->_stats = stats;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+///@brief Returns the statistics object set by mip_cmd_queue_set_stats, or NULL.
+///
+mip_cmd_stats* mip_cmd_queue_stats(const mip_cmd_queue* queue)
+{
+    return queue->_stats;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+///@brief Gets the oldest outstanding command.
+///
+/// Use with mip_cmd_queue_next_pending to inspect every command in the queue,
+/// e.g. to count how many of a given type are in flight. This must be called
+/// from the same thread context as the update function, and the returned
+/// commands must not be modified.
+///
+///@param queue
+///
+///@returns The first command in the queue, or NULL if the queue is empty.
+///
+const mip_pending_cmd* mip_cmd_queue_first_pending(const mip_cmd_queue* queue)
+{
+    return queue->_first_pending_cmd;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+///@brief Gets the next outstanding command after cmd.
+///
+///@param cmd A command returned by mip_cmd_queue_first_pending or this function.
+///
+///@returns The next command in the queue, or NULL if cmd was the last one.
+///
+const mip_pending_cmd* mip_cmd_queue_next_pending(const mip_pending_cmd* cmd)
+{
+    return cmd->_next;
+}
@@ -6,6 +6,7 @@
 #include "mip_types.h"
 #include "mip_result.h"
 #include "mip_packet.h"
+#include "mip_cmd_stats.h"
 
 #ifdef __cplusplus
 namespace mip {
@@ -47,6 +48,7 @@ typedef struct mip_pending_cmd
         timestamp_type          _timeout_time;         ///<@private If MIP_STATUS_WAITING:   timestamp_type after which the command will be timed out.
         timestamp_type          _reply_time;           ///<@private If MIP_STATUS_COMPLETED: timestamp_type from the packet containing the ack/nack.
     };
+    timestamp_type              _send_time;            ///<@private Time the command was sent, if statistics were enabled when it was queued.
     uint8_t                     _descriptor_set;       ///<@private Command descriptor set.
     uint8_t                     _field_descriptor;     ///<@private Command field descriptor.
     uint8_t                     _response_descriptor;  ///<@private Response field descriptor, or 0x00 if no response field expected.
@@ -82,7 +84,10 @@ bool mip_pending_cmd_check_timeout(const mip_pending_cmd* cmd, timestamp_type no
 ////////////////////////////////////////////////////////////////////////////////
 ///@brief Holds a list of pending commands.
 ///
-/// Currently only one command may be pending at a time.
+/// Any number of commands may be pending at once. They are kept in the order
+/// they were queued, which must match the order they were sent to the device.
+/// Each ack/nack reply completes the oldest pending command with matching
+/// descriptors.
 ///
 ///@note This should be considered an "opaque" structure; its members should be
 /// considered an internal implementation detail. Avoid accessing them directly
@@ -93,6 +98,7 @@ typedef struct mip_cmd_queue
 {
     mip_pending_cmd* _first_pending_cmd;
     timeout_type     _base_timeout;
+    mip_cmd_stats*   _stats;
 } mip_cmd_queue;
 
 void mip_cmd_queue_init(mip_cmd_queue* queue, timeout_type base_reply_timeout);
@@ -102,10 +108,17 @@ void mip_cmd_queue_dequeue(mip_cmd_queue* queue, mip_pending_cmd* cmd);
 void mip_cmd_queue_clear(mip_cmd_queue* queue);
 
 void mip_cmd_queue_update(mip_cmd_queue* queue, timestamp_type timestamp);
+timeout_type mip_cmd_queue_time_until_deadline(const mip_cmd_queue* queue, timestamp_type now, timeout_type max_wait);
 
 void mip_cmd_queue_set_base_reply_timeout(mip_cmd_queue* queue, timeout_type timeout);
 timeout_type mip_cmd_queue_base_reply_timeout(const mip_cmd_queue* queue);
 
+void mip_cmd_queue_set_stats(mip_cmd_queue* queue, mip_cmd_stats* stats);
+mip_cmd_stats* mip_cmd_queue_stats(const mip_cmd_queue* queue);
+
+const mip_pending_cmd* mip_cmd_queue_first_pending(const mip_cmd_queue* queue);
+const mip_pending_cmd* mip_cmd_queue_next_pending(const mip_pending_cmd* cmd);
+
 void mip_cmd_queue_process_packet(mip_cmd_queue* queue, const mip_packet* packet, timestamp_type timestamp);
 
 
@@ -18,3 +18,110 @@ bool mip_interface_user_send_to_device(mip_interface* device, const uint8_t* dat
 } // extern "C"
 } // namespace C
 } // namespace mip
+
+
+namespace mip {
+
+////////////////////////////////////////////////////////////////////////////////
+///@copydoc mip::C::mip_interface_init
+///
+/// The update function is set to call defaultUpdate().
+///
+///@param connection The connection object used to communicate with the device. This object must exist for the life of the DeviceInterface object
+///
+DeviceInterface::DeviceInterface(Connection* connection, uint8_t* parseBuffer, size_t parseBufferSize, Timeout parseTimeout, Timeout baseReplyTimeout) :
+    mConnection(connection)
+{
+    C::mip_interface_init(this, parseBuffer, parseBufferSize, parseTimeout, baseReplyTimeout);
+
+    setUpdateFunction([](C::mip_interface* device, bool blocking){ return static_cast<DeviceInterface*>(device)->defaultUpdate(blocking); });
+}
+
+////////////////////////////////////////////////////////////////////////////////
+///@brief Reads data from the connection into the parser and processes it.
+///
+/// This is the C++ equivalent of mip_interface_default_update, except that
+/// it receives into all free space in the parse buffer with
+/// Connection::recvFromDeviceV, rather than only up to the end of the buffer.
+///
+///@param blocking Ignored.
+///
+///@returns The value returned by Connection::recvFromDeviceV.
+///
+bool DeviceInterface::defaultUpdate(bool blocking)
+{
+    (void)blocking;
+
+    C::mip_parser* parser = C::mip_interface_parser(this);
+
+    byte_ring_iov segments[2];
+    const unsigned int count = C::mip_parser_get_write_iov(parser, segments);
+
+    if( mClock )
+        mConnection->setReadTimeout(adaptiveReadTimeout(mClock()));
+
+    size_t length = 0;
+    Timestamp timestamp = 0;
+    if( !mConnection->recvFromDeviceV(segments, count, &length, &timestamp) )
+        return false;
+
+    assert(length <= (count > 0 ? segments[0].length : 0) + (count > 1 ? segments[1].length : 0));
+
+    C::mip_parser_process_written(parser, length, timestamp, 0);
+    C::mip_cmd_queue_update(C::mip_interface_cmd_queue(this), timestamp);
+    return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+///@brief Makes defaultUpdate() choose the connection's read timeout before
+///       each read.
+///
+/// A fixed read timeout is a tradeoff: a short one wakes the CPU needlessly
+/// while the device is idle, and a long one delays detection of command
+/// timeouts. Arriving data always ends the wait immediately, so the wait
+/// only needs to end by the time something else must be done. In this
+/// mode, it's the time until the next command would time out (see
+/// mip_cmd_queue_time_until_deadline), limited by the expected packet
+/// interval and maxTimeout.
+///
+///@param clock
+///       Function returning the current time, on the same time base as the
+///       connection's timestamps (e.g. getCurrentTimestamp).
+///@param maxTimeout
+///       Longest wait, used while no commands are outstanding. This limits
+///       how long update() can block while the device is silent.
+///@param packetInterval
+///       Expected time between data packets, or 0 if not streaming. When set,
+///       update() returns at least this often even if a packet goes missing,
+///       so that the application can notice the gap promptly.
+///
+///@returns False if the connection doesn't support setting the read
+///         timeout. The adaptive timeout is not enabled in that case.
+///
+bool DeviceInterface::setAdaptiveReadTimeout(Timestamp (*clock)(), Timeout maxTimeout, Timeout packetInterval)
+{
+    if( !clock || !mConnection || !mConnection->setReadTimeout(maxTimeout) )
+        return false;
+
+    mClock          = clock;
+    mMaxTimeout     = maxTimeout;
+    mPacketInterval = packetInterval;
+
+    return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+///@brief Computes the read timeout used in adaptive mode at the given time.
+///
+///@see setAdaptiveReadTimeout
+///
+Timeout DeviceInterface::adaptiveReadTimeout(Timestamp now) const
+{
+    Timeout maxWait = mMaxTimeout;
+    if( mPacketInterval > 0 && mPacketInterval < maxWait )
+        maxWait = mPacketInterval;
+
+    return C::mip_cmd_queue_time_until_deadline(&cmdQueue(), now, maxWait);
+}
+
+} // namespace mip
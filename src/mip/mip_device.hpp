@@ -21,6 +21,9 @@ struct Dispatcher : public C::mip_dispatcher
         ANY_DATA_SET = C::MIP_DISPATCH_ANY_DATA_SET,
         ANY_DESCRIPTOR = C::MIP_DISPATCH_ANY_DESCRIPTOR,
     };
+
+    void removeHandler(DispatchHandler& handler) { C::mip_dispatcher_remove_handler(this, &handler); }
+    void removeAllHandlers() { C::mip_dispatcher_remove_all_handlers(this); }
 };
 
 
@@ -46,10 +49,51 @@ struct CmdQueue : public C::mip_cmd_queue
     Timeout baseReplyTimeout() const { return C::mip_cmd_queue_base_reply_timeout(this); }
 
     void processPacket(const C::mip_packet& packet, Timestamp timestamp) { C::mip_cmd_queue_process_packet(this, &packet, timestamp); }
+
+    void setStats(C::mip_cmd_stats* stats) { C::mip_cmd_queue_set_stats(this, stats); }
+    C::mip_cmd_stats* stats() const { return C::mip_cmd_queue_stats(this); }
 };
 static_assert(sizeof(CmdQueue) == sizeof(C::mip_cmd_queue), "CmdQueue must not have additional data members.");
 
 
+////////////////////////////////////////////////////////////////////////////////
+///@brief C++ wrapper around command statistics.
+///
+/// Attach to a device with `device.cmdQueue().setStats(&stats)`.
+///
+///@tparam MaxCommands Maximum number of distinct commands to track.
+///
+template<size_t MaxCommands=32>
+struct CmdStats : public C::mip_cmd_stats
+{
+    static_assert(MaxCommands <= UINT16_MAX, "Too many commands.");
+
+    using Entry = C::mip_cmd_stats_entry;
+
+    ///@copydoc C::mip_cmd_stats_init
+    CmdStats(C::mip_cmd_stats_clock clock=nullptr) { C::mip_cmd_stats_init(this, mEntries, MaxCommands, clock); }
+
+    CmdStats(const CmdStats&) = delete;
+    CmdStats& operator=(const CmdStats&) = delete;
+
+    void reset() { C::mip_cmd_stats_reset(this); }
+
+    size_t count() const { return C::mip_cmd_stats_count(this); }
+    const Entry& operator[](size_t index) const { return *C::mip_cmd_stats_entry_at(this, uint16_t(index)); }
+    const Entry* find(uint8_t descriptorSet, uint8_t fieldDescriptor) const { return C::mip_cmd_stats_find(this, descriptorSet, fieldDescriptor); }
+    template<class Cmd>
+    const Entry* find() const { return find(Cmd::DESCRIPTOR_SET, Cmd::FIELD_DESCRIPTOR); }
+
+    uint32_t numUntracked() const { return C::mip_cmd_stats_num_untracked(this); }
+
+    ///@copydoc C::mip_cmd_stats_snapshot
+    size_t snapshot(Entry* entries, size_t maxEntries) const { return C::mip_cmd_stats_snapshot(this, entries, uint16_t(maxEntries)); }
+
+private:
+    Entry mEntries[MaxCommands];
+};
+
+
 ////////////////////////////////////////////////////////////////////////////////
 ///@brief C++ class representing the state of a MIP command.
 ///
@@ -132,11 +176,35 @@ template<class Cmd> bool startCommand(C::mip_interface& device, C::mip_pending_c
 ///@li `bool sendToDevice(const uint8_t* data, size_t length)` - corresponds to mip_interface_user_send_to_device.
 ///@li `bool recvFromDevice(uint8_t* buffer, size_t maxLength, size_t* lengthOut, Timestamp* timestampOut)` - corresponds to mip_interface_user_recv_from_device.
 ///
+/// Serial connections may also override baudrate() and setBaudrate() to allow
+/// the link speed to be changed (see extras::upgradeBaudrate).
+/// Connections backed by a file descriptor may override fileDescriptor() so
+/// that they can be waited on together (see platform::Reactor).
+///
+/// recvFromDeviceV() receives into both free segments of the parse buffer at
+/// once. By default it calls recvFromDevice() with the first segment only;
+/// connections which can do a vectored read (readv/recvmsg) should override
+/// it to avoid a short read at the end of the buffer.
+///
+/// Connections which wait for data may override setReadTimeout() so that the
+/// wait can be configured (see DeviceInterface::setAdaptiveReadTimeout).
+///
 class Connection
 {
 public:
     virtual bool sendToDevice(const uint8_t* data, size_t length) = 0;  // Must be implemented by a derived class.
     virtual bool recvFromDevice(uint8_t* buffer, size_t max_length, size_t* length_out, Timestamp* timestamp) = 0;  // Must be implemented by a derived class.
+
+    virtual uint32_t baudrate() const { return 0; }  ///< Current baud rate, or 0 if not applicable (e.g. TCP or USB).
+    virtual bool setBaudrate(uint32_t baudrate) { (void)baudrate; return false; }  ///< Changes the host baud rate. Returns false if not supported.
+
+    virtual int fileDescriptor() const { return -1; }  ///< OS file descriptor which becomes readable when data arrives, or -1 if none.
+    virtual bool setReadTimeout(Timeout timeout) { (void)timeout; return false; }  ///< Sets the maximum time to wait for data in recvFromDevice. Returns false if not supported.
+
+    virtual bool recvFromDeviceV(const byte_ring_iov* segments, unsigned int count, size_t* length_out, Timestamp* timestamp)
+    {
+        return recvFromDevice(count ? segments[0].ptr : nullptr, count ? segments[0].length : 0, length_out, timestamp);
+    }
 };
 
 
@@ -152,7 +220,7 @@ public:
 
     ///@copydoc mip::C::mip_interface_init
     ///@param connection The connection object used to communicate with the device. This object must exist for the life of the DeviceInterface object
-    DeviceInterface(Connection* connection, uint8_t* parseBuffer, size_t parseBufferSize, Timeout parseTimeout, Timeout baseReplyTimeout) : mConnection(connection) { C::mip_interface_init(this, parseBuffer, parseBufferSize, parseTimeout, baseReplyTimeout); }
+    DeviceInterface(Connection* connection, uint8_t* parseBuffer, size_t parseBufferSize, Timeout parseTimeout, Timeout baseReplyTimeout);
 
     DeviceInterface(const DeviceInterface&) = delete;
     DeviceInterface& operator=(const DeviceInterface&) = delete;
@@ -177,10 +245,12 @@ public:
 
     Parser&   parser()   { return *static_cast<Parser*>(C::mip_interface_parser(this)); }
     CmdQueue& cmdQueue() { return *static_cast<CmdQueue*>(C::mip_interface_cmd_queue(this)); }
+    Dispatcher& dispatcher() { return *static_cast<Dispatcher*>(C::mip_interface_dispatcher(this)); }
 
     const Parser&   parser()   const   { return const_cast<DeviceInterface*>(this)->parser(); }
     const CmdQueue& cmdQueue() const { return const_cast<DeviceInterface*>(this)->cmdQueue(); }
 
+    Connection* connection() { return mConnection; }
     const Connection* connection() const { return mConnection; }
     void setConnection(Connection* connection) { mConnection = connection; }
 
@@ -202,7 +272,11 @@ public:
 
     CmdResult      waitForReply(const C::mip_pending_cmd& cmd) { return C::mip_interface_wait_for_reply(this, &cmd); }
 
-    bool           defaultUpdate(bool blocking=false) { return C::mip_interface_default_update(this, blocking); }
+    bool           defaultUpdate(bool blocking=false);
+
+    bool           setAdaptiveReadTimeout(Timestamp (*clock)(), Timeout maxTimeout, Timeout packetInterval=0);
+    void           disableAdaptiveReadTimeout() { mClock = nullptr; }
+    Timeout        adaptiveReadTimeout(Timestamp now) const;
 
     //
     // Data Callbacks
@@ -258,6 +332,10 @@ public:
 
 private:
     Connection* mConnection;
+
+    Timestamp (*mClock)()      = nullptr;  ///< Non-null if the adaptive read timeout is enabled.
+    Timeout     mMaxTimeout     = 0;
+    Timeout     mPacketInterval = 0;
 };
 
 
@@ -360,10 +438,10 @@ void DeviceInterface::registerPacketCallback(C::mip_dispatch_handler& handler, u
 template<class Object, void (Object::*Callback)(const Packet&, Timestamp)>
 void DeviceInterface::registerPacketCallback(C::mip_dispatch_handler& handler, uint8_t descriptorSet, bool afterFields, Object* object)
 {
-    auto callback = [](void* pointer, const Packet& packet, Timestamp timestamp)
+    auto callback = [](void* pointer, const C::mip_packet* packet, Timestamp timestamp)
     {
         Object* obj = static_cast<Object*>(pointer);
-        (obj->*Callback)(Packet(packet), timestamp);
+        (obj->*Callback)(Packet(*packet), timestamp);
     };
 
     registerPacketCallback(handler, descriptorSet, afterFields, callback, object);
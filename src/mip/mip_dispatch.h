@@ -11,6 +11,7 @@
 #ifdef __cplusplus
 namespace mip {
 namespace C {
+extern "C" {
 #endif
 
 
@@ -138,6 +139,7 @@ void mip_dispatcher_dispatch_packet(mip_dispatcher* self, const mip_packet* pack
 
 
 #ifdef __cplusplus
+} // extern "C"
 } // namespace C
 } // namespace mip
 #endif
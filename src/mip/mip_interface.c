@@ -6,6 +6,7 @@
 #include "definitions/descriptors.h"
 
 #include <assert.h>
+#include <string.h>
 
 #include <stdio.h>
 
@@ -49,6 +50,8 @@ void mip_interface_init(mip_interface* device, uint8_t* parse_buffer, size_t par
     mip_cmd_queue_init(&device->_queue, base_reply_timeout);
 
     mip_dispatcher_init(&device->_dispatcher);
+
+    device->_cmd_hook = NULL;
 }
 
 
@@ -108,6 +111,27 @@ void* mip_interface_user_pointer(const mip_interface* device)
     return device->_user_pointer;
 }
 
+////////////////////////////////////////////////////////////////////////////////
+///@brief Sets callbacks to observe or intercept commands.
+///
+///@param device
+///@param hook
+///       The hook callbacks, or NULL to remove the hook. Must remain valid
+///       while set.
+///
+void mip_interface_set_command_hook(mip_interface* device, const mip_command_hook* hook)
+{
+    device->_cmd_hook = hook;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+///@brief Returns the command hook set by mip_interface_set_command_hook, or NULL.
+///
+const mip_command_hook* mip_interface_command_hook(const mip_interface* device)
+{
+    return device->_cmd_hook;
+}
+
 
 ////////////////////////////////////////////////////////////////////////////////
 ///@brief Returns the maximum number of packets to parser per update call.
@@ -288,6 +312,16 @@ mip_cmd_queue* mip_interface_cmd_queue(mip_interface* device)
     return &device->_queue;
 }
 
+////////////////////////////////////////////////////////////////////////////////
+///@brief Returns the data dispatcher for the device.
+///
+/// Use this to remove individual handlers with mip_dispatcher_remove_handler.
+///
+mip_dispatcher* mip_interface_dispatcher(mip_interface* device)
+{
+    return &device->_dispatcher;
+}
+
 
 ////////////////////////////////////////////////////////////////////////////////
 ///@brief Blocks until the pending command completes or times out.
@@ -355,7 +389,7 @@ enum mip_cmd_result mip_interface_run_command_with_response(mip_interface* devic
     const uint8_t response_length = response_length_inout ? *response_length_inout : 0;
     mip_pending_cmd_init_with_response(&cmd, descriptor_set, cmd_descriptor, response_descriptor, response_buffer, response_length);
 
-    enum mip_cmd_result result = mip_interface_run_command_packet(device, &packet, &cmd);
+    const enum mip_cmd_result result = mip_interface_run_command_packet(device, &packet, &cmd);
 
     if( response_length_inout )
         *response_length_inout = mip_pending_cmd_response_length(&cmd);
@@ -373,12 +407,62 @@ enum mip_cmd_result mip_interface_run_command_with_response(mip_interface* devic
 ///@param cmd
 ///       The command status tracker. No lifetime requirement.
 ///
+/// The device's command hook, if any, is invoked for the command field of
+/// the packet which matches cmd.
+///
 enum mip_cmd_result mip_interface_run_command_packet(mip_interface* device, const mip_packet* packet, mip_pending_cmd* cmd)
 {
+    const mip_command_hook* hook = device->_cmd_hook;
+
+    if( !hook )
+    {
+        if( !mip_interface_start_command_packet(device, packet, cmd) )
+            return MIP_STATUS_ERROR;
+
+        return mip_interface_wait_for_reply(device, cmd);
+    }
+
+    mip_field field = mip_field_first_from_packet(packet);
+    while( mip_field_is_valid(&field) && mip_field_field_descriptor(&field) != cmd->_field_descriptor )
+        mip_field_next(&field);
+
+    // The response buffer may overlap the packet (e.g. in the C++
+    // runCommand), so keep a copy of the payload for the after callback.
+    uint8_t payload[MIP_FIELD_PAYLOAD_LENGTH_MAX];
+    const uint8_t payload_length = mip_field_payload_length(&field);
+    if( payload_length > 0 )
+        memcpy(payload, mip_field_payload(&field), payload_length);
+
+    uint8_t* const response_buffer = cmd->_response_buffer;
+    const uint8_t  response_buffer_size = cmd->_response_buffer_size;
+
+    enum mip_cmd_result result;
+
+    if( hook->before )
+    {
+        uint8_t response_length = response_buffer_size;
+
+        if( hook->before(hook->user_data, cmd->_descriptor_set, cmd->_field_descriptor, payload, payload_length, cmd->_response_descriptor, response_buffer, response_buffer ? &response_length : NULL, &result) )
+        {
+            cmd->_response_length = response_buffer ? response_length : 0;
+            cmd->_status = result;
+            return result;
+        }
+    }
+
     if( !mip_interface_start_command_packet(device, packet, cmd) )
-        return MIP_STATUS_ERROR;
+        result = MIP_STATUS_ERROR;
+    else
+        result = mip_interface_wait_for_reply(device, cmd);
 
-    return mip_interface_wait_for_reply(device, cmd);
+    if( hook->after )
+    {
+        const uint8_t response_length = (result == MIP_STATUS_ERROR) ? 0 : mip_pending_cmd_response_length(cmd);
+
+        hook->after(hook->user_data, cmd->_descriptor_set, cmd->_field_descriptor, payload, payload_length, cmd->_response_descriptor, response_buffer, response_length, response_buffer_size, result);
+    }
+
+    return result;
 }
 
 ////////////////////////////////////////////////////////////////////////////////
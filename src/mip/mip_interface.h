@@ -45,6 +45,64 @@ struct mip_interface;
 ///
 typedef bool (*mip_update_callback)(struct mip_interface* device, bool blocking);
 
+////////////////////////////////////////////////////////////////////////////////
+///@brief Callback invoked before a command is run.
+///
+/// May be used to answer a command locally (e.g. from a cache) instead of
+/// sending it to the device.
+///
+///@param user_data           The user_data pointer from the mip_command_hook.
+///@param descriptor_set      Command descriptor set.
+///@param field_descriptor    Command field descriptor.
+///@param payload             Command payload (including the function selector, if any).
+///@param payload_length      Length of the command payload.
+///@param response_descriptor Expected response descriptor, or MIP_INVALID_FIELD_DESCRIPTOR.
+///@param response_buffer     Buffer for response data. May be NULL if no response is expected.
+///@param response_length_inout
+///       On input, the size of response_buffer. If the command is handled,
+///       set this to the length of the response data. May be NULL if no
+///       response is expected.
+///@param result_out          If the command is handled, set this to the result.
+///
+///@returns True if the command was handled and should not be sent.
+///@returns False to send the command normally.
+///
+typedef bool (*mip_command_hook_before)(void* user_data, uint8_t descriptor_set, uint8_t field_descriptor, const uint8_t* payload, uint8_t payload_length, uint8_t response_descriptor, uint8_t* response_buffer, uint8_t* response_length_inout, enum mip_cmd_result* result_out);
+
+////////////////////////////////////////////////////////////////////////////////
+///@brief Callback invoked after a command sent to the device completes.
+///
+///@param user_data           The user_data pointer from the mip_command_hook.
+///@param descriptor_set      Command descriptor set.
+///@param field_descriptor    Command field descriptor.
+///@param payload             Command payload (including the function selector, if any).
+///@param payload_length      Length of the command payload.
+///@param response_descriptor Expected response descriptor, or MIP_INVALID_FIELD_DESCRIPTOR.
+///@param response            Response data received from the device.
+///@param response_length     Length of the response data (0 if none).
+///@param response_buffer_size
+///       Size of the caller's response buffer. A response which filled it may
+///       have been truncated.
+///@param result              The command result.
+///
+typedef void (*mip_command_hook_after)(void* user_data, uint8_t descriptor_set, uint8_t field_descriptor, const uint8_t* payload, uint8_t payload_length, uint8_t response_descriptor, const uint8_t* response, uint8_t response_length, uint8_t response_buffer_size, enum mip_cmd_result result);
+
+////////////////////////////////////////////////////////////////////////////////
+///@brief Optional callbacks to observe or intercept commands.
+///
+/// The hook applies to every command run to completion with
+/// mip_interface_run_command_packet, which includes mip_interface_run_command,
+/// the generated command functions and the C++ runCommand templates.
+/// Commands which are only started (mip_interface_start_command_packet) bypass
+/// the hook.
+///
+typedef struct mip_command_hook
+{
+    mip_command_hook_before before;     ///< Called before sending. May be NULL.
+    mip_command_hook_after  after;      ///< Called after the command completes. May be NULL.
+    void*                   user_data;  ///< Passed to the callbacks.
+} mip_command_hook;
+
 ////////////////////////////////////////////////////////////////////////////////
 ///@brief State of the interface for communicating with a MIP device.
 ///
@@ -56,6 +114,7 @@ typedef struct mip_interface
     unsigned int         _max_update_pkts; ///<@private Max number of MIP packets to parse at once.
     mip_update_callback  _update_function; ///<@private Optional function to call during updates.
     void*                _user_pointer;    ///<@private Optional user-specified data pointer.
+    const mip_command_hook* _cmd_hook;     ///<@private Optional command hook.
 } mip_interface;
 
 void mip_interface_init(mip_interface* device, uint8_t* parse_buffer, size_t parse_buffer_size, timeout_type parse_timeout, timeout_type base_reply_timeout);
@@ -100,12 +159,15 @@ void mip_interface_register_extractor(mip_interface* device, mip_dispatch_handle
 void mip_interface_set_update_function(mip_interface* device, mip_update_callback function);
 void mip_interface_set_user_pointer(mip_interface* device, void* pointer);
 void mip_interface_set_max_packets_per_update(mip_interface* device, unsigned int max_packets);
+void mip_interface_set_command_hook(mip_interface* device, const mip_command_hook* hook);
 unsigned int mip_interface_max_packets_per_update(const mip_interface* device);
 
 mip_update_callback mip_interface_update_function(mip_interface* device);
 void* mip_interface_user_pointer(const mip_interface* device);
 mip_parser*    mip_interface_parser(mip_interface* device);
 mip_cmd_queue* mip_interface_cmd_queue(mip_interface* device);
+mip_dispatcher* mip_interface_dispatcher(mip_interface* device);
+const mip_command_hook* mip_interface_command_hook(const mip_interface* device);
 
 ///@}
 ///@}
@@ -382,7 +382,7 @@ remaining_count mip_packet_realloc_last_field(mip_packet* packet, uint8_t* paylo
 
     const remaining_count delta_length = new_field_length - old_field_length;
 
-    remaining_count remaining = mip_packet_remaining_space(packet) + delta_length;
+    remaining_count remaining = mip_packet_remaining_space(packet) - delta_length;
 
     if( remaining >= 0 )
     {
@@ -412,9 +412,9 @@ remaining_count mip_packet_cancel_last_field(mip_packet* packet, uint8_t* payloa
     assert(payload_ptr != NULL);
 
     uint8_t* field_ptr = payload_ptr - MIP_INDEX_FIELD_PAYLOAD;
-    const uint8_t old_payload_length = field_ptr[MIP_INDEX_FIELD_LEN];
+    const uint8_t old_field_length = field_ptr[MIP_INDEX_FIELD_LEN];  // Includes the field header.
 
-    packet->_buffer[MIP_INDEX_LENGTH] -= MIP_FIELD_HEADER_LENGTH + old_payload_length;
+    packet->_buffer[MIP_INDEX_LENGTH] -= old_field_length;
 
     return mip_packet_remaining_space(packet);
 }
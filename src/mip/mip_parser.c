@@ -247,6 +247,23 @@ void mip_parser_set_timeout(mip_parser* parser, timestamp_type timeout)
     parser->_timeout = timeout;
 }
 
+////////////////////////////////////////////////////////////////////////////////
+///@brief Returns the buffer which backs the parser's ring buffer.
+///
+/// The write pointer from mip_parser_get_write_ptr always lies within this
+/// buffer, so it can be registered with the OS once (e.g. as an io_uring
+/// fixed buffer) and reused for every read.
+///
+///@param parser
+///@param size_out
+///       Receives the size of the buffer, in bytes.
+///
+uint8_t* mip_parser_buffer(mip_parser* parser, size_t* size_out)
+{
+    *size_out = parser->_ring.size;
+    return parser->_ring.buffer;
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 ///@brief mip_parser_set_callback
 ///
@@ -342,6 +359,36 @@ size_t mip_parser_get_write_ptr(mip_parser* parser, uint8_t** const ptr_out)
     return byte_ring_get_write_ptr(&parser->_ring, ptr_out);
 }
 
+////////////////////////////////////////////////////////////////////////////////
+///@brief Obtain all free space in the parser's buffer, for vectored reads.
+///
+/// Unlike mip_parser_get_write_ptr(), which stops at the end of the circular
+/// buffer, this also returns the space at the start of the buffer, so that a
+/// single readv() or recvmsg() call can fill both. Call
+/// mip_parser_process_written() with the total count afterward.
+///
+///@code{.c}
+/// byte_ring_iov segments[2];
+/// unsigned int num = mip_parser_get_write_iov(&parser, segments);
+/// // Copy segments to a struct iovec array and call readv(fd, iov, num).
+/// mip_parser_process_written(&parser, total_bytes_read, timestamp, 0);
+///@endcode
+///
+///@param parser
+///@param iov_out
+///       Array of two segments to fill in. Only the returned number of
+///       segments is valid. Data must fill the first segment before the
+///       second, as readv does.
+///
+///@returns The number of segments, from 0 (buffer full) to 2.
+///
+unsigned int mip_parser_get_write_iov(mip_parser* parser, byte_ring_iov iov_out[2])
+{
+    assert(iov_out != NULL);
+
+    return byte_ring_get_write_iov(&parser->_ring, iov_out);
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 ///@brief Notify the parser that data has been written to the pointer previously
 ///       obtained via mip_parser_get_write_ptr().
@@ -76,6 +76,7 @@ remaining_count mip_parser_parse(mip_parser* parser, const uint8_t* input_buffer
 void mip_parser_reset(mip_parser* parser);
 
 size_t mip_parser_get_write_ptr(mip_parser* parser, uint8_t** ptr_out);
+unsigned int mip_parser_get_write_iov(mip_parser* parser, byte_ring_iov iov_out[2]);
 void mip_parser_process_written(mip_parser* parser, size_t count, timestamp_type timestamp, unsigned int max_packets);
 
 //
@@ -91,6 +92,8 @@ void* mip_parser_callback_object(const mip_parser* parser);
 
 timestamp_type mip_parser_last_packet_timestamp(const mip_parser* parser);
 
+uint8_t* mip_parser_buffer(mip_parser* parser, size_t* size_out);
+
 //
 // Misc
 //
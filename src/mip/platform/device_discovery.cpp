@@ -0,0 +1,156 @@
+#include "device_discovery.hpp"
+
+#include "serial_connection.hpp"
+
+#include <thread>
+#include <algorithm>
+#include <stdexcept>
+
+#ifdef WIN32
+    #include <windows.h>
+#else
+    #include <glob.h>
+#endif
+
+namespace mip
+{
+namespace platform
+{
+
+////////////////////////////////////////////////////////////////////////////////
+///@brief Returns the serial ports which may have a MIP device attached.
+///
+/// On Linux, these are the USB serial adapters and USB CDC devices
+/// (/dev/ttyUSB* and /dev/ttyACM*). On Windows, these are the COM ports which
+/// currently exist.
+///
+std::vector<std::string> listSerialPorts()
+{
+    std::vector<std::string> ports;
+
+#ifdef WIN32
+    char target[256];
+
+    for(unsigned int i=1; i<=255; i++)
+    {
+        const std::string name = "COM" + std::to_string(i);
+
+        if( QueryDosDeviceA(name.c_str(), target, sizeof(target)) != 0 )
+            ports.push_back(name);
+    }
+#else
+    for(const char* pattern : { "/dev/ttyUSB*", "/dev/ttyACM*" })
+    {
+        glob_t result;
+
+        if( glob(pattern, 0, nullptr, &result) == 0 )
+        {
+            for(size_t i=0; i<result.gl_pathc; i++)
+                ports.push_back(result.gl_pathv[i]);
+        }
+
+        globfree(&result);
+    }
+#endif
+
+    return ports;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+///@brief Looks for a device on a single port, trying each baud rate in turn.
+///
+/// The port is opened once and switched between baud rates in place. At each
+/// rate the device info is queried with a timeout just long enough for a
+/// reply at that rate.
+///
+///@param port
+///@param options
+///@param deviceOut
+///       Filled in if a device is found.
+///
+///@returns True if a device responded.
+///
+bool probePort(const std::string& port, const DiscoveryOptions& options, DiscoveredDevice* deviceOut)
+{
+    if( options.baudrates.empty() )
+        return false;
+
+    const Timestamp startTime = getCurrentTimestamp();
+
+    std::unique_ptr<SerialConnection> connection;
+    try
+    {
+        connection.reset(new SerialConnection(port, options.baudrates.front()));
+    }
+    catch(const std::exception&)
+    {
+        return false;  // Busy, no permission, or not a serial port.
+    }
+
+    uint8_t parseBuffer[1024];
+
+    for(uint32_t baud : options.baudrates)
+    {
+        if( !connection->setBaudrate(baud) )
+            continue;
+
+        const Timeout packetTime = C::mip_timeout_from_baudrate(baud);
+
+        DeviceInterface device(connection.get(), parseBuffer, sizeof(parseBuffer), packetTime, packetTime + options.processingTime);
+
+        for(unsigned int attempt=0; attempt<options.attempts; attempt++)
+        {
+            if( commands_base::getDeviceInfo(device, &deviceOut->info) == CmdResult::ACK_OK )
+            {
+                deviceOut->port     = port;
+                deviceOut->baudrate = baud;
+                deviceOut->duration = getCurrentTimestamp() - startTime;
+                return true;
+            }
+        }
+    }
+
+    return false;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+///@brief Finds MIP devices on all candidate serial ports at once.
+///
+/// Each port is probed by its own thread, so discovery takes about as long as
+/// the slowest port rather than the sum of all of them.
+///
+///@returns The devices found, in port order.
+///
+std::vector<DiscoveredDevice> discoverDevices(const DiscoveryOptions& options)
+{
+    const std::vector<std::string> ports = options.ports.empty() ? listSerialPorts() : options.ports;
+
+    std::vector<DiscoveredDevice> results(ports.size());
+    std::unique_ptr<bool[]> found(new bool[ports.size()]);
+
+    std::vector<std::thread> threads;
+    threads.reserve(ports.size());
+
+    for(size_t i=0; i<ports.size(); i++)
+    {
+        threads.emplace_back([&, i]()
+        {
+            found[i] = probePort(ports[i], options, &results[i]);
+        });
+    }
+
+    for(std::thread& thread : threads)
+        thread.join();
+
+    std::vector<DiscoveredDevice> devices;
+    for(size_t i=0; i<ports.size(); i++)
+    {
+        if( found[i] )
+            devices.push_back(std::move(results[i]));
+    }
+
+    return devices;
+}
+
+};  // namespace platform
+};  // namespace mip
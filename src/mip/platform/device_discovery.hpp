@@ -0,0 +1,60 @@
+#pragma once
+
+#include <mip/mip_device.hpp>
+#include <mip/definitions/commands_base.hpp>
+
+#include <string>
+#include <vector>
+
+
+extern mip::Timestamp getCurrentTimestamp();
+
+namespace mip
+{
+namespace platform
+{
+
+////////////////////////////////////////////////////////////////////////////////
+///@brief A device found by discoverDevices().
+///
+struct DiscoveredDevice
+{
+    std::string                   port;
+    uint32_t                      baudrate = 0;
+    commands_base::BaseDeviceInfo info;
+    Timeout                       duration = 0;  ///< Time taken to find the device on this port.
+};
+
+////////////////////////////////////////////////////////////////////////////////
+///@brief Options for discoverDevices().
+///
+struct DiscoveryOptions
+{
+    ///@brief Ports to probe. If empty, all ports from listSerialPorts() are probed.
+    std::vector<std::string> ports;
+
+    ///@brief Baud rates to try on each port, in order.
+    ///
+    /// The MIP default rate comes first, then the rates most often configured
+    /// for streaming. Put a known or last-used rate first for the fastest
+    /// result.
+    std::vector<uint32_t> baudrates = { 115200, 921600, 460800, 230400, 57600, 19200, 9600 };
+
+    ///@brief Time allowed for the device to process the query, on top of the
+    ///       time to transmit a maximum-size packet at the baud rate being
+    ///       tried (see mip_timeout_from_baudrate).
+    Timeout processingTime = 25;
+
+    ///@brief Number of times to query at each baud rate before moving on.
+    unsigned int attempts = 2;
+};
+
+
+std::vector<std::string> listSerialPorts();
+
+std::vector<DiscoveredDevice> discoverDevices(const DiscoveryOptions& options=DiscoveryOptions());
+
+bool probePort(const std::string& port, const DiscoveryOptions& options, DiscoveredDevice* deviceOut);
+
+};  // namespace platform
+};  // namespace mip
@@ -0,0 +1,406 @@
+#include "poll_scheduler.hpp"
+
+#include <mip/definitions/commands_3dm.hpp>
+#include <mip/definitions/data_sensor.hpp>
+#include <mip/definitions/data_gnss.hpp>
+#include <mip/definitions/data_filter.hpp>
+
+#include <algorithm>
+#include <stdexcept>
+
+#include <errno.h>
+#include <poll.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+
+namespace mip
+{
+namespace platform
+{
+
+namespace
+{
+    ///@brief Returns the CLOCK_MONOTONIC time in microseconds.
+    uint64_t monotonicMicroseconds()
+    {
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return uint64_t(ts.tv_sec) * 1000000 + uint64_t(ts.tv_nsec) / 1000;
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+///@brief Creates a poll scheduler.
+///
+///@param device
+///@param rate   Tick rate in Hz. Each poll is sent every N ticks, where N is
+///              its divider.
+///@param sendMutex
+///              If not NULL, held while sending each poll. Other threads
+///              which send to the device must hold it too.
+///
+PollScheduler::PollScheduler(DeviceInterface& device, float rate, std::mutex* sendMutex) :
+    mDevice(device), mRate(rate), mPeriod(uint64_t(1e9 / rate)), mSendMutex(sendMutex)
+{
+    assert(rate > 0);
+}
+
+PollScheduler::~PollScheduler()
+{
+    stop();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+///@brief Adds a poll using the 3DM PollData command.
+///
+///@param descriptorSet Data descriptor set to poll.
+///@param descriptors   Data field descriptors to include in the reply.
+///@param count         Number of descriptors.
+///@param divider       The poll is sent on every Nth tick.
+///@param timeout       Time allowed for the reply, in microseconds. If 0,
+///                     the reply is due before the poll is sent again.
+///
+///@returns The index of the poll, for use with pollStats().
+///
+size_t PollScheduler::addPollData(uint8_t descriptorSet, const uint8_t* descriptors, uint8_t count, unsigned int divider, uint32_t timeout)
+{
+    commands_3dm::PollData cmd;
+    cmd.desc_set        = descriptorSet;
+    cmd.suppress_ack    = true;
+    cmd.num_descriptors = count;
+    cmd.descriptors     = const_cast<uint8_t*>(descriptors);
+
+    uint8_t buffer[PACKET_LENGTH_MAX];
+    return addPoll(descriptorSet, Packet::createFromField(buffer, sizeof(buffer), cmd), divider, timeout);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+///@brief Adds a poll using the PollImuMessage, PollGnssMessage, or
+///       PollFilterMessage command, depending on the descriptor set.
+///
+/// The decimations in the descriptor list are ignored by the device.
+///
+///@param descriptorSet Sensor, GNSS, or filter data descriptor set.
+///@param descriptors   Data fields to include in the reply.
+///@param count         Number of descriptors.
+///@param divider       The poll is sent on every Nth tick.
+///@param timeout       Time allowed for the reply, in microseconds. If 0,
+///                     the reply is due before the poll is sent again.
+///
+///@returns The index of the poll, for use with pollStats().
+///
+///@throws std::invalid_argument if descriptorSet can't be polled this way.
+///
+size_t PollScheduler::addPollMessage(uint8_t descriptorSet, const DescriptorRate* descriptors, uint8_t count, unsigned int divider, uint32_t timeout)
+{
+    uint8_t buffer[PACKET_LENGTH_MAX];
+    DescriptorRate* list = const_cast<DescriptorRate*>(descriptors);
+
+    switch(descriptorSet)
+    {
+    case data_sensor::DESCRIPTOR_SET:
+        return addPoll(descriptorSet, Packet::createFromField(buffer, sizeof(buffer), commands_3dm::PollImuMessage{true, count, list}), divider, timeout);
+
+    case data_gnss::DESCRIPTOR_SET:
+        return addPoll(descriptorSet, Packet::createFromField(buffer, sizeof(buffer), commands_3dm::PollGnssMessage{true, count, list}), divider, timeout);
+
+    case data_filter::DESCRIPTOR_SET:
+        return addPoll(descriptorSet, Packet::createFromField(buffer, sizeof(buffer), commands_3dm::PollFilterMessage{true, count, list}), divider, timeout);
+
+    default:
+        throw std::invalid_argument("No poll message command for this descriptor set");
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+///@brief Starts issuing polls.
+///
+/// Call this from the thread which updates the device, or while it isn't
+/// being updated, since it registers the data callbacks.
+///
+///@returns False if already running, no polls were added, or the timer
+///         could not be created.
+///
+bool PollScheduler::start()
+{
+    if( isRunning() || mPolls.empty() )
+        return false;
+
+    mTimerFd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+    mWakeFd  = eventfd(0, EFD_CLOEXEC);
+
+    struct itimerspec spec;
+    spec.it_interval.tv_sec  = time_t(mPeriod / 1000000000);
+    spec.it_interval.tv_nsec = long(mPeriod % 1000000000);
+    spec.it_value            = spec.it_interval;
+
+    if( mTimerFd < 0 || mWakeFd < 0 || timerfd_settime(mTimerFd, 0, &spec, nullptr) != 0 )
+    {
+        if( mTimerFd >= 0 )
+            close(mTimerFd);
+        if( mWakeFd >= 0 )
+            close(mWakeFd);
+
+        mTimerFd = -1;
+        mWakeFd  = -1;
+        return false;
+    }
+
+    for(std::unique_ptr<DataSet>& set : mDataSets)
+        mDevice.registerPacketCallback(set->handler, set->descriptorSet, false, &PollScheduler::packetCallback, set.get());
+
+    mTick = 0;
+    mStop = false;
+    mThread = std::thread(&PollScheduler::run, this);
+
+    return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+///@brief Stops issuing polls.
+///
+/// Polls still outstanding are discarded without counting them as missed.
+/// The same threading restrictions as start() apply.
+///
+void PollScheduler::stop()
+{
+    if( !isRunning() )
+        return;
+
+    mStop = true;
+
+    const uint64_t one = 1;
+    ssize_t written = write(mWakeFd, &one, sizeof(one));
+    (void)written;
+
+    mThread.join();
+
+    close(mTimerFd);
+    close(mWakeFd);
+    mTimerFd = -1;
+    mWakeFd  = -1;
+
+    for(std::unique_ptr<DataSet>& set : mDataSets)
+    {
+        mDevice.dispatcher().removeHandler(set->handler);
+        set->outstanding.clear();
+    }
+}
+
+PollScheduler::Stats PollScheduler::stats() const
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    return mStats;
+}
+
+PollScheduler::PollStats PollScheduler::pollStats(size_t poll) const
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    return mPolls.at(poll).stats;
+}
+
+void PollScheduler::resetStats()
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+
+    mStats = Stats();
+    for(Poll& poll : mPolls)
+        poll.stats = PollStats();
+}
+
+size_t PollScheduler::addPoll(uint8_t descriptorSet, const Packet& packet, unsigned int divider, uint32_t timeout)
+{
+    assert(!isRunning());
+    assert(divider > 0);
+
+    Poll poll;
+    poll.packet.assign(packet.pointer(), packet.pointer() + packet.totalLength());
+    poll.descriptorSet = descriptorSet;
+    poll.divider       = std::max(divider, 1u);
+    poll.timeout       = timeout ? timeout : uint32_t(poll.divider * mPeriod / 1000);
+
+    mPolls.push_back(std::move(poll));
+    dataSet(descriptorSet);
+
+    return mPolls.size() - 1;
+}
+
+PollScheduler::DataSet& PollScheduler::dataSet(uint8_t descriptorSet)
+{
+    for(std::unique_ptr<DataSet>& set : mDataSets)
+    {
+        if( set->descriptorSet == descriptorSet )
+            return *set;
+    }
+
+    // Allocated individually because the dispatcher keeps pointers to the handlers.
+    mDataSets.emplace_back(new DataSet());
+    mDataSets.back()->scheduler     = this;
+    mDataSets.back()->descriptorSet = descriptorSet;
+
+    return *mDataSets.back();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+///@brief Timer thread. Waits for each timer expiration or a stop request.
+///
+void PollScheduler::run()
+{
+    struct pollfd fds[2] = {
+        { mTimerFd, POLLIN, 0 },
+        { mWakeFd,  POLLIN, 0 },
+    };
+
+    while( !mStop )
+    {
+        if( ::poll(fds, 2, -1) < 0 )
+        {
+            if( errno == EINTR )
+                continue;
+            break;
+        }
+
+        if( fds[1].revents & POLLIN )
+            break;
+
+        uint64_t expirations = 0;
+        if( (fds[0].revents & POLLIN) && read(mTimerFd, &expirations, sizeof(expirations)) == sizeof(expirations) && expirations > 0 )
+            tick(expirations);
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+///@brief Sends the polls which are due.
+///
+/// If more than one period has elapsed since the last tick, each poll which
+/// was due during that time is sent once, now.
+///
+///@param expirations Number of timer periods since the last tick.
+///
+void PollScheduler::tick(uint64_t expirations)
+{
+    const uint64_t first = mTick;
+    mTick += expirations;
+
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mStats.ticks     += expirations;
+        mStats.lateTicks += expirations - 1;
+    }
+
+    for(size_t i=0; i<mPolls.size(); i++)
+    {
+        Poll& poll = mPolls[i];
+
+        // Due if any tick in [first, mTick) is a multiple of the divider.
+        const uint64_t next = (first + poll.divider - 1) / poll.divider * poll.divider;
+        if( next >= mTick )
+            continue;
+
+        DataSet& set = dataSet(poll.descriptorSet);
+        uint32_t sequence;
+
+        // Queue it before sending so that a fast reply finds it.
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+
+            const uint64_t now = monotonicMicroseconds();
+            expire(set, now);
+
+            sequence = ++mSequence;
+            set.outstanding.push_back({i, sequence, now, now + poll.timeout});
+            poll.stats.sent++;
+        }
+
+        if( !send(poll) )
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+
+            auto iter = std::find_if(set.outstanding.begin(), set.outstanding.end(), [sequence](const Outstanding& o){ return o.sequence == sequence; });
+            if( iter != set.outstanding.end() )
+                set.outstanding.erase(iter);
+
+            poll.stats.sent--;
+            mStats.sendErrors++;
+        }
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+///@brief Writes a poll to the device, holding the send mutex if there is one.
+///
+bool PollScheduler::send(const Poll& poll)
+{
+    if( !mSendMutex )
+        return mDevice.sendToDevice(poll.packet.data(), poll.packet.size());
+
+    std::lock_guard<std::mutex> lock(*mSendMutex);
+    return mDevice.sendToDevice(poll.packet.data(), poll.packet.size());
+}
+
+////////////////////////////////////////////////////////////////////////////////
+///@brief Counts polls past their deadline as missed. Must hold mMutex.
+///
+void PollScheduler::expire(DataSet& set, uint64_t now)
+{
+    while( !set.outstanding.empty() && set.outstanding.front().deadline < now )
+    {
+        mPolls[set.outstanding.front().poll].stats.missed++;
+        set.outstanding.pop_front();
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+///@brief Matches a data packet to the oldest outstanding poll of its set.
+///
+void PollScheduler::handlePacket(DataSet& set, const Packet& packet)
+{
+    size_t   poll;
+    uint32_t latency;
+
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+
+        const uint64_t now = monotonicMicroseconds();
+        expire(set, now);
+
+        if( set.outstanding.empty() )
+        {
+            mStats.unmatched++;
+            return;
+        }
+
+        const Outstanding outstanding = set.outstanding.front();
+        set.outstanding.pop_front();
+
+        poll    = outstanding.poll;
+        latency = uint32_t(now - outstanding.sentTime);
+
+        PollStats& stats = mPolls[poll].stats;
+
+        if( stats.received == 0 || latency < stats.minLatency )
+            stats.minLatency = latency;
+        if( latency > stats.maxLatency )
+            stats.maxLatency = latency;
+
+        stats.lastLatency  = latency;
+        stats.sumLatency  += latency;
+        stats.received++;
+    }
+
+    if( mCallback )
+        mCallback(mUserData, poll, packet, latency);
+}
+
+void PollScheduler::packetCallback(void* context, const C::mip_packet* packet, Timestamp timestamp)
+{
+    (void)timestamp;
+
+    DataSet* set = static_cast<DataSet*>(context);
+    set->scheduler->handlePacket(*set, Packet(packet));
+}
+
+};  // namespace platform
+};  // namespace mip
@@ -0,0 +1,176 @@
+#pragma once
+
+#include <mip/mip_device.hpp>
+#include <mip/definitions/descriptors.h>
+
+#include <atomic>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace mip
+{
+namespace platform
+{
+
+////////////////////////////////////////////////////////////////////////////////
+///@brief Issues data polls on a precise host timer and matches the replies.
+///
+/// Polls are sent from a dedicated thread woken by a CLOCK_MONOTONIC timerfd,
+/// so their timing doesn't depend on how often the device is updated. Each
+/// poll is sent with suppressAck set and is not added to the command queue,
+/// so nothing waits for a reply and rates of several hundred Hz are possible.
+///
+/// Each data packet of a polled descriptor set is matched to the oldest
+/// outstanding poll of that set and the latency (from sending the poll to
+/// dispatching the packet) is recorded. A poll is missed if its packet hasn't
+/// arrived by its deadline. Matching happens in the data callbacks, so the
+/// device must still be updated (e.g. by the application's main loop).
+///
+/// Polls are written to the connection from the timer thread. Nothing else
+/// may write to the device at the same time, so if the application sends
+/// commands while the scheduler runs, pass a send mutex to the constructor
+/// and hold it around every other write to the connection (e.g. in the
+/// Connection's sendToDevice, which also covers the command functions).
+/// Without a mutex, no other thread may send to the device between start()
+/// and stop().
+///
+/// Streaming should be disabled for the polled descriptor sets, since
+/// streamed packets can't be told apart from polled ones. Likewise, a reply
+/// which arrives after its deadline is matched to the next poll of the set.
+///
+///@code{.cpp}
+/// PollScheduler scheduler(device, 200);  // 200 Hz ticks.
+///
+/// const uint8_t imu[] = { data_sensor::DATA_ACCEL_SCALED, data_sensor::DATA_GYRO_SCALED };
+/// scheduler.addPollData(data_sensor::DESCRIPTOR_SET, imu, 2);         // Every tick.
+/// const uint8_t filter[] = { data_filter::DATA_ATT_QUATERNION };
+/// scheduler.addPollData(data_filter::DESCRIPTOR_SET, filter, 1, 4);   // Every 4th tick (50 Hz).
+///
+/// scheduler.start();
+/// while(running)
+///     device.update();
+/// scheduler.stop();
+///@endcode
+///
+/// This class is only available on Linux.
+///
+class PollScheduler
+{
+public:
+    ///@brief Statistics for one poll. Latencies are in microseconds.
+    struct PollStats
+    {
+        uint32_t sent        = 0;
+        uint32_t received    = 0;
+        uint32_t missed      = 0;  ///< Replies not received by the deadline.
+        uint32_t minLatency  = 0;
+        uint32_t maxLatency  = 0;
+        uint32_t lastLatency = 0;
+        uint64_t sumLatency  = 0;
+
+        uint32_t meanLatency() const { return received ? uint32_t(sumLatency / received) : 0; }
+    };
+
+    ///@brief Statistics for the scheduler as a whole.
+    struct Stats
+    {
+        uint64_t ticks      = 0;  ///< Timer periods elapsed.
+        uint64_t lateTicks  = 0;  ///< Periods which elapsed before the thread could handle the previous one.
+        uint32_t sendErrors = 0;  ///< Polls which could not be sent.
+        uint32_t unmatched  = 0;  ///< Packets of a polled descriptor set without an outstanding poll.
+    };
+
+    ///@brief Called (during device updates) for each matched reply.
+    ///
+    ///@param userData
+    ///@param poll    Index of the poll, as returned from addPollData or addPollMessage.
+    ///@param packet  The data packet.
+    ///@param latency Time from sending the poll to receiving the packet, in microseconds.
+    ///
+    typedef void (*Callback)(void* userData, size_t poll, const Packet& packet, uint32_t latency);
+
+    PollScheduler(DeviceInterface& device, float rate, std::mutex* sendMutex=nullptr);
+    ~PollScheduler();
+
+    PollScheduler(const PollScheduler&) = delete;
+    PollScheduler& operator=(const PollScheduler&) = delete;
+
+    size_t addPollData(uint8_t descriptorSet, const uint8_t* descriptors, uint8_t count, unsigned int divider=1, uint32_t timeout=0);
+    size_t addPollMessage(uint8_t descriptorSet, const DescriptorRate* descriptors, uint8_t count, unsigned int divider=1, uint32_t timeout=0);
+
+    void setCallback(Callback callback, void* userData) { mCallback = callback; mUserData = userData; }
+
+    bool start();
+    void stop();
+    bool isRunning() const { return mThread.joinable(); }
+
+    float rate() const { return mRate; }
+
+    Stats stats() const;
+    PollStats pollStats(size_t poll) const;
+    void resetStats();
+
+private:
+    struct Poll
+    {
+        std::vector<uint8_t> packet;
+        uint8_t              descriptorSet;
+        unsigned int         divider;
+        uint32_t             timeout;
+        PollStats            stats;
+    };
+
+    struct Outstanding
+    {
+        size_t   poll;
+        uint32_t sequence;
+        uint64_t sentTime;
+        uint64_t deadline;
+    };
+
+    struct DataSet
+    {
+        PollScheduler*          scheduler;
+        uint8_t                 descriptorSet;
+        C::mip_dispatch_handler handler;
+        std::deque<Outstanding> outstanding;
+    };
+
+    size_t addPoll(uint8_t descriptorSet, const Packet& packet, unsigned int divider, uint32_t timeout);
+    DataSet& dataSet(uint8_t descriptorSet);
+
+    void run();
+    void tick(uint64_t expirations);
+    bool send(const Poll& poll);
+    void expire(DataSet& set, uint64_t now);
+    void handlePacket(DataSet& set, const Packet& packet);
+
+    static void packetCallback(void* context, const C::mip_packet* packet, Timestamp timestamp);
+
+    DeviceInterface& mDevice;
+    float            mRate;
+    uint64_t         mPeriod;  ///< Nanoseconds.
+    std::mutex*      mSendMutex;
+
+    std::vector<Poll>                     mPolls;
+    std::vector<std::unique_ptr<DataSet>> mDataSets;
+
+    Callback mCallback = nullptr;
+    void*    mUserData = nullptr;
+
+    mutable std::mutex mMutex;  ///< Guards the stats and outstanding polls.
+    Stats              mStats;
+    uint64_t           mTick     = 0;
+    uint32_t           mSequence = 0;
+
+    std::thread       mThread;
+    std::atomic<bool> mStop{false};
+    int               mTimerFd = -1;
+    int               mWakeFd  = -1;
+};
+
+};  // namespace platform
+};  // namespace mip
@@ -0,0 +1,265 @@
+#include "reactor.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+
+#include <errno.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#include <sys/uio.h>
+
+namespace mip
+{
+namespace platform
+{
+
+////////////////////////////////////////////////////////////////////////////////
+///@brief Creates an empty reactor.
+///
+///@throws std::runtime_error if the epoll, timer, or wakeup descriptors
+///        could not be created.
+///
+Reactor::Reactor()
+{
+    mEpollFd = epoll_create1(EPOLL_CLOEXEC);
+    mTimerFd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC | TFD_NONBLOCK);
+    mWakeFd  = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+
+    struct epoll_event timerEvent = {};
+    timerEvent.events   = EPOLLIN;
+    timerEvent.data.ptr = &mTimerFd;
+
+    struct epoll_event wakeEvent = {};
+    wakeEvent.events   = EPOLLIN;
+    wakeEvent.data.ptr = &mWakeFd;
+
+    if( mEpollFd < 0 || mTimerFd < 0 || mWakeFd < 0 ||
+        epoll_ctl(mEpollFd, EPOLL_CTL_ADD, mTimerFd, &timerEvent) != 0 ||
+        epoll_ctl(mEpollFd, EPOLL_CTL_ADD, mWakeFd, &wakeEvent) != 0 ||
+        !setTickInterval(mTickInterval) )
+    {
+        for(int fd : { mEpollFd, mTimerFd, mWakeFd })
+        {
+            if( fd >= 0 )
+                close(fd);
+        }
+
+        throw std::runtime_error("Unable to create reactor");
+    }
+}
+
+Reactor::~Reactor()
+{
+    close(mWakeFd);
+    close(mTimerFd);
+    close(mEpollFd);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+///@brief Adds a device.
+///
+///@returns False if the device has no file descriptor, is already added, or
+///         the descriptor can't be polled.
+///
+bool Reactor::add(DeviceInterface& device)
+{
+    const Connection* connection = device.connection();
+    const int fd = connection ? connection->fileDescriptor() : -1;
+
+    if( fd < 0 )
+        return false;
+
+    if( std::any_of(mEntries.begin(), mEntries.end(), [&](const std::unique_ptr<Entry>& entry){ return entry->device == &device; }) )
+        return false;
+
+    std::unique_ptr<Entry> entry(new Entry{&device, fd});
+
+    struct epoll_event event = {};
+    event.events   = EPOLLIN;
+    event.data.ptr = entry.get();
+
+    if( epoll_ctl(mEpollFd, EPOLL_CTL_ADD, fd, &event) != 0 )
+        return false;
+
+    mEntries.push_back(std::move(entry));
+    return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+///@brief Removes a device. This may be called from within a callback.
+///
+///@returns False if the device wasn't added.
+///
+bool Reactor::remove(DeviceInterface& device)
+{
+    auto iter = std::find_if(mEntries.begin(), mEntries.end(), [&](const std::unique_ptr<Entry>& entry){ return entry->device == &device; });
+    if( iter == mEntries.end() )
+        return false;
+
+    epoll_ctl(mEpollFd, EPOLL_CTL_DEL, (*iter)->fd, nullptr);
+
+    // Events for this entry may still be pending in the current runOnce call,
+    // so it is only marked here and erased once they have been handled.
+    (*iter)->device = nullptr;
+
+    return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+///@brief Sets how often command queues are updated in the absence of data.
+///
+/// This bounds how late a command timeout may be detected.
+///
+///@param interval Milliseconds. Must be greater than 0.
+///
+bool Reactor::setTickInterval(Timeout interval)
+{
+    if( interval == 0 )
+        return false;
+
+    struct itimerspec spec;
+    spec.it_interval.tv_sec  = time_t(interval / 1000);
+    spec.it_interval.tv_nsec = long(interval % 1000) * 1000000;
+    spec.it_value            = spec.it_interval;
+
+    if( timerfd_settime(mTimerFd, 0, &spec, nullptr) != 0 )
+        return false;
+
+    mTickInterval = interval;
+    return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+///@brief Waits for activity and services it once.
+///
+///@param timeout
+///       Maximum time to wait in milliseconds, or -1 to wait indefinitely.
+///       Since the tick timer fires regularly, the wait never exceeds the
+///       tick interval by much.
+///
+///@returns The number of events handled, 0 on timeout, or -1 on error.
+///
+int Reactor::runOnce(int timeout)
+{
+    const int MAX_EVENTS = 64;
+    struct epoll_event events[MAX_EVENTS];
+
+    const int count = epoll_wait(mEpollFd, events, MAX_EVENTS, timeout);
+    if( count < 0 )
+        return (errno == EINTR) ? 0 : -1;
+
+    const Timestamp timestamp = getCurrentTimestamp();
+
+    for(int i=0; i<count; i++)
+    {
+        if( events[i].data.ptr == &mTimerFd )
+        {
+            uint64_t expirations;
+            if( read(mTimerFd, &expirations, sizeof(expirations)) > 0 )
+                tick(timestamp);
+        }
+        else if( events[i].data.ptr == &mWakeFd )
+        {
+            uint64_t value;
+            if( read(mWakeFd, &value, sizeof(value)) > 0 )
+                mStop = true;
+        }
+        else
+        {
+            Entry& entry = *static_cast<Entry*>(events[i].data.ptr);
+
+            if( entry.device && !service(entry, timestamp) )
+                disconnect(*entry.device);
+        }
+    }
+
+    mEntries.erase(std::remove_if(mEntries.begin(), mEntries.end(), [](const std::unique_ptr<Entry>& entry){ return entry->device == nullptr; }), mEntries.end());
+
+    return count;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+///@brief Services devices until stop() is called.
+///
+void Reactor::run()
+{
+    mStop = false;
+
+    while( !mStop )
+    {
+        if( runOnce(-1) < 0 )
+            break;
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+///@brief Makes run() return. May be called from any thread.
+///
+void Reactor::stop()
+{
+    const uint64_t one = 1;
+    ssize_t written = write(mWakeFd, &one, sizeof(one));
+    (void)written;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+///@brief Reads available data directly into the device's parser.
+///
+///@returns False if the connection failed or was closed.
+///
+bool Reactor::service(Entry& entry, Timestamp timestamp)
+{
+    C::mip_parser* parser = C::mip_interface_parser(entry.device);
+
+    // Read into both free segments at once, in case the free space wraps.
+    byte_ring_iov segments[2];
+    const unsigned int numSegments = C::mip_parser_get_write_iov(parser, segments);
+
+    struct iovec iov[2];
+    size_t maxCount = 0;
+    for(unsigned int i=0; i<numSegments; i++)
+    {
+        iov[i].iov_base = segments[i].ptr;
+        iov[i].iov_len  = segments[i].length;
+        maxCount += segments[i].length;
+    }
+
+    const ssize_t count = (numSegments > 0) ? readv(entry.fd, iov, int(numSegments)) : 0;
+
+    if( count < 0 )
+        return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+
+    // Readable with no data means end of file, e.g. a closed socket.
+    if( count == 0 && maxCount > 0 )
+        return false;
+
+    C::mip_parser_process_written(parser, size_t(count), timestamp, 0);
+    C::mip_cmd_queue_update(C::mip_interface_cmd_queue(entry.device), timestamp);
+
+    return true;
+}
+
+void Reactor::disconnect(DeviceInterface& device)
+{
+    remove(device);
+
+    if( mDisconnectCallback )
+        mDisconnectCallback(mUserData, device);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+///@brief Updates every command queue, so that timeouts are detected.
+///
+void Reactor::tick(Timestamp timestamp)
+{
+    for(std::unique_ptr<Entry>& entry : mEntries)
+    {
+        if( entry->device )
+            C::mip_cmd_queue_update(C::mip_interface_cmd_queue(entry->device), timestamp);
+    }
+}
+
+};  // namespace platform
+};  // namespace mip
@@ -0,0 +1,97 @@
+#pragma once
+
+#include <mip/mip_device.hpp>
+
+#include <memory>
+#include <vector>
+
+
+extern mip::Timestamp getCurrentTimestamp();
+
+namespace mip
+{
+namespace platform
+{
+
+////////////////////////////////////////////////////////////////////////////////
+///@brief Services many devices from a single thread using epoll.
+///
+/// Instead of calling DeviceInterface::update for each device in turn (each
+/// of which may wait on its own connection), the reactor waits on all of
+/// them at once. When a connection becomes readable, its data is read
+/// straight into the device's parser buffer and parsed, which dispatches the
+/// data callbacks and completes pending commands. A periodic timerfd tick
+/// updates every command queue so that command timeouts are detected even
+/// when a device goes quiet.
+///
+/// Each device's connection must provide a file descriptor (see
+/// Connection::fileDescriptor), as SerialConnection and TcpConnection do.
+///
+/// Commands should be started without blocking (e.g. with startCommand or a
+/// CommandScheduler) from the reactor's thread, typically in a data callback.
+/// Blocking commands also work from that thread, since they update only
+/// their own device while waiting, but other devices stall meanwhile.
+///
+///@code{.cpp}
+/// Reactor reactor;
+/// for(DeviceInterface& device : devices)
+///     reactor.add(device);
+///
+/// reactor.run();  // Until reactor.stop() is called.
+///@endcode
+///
+/// This class is only available on Linux.
+///
+class Reactor
+{
+public:
+    ///@brief Called when a device's connection fails or is closed. The device
+    ///       has already been removed from the reactor.
+    typedef void (*DisconnectCallback)(void* userData, DeviceInterface& device);
+
+    Reactor();
+    ~Reactor();
+
+    Reactor(const Reactor&) = delete;
+    Reactor& operator=(const Reactor&) = delete;
+
+    bool add(DeviceInterface& device);
+    bool remove(DeviceInterface& device);
+
+    size_t size() const { return mEntries.size(); }
+
+    bool setTickInterval(Timeout interval);
+    Timeout tickInterval() const { return mTickInterval; }
+
+    void setDisconnectCallback(DisconnectCallback callback, void* userData) { mDisconnectCallback = callback; mUserData = userData; }
+
+    int runOnce(int timeout);
+    void run();
+    void stop();
+
+private:
+    struct Entry
+    {
+        DeviceInterface* device;
+        int              fd;
+    };
+
+    bool service(Entry& entry, Timestamp timestamp);
+    void disconnect(DeviceInterface& device);
+    void tick(Timestamp timestamp);
+
+    int mEpollFd = -1;
+    int mTimerFd = -1;
+    int mWakeFd  = -1;
+
+    Timeout mTickInterval = 10;
+    bool    mStop = false;
+
+    std::vector<std::unique_ptr<Entry>> mEntries;
+
+    DisconnectCallback mDisconnectCallback = nullptr;
+    void*              mUserData           = nullptr;
+};
+
+};  // namespace platform
+};  // namespace mip
@@ -0,0 +1,710 @@
+#include "relay_server.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+#include <errno.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+
+namespace mip
+{
+namespace platform
+{
+
+RelayServer::Client::Client(RelayServer& server, unsigned int id, int fd, const Filter& filter) :
+    Endpoint{Kind::CLIENT, fd}, server(server), id(id), filter(filter),
+    parser(parseBuffer, sizeof(parseBuffer), server.mDevice.parser().timeout())
+{
+    parser.setCallback<Client, &Client::onPacket>(*this);
+}
+
+bool RelayServer::Client::onPacket(const Packet& packet, Timestamp timestamp)
+{
+    (void)timestamp;
+
+    server.onClientCommand(*this, packet);
+    return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+///@brief Creates a relay for a device, with no listeners yet.
+///
+///@param device
+///       The device to share. Its connection must provide a file descriptor.
+///@param bufferSize
+///       Size of the shared buffer of packets waiting to be sent to clients.
+///       A client which falls further behind is disconnected.
+///
+///@throws std::invalid_argument if the connection has no file descriptor.
+///@throws std::runtime_error if the epoll or wakeup descriptors could not be
+///        created.
+///
+RelayServer::RelayServer(DeviceInterface& device, size_t bufferSize) :
+    mDevice(device), mBuffer(std::max<size_t>(bufferSize, PACKET_LENGTH_MAX))
+{
+    const Connection* connection = device.connection();
+    const int deviceFd = connection ? connection->fileDescriptor() : -1;
+
+    if( deviceFd < 0 )
+        throw std::invalid_argument("The device connection has no file descriptor");
+
+    mDeviceEndpoint = Endpoint{Kind::DEVICE, deviceFd};
+
+    mEpollFd = epoll_create1(EPOLL_CLOEXEC);
+    mWakeFd  = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+
+    mWakeEndpoint = Endpoint{Kind::WAKE, mWakeFd};
+
+    struct epoll_event deviceEvent = {};
+    deviceEvent.events   = EPOLLIN;
+    deviceEvent.data.ptr = &mDeviceEndpoint;
+
+    struct epoll_event wakeEvent = {};
+    wakeEvent.events   = EPOLLIN;
+    wakeEvent.data.ptr = &mWakeEndpoint;
+
+    if( mEpollFd < 0 || mWakeFd < 0 ||
+        epoll_ctl(mEpollFd, EPOLL_CTL_ADD, deviceFd, &deviceEvent) != 0 ||
+        epoll_ctl(mEpollFd, EPOLL_CTL_ADD, mWakeFd, &wakeEvent) != 0 )
+    {
+        for(int fd : { mEpollFd, mWakeFd })
+        {
+            if( fd >= 0 )
+                close(fd);
+        }
+
+        throw std::runtime_error("Unable to create relay server");
+    }
+
+    mDevice.registerPacketCallback<RelayServer, &RelayServer::onDevicePacket>(mHandler, Dispatcher::ANY_DESCRIPTOR, false, this);
+}
+
+RelayServer::~RelayServer()
+{
+    mDevice.dispatcher().removeHandler(mHandler);
+
+    for(std::unique_ptr<Client>& client : mClients)
+    {
+        if( client->fd >= 0 )
+            close(client->fd);
+    }
+
+    for(std::unique_ptr<Listener>& listener : mListeners)
+    {
+        close(listener->fd);
+
+        if( !listener->path.empty() )
+            unlink(listener->path.c_str());
+    }
+
+    close(mWakeFd);
+    close(mEpollFd);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+///@brief Accepts clients on a Unix-domain stream socket.
+///
+/// An existing socket at path is removed first, e.g. one left behind by a
+/// previous relay which was killed. Any other kind of file is left alone and
+/// the call fails. The socket file is removed again when the relay is
+/// destroyed.
+///
+///@param path   File system path of the socket.
+///@param filter Initial filter of clients connecting to this socket.
+///
+bool RelayServer::listenUnix(const std::string& path, const Filter& filter)
+{
+    struct sockaddr_un address = {};
+    address.sun_family = AF_UNIX;
+
+    if( path.empty() || path.size() >= sizeof(address.sun_path) )
+        return false;
+
+    std::memcpy(address.sun_path, path.c_str(), path.size() + 1);
+
+    const int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if( fd < 0 )
+        return false;
+
+    // Only replace a stale socket, never a regular file or directory.
+    struct stat existing;
+    if( lstat(path.c_str(), &existing) == 0 && S_ISSOCK(existing.st_mode) )
+        unlink(path.c_str());
+
+    if( bind(fd, reinterpret_cast<const struct sockaddr*>(&address), sizeof(address)) != 0 || !addListener(fd, filter, path) )
+    {
+        close(fd);
+        return false;
+    }
+
+    return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+///@brief Accepts clients on a TCP port.
+///
+///@param port    Port number to listen on.
+///@param address IPv4 address of the interface to listen on, e.g.
+///               "127.0.0.1" for local clients only. Null for all interfaces.
+///@param filter  Initial filter of clients connecting to this port.
+///
+bool RelayServer::listenTcp(uint16_t port, const char* address, const Filter& filter)
+{
+    struct sockaddr_in socketAddress = {};
+    socketAddress.sin_family      = AF_INET;
+    socketAddress.sin_port        = htons(port);
+    socketAddress.sin_addr.s_addr = htonl(INADDR_ANY);
+
+    if( address && inet_pton(AF_INET, address, &socketAddress.sin_addr) != 1 )
+        return false;
+
+    const int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, IPPROTO_TCP);
+    if( fd < 0 )
+        return false;
+
+    const int reuse = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+    if( bind(fd, reinterpret_cast<const struct sockaddr*>(&socketAddress), sizeof(socketAddress)) != 0 || !addListener(fd, filter, std::string()) )
+    {
+        close(fd);
+        return false;
+    }
+
+    return true;
+}
+
+bool RelayServer::addListener(int fd, const Filter& filter, const std::string& path)
+{
+    if( listen(fd, 16) != 0 )
+        return false;
+
+    std::unique_ptr<Listener> listener(new Listener);
+    listener->kind   = Kind::LISTENER;
+    listener->fd     = fd;
+    listener->filter = filter;
+    listener->path   = path;
+
+    struct epoll_event event = {};
+    event.events   = EPOLLIN;
+    event.data.ptr = static_cast<Endpoint*>(listener.get());
+
+    if( epoll_ctl(mEpollFd, EPOLL_CTL_ADD, fd, &event) != 0 )
+        return false;
+
+    mListeners.push_back(std::move(listener));
+    return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+///@brief Changes which descriptor sets are sent to a client.
+///
+///@returns False if there is no such client.
+///
+bool RelayServer::setClientFilter(unsigned int clientId, const Filter& filter)
+{
+    Client* client = findClient(clientId);
+    if( !client )
+        return false;
+
+    client->filter = filter;
+    return true;
+}
+
+size_t RelayServer::numClients() const
+{
+    return std::count_if(mClients.begin(), mClients.end(), [](const std::unique_ptr<Client>& client){ return client->fd >= 0; });
+}
+
+////////////////////////////////////////////////////////////////////////////////
+///@brief Waits for activity and services it once.
+///
+///@param timeout
+///       Maximum time to wait in milliseconds, or -1 to wait indefinitely.
+///       The wait ends early when the outstanding command times out.
+///
+///@returns The number of events handled, 0 on timeout, or -1 if the device
+///         connection failed or on error.
+///
+int RelayServer::runOnce(int timeout)
+{
+    if( mCommandPending )
+    {
+        const int remaining = std::max(int(mCommandDeadline - getCurrentTimestamp()), 0);
+        if( timeout < 0 || remaining < timeout )
+            timeout = remaining;
+    }
+
+    const int MAX_EVENTS = 64;
+    struct epoll_event events[MAX_EVENTS];
+
+    const int count = epoll_wait(mEpollFd, events, MAX_EVENTS, timeout);
+    if( count < 0 )
+        return (errno == EINTR) ? 0 : -1;
+
+    for(int i=0; i<count; i++)
+    {
+        Endpoint& endpoint = *static_cast<Endpoint*>(events[i].data.ptr);
+
+        switch( endpoint.kind )
+        {
+        case Kind::DEVICE:
+            // Dispatches each packet to onDevicePacket. A hangup or error
+            // (e.g. an unplugged adapter) is reported by every wait, so
+            // stop instead of spinning on it.
+            if( !mDevice.update(false) || (events[i].events & (EPOLLHUP | EPOLLERR)) )
+            {
+                mDeviceFailed = true;
+                mStop = true;
+            }
+            break;
+
+        case Kind::WAKE:
+        {
+            uint64_t value;
+            if( read(mWakeFd, &value, sizeof(value)) > 0 )
+                mStop = true;
+            break;
+        }
+        case Kind::LISTENER:
+            accept(static_cast<Listener&>(endpoint));
+            break;
+
+        case Kind::CLIENT:
+        {
+            Client& client = static_cast<Client&>(endpoint);
+
+            // Closed earlier in this call.
+            if( client.fd < 0 )
+                break;
+
+            if( (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR)) && !receive(client) )
+                closeClient(client);
+            else if( (events[i].events & EPOLLOUT) && !flush(client) )
+                closeClient(client);
+            break;
+        }
+        }
+    }
+
+    const Timestamp now = getCurrentTimestamp();
+
+    // Give up on the outstanding command; the client will time out on its own.
+    if( mCommandPending && int(now - mCommandDeadline) >= 0 )
+    {
+        mCommands.pop_front();
+        mCommandPending = false;
+    }
+
+    sendNextCommand(now);
+
+    flushAll();
+    trim();
+
+    mClients.erase(std::remove_if(mClients.begin(), mClients.end(), [](const std::unique_ptr<Client>& client){ return client->fd < 0; }), mClients.end());
+
+    return mDeviceFailed ? -1 : count;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+///@brief Relays data until stop() is called or the device connection fails.
+///
+///@returns False if the device connection failed.
+///
+bool RelayServer::run()
+{
+    mStop = false;
+
+    while( !mStop )
+    {
+        if( runOnce(-1) < 0 )
+            return false;
+    }
+
+    return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+///@brief Makes run() return. May be called from any thread or a signal
+///       handler.
+///
+void RelayServer::stop()
+{
+    const uint64_t one = 1;
+    ssize_t written = write(mWakeFd, &one, sizeof(one));
+    (void)written;
+}
+
+void RelayServer::accept(Listener& listener)
+{
+    const int fd = accept4(listener.fd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+    if( fd < 0 )
+        return;
+
+    // Replies to small commands shouldn't wait for Nagle's algorithm. This
+    // fails harmlessly on Unix-domain sockets.
+    const int noDelay = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof(noDelay));
+
+    std::unique_ptr<Client> client(new Client(*this, mNextClientId, fd, listener.filter));
+
+    // Start with the next packet rather than whatever is still buffered.
+    client->cursor = mFirstRecord + mRecords.size();
+
+    struct epoll_event event = {};
+    event.events   = EPOLLIN;
+    event.data.ptr = static_cast<Endpoint*>(client.get());
+
+    if( epoll_ctl(mEpollFd, EPOLL_CTL_ADD, fd, &event) != 0 )
+    {
+        close(fd);
+        return;
+    }
+
+    mNextClientId++;
+    mClients.push_back(std::move(client));
+
+    if( mClientCallback )
+        mClientCallback(mUserData, mClients.back()->id, true);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+///@brief Reads commands from a client into its parser.
+///
+///@returns False if the client disconnected or an error occurred.
+///
+bool RelayServer::receive(Client& client)
+{
+    byte_ring_iov segments[2];
+    const unsigned int numSegments = C::mip_parser_get_write_iov(&client.parser, segments);
+
+    struct iovec iov[2];
+    for(unsigned int i=0; i<numSegments; i++)
+    {
+        iov[i].iov_base = segments[i].ptr;
+        iov[i].iov_len  = segments[i].length;
+    }
+
+    const ssize_t count = readv(client.fd, iov, int(numSegments));
+
+    if( count < 0 )
+        return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+
+    if( count == 0 )
+        return false;
+
+    // Dispatches each command packet to onClientCommand.
+    C::mip_parser_process_written(&client.parser, size_t(count), getCurrentTimestamp(), 0);
+
+    return true;
+}
+
+void RelayServer::closeClient(Client& client)
+{
+    epoll_ctl(mEpollFd, EPOLL_CTL_DEL, client.fd, nullptr);
+    close(client.fd);
+    client.fd = -1;
+
+    // Drop its queued commands. A reply to its outstanding command, if any,
+    // is routed to the old id and therefore discarded.
+    const auto first = mCommands.begin() + (mCommandPending ? 1 : 0);
+    mCommands.erase(std::remove_if(first, mCommands.end(), [&](const Command& command){ return command.clientId == client.id; }), mCommands.end());
+
+    if( mClientCallback )
+        mClientCallback(mUserData, client.id, false);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+///@brief Adds a packet from the device to the shared buffer.
+///
+/// If it's the reply to the outstanding command, it's routed to that
+/// command's client and the next command is sent.
+///
+void RelayServer::onDevicePacket(const Packet& packet, Timestamp timestamp)
+{
+    unsigned int clientId = NO_CLIENT;
+    bool replied = false;
+
+    if( mCommandPending && isReplyTo(packet, mCommands.front()) )
+    {
+        clientId = mCommands.front().clientId;
+        mCommands.pop_front();
+        mCommandPending = false;
+        replied = true;
+    }
+
+    append(packet.pointer(), packet.totalLength(), packet.descriptorSet(), clientId);
+
+    if( replied )
+        sendNextCommand(timestamp);
+}
+
+void RelayServer::onClientCommand(Client& client, const Packet& packet)
+{
+    // Clients may only send commands.
+    if( !isCommandDescriptorSet(packet.descriptorSet()) )
+        return;
+
+    Command command;
+    command.clientId      = client.id;
+    command.descriptorSet = packet.descriptorSet();
+    command.packet.assign(packet.pointer(), packet.pointer() + packet.totalLength());
+
+    for(const Field& field : packet)
+        command.fieldDescriptors.push_back(field.fieldDescriptor());
+
+    if( command.fieldDescriptors.empty() )
+        return;
+
+    mCommands.push_back(std::move(command));
+}
+
+////////////////////////////////////////////////////////////////////////////////
+///@brief Determines if a packet contains an ack or nack for any field of a
+///       command packet.
+///
+bool RelayServer::isReplyTo(const Packet& packet, const Command& command) const
+{
+    if( packet.descriptorSet() != command.descriptorSet )
+        return false;
+
+    for(const Field& field : packet)
+    {
+        if( field.fieldDescriptor() != C::MIP_REPLY_DESCRIPTOR || field.payloadLength() < 1 )
+            continue;
+
+        if( std::find(command.fieldDescriptors.begin(), command.fieldDescriptors.end(), field.payload(0)) != command.fieldDescriptors.end() )
+            return true;
+    }
+
+    return false;
+}
+
+void RelayServer::sendNextCommand(Timestamp now)
+{
+    while( !mCommandPending && !mCommands.empty() )
+    {
+        const Command& command = mCommands.front();
+
+        if( !mDevice.sendToDevice(command.packet.data(), command.packet.size()) )
+        {
+            mCommands.pop_front();
+            continue;
+        }
+
+        mCommandPending  = true;
+        mCommandDeadline = now + mCommandTimeout;
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+///@brief Copies a packet into the shared buffer, making room if necessary.
+///
+/// Clients which still need to send the oldest packets are disconnected.
+///
+///@param data
+///@param length
+///@param descriptorSet
+///@param clientId
+///       The only client to receive the packet, or NO_CLIENT to send it to
+///       all clients with a matching filter.
+///
+void RelayServer::append(const uint8_t* data, uint16_t length, uint8_t descriptorSet, unsigned int clientId)
+{
+    const size_t capacity = mBuffer.size();
+
+    while( !mRecords.empty() && mHead + length - mRecords.front().offset > capacity )
+    {
+        for(std::unique_ptr<Client>& client : mClients)
+        {
+            if( client->fd < 0 || client->cursor != mFirstRecord )
+                continue;
+
+            // A partly sent packet can't be skipped without corrupting the
+            // stream, even if the client's filter no longer wants it.
+            if( sending(*client, mFirstRecord) )
+                closeClient(*client);
+            else
+            {
+                client->cursor++;
+                client->partial = 0;
+            }
+        }
+
+        mRecords.pop_front();
+        mFirstRecord++;
+    }
+
+    const size_t start = size_t(mHead % capacity);
+    const size_t first = std::min<size_t>(length, capacity - start);
+
+    std::memcpy(&mBuffer[start], data, first);
+    std::memcpy(&mBuffer[0], data + first, length - first);
+
+    mRecords.push_back(Record{mHead, length, descriptorSet, clientId});
+    mHead += length;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+///@brief Sends as much buffered data to a client as its socket accepts.
+///
+/// The data is sent straight from the shared buffer, with packets the client
+/// doesn't want left out.
+///
+///@returns False if the client disconnected or an error occurred.
+///
+bool RelayServer::flush(Client& client)
+{
+    const size_t   capacity = mBuffer.size();
+    const uint64_t end      = mFirstRecord + mRecords.size();
+
+    bool blocked = false;
+
+    while( !blocked )
+    {
+        const int MAX_IOV = 64;
+        struct iovec iov[MAX_IOV];
+        int count = 0;
+
+        size_t skip = client.partial;
+
+        for(uint64_t seq = client.cursor; seq < end && count <= MAX_IOV-2; seq++)
+        {
+            const Record& record = mRecords[size_t(seq - mFirstRecord)];
+            if( !sending(client, seq) )
+                continue;
+
+            const size_t start  = size_t((record.offset + skip) % capacity);
+            const size_t length = record.length - skip;
+            const size_t first  = std::min(length, capacity - start);
+            skip = 0;
+
+            // Merge with the previous packet when contiguous.
+            if( count > 0 && static_cast<uint8_t*>(iov[count-1].iov_base) + iov[count-1].iov_len == &mBuffer[start] )
+                iov[count-1].iov_len += first;
+            else
+                iov[count++] = { &mBuffer[start], first };
+
+            if( first < length )
+                iov[count++] = { &mBuffer[0], length - first };
+        }
+
+        if( count == 0 )
+        {
+            // Nothing left but unwanted packets.
+            client.cursor  = end;
+            client.partial = 0;
+            break;
+        }
+
+        struct msghdr message = {};
+        message.msg_iov    = iov;
+        message.msg_iovlen = size_t(count);
+
+        ssize_t result = sendmsg(client.fd, &message, MSG_NOSIGNAL | MSG_DONTWAIT);
+
+        if( result < 0 )
+        {
+            if( errno != EAGAIN && errno != EWOULDBLOCK )
+                return false;
+
+            result = 0;
+        }
+
+        size_t sent = size_t(result);
+
+        size_t total = 0;
+        for(int i=0; i<count; i++)
+            total += iov[i].iov_len;
+
+        blocked = (sent < total);
+
+        while( client.cursor < end )
+        {
+            const Record& record = mRecords[size_t(client.cursor - mFirstRecord)];
+
+            if( sending(client, client.cursor) )
+            {
+                const size_t remaining = record.length - client.partial;
+                if( sent < remaining )
+                {
+                    client.partial += sent;
+                    break;
+                }
+
+                sent -= remaining;
+            }
+
+            client.cursor++;
+            client.partial = 0;
+        }
+    }
+
+    // Wait for the socket to become writable only while data is left over.
+    if( blocked != client.writing )
+    {
+        struct epoll_event event = {};
+        event.events   = blocked ? (EPOLLIN | EPOLLOUT) : EPOLLIN;
+        event.data.ptr = static_cast<Endpoint*>(&client);
+
+        if( epoll_ctl(mEpollFd, EPOLL_CTL_MOD, client.fd, &event) != 0 )
+            return false;
+
+        client.writing = blocked;
+    }
+
+    return true;
+}
+
+void RelayServer::flushAll()
+{
+    for(std::unique_ptr<Client>& client : mClients)
+    {
+        if( client->fd >= 0 && !client->writing && !flush(*client) )
+            closeClient(*client);
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+///@brief Discards packets which every client has already sent.
+///
+void RelayServer::trim()
+{
+    uint64_t oldest = mFirstRecord + mRecords.size();
+
+    for(const std::unique_ptr<Client>& client : mClients)
+    {
+        if( client->fd >= 0 )
+            oldest = std::min(oldest, client->cursor);
+    }
+
+    while( mFirstRecord < oldest )
+    {
+        mRecords.pop_front();
+        mFirstRecord++;
+    }
+}
+
+RelayServer::Client* RelayServer::findClient(unsigned int clientId)
+{
+    for(std::unique_ptr<Client>& client : mClients)
+    {
+        if( client->id == clientId && client->fd >= 0 )
+            return client.get();
+    }
+
+    return nullptr;
+}
+
+};  // namespace platform
+};  // namespace mip
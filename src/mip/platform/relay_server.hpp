@@ -0,0 +1,207 @@
+#pragma once
+
+#include <mip/mip_device.hpp>
+
+#include <bitset>
+#include <deque>
+#include <memory>
+#include <string>
+#include <vector>
+
+
+extern mip::Timestamp getCurrentTimestamp();
+
+namespace mip
+{
+namespace platform
+{
+
+////////////////////////////////////////////////////////////////////////////////
+///@brief Shares one device with many local clients over Unix-domain and TCP
+///       sockets.
+///
+/// Only one process can own a serial port. The relay owns it instead and
+/// lets any number of clients connect. Each client receives the raw MIP
+/// stream from the device, as if it were connected directly, and may send
+/// commands. A client can therefore simply use a TcpConnection (or a Unix
+/// socket connection) in place of a SerialConnection.
+///
+/// Every packet from the device is copied once, into a shared ring buffer,
+/// and sent to each client straight from there. No per-client copies are
+/// made and the stream is not parsed again for each client. Clients which
+/// fall behind by more than the buffer size are disconnected.
+///
+/// Each client has a descriptor set filter, set from the listener it
+/// connected to or through the client callback. Packets outside the filter
+/// are not sent to the client.
+///
+/// Commands from all clients go through a single queue, and only one command
+/// packet is outstanding at the device at a time. When the reply (an ack or
+/// nack for one of the command's fields) arrives, it's sent only to the
+/// client which sent the command, and the next command is sent. If no reply
+/// arrives within the command timeout, the next command is sent anyway.
+///
+///@code{.cpp}
+/// RelayServer relay(device);
+/// relay.listenUnix("/run/mip.sock");
+/// relay.listenTcp(5000, "127.0.0.1");
+/// relay.run();  // Until relay.stop() is called or the device fails.
+///@endcode
+///
+/// The device's connection must provide a file descriptor (see
+/// Connection::fileDescriptor). The device is read with
+/// DeviceInterface::update, so packet and field callbacks registered on the
+/// device still work. Nothing else should send commands to the device while
+/// the relay is running.
+///
+/// This class is only available on Linux.
+///
+class RelayServer
+{
+public:
+    ///@brief Selects which descriptor sets are sent to a client.
+    ///
+    /// Command replies are always sent to the client which sent the
+    /// command, regardless of its filter.
+    ///
+    struct Filter
+    {
+        std::bitset<256> descriptorSets;
+
+        Filter() { descriptorSets.set(); }  ///< Allows every descriptor set.
+
+        void clear() { descriptorSets.reset(); }
+        void allow(uint8_t descriptorSet) { descriptorSets.set(descriptorSet); }
+        bool allows(uint8_t descriptorSet) const { return descriptorSets.test(descriptorSet); }
+    };
+
+    ///@brief Called when a client connects or disconnects.
+    ///
+    /// When a client connects, its filter (initially the listener's) may be
+    /// changed with setClientFilter.
+    ///
+    typedef void (*ClientCallback)(void* userData, unsigned int clientId, bool connected);
+
+    explicit RelayServer(DeviceInterface& device, size_t bufferSize=256*1024);
+    ~RelayServer();
+
+    RelayServer(const RelayServer&) = delete;
+    RelayServer& operator=(const RelayServer&) = delete;
+
+    bool listenUnix(const std::string& path, const Filter& filter=Filter());
+    bool listenTcp(uint16_t port, const char* address=nullptr, const Filter& filter=Filter());
+
+    bool setClientFilter(unsigned int clientId, const Filter& filter);
+    void setClientCallback(ClientCallback callback, void* userData) { mClientCallback = callback; mUserData = userData; }
+
+    void setCommandTimeout(Timeout timeout) { mCommandTimeout = timeout; }
+    Timeout commandTimeout() const { return mCommandTimeout; }
+
+    size_t numClients() const;
+
+    int runOnce(int timeout);
+    bool run();
+    void stop();
+
+private:
+    enum class Kind { DEVICE, WAKE, LISTENER, CLIENT };
+
+    struct Endpoint
+    {
+        Kind kind;
+        int  fd;
+    };
+
+    struct Listener : Endpoint
+    {
+        Filter      filter;
+        std::string path;  ///< Unix socket path, removed on destruction.
+    };
+
+    struct Client : Endpoint
+    {
+        Client(RelayServer& server, unsigned int id, int fd, const Filter& filter);
+
+        bool onPacket(const Packet& packet, Timestamp timestamp);
+
+        RelayServer& server;
+        unsigned int id;
+        Filter       filter;
+        bool         writing = false;  ///< True while waiting for the socket to become writable.
+
+        uint64_t cursor  = 0;  ///< Sequence number of the next record to send.
+        size_t   partial = 0;  ///< Bytes of that record which were already sent.
+
+        uint8_t parseBuffer[1024];
+        Parser  parser;
+    };
+
+    ///@brief A packet in the shared buffer.
+    struct Record
+    {
+        uint64_t     offset;         ///< Position in the stream of all packets.
+        uint16_t     length;
+        uint8_t      descriptorSet;
+        unsigned int clientId;       ///< NO_CLIENT to send to every client allowing descriptorSet.
+    };
+
+    ///@brief A command packet waiting to be sent or awaiting its reply.
+    struct Command
+    {
+        unsigned int         clientId;
+        uint8_t              descriptorSet;
+        std::vector<uint8_t> fieldDescriptors;
+        std::vector<uint8_t> packet;
+    };
+
+    static const unsigned int NO_CLIENT = 0;
+
+    bool addListener(int fd, const Filter& filter, const std::string& path);
+    void accept(Listener& listener);
+    bool receive(Client& client);
+    void closeClient(Client& client);
+
+    void onDevicePacket(const Packet& packet, Timestamp timestamp);
+    void onClientCommand(Client& client, const Packet& packet);
+    bool isReplyTo(const Packet& packet, const Command& command) const;
+    void sendNextCommand(Timestamp now);
+
+    void append(const uint8_t* data, uint16_t length, uint8_t descriptorSet, unsigned int clientId);
+    bool wants(const Client& client, const Record& record) const { return record.clientId == client.id || (record.clientId == NO_CLIENT && client.filter.allows(record.descriptorSet)); }
+    bool sending(const Client& client, uint64_t seq) const { return (seq == client.cursor && client.partial > 0) || wants(client, mRecords[size_t(seq - mFirstRecord)]); }  ///< Finishes a partly sent packet even if the filter changed.
+    bool flush(Client& client);
+    void flushAll();
+    void trim();
+
+    Client* findClient(unsigned int clientId);
+
+    DeviceInterface&        mDevice;
+    DispatchHandler         mHandler;
+
+    int      mEpollFd = -1;
+    int      mWakeFd  = -1;
+    Endpoint mDeviceEndpoint;
+    Endpoint mWakeEndpoint;
+    bool     mStop = false;
+    bool     mDeviceFailed = false;
+
+    std::vector<std::unique_ptr<Listener>> mListeners;
+    std::vector<std::unique_ptr<Client>>   mClients;
+    unsigned int                           mNextClientId = 1;
+
+    std::vector<uint8_t> mBuffer;                 ///< Shared ring of packets from the device.
+    uint64_t             mHead = 0;               ///< Stream position of the next packet.
+    std::deque<Record>   mRecords;
+    uint64_t             mFirstRecord = 0;        ///< Sequence number of mRecords.front().
+
+    std::deque<Command> mCommands;                ///< The front one is at the device if mCommandPending.
+    bool                mCommandPending = false;
+    Timestamp           mCommandDeadline = 0;
+    Timeout             mCommandTimeout  = 1000;
+
+    ClientCallback mClientCallback = nullptr;
+    void*          mUserData       = nullptr;
+};
+
+};  // namespace platform
+};  // namespace mip
@@ -0,0 +1,417 @@
+#include "replay_connection.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+#include <stdexcept>
+#include <thread>
+
+namespace mip
+{
+namespace platform
+{
+
+////////////////////////////////////////////////////////////////////////////////
+///@brief Opens a recording for replay.
+///
+///@param dataFile
+///       File containing the raw bytes received from the device.
+///@param timestampFile
+///       File containing the receive timestamps, or empty to replay the data
+///       untimed.
+///
+///@throws std::runtime_error if either file can't be read or the timestamp
+///        file is malformed.
+///
+ReplayConnection::ReplayConnection(const std::string& dataFile, const std::string& timestampFile) :
+    mData(dataFile, std::ios::binary),
+    mCommandParser(mCommandBuffer, sizeof(mCommandBuffer), 100)
+{
+    if( !mData )
+        throw std::runtime_error("Unable to open replay data file '" + dataFile + "'");
+
+    mData.seekg(0, std::ios::end);
+    mDataSize = uint64_t(mData.tellg());
+    mData.seekg(0, std::ios::beg);
+
+    if( !timestampFile.empty() )
+    {
+        std::ifstream file(timestampFile);
+        if( !file )
+            throw std::runtime_error("Unable to open replay timestamp file '" + timestampFile + "'");
+
+        loadTimestamps(file);
+        mTimed = true;
+        mLastTimestamp = mChunks.front().timestamp;
+    }
+    else
+        mChunks.push_back(Chunk{0, 0});  // All of the data as one untimed chunk.
+
+    mCommandParser.setCallback<ReplayConnection, &ReplayConnection::onCommand>(*this);
+}
+
+void ReplayConnection::loadTimestamps(std::ifstream& file)
+{
+    std::string line;
+    unsigned int lineNumber = 0;
+
+    while( std::getline(file, line) )
+    {
+        lineNumber++;
+
+        const size_t start = line.find_first_not_of(" \t\r");
+        if( start == std::string::npos || line[start] == '#' )
+            continue;
+
+        const char* text = line.c_str() + start;
+        char* end;
+
+        Chunk chunk;
+        chunk.offset = std::strtoull(text, &end, 10);
+        const bool haveOffset = (end != text);
+        text = end;
+        chunk.timestamp = std::strtoull(text, &end, 10);
+
+        if( !haveOffset || end == text || chunk.offset > mDataSize || (!mChunks.empty() && chunk.offset < mChunks.back().offset) )
+            throw std::runtime_error("Invalid line " + std::to_string(lineNumber) + " in replay timestamp file");
+
+        if( mChunks.empty() )
+        {
+            // Bytes before the first entry are treated as received with it.
+            chunk.offset = 0;
+        }
+        else
+        {
+            // Keep time monotonic if the recording host's clock stepped back.
+            chunk.timestamp = std::max(chunk.timestamp, mChunks.back().timestamp);
+        }
+
+        mChunks.push_back(chunk);
+    }
+
+    if( mChunks.empty() )
+        throw std::runtime_error("The replay timestamp file is empty");
+}
+
+////////////////////////////////////////////////////////////////////////////////
+///@brief Sets how fast the recording is replayed.
+///
+/// May be changed at any time; the replay continues from the current replay
+/// time.
+///
+///@param pacing
+///@param speed
+///       Replay speed for Pacing::SCALED, e.g. 10 for ten times real time.
+///       Ignored for the other modes.
+///
+///@throws std::invalid_argument if the speed is not positive.
+///
+void ReplayConnection::setPacing(Pacing pacing, double speed)
+{
+    if( pacing == Pacing::SCALED && !(speed > 0) )
+        throw std::invalid_argument("The replay speed must be positive");
+
+    if( mStarted )
+    {
+        mLastTimestamp = std::max(mLastTimestamp, replayTime());
+        anchor();
+    }
+
+    mPacing = pacing;
+    mSpeed  = (pacing == Pacing::SCALED) ? speed : 1.0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+///@brief Scripts the reply to a command.
+///
+/// Every field with the given descriptors in a packet sent to the device is
+/// answered with an ack/nack field containing the result. If a response
+/// descriptor is given and the result is an ack, the response field follows.
+///
+///@param descriptorSet
+///@param fieldDescriptor
+///       Command to reply to.
+///@param result
+///       Ack or nack code.
+///@param responseDescriptor
+///       Field descriptor of the response, or 0 if there is none.
+///@param response
+///       Response payload.
+///@param responseLength
+///
+///@throws std::invalid_argument if the response doesn't fit in a packet.
+///
+void ReplayConnection::setReply(uint8_t descriptorSet, uint8_t fieldDescriptor, CmdResult result, uint8_t responseDescriptor, const uint8_t* response, size_t responseLength)
+{
+    if( responseLength > C::MIP_PACKET_PAYLOAD_LENGTH_MAX - 2*C::MIP_FIELD_HEADER_LENGTH - 2 )
+        throw std::invalid_argument("The scripted response is too long");
+
+    Reply& reply = mReplies[replyKey(descriptorSet, fieldDescriptor)];
+
+    reply.result             = result;
+    reply.responseDescriptor = responseDescriptor;
+    reply.response.assign(response, response + responseLength);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+///@brief Returns the current time on the recording's time base.
+///
+/// This is the timestamp of the latest data returned, advanced by the
+/// elapsed wall time (scaled by the speed) unless replaying as fast as
+/// possible.
+///
+Timestamp ReplayConnection::replayTime() const
+{
+    if( !mTimed )
+        return getCurrentTimestamp();
+
+    if( !mStarted || mPacing == Pacing::AS_FAST_AS_POSSIBLE )
+        return mLastTimestamp;
+
+    const std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - mWallStart;
+
+    return mReplayStart + Timestamp(elapsed.count() * mSpeed);
+}
+
+void ReplayConnection::anchor()
+{
+    mStarted     = true;
+    mWallStart   = std::chrono::steady_clock::now();
+    mReplayStart = mLastTimestamp;
+}
+
+bool ReplayConnection::recvFromDevice(uint8_t* buffer, size_t max_length, size_t* length_out, mip::Timestamp* timestamp)
+{
+    const byte_ring_iov segment = {buffer, max_length};
+
+    return recvFromDeviceV(&segment, 1, length_out, timestamp);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+///@brief Returns the next chunk of recorded data once it's due, or any
+///       pending replies to commands.
+///
+/// Waits up to the read timeout for the next chunk. Each call returns bytes
+/// from one chunk only, so that every byte keeps its recorded timestamp.
+///
+///@returns False at the end of the recording.
+///
+bool ReplayConnection::recvFromDeviceV(const byte_ring_iov* segments, unsigned int count, size_t* length_out, mip::Timestamp* timestamp)
+{
+    *length_out = 0;
+
+    if( !mPendingReplies.empty() )
+    {
+        size_t length = 0;
+        for(unsigned int i=0; i<count && length < mPendingReplies.size(); i++)
+        {
+            const size_t n = std::min(segments[i].length, mPendingReplies.size() - length);
+            std::copy_n(mPendingReplies.data() + length, n, segments[i].ptr);
+            length += n;
+        }
+        mPendingReplies.erase(mPendingReplies.begin(), mPendingReplies.begin() + length);
+
+        mLastTimestamp = std::max(mLastTimestamp, replayTime());
+
+        *length_out = length;
+        *timestamp  = mLastTimestamp;
+        return true;
+    }
+
+    if( !mTimed )
+    {
+        if( mChunk >= mChunks.size() )
+            return false;
+
+        *length_out = readChunk(segments, count);
+        *timestamp  = getCurrentTimestamp();
+        return true;
+    }
+
+    // Skip chunks which contain no data (duplicate offsets).
+    while( mChunk + 1 < mChunks.size() && mChunks[mChunk + 1].offset <= mPosition )
+        mChunk++;
+
+    if( mChunk >= mChunks.size() || mPosition >= mDataSize )
+        return false;
+
+    if( !mStarted )
+        anchor();
+
+    const Timestamp due = mChunks[mChunk].timestamp;
+
+    if( mPacing != Pacing::AS_FAST_AS_POSSIBLE )
+    {
+        Timestamp now = replayTime();
+
+        if( due > now )
+        {
+            const double wait = std::min(double(due - now) / mSpeed, double(mReadTimeout));
+            std::this_thread::sleep_for(std::chrono::duration<double, std::milli>(wait));
+
+            now = replayTime();
+            if( due > now )
+            {
+                mLastTimestamp = std::max(mLastTimestamp, now);
+                *timestamp = mLastTimestamp;
+                return true;
+            }
+        }
+    }
+
+    *length_out = readChunk(segments, count);
+
+    mLastTimestamp = std::max(mLastTimestamp, due);
+    *timestamp = mLastTimestamp;
+    return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+///@brief Reads the rest of the current chunk, or as much as fits.
+///
+///@returns The number of bytes read.
+///
+size_t ReplayConnection::readChunk(const byte_ring_iov* segments, unsigned int count)
+{
+    const uint64_t end = (mChunk + 1 < mChunks.size()) ? mChunks[mChunk + 1].offset : mDataSize;
+
+    size_t length = 0;
+    for(unsigned int i=0; i<count && mPosition + length < end; i++)
+    {
+        const size_t n = size_t(std::min<uint64_t>(segments[i].length, end - mPosition - length));
+        mData.read(reinterpret_cast<char*>(segments[i].ptr), std::streamsize(n));
+        length += size_t(mData.gcount());
+
+        if( size_t(mData.gcount()) < n )
+        {
+            // The file was truncated after it was opened.
+            mPosition = mDataSize = mPosition + length;
+            mChunk = mChunks.size();
+            return length;
+        }
+    }
+
+    mPosition += length;
+    if( mPosition >= end )
+        mChunk++;
+
+    return length;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+///@brief Accepts data sent to the device and queues any scripted replies.
+///
+///@returns True.
+///
+bool ReplayConnection::sendToDevice(const uint8_t* data, size_t length)
+{
+    // Dispatches each command packet to onCommand.
+    mCommandParser.parse(data, length, replayTime(), 0);
+    return true;
+}
+
+bool ReplayConnection::onCommand(const Packet& packet, Timestamp timestamp)
+{
+    (void)timestamp;
+
+    if( packet.isData() )
+        return true;
+
+    mCommands++;
+
+    uint8_t buffer[PACKET_LENGTH_MAX];
+    Packet reply(buffer, sizeof(buffer), packet.descriptorSet());
+    bool replied = false;
+
+    for(const Field& field : packet)
+    {
+        const auto iter = mReplies.find(replyKey(packet.descriptorSet(), field.fieldDescriptor()));
+
+        Reply ack = {CmdResult::ACK_OK, 0, {}};
+        if( iter != mReplies.end() )
+            ack = iter->second;
+        else if( mReplyMode == ReplyMode::SWALLOW )
+            continue;
+
+        const uint8_t ackPayload[2] = { field.fieldDescriptor(), uint8_t(ack.result.value) };
+        if( !reply.addField(C::MIP_REPLY_DESCRIPTOR, ackPayload, sizeof(ackPayload)) )
+            break;
+
+        if( ack.responseDescriptor != 0 && ack.result.isAck() )
+            reply.addField(ack.responseDescriptor, ack.response.data(), ack.response.size());
+
+        replied = true;
+    }
+
+    if( replied )
+    {
+        reply.finalize();
+        mPendingReplies.insert(mPendingReplies.end(), reply.pointer(), reply.pointer() + reply.totalLength());
+    }
+
+    return true;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+///@brief Starts recording the data received through a connection.
+///
+///@param connection
+///       The connection to the device. It must outlive this object.
+///@param dataFile
+///       File to write the received bytes to. Overwritten if it exists.
+///@param timestampFile
+///       File to write the receive timestamps to. Overwritten if it exists.
+///
+///@throws std::runtime_error if either file can't be created.
+///
+RecordingConnection::RecordingConnection(Connection& connection, const std::string& dataFile, const std::string& timestampFile) :
+    mConnection(connection),
+    mData(dataFile, std::ios::binary | std::ios::trunc),
+    mTimestamps(timestampFile, std::ios::trunc)
+{
+    if( !mData )
+        throw std::runtime_error("Unable to create recording data file '" + dataFile + "'");
+    if( !mTimestamps )
+        throw std::runtime_error("Unable to create recording timestamp file '" + timestampFile + "'");
+
+    mTimestamps << "# <byte offset> <timestamp>\n";
+}
+
+bool RecordingConnection::recvFromDevice(uint8_t* buffer, size_t max_length, size_t* length_out, mip::Timestamp* timestamp)
+{
+    if( !mConnection.recvFromDevice(buffer, max_length, length_out, timestamp) )
+        return false;
+
+    const byte_ring_iov segment = {buffer, max_length};
+    record(&segment, 1, *length_out, *timestamp);
+    return true;
+}
+
+bool RecordingConnection::recvFromDeviceV(const byte_ring_iov* segments, unsigned int count, size_t* length_out, mip::Timestamp* timestamp)
+{
+    if( !mConnection.recvFromDeviceV(segments, count, length_out, timestamp) )
+        return false;
+
+    record(segments, count, *length_out, *timestamp);
+    return true;
+}
+
+void RecordingConnection::record(const byte_ring_iov* segments, unsigned int count, size_t length, Timestamp timestamp)
+{
+    if( length == 0 )
+        return;
+
+    mTimestamps << mPosition << ' ' << timestamp << '\n';
+
+    mPosition += length;
+
+    for(unsigned int i=0; i<count && length > 0; i++)
+    {
+        const size_t n = std::min(segments[i].length, length);
+        mData.write(reinterpret_cast<const char*>(segments[i].ptr), std::streamsize(n));
+        length -= n;
+    }
+}
+
+};  // namespace platform
+};  // namespace mip
@@ -0,0 +1,217 @@
+#pragma once
+
+#include <mip/mip_device.hpp>
+
+#include <chrono>
+#include <fstream>
+#include <map>
+#include <string>
+#include <vector>
+
+
+extern mip::Timestamp getCurrentTimestamp();
+
+namespace mip
+{
+namespace platform
+{
+
+////////////////////////////////////////////////////////////////////////////////
+///@brief Replays data recorded from a device, in place of a real connection.
+///
+/// The data file contains the raw bytes received from the device, exactly as
+/// read from the connection. The optional timestamp file (the "sidecar")
+/// records when the host received them, as text with one line per read:
+///
+///     <byte offset> <timestamp>
+///
+/// i.e. the bytes starting at the given offset in the data file, up to the
+/// offset on the next line, were received at the given time (in
+/// milliseconds, as returned by getCurrentTimestamp). Lines starting with '#'
+/// are ignored. RecordingConnection writes both files.
+///
+/// Each chunk is handed to the parser with its recorded timestamp, so packet
+/// callbacks and everything downstream see the same timestamps as during
+/// the recording, regardless of the replay speed. The pacing decides only
+/// how long recvFromDevice waits before returning each chunk:
+///@li REAL_TIME  - chunks are spaced as they were recorded.
+///@li SCALED     - N times faster (or slower) than recorded.
+///@li AS_FAST_AS_POSSIBLE - no waiting at all. Useful to run whole
+///    application pipelines against field captures in CI.
+///
+/// Without a timestamp file, the data is always replayed as fast as possible
+/// and timestamped with getCurrentTimestamp().
+///
+/// Commands sent to the device are swallowed by default (sendToDevice
+/// succeeds but no reply arrives, so they eventually time out). Replies can
+/// be scripted per command with setReply or setResponse, or every command
+/// can be acknowledged with setReplyMode(ReplyMode::ACK_ALL) (without a
+/// response, so commands which read something still need a script). Replies are
+/// injected ahead of the recorded data and timestamped with the current
+/// replay time, which is also the time base for command timeouts.
+///
+///@code{.cpp}
+/// ReplayConnection connection("gq7_drive.bin", "gq7_drive.ts");
+/// connection.setPacing(ReplayConnection::Pacing::AS_FAST_AS_POSSIBLE);
+/// connection.setReplyMode(ReplayConnection::ReplyMode::ACK_ALL);
+///
+/// DeviceInterface device(&connection, buffer, sizeof(buffer), 1000, 2000);
+/// // Register callbacks, run setup commands, etc.
+///
+/// while(device.update())  // False at the end of the recording.
+///     ;
+///@endcode
+///
+class ReplayConnection : public mip::Connection
+{
+public:
+    enum class Pacing
+    {
+        REAL_TIME,           ///< Wait until each chunk is due according to the recording.
+        SCALED,              ///< Like REAL_TIME, but at the speed given to setPacing.
+        AS_FAST_AS_POSSIBLE, ///< Never wait.
+    };
+
+    enum class ReplyMode
+    {
+        SWALLOW,  ///< Commands without a scripted reply are ignored.
+        ACK_ALL,  ///< Commands without a scripted reply are acknowledged with ACK_OK.
+    };
+
+    ReplayConnection(const std::string& dataFile, const std::string& timestampFile="");
+
+    ReplayConnection(const ReplayConnection&) = delete;
+    ReplayConnection& operator=(const ReplayConnection&) = delete;
+
+    bool recvFromDevice(uint8_t* buffer, size_t max_length, size_t* length_out, mip::Timestamp* timestamp) final;
+    bool recvFromDeviceV(const byte_ring_iov* segments, unsigned int count, size_t* length_out, mip::Timestamp* timestamp) final;
+    bool sendToDevice(const uint8_t* data, size_t length) final;
+
+    bool setReadTimeout(Timeout timeout) final { mReadTimeout = timeout; return true; }
+
+    void setPacing(Pacing pacing, double speed=1.0);
+    Pacing pacing() const { return mPacing; }
+    double speed() const { return mSpeed; }
+
+    void setReplyMode(ReplyMode mode) { mReplyMode = mode; }
+    void setReply(uint8_t descriptorSet, uint8_t fieldDescriptor, CmdResult result, uint8_t responseDescriptor=0, const uint8_t* response=nullptr, size_t responseLength=0);
+    template<class Cmd> void setResponse(const typename Cmd::Response& response);
+    void clearReplies() { mReplies.clear(); }
+
+    Timestamp replayTime() const;
+    bool finished() const { return mChunk >= mChunks.size() && mPendingReplies.empty(); }
+
+    uint64_t bytesReplayed() const { return mPosition; }
+    uint64_t commandsReceived() const { return mCommands; }
+
+private:
+    ///@brief A block of bytes received at once, from the timestamp file.
+    struct Chunk
+    {
+        uint64_t  offset;
+        Timestamp timestamp;
+    };
+
+    ///@brief A scripted reply to one command.
+    struct Reply
+    {
+        CmdResult            result;
+        uint8_t              responseDescriptor;
+        std::vector<uint8_t> response;
+    };
+
+    static uint16_t replyKey(uint8_t descriptorSet, uint8_t fieldDescriptor) { return uint16_t(descriptorSet) << 8 | fieldDescriptor; }
+
+    void loadTimestamps(std::ifstream& file);
+    void anchor();
+    bool onCommand(const Packet& packet, Timestamp timestamp);
+    size_t readChunk(const byte_ring_iov* segments, unsigned int count);
+
+    std::ifstream        mData;
+    uint64_t             mDataSize = 0;
+    uint64_t             mPosition = 0;     ///< Offset of the next byte to replay.
+    std::vector<Chunk>   mChunks;
+    size_t               mChunk    = 0;     ///< Index of the chunk containing mPosition.
+    bool                 mTimed    = false; ///< True if a timestamp file was given.
+
+    Pacing   mPacing = Pacing::REAL_TIME;
+    double   mSpeed  = 1.0;
+    Timeout  mReadTimeout = 10;
+
+    bool                                  mStarted = false;
+    std::chrono::steady_clock::time_point mWallStart;
+    Timestamp                             mReplayStart   = 0;  ///< Replay time at mWallStart.
+    Timestamp                             mLastTimestamp = 0;  ///< Latest timestamp returned.
+
+    ReplyMode                 mReplyMode = ReplyMode::SWALLOW;
+    std::map<uint16_t, Reply> mReplies;
+    std::vector<uint8_t>      mPendingReplies;  ///< Reply packets waiting to be received.
+    uint64_t                  mCommands = 0;
+
+    uint8_t mCommandBuffer[1024];
+    Parser  mCommandParser;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+///@brief Scripts a successful reply to a command, including its response.
+///
+///@code{.cpp}
+/// commands_base::GetDeviceInfo::Response info;
+/// std::strcpy(info.device_info.model_name, "3DM-GQ7");
+/// connection.setResponse<commands_base::GetDeviceInfo>(info);
+///@endcode
+///
+template<class Cmd>
+void ReplayConnection::setResponse(const typename Cmd::Response& response)
+{
+    uint8_t buffer[PACKET_LENGTH_MAX];
+    const Packet packet = Packet::createFromField(buffer, sizeof(buffer), response);
+    const Field field = packet.firstField();
+
+    setReply(Cmd::DESCRIPTOR_SET, Cmd::FIELD_DESCRIPTOR, CmdResult::ACK_OK, Cmd::Response::FIELD_DESCRIPTOR, field.payload(), field.payloadLength());
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+///@brief Records everything received from a device, for ReplayConnection.
+///
+/// Wraps the real connection and passes everything through, while writing
+/// the received bytes to the data file and their receive timestamps to the
+/// timestamp file. Data sent to the device is not recorded.
+///
+///@code{.cpp}
+/// SerialConnection serial("/dev/ttyACM0", 921600);
+/// RecordingConnection connection(serial, "gq7_drive.bin", "gq7_drive.ts");
+/// DeviceInterface device(&connection, buffer, sizeof(buffer), 1000, 2000);
+///@endcode
+///
+class RecordingConnection : public mip::Connection
+{
+public:
+    RecordingConnection(Connection& connection, const std::string& dataFile, const std::string& timestampFile);
+
+    RecordingConnection(const RecordingConnection&) = delete;
+    RecordingConnection& operator=(const RecordingConnection&) = delete;
+
+    bool recvFromDevice(uint8_t* buffer, size_t max_length, size_t* length_out, mip::Timestamp* timestamp) final;
+    bool recvFromDeviceV(const byte_ring_iov* segments, unsigned int count, size_t* length_out, mip::Timestamp* timestamp) final;
+    bool sendToDevice(const uint8_t* data, size_t length) final { return mConnection.sendToDevice(data, length); }
+
+    uint32_t baudrate() const final { return mConnection.baudrate(); }
+    bool setBaudrate(uint32_t baudrate) final { return mConnection.setBaudrate(baudrate); }
+    int fileDescriptor() const final { return mConnection.fileDescriptor(); }
+    bool setReadTimeout(Timeout timeout) final { return mConnection.setReadTimeout(timeout); }
+
+    uint64_t bytesRecorded() const { return mPosition; }
+
+private:
+    void record(const byte_ring_iov* segments, unsigned int count, size_t length, Timestamp timestamp);
+
+    Connection&   mConnection;
+    std::ofstream mData;
+    std::ofstream mTimestamps;
+    uint64_t      mPosition = 0;
+};
+
+};  // namespace platform
+};  // namespace mip
@@ -4,6 +4,11 @@
 #include <chrono>
 #include <cstdio>
 
+#ifndef WIN32
+    #include <errno.h>
+    #include <sys/uio.h>
+#endif
+
 namespace mip
 {
 namespace platform
@@ -13,6 +18,8 @@ SerialConnection::SerialConnection(const std::string& portName, uint32_t baudrat
 {
     if (!serial_port_open(&mPort, portName.c_str(), baudrate))
         throw std::runtime_error("Unable to open serial port");
+
+    mBaudrate = baudrate;
 }
 
 SerialConnection::~SerialConnection()
@@ -26,6 +33,89 @@ bool SerialConnection::recvFromDevice(uint8_t* buffer, size_t max_length, size_t
     return serial_port_read(&mPort, buffer, max_length, length_out);
 }
 
+#ifndef WIN32
+///@brief Reads into both free segments of the parse buffer with one readv call.
+///
+/// Like serial_port_read, this waits up to the read timeout for data to arrive.
+/// A hangup or error on the port, or no data although the port was readable
+/// (i.e. the device was disconnected), is reported as a failure.
+///
+bool SerialConnection::recvFromDeviceV(const byte_ring_iov* segments, unsigned int count, size_t* length_out, mip::Timestamp* timestamp)
+{
+    *timestamp  = getCurrentTimestamp();
+    *length_out = 0;
+
+    if( !mPort.is_open )
+        return false;
+
+    const int readable = serial_port_wait_readable(&mPort);
+
+    if( readable < 0 )
+        return false;
+
+    if( readable == 0 || count == 0 )
+        return true;
+
+    struct iovec iov[2];
+    size_t maxLength = 0;
+    for(unsigned int i=0; i<count; i++)
+    {
+        iov[i].iov_base = segments[i].ptr;
+        iov[i].iov_len  = segments[i].length;
+        maxLength += segments[i].length;
+    }
+
+    const ssize_t result = readv(mPort.handle, iov, int(count));
+
+    if( result < 0 )
+        return errno == EAGAIN || errno == EINTR;
+
+    // Readable with no data means end of file, e.g. an unplugged adapter.
+    if( result == 0 && maxLength > 0 )
+        return false;
+
+    *length_out = size_t(result);
+    return true;
+}
+#endif
+
+///@brief Changes the host baud rate.
+///
+/// The open port is reconfigured in place, without closing it, so that
+/// control lines aren't toggled (which resets some devices).
+///
+///@returns False if the rate is not supported or the port could not be
+///         reconfigured. The old rate remains in effect in that case.
+///
+bool SerialConnection::setBaudrate(uint32_t baudrate)
+{
+    if (!serial_port_set_baudrate(&mPort, baudrate))
+        return false;
+
+    mBaudrate = baudrate;
+    return true;
+}
+
+///@brief Configures the port for the lowest possible receive latency.
+///
+/// This enables the driver's low latency mode (e.g. a 1 ms FTDI latency
+/// timer instead of 16 ms), makes the port readable as soon as a single
+/// byte arrives (VMIN=1, VTIME=0), and optionally enables busy polling.
+///
+/// Low latency mode is not supported by every driver. Failure to enable it
+/// is not an error, since the remaining settings still help.
+///
+///@param busyPollUs See setBusyPoll. 0 to wait without spinning.
+///
+///@returns False if the read timing or busy polling couldn't be set.
+///
+bool SerialConnection::enableLowLatencyMode(uint32_t busyPollUs)
+{
+    setLowLatency(true);
+
+    return setReadTiming(1, 0) && setBusyPoll(busyPollUs);
+}
+
 bool SerialConnection::sendToDevice(const uint8_t* data, size_t length)
 {
     size_t length_out;
@@ -23,8 +23,30 @@ public:
     bool recvFromDevice(uint8_t* buffer, size_t max_length, size_t* length_out, mip::Timestamp* timestamp) final;
     bool sendToDevice(const uint8_t* data, size_t length) final;
 
+    uint32_t baudrate() const final { return mBaudrate; }
+    bool setBaudrate(uint32_t baudrate) final;
+
+    ///@copydoc serial_port_set_read_timeout
+    bool setReadTimeout(Timeout timeout) final { return serial_port_set_read_timeout(&mPort, timeout); }
+
+    ///@copydoc serial_port_set_low_latency
+    bool setLowLatency(bool enable) { return serial_port_set_low_latency(&mPort, enable); }
+    ///@copydoc serial_port_set_read_timing
+    bool setReadTiming(uint8_t vmin, uint8_t vtime) { return serial_port_set_read_timing(&mPort, vmin, vtime); }
+    ///@copydoc serial_port_set_busy_poll
+    bool setBusyPoll(uint32_t busyPollUs) { return serial_port_set_busy_poll(&mPort, busyPollUs); }
+
+    bool enableLowLatencyMode(uint32_t busyPollUs=0);
+
+#ifndef WIN32
+    int fileDescriptor() const final { return mPort.is_open ? mPort.handle : -1; }
+
+    bool recvFromDeviceV(const byte_ring_iov* segments, unsigned int count, size_t* length_out, mip::Timestamp* timestamp) final;
+#endif
+
 private:
     serial_port mPort;
+    uint32_t    mBaudrate = 0;
 };
 
 };  // namespace platform
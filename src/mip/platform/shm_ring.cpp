@@ -0,0 +1,548 @@
+#include "shm_ring.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <new>
+#include <stdexcept>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <linux/futex.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+
+namespace mip
+{
+namespace platform
+{
+
+static_assert(ATOMIC_LLONG_LOCK_FREE == 2 && ATOMIC_INT_LOCK_FREE == 2, "Shared memory atomics must be lock free");
+
+////////////////////////////////////////////////////////////////////////////////
+///@brief Layout of the start of the shared memory object.
+///
+/// The ring follows at DATA_OFFSET. It holds a sequence of records, each a
+/// RecordHeader followed by the packet and padding to a multiple of 8 bytes.
+/// Positions are byte counts since the start of the stream; the location in
+/// the ring is the position modulo the capacity, so records may wrap around.
+///
+/// The producer works like a sequence lock: it advances reserve to the end
+/// of a record before writing it, and head once it's complete. A reader
+/// copies a record and then checks that reserve hasn't advanced so far that
+/// the record was overwritten meanwhile.
+///
+/// The generation identifies the producer which created the object. It is
+/// cleared when that producer is destroyed, so consumers can tell that they
+/// are reading from an abandoned ring.
+///
+struct ShmRingHeader
+{
+    static const uint32_t MAGIC   = 0x4D495052;  // "MIPR"
+    static const uint32_t VERSION = 2;
+
+    std::atomic<uint32_t> magic;
+    uint32_t              version;
+    uint64_t              capacity;    ///< Size of the ring in bytes, a power of 2.
+    std::atomic<uint64_t> generation;  ///< Nonzero while the producer exists.
+    int32_t               producerPid;
+
+    alignas(64) std::atomic<uint64_t> reserve;  ///< End of the record being written.
+    alignas(64) std::atomic<uint64_t> head;     ///< End of the last complete record.
+    std::atomic<uint32_t>             notify;   ///< Futex word, incremented for each record.
+    alignas(64) std::atomic<uint32_t> waiters;  ///< Number of consumers sleeping on notify.
+};
+
+namespace
+{
+    struct RecordHeader
+    {
+        uint64_t sequence;
+        uint64_t timestamp;
+        uint16_t length;
+        uint8_t  reserved[6];
+    };
+
+    const size_t DATA_OFFSET  = (sizeof(ShmRingHeader) + 63) & ~size_t(63);
+    const size_t MIN_CAPACITY = 4096;
+
+    uint64_t recordSize(uint16_t length) { return (sizeof(RecordHeader) + length + 7) & ~uint64_t(7); }
+
+    void copyIn(uint8_t* ring, size_t capacity, uint64_t position, const void* source, size_t length)
+    {
+        const size_t start = size_t(position & (capacity - 1));
+        const size_t first = std::min(length, capacity - start);
+
+        std::memcpy(ring + start, source, first);
+        std::memcpy(ring, static_cast<const uint8_t*>(source) + first, length - first);
+    }
+
+    void copyOut(const uint8_t* ring, size_t capacity, uint64_t position, void* destination, size_t length)
+    {
+        const size_t start = size_t(position & (capacity - 1));
+        const size_t first = std::min(length, capacity - start);
+
+        std::memcpy(destination, ring + start, first);
+        std::memcpy(static_cast<uint8_t*>(destination) + first, ring, length - first);
+    }
+
+    ///@brief Copies from the ring to offset within the concatenated segments.
+    void scatter(const uint8_t* ring, size_t capacity, uint64_t position, size_t length, const byte_ring_iov* segments, size_t offset)
+    {
+        while( length > 0 )
+        {
+            const byte_ring_iov* segment = segments;
+            while( offset >= segment->length )
+            {
+                offset -= segment->length;
+                segment++;
+            }
+
+            const size_t chunk = std::min(length, segment->length - offset);
+            copyOut(ring, capacity, position, segment->ptr + offset, chunk);
+
+            position += chunk;
+            length   -= chunk;
+            offset    = 0;
+            segments  = segment + 1;
+        }
+    }
+
+    uint32_t* futexWord(std::atomic<uint32_t>& word) { return reinterpret_cast<uint32_t*>(&word); }
+
+    ///@brief Returns a value unique to this producer instance, never 0.
+    uint64_t newGeneration()
+    {
+        struct timespec now;
+        clock_gettime(CLOCK_REALTIME, &now);
+
+        const uint64_t generation = (uint64_t(now.tv_sec) * 1000000000 + uint64_t(now.tv_nsec)) ^ (uint64_t(getpid()) << 48);
+        return generation ? generation : 1;
+    }
+
+    ///@brief Returns true if the process may still be running.
+    bool processExists(int32_t pid)
+    {
+        return kill(pid_t(pid), 0) == 0 || errno == EPERM;
+    }
+
+    ////////////////////////////////////////////////////////////////////////////
+    ///@brief Checks whether an existing object is a ring left behind by a
+    ///       producer which is gone, so it may be replaced.
+    ///
+    /// Objects which can't be identified as such a ring are left alone.
+    ///
+    bool abandoned(const std::string& name)
+    {
+        const int fd = shm_open(name.c_str(), O_RDONLY | O_CLOEXEC, 0);
+        if( fd < 0 )
+            return errno == ENOENT;  // Removed meanwhile.
+
+        struct stat info;
+        void* memory = MAP_FAILED;
+
+        if( fstat(fd, &info) == 0 && size_t(info.st_size) >= sizeof(ShmRingHeader) )
+            memory = mmap(nullptr, sizeof(ShmRingHeader), PROT_READ, MAP_SHARED, fd, 0);
+
+        close(fd);
+
+        if( memory == MAP_FAILED )
+            return false;
+
+        const ShmRingHeader* header = static_cast<const ShmRingHeader*>(memory);
+
+        const bool gone = header->magic.load(std::memory_order_acquire) == ShmRingHeader::MAGIC && header->version == ShmRingHeader::VERSION &&
+            (header->generation.load(std::memory_order_acquire) == 0 || !processExists(header->producerPid));
+
+        munmap(memory, sizeof(ShmRingHeader));
+
+        return gone;
+    }
+
+    void cpuRelax()
+    {
+#if defined(__x86_64__) || defined(__i386__)
+        __builtin_ia32_pause();
+#elif defined(__aarch64__)
+        asm volatile("yield");
+#endif
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+///@brief Creates the shared memory object.
+///
+/// An existing ring with the same name is replaced only if its producer is
+/// gone, e.g. because it was killed.
+///
+///@param name
+///       Name of the shared memory object, starting with a slash, e.g.
+///       "/mip_gq7". It appears under /dev/shm. Access is limited to the
+///       user and group of the producer.
+///@param capacity
+///       Size of the ring in bytes, rounded up to a power of 2. Consumers
+///       which fall behind by more than this lose data.
+///
+///@throws std::runtime_error if the object can't be created, or if another
+///        producer is using the name.
+///
+ShmRingProducer::ShmRingProducer(const std::string& name, size_t capacity) :
+    mName(name), mCapacity(MIN_CAPACITY)
+{
+    while( mCapacity < capacity )
+        mCapacity *= 2;
+
+    mMapSize = DATA_OFFSET + mCapacity;
+
+    int fd = shm_open(mName.c_str(), O_CREAT | O_EXCL | O_RDWR | O_CLOEXEC, 0660);
+
+    if( fd < 0 && errno == EEXIST )
+    {
+        if( !abandoned(mName) )
+            throw std::runtime_error("Shared memory object " + mName + " is in use");
+
+        shm_unlink(mName.c_str());
+        fd = shm_open(mName.c_str(), O_CREAT | O_EXCL | O_RDWR | O_CLOEXEC, 0660);
+    }
+
+    if( fd < 0 )
+        throw std::runtime_error("Unable to create shared memory object " + mName);
+
+    void* memory = MAP_FAILED;
+    if( ftruncate(fd, off_t(mMapSize)) == 0 )
+        memory = mmap(nullptr, mMapSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+
+    close(fd);
+
+    if( memory == MAP_FAILED )
+    {
+        shm_unlink(mName.c_str());
+        throw std::runtime_error("Unable to map shared memory object " + mName);
+    }
+
+    mHeader = new (memory) ShmRingHeader;
+    mData   = static_cast<uint8_t*>(memory) + DATA_OFFSET;
+
+    mHeader->version     = ShmRingHeader::VERSION;
+    mHeader->capacity    = mCapacity;
+    mHeader->producerPid = int32_t(getpid());
+    mHeader->generation.store(newGeneration(), std::memory_order_relaxed);
+    mHeader->reserve.store(0, std::memory_order_relaxed);
+    mHeader->head.store(0, std::memory_order_relaxed);
+    mHeader->notify.store(0, std::memory_order_relaxed);
+    mHeader->waiters.store(0, std::memory_order_relaxed);
+
+    // Consumers check this last.
+    mHeader->magic.store(ShmRingHeader::MAGIC, std::memory_order_release);
+}
+
+ShmRingProducer::~ShmRingProducer()
+{
+    detach();
+
+    // Tell consumers, including sleeping ones, that the ring is abandoned.
+    mHeader->generation.store(0, std::memory_order_release);
+    mHeader->notify.fetch_add(1);
+    syscall(SYS_futex, futexWord(mHeader->notify), FUTEX_WAKE, INT32_MAX, nullptr, nullptr, 0);
+
+    munmap(mHeader, mMapSize);
+    shm_unlink(mName.c_str());
+}
+
+////////////////////////////////////////////////////////////////////////////////
+///@brief Publishes every packet received by a device from now on.
+///
+void ShmRingProducer::attach(DeviceInterface& device)
+{
+    detach();
+
+    mDevice = &device;
+    mDevice->registerPacketCallback<ShmRingProducer, &ShmRingProducer::publish>(mHandler, Dispatcher::ANY_DESCRIPTOR, false, this);
+}
+
+void ShmRingProducer::detach()
+{
+    if( !mDevice )
+        return;
+
+    mDevice->dispatcher().removeHandler(mHandler);
+    mDevice = nullptr;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+///@brief Writes a packet to the ring and wakes sleeping consumers.
+///
+///@param packet    Complete MIP packet, including header and checksum.
+///@param length    Total length of the packet.
+///@param timestamp Time the packet was received.
+///
+void ShmRingProducer::publish(const uint8_t* packet, uint16_t length, Timestamp timestamp)
+{
+    RecordHeader record = {};
+    record.sequence  = mSequence;
+    record.timestamp = uint64_t(timestamp);
+    record.length    = length;
+
+    const uint64_t position = mHeader->head.load(std::memory_order_relaxed);
+    const uint64_t end      = position + recordSize(length);
+
+    // Readers of the space about to be overwritten must see this first.
+    mHeader->reserve.store(end, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    copyIn(mData, mCapacity, position, &record, sizeof(record));
+    copyIn(mData, mCapacity, position + sizeof(record), packet, length);
+
+    mHeader->head.store(end, std::memory_order_release);
+    mSequence++;
+
+    mHeader->notify.fetch_add(1);
+
+    if( mHeader->waiters.load() != 0 )
+        syscall(SYS_futex, futexWord(mHeader->notify), FUTEX_WAKE, INT32_MAX, nullptr, nullptr, 0);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+///@brief Attaches to a producer's shared memory object.
+///
+/// Reading starts with the next packet published.
+///
+///@param name Name given to the ShmRingProducer.
+///
+///@throws std::runtime_error if the object doesn't exist or isn't a ring
+///        created by a compatible ShmRingProducer.
+///
+ShmRingConnection::ShmRingConnection(const std::string& name)
+{
+    // Read-write, since sleeping consumers register themselves in the header.
+    const int fd = shm_open(name.c_str(), O_RDWR | O_CLOEXEC, 0);
+    if( fd < 0 )
+        throw std::runtime_error("Unable to open shared memory object " + name);
+
+    struct stat info;
+    void* memory = MAP_FAILED;
+
+    if( fstat(fd, &info) == 0 && size_t(info.st_size) > DATA_OFFSET )
+    {
+        mMapSize = size_t(info.st_size);
+        memory   = mmap(nullptr, mMapSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    }
+
+    close(fd);
+
+    if( memory == MAP_FAILED )
+        throw std::runtime_error("Unable to map shared memory object " + name);
+
+    mHeader   = static_cast<ShmRingHeader*>(memory);
+    mData     = static_cast<const uint8_t*>(memory) + DATA_OFFSET;
+    mCapacity = size_t(mHeader->capacity);
+
+    if( mHeader->magic.load(std::memory_order_acquire) != ShmRingHeader::MAGIC || mHeader->version != ShmRingHeader::VERSION ||
+        mCapacity < MIN_CAPACITY || (mCapacity & (mCapacity - 1)) != 0 || DATA_OFFSET + mCapacity > mMapSize )
+    {
+        munmap(memory, mMapSize);
+        throw std::runtime_error("Shared memory object " + name + " is not a MIP packet ring");
+    }
+
+    mGeneration = mHeader->generation.load(std::memory_order_acquire);
+    if( mGeneration == 0 )
+    {
+        munmap(memory, mMapSize);
+        throw std::runtime_error("Shared memory object " + name + " has no producer");
+    }
+
+    mPosition = mHeader->head.load(std::memory_order_acquire);
+}
+
+ShmRingConnection::~ShmRingConnection()
+{
+    munmap(mHeader, mMapSize);
+}
+
+bool ShmRingConnection::recvFromDevice(uint8_t* buffer, size_t max_length, size_t* length_out, mip::Timestamp* timestamp)
+{
+    const byte_ring_iov segment = { buffer, max_length };
+    return recvFromDeviceV(&segment, 1, length_out, timestamp);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+///@brief Copies as many whole packets as fit into the free segments of the
+///       parse buffer.
+///
+/// Packets are copied straight from shared memory, split across the
+/// segments where necessary. If none are available, this waits up to the
+/// read timeout for one.
+///
+///@returns False if the producer was destroyed or its process exited, e.g.
+///         because it is being restarted. A new connection must be opened
+///         to read from the new producer.
+///
+bool ShmRingConnection::recvFromDeviceV(const byte_ring_iov* segments, unsigned int count, size_t* length_out, mip::Timestamp* timestamp)
+{
+    *length_out = 0;
+    *timestamp  = getCurrentTimestamp();
+
+    uint64_t head = mHeader->head.load(std::memory_order_acquire);
+
+    if( head == mPosition )
+    {
+        // Only checked when idle, since a live producer keeps publishing.
+        if( !waitForData(mPosition) )
+            return producerAlive();
+
+        head = mHeader->head.load(std::memory_order_acquire);
+        *timestamp = getCurrentTimestamp();
+    }
+
+    if( head - mPosition > mCapacity )
+    {
+        resync();
+        head = mPosition;
+    }
+
+    size_t space = 0;
+    for(unsigned int i=0; i<count; i++)
+        space += segments[i].length;
+
+    size_t length = 0;
+
+    while( mPosition != head )
+    {
+        RecordHeader record;
+        copyOut(mData, mCapacity, mPosition, &record, sizeof(record));
+
+        const bool fits = (record.length <= PACKET_LENGTH_MAX) && (length + record.length <= space);
+        if( fits )
+            scatter(mData, mCapacity, mPosition + sizeof(record), record.length, segments, length);
+
+        // If the record was overwritten while copying, it may be garbage.
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if( mHeader->reserve.load(std::memory_order_relaxed) - mPosition > mCapacity || record.length > PACKET_LENGTH_MAX )
+        {
+            resync();
+            break;
+        }
+
+        if( !fits )
+            break;
+
+        // The first packet read determines the starting sequence number.
+        if( mReceived != 0 )
+            mDropped += record.sequence - mNextSequence;
+
+        mNextSequence = record.sequence + 1;
+        mReceived++;
+
+        if( mProducerTimestamps )
+            *timestamp = Timestamp(record.timestamp);
+
+        length    += record.length;
+        mPosition += recordSize(record.length);
+    }
+
+    *length_out = length;
+    return true;
+}
+
+bool ShmRingConnection::sendToDevice(const uint8_t* data, size_t length)
+{
+    (void)data;
+    (void)length;
+    return false;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+///@brief Waits until data is published after position, or the read timeout.
+///
+///@returns True if data is available.
+///
+bool ShmRingConnection::waitForData(uint64_t position)
+{
+    using namespace std::chrono;
+
+    if( mBusyPollUs > 0 )
+    {
+        const auto end = steady_clock::now() + microseconds(mBusyPollUs);
+        do
+        {
+            for(unsigned int i=0; i<64; i++)
+            {
+                if( mHeader->head.load(std::memory_order_acquire) != position )
+                    return true;
+
+                cpuRelax();
+            }
+
+        } while( steady_clock::now() < end );
+    }
+
+    if( mReadTimeout == 0 )
+        return mHeader->head.load(std::memory_order_acquire) != position;
+
+    const auto deadline = steady_clock::now() + milliseconds(mReadTimeout);
+    bool ready = false;
+
+    mHeader->waiters.fetch_add(1);
+
+    while( true )
+    {
+        const uint32_t expected = mHeader->notify.load();
+
+        if( mHeader->head.load(std::memory_order_acquire) != position )
+        {
+            ready = true;
+            break;
+        }
+
+        if( mHeader->generation.load(std::memory_order_acquire) != mGeneration )
+            break;
+
+        const auto remaining = duration_cast<nanoseconds>(deadline - steady_clock::now()).count();
+        if( remaining <= 0 )
+            break;
+
+        struct timespec timeout;
+        timeout.tv_sec  = time_t(remaining / 1000000000);
+        timeout.tv_nsec = long(remaining % 1000000000);
+
+        syscall(SYS_futex, futexWord(mHeader->notify), FUTEX_WAIT, expected, &timeout, nullptr, 0);
+    }
+
+    mHeader->waiters.fetch_sub(1);
+
+    return ready;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+///@brief Returns false if the producer which created the ring is gone.
+///
+/// A destroyed producer clears the generation. One which was killed can't,
+/// so its process is checked too.
+///
+bool ShmRingConnection::producerAlive() const
+{
+    if( mHeader->generation.load(std::memory_order_acquire) != mGeneration )
+        return false;
+
+    return processExists(mHeader->producerPid);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+///@brief Skips to the newest data after falling behind the producer.
+///
+/// The packets skipped are counted from the sequence number of the next
+/// packet read.
+///
+void ShmRingConnection::resync()
+{
+    mPosition = mHeader->head.load(std::memory_order_acquire);
+}
+
+};  // namespace platform
+};  // namespace mip
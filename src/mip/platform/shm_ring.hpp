@@ -0,0 +1,156 @@
+#pragma once
+
+#include <mip/mip_device.hpp>
+
+#include <string>
+
+
+extern mip::Timestamp getCurrentTimestamp();
+
+namespace mip
+{
+namespace platform
+{
+
+struct ShmRingHeader;
+
+////////////////////////////////////////////////////////////////////////////////
+///@brief Publishes a device's packets to other processes through shared
+///       memory.
+///
+/// The process which owns the device creates a POSIX shared memory object
+/// containing a ring buffer. Every packet received from the device (after
+/// its checksum was validated by the parser) is written to the ring with a
+/// sequence number and its timestamp. Any number of consumer processes read
+/// the ring with a ShmRingConnection, without copying through the kernel.
+///
+/// The producer never waits for consumers. A consumer which falls behind by
+/// more than the ring size loses the overwritten packets, which it detects
+/// from the sequence numbers. Publishing involves no system calls, except
+/// a futex wakeup when a consumer is asleep waiting for data.
+///
+///@code{.cpp}
+/// ShmRingProducer producer("/mip_gq7");
+/// producer.attach(device);  // Publishes every packet the device receives.
+///
+/// while(running)
+///     device.update();
+///@endcode
+///
+/// The shared memory object is removed when the producer is destroyed.
+/// Consumers then fail to receive and must reconnect, e.g. through a
+/// ResilientConnection, to read from a restarted producer.
+///
+/// This class is only available on Linux.
+///
+class ShmRingProducer
+{
+public:
+    ShmRingProducer(const std::string& name, size_t capacity=1024*1024);
+    ~ShmRingProducer();
+
+    ShmRingProducer(const ShmRingProducer&) = delete;
+    ShmRingProducer& operator=(const ShmRingProducer&) = delete;
+
+    void attach(DeviceInterface& device);
+    void detach();
+
+    void publish(const uint8_t* packet, uint16_t length, Timestamp timestamp);
+    void publish(const Packet& packet, Timestamp timestamp) { publish(packet.pointer(), packet.totalLength(), timestamp); }
+
+    const std::string& name() const { return mName; }
+    size_t   capacity() const { return mCapacity; }
+    uint64_t sequence() const { return mSequence; }  ///< Number of packets published.
+
+private:
+    std::string      mName;
+    ShmRingHeader*   mHeader   = nullptr;
+    uint8_t*         mData     = nullptr;
+    size_t           mCapacity = 0;
+    size_t           mMapSize  = 0;
+    uint64_t         mSequence = 0;
+
+    DeviceInterface* mDevice = nullptr;
+    DispatchHandler  mHandler;
+};
+
+
+////////////////////////////////////////////////////////////////////////////////
+///@brief Receives a device's packets from a ShmRingProducer in another
+///       process.
+///
+/// Use it in place of a SerialConnection or TcpConnection. Packets are
+/// copied straight from shared memory into the parse buffer; while data is
+/// available, no system calls are made. When the ring is empty, the
+/// connection spins for the busy poll time (0 by default) and then sleeps on
+/// a futex until data arrives or the read timeout expires. With busy polling
+/// long enough to cover the interval between packets, the latency from
+/// publication to parsing is well under a microsecond, at the cost of a
+/// whole CPU core.
+///
+/// The connection is receive-only. sendToDevice always fails, so commands
+/// must be sent by the producer (or through a RelayServer).
+///
+/// Lost packets (see droppedPackets) are skipped; the stream handed to the
+/// parser always consists of whole packets.
+///
+/// Receiving fails once the producer is destroyed or its process exits, as
+/// a closed socket would. The connection can't follow a restarted producer,
+/// which creates a new shared memory object.
+///
+/// This class is only available on Linux.
+///
+class ShmRingConnection : public mip::Connection
+{
+public:
+    explicit ShmRingConnection(const std::string& name);
+    ~ShmRingConnection();
+
+    ShmRingConnection(const ShmRingConnection&) = delete;
+    ShmRingConnection& operator=(const ShmRingConnection&) = delete;
+
+    bool recvFromDevice(uint8_t* buffer, size_t max_length, size_t* length_out, mip::Timestamp* timestamp) final;
+    bool recvFromDeviceV(const byte_ring_iov* segments, unsigned int count, size_t* length_out, mip::Timestamp* timestamp) final;
+    bool sendToDevice(const uint8_t* data, size_t length) final;
+
+    bool setReadTimeout(Timeout timeout) final { mReadTimeout = timeout; return true; }
+
+    ///@brief Sets how long to spin, in microseconds, before sleeping while
+    ///       waiting for data. 0 disables busy polling.
+    void setBusyPoll(uint32_t busyPollUs) { mBusyPollUs = busyPollUs; }
+
+    ///@brief Uses the timestamps recorded by the producer instead of the time
+    ///       of reading.
+    ///
+    /// These exclude the delay through the ring, but are only meaningful if
+    /// both processes use the same clock for getCurrentTimestamp (e.g.
+    /// CLOCK_MONOTONIC). Otherwise command timeouts would be miscalculated.
+    ///
+    void setProducerTimestamps(bool enable) { mProducerTimestamps = enable; }
+
+    uint64_t receivedPackets() const { return mReceived; }
+    uint64_t droppedPackets() const { return mDropped; }
+
+private:
+    bool waitForData(uint64_t position);
+    bool producerAlive() const;
+    void resync();
+
+    ShmRingHeader*  mHeader   = nullptr;
+    const uint8_t*  mData     = nullptr;
+    size_t          mCapacity = 0;
+    size_t          mMapSize  = 0;
+
+    uint64_t mGeneration   = 0;  ///< Generation of the producer when connected.
+    uint64_t mPosition     = 0;  ///< Ring position of the next record to read.
+    uint64_t mNextSequence = 0;  ///< Expected sequence number of that record.
+    uint64_t mReceived     = 0;
+    uint64_t mDropped      = 0;
+
+    Timeout  mReadTimeout        = 10;
+    uint32_t mBusyPollUs         = 0;
+    bool     mProducerTimestamps = false;
+};
+
+};  // namespace platform
+};  // namespace mip
@@ -4,6 +4,13 @@
 #include <stdexcept>
 #include <chrono>
 #include <cstdio>
+#include <cstring>
+
+#ifndef WIN32
+    #include <sys/socket.h>
+    #include <sys/uio.h>
+    #include <time.h>
+#endif
 
 namespace mip
 {
@@ -23,9 +30,120 @@ TcpConnection::~TcpConnection()
 
 bool TcpConnection::recvFromDevice(uint8_t* buffer, size_t max_length, size_t* length_out, mip::Timestamp* timestamp)
 {
+#ifndef WIN32
+    // Use recvmsg so that kernel timestamps are available.
+    const byte_ring_iov segment = { buffer, max_length };
+    return recvFromDeviceV(&segment, 1, length_out, timestamp);
+#else
     *timestamp = getCurrentTimestamp();
     return tcp_socket_recv(&mSocket, buffer, max_length, length_out);
+#endif
+}
+
+///@brief Timestamps received data with the time the kernel received it,
+///       instead of the time the read returned.
+///
+/// This removes the delay between the data arriving and the receiving
+/// thread being scheduled from packet timestamps. The kernel time is
+/// converted to the getCurrentTimestamp() timebase by subtracting the
+/// data's age from the current time, so getCurrentTimestamp may use any
+/// clock.
+///
+/// When a read returns data from several network packets, the timestamp of
+/// the last one applies to all of it.
+///
+///@copydetails tcp_socket_set_rx_timestamps
+///
+bool TcpConnection::setKernelTimestamps(bool enable)
+{
+    return tcp_socket_set_rx_timestamps(&mSocket, enable);
+}
+
+///@brief Configures the socket for the lowest possible latency.
+///
+/// This enables TCP_NODELAY (already the default) and quick acks, and
+/// optionally busy polling. Quick acks and busy polling are not supported on
+/// every platform, and busy polling may require extra privileges. Failure to
+/// enable them is not an error.
+///
+///@param busyPollUs See setBusyPoll. 0 to wait without spinning.
+///
+///@returns False if TCP_NODELAY couldn't be set.
+///
+bool TcpConnection::enableLowLatencyMode(uint32_t busyPollUs)
+{
+    setQuickAck(true);
+
+    if( busyPollUs > 0 )
+        setBusyPoll(busyPollUs);
+
+    return setNoDelay(true);
+}
+
+#ifndef WIN32
+///@brief Receives into both free segments of the parse buffer with one
+///       recvmsg call.
+///
+/// Like tcp_socket_recv, this waits up to the read timeout for data to
+/// arrive, and returns false if the connection was closed.
+///
+bool TcpConnection::recvFromDeviceV(const byte_ring_iov* segments, unsigned int count, size_t* length_out, mip::Timestamp* timestamp)
+{
+    *timestamp  = getCurrentTimestamp();
+    *length_out = 0;
+
+    struct iovec iov[2];
+    for(unsigned int i=0; i<count; i++)
+    {
+        iov[i].iov_base = segments[i].ptr;
+        iov[i].iov_len  = segments[i].length;
+    }
+
+    struct msghdr message = {};
+    message.msg_iov    = iov;
+    message.msg_iovlen = count;
+
+#ifdef SCM_TIMESTAMPNS
+    union
+    {
+        char buffer[CMSG_SPACE(sizeof(struct timespec))];
+        struct cmsghdr align;
+    } control;
+
+    if( mSocket.rx_timestamps )
+    {
+        message.msg_control    = control.buffer;
+        message.msg_controllen = sizeof(control.buffer);
+    }
+#endif
+
+    if( !tcp_socket_recvmsg(&mSocket, &message, length_out) )
+        return false;
+
+    if( *length_out == 0 )
+        return true;
+
+    *timestamp = getCurrentTimestamp();
+
+#ifdef SCM_TIMESTAMPNS
+    for(struct cmsghdr* cmsg = CMSG_FIRSTHDR(&message); cmsg != nullptr; cmsg = CMSG_NXTHDR(&message, cmsg))
+    {
+        if( cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_TIMESTAMPNS )
+            continue;
+
+        struct timespec received, now;
+        std::memcpy(&received, CMSG_DATA(cmsg), sizeof(received));
+        clock_gettime(CLOCK_REALTIME, &now);
+
+        const int64_t ageNs = int64_t(now.tv_sec - received.tv_sec) * 1000000000 + (now.tv_nsec - received.tv_nsec);
+        if( ageNs > 0 )
+            *timestamp -= mip::Timestamp(ageNs / 1000000);
+    }
+#endif
+
+    return true;
 }
+#endif
 
 bool TcpConnection::sendToDevice(const uint8_t* data, size_t length)
 {
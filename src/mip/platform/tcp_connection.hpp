@@ -24,6 +24,30 @@ public:
     bool recvFromDevice(uint8_t* buffer, size_t max_length, size_t* length_out, mip::Timestamp* timestamp) final;
     bool sendToDevice(const uint8_t* data, size_t length) final;
 
+    ///@copydoc tcp_socket_set_recv_timeout
+    bool setReadTimeout(Timeout timeout) final { return tcp_socket_set_recv_timeout(&mSocket, timeout); }
+
+    ///@copydoc tcp_socket_set_no_delay
+    bool setNoDelay(bool enable) { return tcp_socket_set_no_delay(&mSocket, enable); }
+    ///@copydoc tcp_socket_set_buffer_sizes
+    bool setBufferSizes(uint32_t recvBytes, uint32_t sendBytes) { return tcp_socket_set_buffer_sizes(&mSocket, recvBytes, sendBytes); }
+    ///@copydoc tcp_socket_set_keepalive
+    bool setKeepAlive(bool enable, uint32_t idleS=0, uint32_t intervalS=0, uint32_t count=0) { return tcp_socket_set_keepalive(&mSocket, enable, idleS, intervalS, count); }
+    ///@copydoc tcp_socket_set_quick_ack
+    bool setQuickAck(bool enable) { return tcp_socket_set_quick_ack(&mSocket, enable); }
+    ///@copydoc tcp_socket_set_busy_poll
+    bool setBusyPoll(uint32_t busyPollUs) { return tcp_socket_set_busy_poll(&mSocket, busyPollUs); }
+
+    bool setKernelTimestamps(bool enable);
+
+    bool enableLowLatencyMode(uint32_t busyPollUs=0);
+
+#ifndef WIN32
+    int fileDescriptor() const final { return mSocket.handle; }
+
+    bool recvFromDeviceV(const byte_ring_iov* segments, unsigned int count, size_t* length_out, mip::Timestamp* timestamp) final;
+#endif
+
 private:
     tcp_socket mSocket;
 };
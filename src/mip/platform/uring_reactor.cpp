@@ -0,0 +1,481 @@
+#include "uring_reactor.hpp"
+
+#include <cstring>
+#include <stdexcept>
+
+#include <errno.h>
+#include <unistd.h>
+#include <linux/io_uring.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+
+namespace mip
+{
+namespace platform
+{
+
+namespace
+{
+    // Completions which aren't device reads. Entry pointers are never this small.
+    const uint64_t TICK_USER_DATA = 1;
+    const uint64_t WAKE_USER_DATA = 2;
+
+    int uringSetup(unsigned int entries, struct io_uring_params* params)
+    {
+        return int(syscall(__NR_io_uring_setup, entries, params));
+    }
+
+    int uringEnter(int fd, unsigned int toSubmit, unsigned int minComplete, unsigned int flags, const void* arg, size_t argSize)
+    {
+        return int(syscall(__NR_io_uring_enter, fd, toSubmit, minComplete, flags, arg, argSize));
+    }
+
+    int uringRegister(int fd, unsigned int opcode, const void* arg, unsigned int count)
+    {
+        return int(syscall(__NR_io_uring_register, fd, opcode, arg, count));
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+///@brief The mapped submission and completion queues.
+///
+struct UringReactor::Ring
+{
+    int fd = -1;
+
+    void*  sqMap   = MAP_FAILED;
+    size_t sqSize  = 0;
+    void*  cqMap   = MAP_FAILED;
+    size_t cqSize  = 0;
+    struct io_uring_sqe* sqes = static_cast<struct io_uring_sqe*>(MAP_FAILED);
+    size_t sqesSize = 0;
+
+    unsigned int* sqHead  = nullptr;
+    unsigned int* sqTail  = nullptr;
+    unsigned int* sqArray = nullptr;
+    unsigned int  sqMask  = 0;
+    unsigned int  sqEntries = 0;
+    unsigned int  sqLocalTail = 0;  ///< Tail including entries not yet submitted.
+
+    unsigned int*         cqHead = nullptr;
+    unsigned int*         cqTail = nullptr;
+    unsigned int          cqMask = 0;
+    struct io_uring_cqe*  cqes   = nullptr;
+
+    bool extArg = false;
+
+    struct __kernel_timespec tickTime = {};
+
+    Ring(unsigned int entries);
+    ~Ring() { release(); }
+
+    void release();
+
+    struct io_uring_sqe* getSqe();
+    unsigned int flush();
+};
+
+UringReactor::Ring::Ring(unsigned int entries)
+{
+    struct io_uring_params params;
+    std::memset(&params, 0, sizeof(params));
+
+    fd = uringSetup(entries, &params);
+    if( fd < 0 )
+        throw std::runtime_error("Unable to create io_uring");
+
+    extArg = (params.features & IORING_FEAT_EXT_ARG) != 0;
+
+    sqSize = params.sq_off.array + params.sq_entries * sizeof(unsigned int);
+    cqSize = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+
+    const bool singleMap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if( singleMap )
+        sqSize = cqSize = (sqSize > cqSize) ? sqSize : cqSize;
+
+    sqMap = mmap(nullptr, sqSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+    cqMap = singleMap ? sqMap : mmap(nullptr, cqSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+
+    sqesSize = params.sq_entries * sizeof(struct io_uring_sqe);
+    sqes = static_cast<struct io_uring_sqe*>(mmap(nullptr, sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES));
+
+    if( sqMap == MAP_FAILED || cqMap == MAP_FAILED || sqes == MAP_FAILED )
+    {
+        release();
+        throw std::runtime_error("Unable to map io_uring");
+    }
+
+    uint8_t* sq = static_cast<uint8_t*>(sqMap);
+    sqHead    = reinterpret_cast<unsigned int*>(sq + params.sq_off.head);
+    sqTail    = reinterpret_cast<unsigned int*>(sq + params.sq_off.tail);
+    sqArray   = reinterpret_cast<unsigned int*>(sq + params.sq_off.array);
+    sqMask    = *reinterpret_cast<unsigned int*>(sq + params.sq_off.ring_mask);
+    sqEntries = *reinterpret_cast<unsigned int*>(sq + params.sq_off.ring_entries);
+    sqLocalTail = *sqTail;
+
+    uint8_t* cq = static_cast<uint8_t*>(cqMap);
+    cqHead = reinterpret_cast<unsigned int*>(cq + params.cq_off.head);
+    cqTail = reinterpret_cast<unsigned int*>(cq + params.cq_off.tail);
+    cqMask = *reinterpret_cast<unsigned int*>(cq + params.cq_off.ring_mask);
+    cqes   = reinterpret_cast<struct io_uring_cqe*>(cq + params.cq_off.cqes);
+}
+
+void UringReactor::Ring::release()
+{
+    if( sqes != MAP_FAILED )
+        munmap(sqes, sqesSize);
+    if( cqMap != MAP_FAILED && cqMap != sqMap )
+        munmap(cqMap, cqSize);
+    if( sqMap != MAP_FAILED )
+        munmap(sqMap, sqSize);
+
+    // Closing the ring cancels any requests still in flight.
+    if( fd >= 0 )
+        close(fd);
+
+    sqes  = static_cast<struct io_uring_sqe*>(MAP_FAILED);
+    cqMap = sqMap = MAP_FAILED;
+    fd    = -1;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+///@brief Returns a cleared submission entry, or NULL if the queue is full.
+///
+struct io_uring_sqe* UringReactor::Ring::getSqe()
+{
+    const unsigned int head = __atomic_load_n(sqHead, __ATOMIC_ACQUIRE);
+
+    if( sqLocalTail - head >= sqEntries )
+        return nullptr;
+
+    const unsigned int index = sqLocalTail & sqMask;
+    sqLocalTail++;
+
+    struct io_uring_sqe* sqe = &sqes[index];
+    std::memset(sqe, 0, sizeof(*sqe));
+    sqArray[index] = index;
+
+    return sqe;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+///@brief Publishes the new submission entries to the kernel.
+///
+///@returns The number of entries to submit.
+///
+unsigned int UringReactor::Ring::flush()
+{
+    const unsigned int count = sqLocalTail - *sqTail;
+    __atomic_store_n(sqTail, sqLocalTail, __ATOMIC_RELEASE);
+    return count;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+///@brief Creates an empty reactor.
+///
+///@param queueDepth
+///       Size of the submission queue. Each device uses one entry, plus two
+///       for the reactor itself.
+///
+///@throws std::runtime_error if io_uring is not available.
+///
+UringReactor::UringReactor(unsigned int queueDepth) : mRing(new Ring(queueDepth))
+{
+    mWakeFd = eventfd(0, EFD_CLOEXEC);
+    if( mWakeFd < 0 )
+        throw std::runtime_error("Unable to create eventfd");
+}
+
+UringReactor::~UringReactor()
+{
+    // The ring must go first, since reads may still target the parser buffers.
+    mRing.reset();
+
+    close(mWakeFd);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+///@brief Adds a device. Must be called before the reactor runs.
+///
+///@returns False if the reactor has started, the device has no file
+///         descriptor, or the queue depth would be exceeded.
+///
+bool UringReactor::add(DeviceInterface& device)
+{
+    const Connection* connection = device.connection();
+    const int fd = connection ? connection->fileDescriptor() : -1;
+
+    if( mStarted || fd < 0 || mEntries.size() + 2 >= mRing->sqEntries )
+        return false;
+
+    mEntries.emplace_back(new Entry{&device, fd, unsigned(mEntries.size()), true});
+    return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+///@brief Sets how often command queues are updated in the absence of data.
+///
+///@param interval Milliseconds. Must be greater than 0.
+///
+bool UringReactor::setTickInterval(Timeout interval)
+{
+    if( interval == 0 )
+        return false;
+
+    mTickInterval = interval;
+    return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+///@brief Submits pending reads, waits for completions and handles all of
+///       them.
+///
+///@param timeout
+///       Maximum time to wait in milliseconds, 0 to not wait, or -1 to wait
+///       for at least one completion. Since the tick fires regularly, a wait
+///       never exceeds the tick interval by much.
+///
+///@returns The number of completions handled, or -1 on error.
+///
+int UringReactor::runOnce(int timeout)
+{
+    if( !mStarted && !start() )
+        return -1;
+
+    Ring& ring = *mRing;
+
+    const unsigned int toSubmit = ring.flush();
+
+    unsigned int flags = 0;
+    unsigned int minComplete = 0;
+    const void* arg = nullptr;
+    size_t argSize = 0;
+
+    struct __kernel_timespec waitTime;
+    struct io_uring_getevents_arg getevents;
+
+    if( timeout != 0 )
+    {
+        flags |= IORING_ENTER_GETEVENTS;
+        minComplete = 1;
+
+        if( timeout > 0 && ring.extArg )
+        {
+            waitTime.tv_sec  = timeout / 1000;
+            waitTime.tv_nsec = (timeout % 1000) * 1000000L;
+
+            std::memset(&getevents, 0, sizeof(getevents));
+            getevents.ts = uint64_t(uintptr_t(&waitTime));
+
+            flags  |= IORING_ENTER_EXT_ARG;
+            arg     = &getevents;
+            argSize = sizeof(getevents);
+        }
+    }
+
+    if( toSubmit > 0 || minComplete > 0 )
+    {
+        mNumSystemCalls++;
+
+        if( uringEnter(ring.fd, toSubmit, minComplete, flags, arg, argSize) < 0 && errno != EINTR && errno != ETIME && errno != EBUSY )
+            return -1;
+    }
+
+    const Timestamp timestamp = getCurrentTimestamp();
+
+    // Handle every completion now available, for all devices.
+    int count = 0;
+    unsigned int head = *ring.cqHead;
+
+    while( head != __atomic_load_n(ring.cqTail, __ATOMIC_ACQUIRE) )
+    {
+        const struct io_uring_cqe cqe = ring.cqes[head & ring.cqMask];
+        head++;
+        __atomic_store_n(ring.cqHead, head, __ATOMIC_RELEASE);
+
+        complete(cqe.user_data, cqe.res, timestamp);
+        count++;
+    }
+
+    return count;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+///@brief Services devices until stop() is called.
+///
+void UringReactor::run()
+{
+    mStop = false;
+
+    while( !mStop )
+    {
+        if( runOnce(-1) < 0 )
+            break;
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+///@brief Makes run() return. May be called from any thread.
+///
+void UringReactor::stop()
+{
+    const uint64_t one = 1;
+    ssize_t written = write(mWakeFd, &one, sizeof(one));
+    (void)written;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+///@brief Registers the parser buffers and queues the first operations.
+///
+bool UringReactor::start()
+{
+    std::vector<struct iovec> buffers(mEntries.size());
+
+    for(size_t i=0; i<mEntries.size(); i++)
+    {
+        size_t size;
+        buffers[i].iov_base = C::mip_parser_buffer(C::mip_interface_parser(mEntries[i]->device), &size);
+        buffers[i].iov_len  = size;
+    }
+
+    if( !buffers.empty() && uringRegister(mRing->fd, IORING_REGISTER_BUFFERS, buffers.data(), unsigned(buffers.size())) != 0 )
+        return false;
+
+    mStarted = true;
+
+    for(std::unique_ptr<Entry>& entry : mEntries)
+        submitRead(*entry);
+
+    return submitTimeout() && submitWake();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+///@brief Queues a fixed-buffer read into the free space of the parser.
+///
+bool UringReactor::submitRead(Entry& entry)
+{
+    C::mip_parser* parser = C::mip_interface_parser(entry.device);
+
+    uint8_t* ptr;
+    size_t space = C::mip_parser_get_write_ptr(parser, &ptr);
+
+    // Parsing frees up space if the buffer is full.
+    if( space == 0 )
+    {
+        C::mip_parser_process_written(parser, 0, getCurrentTimestamp(), 0);
+        space = C::mip_parser_get_write_ptr(parser, &ptr);
+
+        if( space == 0 )
+            return false;
+    }
+
+    struct io_uring_sqe* sqe = mRing->getSqe();
+    if( !sqe )
+        return false;
+
+    sqe->opcode    = IORING_OP_READ_FIXED;
+    sqe->fd        = entry.fd;
+    sqe->addr      = uint64_t(uintptr_t(ptr));
+    sqe->len       = unsigned(space);
+    sqe->off       = uint64_t(-1);  // Current position; these are streams.
+    sqe->buf_index = uint16_t(entry.index);
+    sqe->user_data = uint64_t(uintptr_t(&entry));
+
+    return true;
+}
+
+bool UringReactor::submitTimeout()
+{
+    Ring& ring = *mRing;
+
+    ring.tickTime.tv_sec  = mTickInterval / 1000;
+    ring.tickTime.tv_nsec = (mTickInterval % 1000) * 1000000L;
+
+    struct io_uring_sqe* sqe = ring.getSqe();
+    if( !sqe )
+        return false;
+
+    sqe->opcode    = IORING_OP_TIMEOUT;
+    sqe->fd        = -1;
+    sqe->addr      = uint64_t(uintptr_t(&ring.tickTime));
+    sqe->len       = 1;
+    sqe->user_data = TICK_USER_DATA;
+
+    return true;
+}
+
+bool UringReactor::submitWake()
+{
+    struct io_uring_sqe* sqe = mRing->getSqe();
+    if( !sqe )
+        return false;
+
+    sqe->opcode    = IORING_OP_READ;
+    sqe->fd        = mWakeFd;
+    sqe->addr      = uint64_t(uintptr_t(&mWakeValue));
+    sqe->len       = sizeof(mWakeValue);
+    sqe->off       = uint64_t(-1);
+    sqe->user_data = WAKE_USER_DATA;
+
+    return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+///@brief Handles one completion.
+///
+void UringReactor::complete(uint64_t userData, int result, Timestamp timestamp)
+{
+    if( userData == TICK_USER_DATA )
+    {
+        tick(timestamp);
+        submitTimeout();
+        return;
+    }
+
+    if( userData == WAKE_USER_DATA )
+    {
+        mStop = true;
+        submitWake();
+        return;
+    }
+
+    Entry& entry = *reinterpret_cast<Entry*>(uintptr_t(userData));
+
+    if( !entry.active )
+        return;
+
+    if( result > 0 )
+    {
+        C::mip_parser_process_written(C::mip_interface_parser(entry.device), size_t(result), timestamp, 0);
+        C::mip_cmd_queue_update(C::mip_interface_cmd_queue(entry.device), timestamp);
+    }
+
+    const bool retry = (result > 0) || (result == -EAGAIN) || (result == -EINTR);
+
+    // A read of 0 bytes means end of file, e.g. a closed socket.
+    if( !retry || !submitRead(entry) )
+    {
+        entry.active = false;
+
+        if( mDisconnectCallback )
+            mDisconnectCallback(mUserData, *entry.device);
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+///@brief Updates every command queue, so that timeouts are detected.
+///
+void UringReactor::tick(Timestamp timestamp)
+{
+    for(std::unique_ptr<Entry>& entry : mEntries)
+    {
+        if( entry->active )
+            C::mip_cmd_queue_update(C::mip_interface_cmd_queue(entry->device), timestamp);
+    }
+}
+
+};  // namespace platform
+};  // namespace mip
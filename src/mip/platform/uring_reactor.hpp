@@ -0,0 +1,113 @@
+#pragma once
+
+#include <mip/mip_device.hpp>
+
+#include <memory>
+#include <vector>
+
+
+extern mip::Timestamp getCurrentTimestamp();
+
+namespace mip
+{
+namespace platform
+{
+
+////////////////////////////////////////////////////////////////////////////////
+///@brief Services many devices from a single thread using io_uring.
+///
+/// This is an alternative to Reactor for the highest data rates. Each
+/// device's parser buffer is registered with the kernel as a fixed buffer,
+/// and a fixed-buffer read into the parser's free space is kept in flight on
+/// every connection. Completions for all devices are collected and parsed
+/// together, and the follow-up reads are submitted in the same system call
+/// which waits for the next completions. Typically there's one system call
+/// per batch of packets across all devices, instead of a poll and a read
+/// per device and packet. The batches are largest when devices send at the
+/// same time; the UringSyscalls example measures this.
+///
+/// Command timeouts are detected with a periodic io_uring timeout, as with
+/// Reactor's timer tick.
+///
+/// Devices must be added before the first call to run() or runOnce(), since
+/// the buffers are registered then. While a read is in flight, the kernel
+/// owns part of the parser buffer. Therefore the devices must not be updated
+/// in any other way, which rules out blocking commands. Start commands
+/// without blocking (e.g. with startCommand or a CommandScheduler) instead.
+///
+///@code{.cpp}
+/// UringReactor reactor;
+/// for(DeviceInterface& device : devices)
+///     reactor.add(device);
+///
+/// reactor.run();  // Until reactor.stop() is called.
+///@endcode
+///
+/// This class is only available on Linux 5.6 or later, when built with
+/// WITH_IO_URING.
+///
+class UringReactor
+{
+public:
+    ///@brief Called when a device's connection fails or is closed. No more
+    ///       data is read for the device afterward.
+    typedef void (*DisconnectCallback)(void* userData, DeviceInterface& device);
+
+    explicit UringReactor(unsigned int queueDepth=64);
+    ~UringReactor();
+
+    UringReactor(const UringReactor&) = delete;
+    UringReactor& operator=(const UringReactor&) = delete;
+
+    bool add(DeviceInterface& device);
+
+    size_t size() const { return mEntries.size(); }
+
+    bool setTickInterval(Timeout interval);
+    Timeout tickInterval() const { return mTickInterval; }
+
+    void setDisconnectCallback(DisconnectCallback callback, void* userData) { mDisconnectCallback = callback; mUserData = userData; }
+
+    int runOnce(int timeout);
+    void run();
+    void stop();
+
+    ///@brief Number of io_uring_enter system calls made, for diagnostics.
+    uint64_t numSystemCalls() const { return mNumSystemCalls; }
+
+private:
+    struct Ring;
+
+    struct Entry
+    {
+        DeviceInterface* device;
+        int              fd;
+        unsigned int     index;     ///< Fixed buffer index.
+        bool             active;    ///< False once disconnected.
+    };
+
+    bool start();
+    bool submitRead(Entry& entry);
+    bool submitTimeout();
+    bool submitWake();
+    void complete(uint64_t userData, int result, Timestamp timestamp);
+    void tick(Timestamp timestamp);
+
+    std::unique_ptr<Ring> mRing;
+
+    std::vector<std::unique_ptr<Entry>> mEntries;
+
+    int      mWakeFd   = -1;
+    uint64_t mWakeValue = 0;
+
+    Timeout  mTickInterval = 10;
+    bool     mStarted = false;
+    bool     mStop    = false;
+    uint64_t mNumSystemCalls = 0;
+
+    DisconnectCallback mDisconnectCallback = nullptr;
+    void*              mUserData           = nullptr;
+};
+
+};  // namespace platform
+};  // namespace mip
@@ -108,6 +108,33 @@ size_t byte_ring_get_write_ptr(byte_ring_state* state, uint8_t** const ptr_out)
         return remainingSpace;
 }
 
+// Returns all free space, which is split in two segments when it wraps
+// around the end of the buffer. Returns the number of segments (0 to 2).
+unsigned int byte_ring_get_write_iov(byte_ring_state* state, byte_ring_iov iov_out[2])
+{
+    const size_t remainingSpace = byte_ring_free_space(state);
+    const size_t capacity = byte_ring_capacity(state);
+
+    const size_t head = state->head % capacity;
+    const size_t bytesUntilWrap = capacity - head;
+
+    if( remainingSpace == 0 )
+        return 0;
+
+    iov_out[0].ptr = &state->buffer[head];
+
+    if( remainingSpace <= bytesUntilWrap )
+    {
+        iov_out[0].length = remainingSpace;
+        return 1;
+    }
+
+    iov_out[0].length = bytesUntilWrap;
+    iov_out[1].ptr    = &state->buffer[0];
+    iov_out[1].length = remainingSpace - bytesUntilWrap;
+    return 2;
+}
+
 void byte_ring_notify_written(byte_ring_state* state, size_t count)
 {
     assert( count <= byte_ring_free_space(state) );
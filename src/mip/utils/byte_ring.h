@@ -12,6 +12,13 @@ typedef struct byte_ring_state
     size_t   tail;
 } byte_ring_state;
 
+///@brief One contiguous segment of a byte ring.
+typedef struct byte_ring_iov
+{
+    uint8_t* ptr;
+    size_t   length;
+} byte_ring_iov;
+
 void byte_ring_init(byte_ring_state* state, uint8_t* buffer, size_t size);
 void byte_ring_clear(byte_ring_state* state);
 
@@ -28,4 +35,5 @@ size_t byte_ring_copy_from_and_update(byte_ring_state* state, const uint8_t** by
 
 
 size_t byte_ring_get_write_ptr(byte_ring_state* state, uint8_t** ptr_out);
+unsigned int byte_ring_get_write_iov(byte_ring_state* state, byte_ring_iov iov_out[2]);
 void byte_ring_notify_written(byte_ring_state* state, size_t count);
@@ -1,8 +1,53 @@
 
 #include "serial_port.h"
 
+#ifndef WIN32
+#include <time.h>
+#endif
+#ifdef __linux__
+#include <linux/serial.h>
+#endif
+
 #define COM_PORT_BUFFER_SIZE  0x200
 
+#define SERIAL_PORT_DEFAULT_READ_TIMEOUT_MS  10
+
+#if defined(__linux__) && defined(TCGETS2)
+// The kernel's termios2 can't be included alongside glibc's termios, so it is
+// declared here (see asm-generic/termbits.h). It allows any baud rate to be
+// set via BOTHER, for rates which have no B* constant.
+#define SERIAL_PORT_HAVE_TERMIOS2
+
+#ifndef BOTHER
+#define BOTHER 0010000
+#endif
+
+struct termios2
+{
+    tcflag_t c_iflag;
+    tcflag_t c_oflag;
+    tcflag_t c_cflag;
+    tcflag_t c_lflag;
+    cc_t     c_line;
+    cc_t     c_cc[19];
+    speed_t  c_ispeed;
+    speed_t  c_ospeed;
+};
+
+static bool set_custom_baudrate(int handle, int baudrate, bool drain)
+{
+    struct termios2 settings;
+    if (ioctl(handle, TCGETS2, &settings) < 0)
+        return false;
+
+    settings.c_cflag  = (settings.c_cflag & (tcflag_t)~CBAUD) | BOTHER;
+    settings.c_ispeed = (speed_t)baudrate;
+    settings.c_ospeed = (speed_t)baudrate;
+
+    return ioctl(handle, drain ? TCSETSW2 : TCSETS2, &settings) == 0;
+}
+#endif
+
 #ifndef WIN32 //Unix only
 speed_t baud_rate_to_speed(int baud_rate)
 {
@@ -116,7 +161,7 @@ bool serial_port_open(serial_port *port, const char *port_str, int baudrate)
     
 #else //Linux
 
-    port->handle = open(port_str, O_RDWR | O_NOCTTY | O_SYNC);
+    port->handle = open(port_str, O_RDWR | O_NOCTTY);
 
     if (port->handle < 0)
     {
@@ -128,7 +173,19 @@ bool serial_port_open(serial_port *port, const char *port_str, int baudrate)
     if (tcgetattr(port->handle, &serial_port_settings) < 0)
         return false;
 
-    if (cfsetispeed(&serial_port_settings, baud_rate_to_speed(baudrate)) < 0 || cfsetospeed(&serial_port_settings, baud_rate_to_speed(baudrate)) < 0)
+    // Rates without a B* constant are set afterward via termios2, if possible.
+    const speed_t speed = baud_rate_to_speed(baudrate);
+    const bool custom_speed = (speed == (speed_t)-1);
+
+#ifndef SERIAL_PORT_HAVE_TERMIOS2
+    if (custom_speed)
+    {
+        close(port->handle);
+        return false;
+    }
+#endif
+
+    if (!custom_speed && (cfsetispeed(&serial_port_settings, speed) < 0 || cfsetospeed(&serial_port_settings, speed) < 0))
         return false;
 
     // Other serial settings to match MSCL
@@ -144,6 +201,17 @@ bool serial_port_open(serial_port *port, const char *port_str, int baudrate)
     // Persist the settings
     if(tcsetattr(port->handle, TCSANOW, &serial_port_settings) < 0)
         return false;
+
+#ifdef SERIAL_PORT_HAVE_TERMIOS2
+    if (custom_speed && !set_custom_baudrate(port->handle, baudrate, false))
+    {
+        close(port->handle);
+        return false;
+    }
+#endif
+
+    port->busy_poll_us    = 0;
+    port->read_timeout_ms = SERIAL_PORT_DEFAULT_READ_TIMEOUT_MS;
     
     // Flush any waiting data
     tcflush(port->handle, TCIOFLUSH);
@@ -173,6 +241,65 @@ bool serial_port_close(serial_port *port)
     return true;
 }
 
+////////////////////////////////////////////////////////////////////////////////
+///@brief Changes the baud rate of an open serial port.
+///
+/// Pending output is transmitted at the old rate first, and any received
+/// data not yet read is discarded.
+///
+///@returns False if the port is not open or the rate is not supported.
+///
+bool serial_port_set_baudrate(serial_port *port, int baudrate)
+{
+    if(!port->is_open)
+        return false;
+
+#ifdef WIN32 //Windows
+    DCB dcb;
+
+    if(!GetCommState(port->handle, &dcb))
+        return false;
+
+    dcb.BaudRate = baudrate;
+
+    if(!SetCommState(port->handle, &dcb))
+        return false;
+
+    PurgeComm(port->handle, PURGE_RXCLEAR);
+
+#else //Linux
+    struct termios serial_port_settings;
+    if (tcgetattr(port->handle, &serial_port_settings) < 0)
+        return false;
+
+    const speed_t speed = baud_rate_to_speed(baudrate);
+    if (speed == (speed_t)-1)
+    {
+#ifdef SERIAL_PORT_HAVE_TERMIOS2
+        if (!set_custom_baudrate(port->handle, baudrate, true))
+            return false;
+
+        tcflush(port->handle, TCIFLUSH);
+        return true;
+#else
+        return false;
+#endif
+    }
+
+    if (cfsetispeed(&serial_port_settings, speed) < 0 || cfsetospeed(&serial_port_settings, speed) < 0)
+        return false;
+
+    // TCSADRAIN waits for pending output to be sent at the old rate.
+    if (tcsetattr(port->handle, TCSADRAIN, &serial_port_settings) < 0)
+        return false;
+
+    tcflush(port->handle, TCIFLUSH);
+
+#endif
+
+    return true;
+}
+
 bool serial_port_write(serial_port *port, const void *buffer, size_t num_bytes, size_t *bytes_written)
 {
  
@@ -224,19 +351,25 @@ bool serial_port_read(serial_port *port, void *buffer, size_t num_bytes, size_t
     *bytes_read = local_bytes_read;
 
  #else //Linux
-    // Poll the device before attempting to read any data, so we will only block for 10ms if there is no data available
-    struct pollfd poll_fd = { .fd = port->handle, .events = POLLIN };
-    int poll_status = poll(&poll_fd, 1, 10);
+    // Poll the device before attempting to read any data, so we will only block for the read timeout if there is no data available
+    const int readable = serial_port_wait_readable(port);
+
+    // Hangup or error, e.g. a USB-serial adapter was unplugged.
+    if (readable < 0)
+        return false;
 
-    // Keep reading and polling while there is still data available
-    if (poll_status > 0 && poll_fd.revents & POLLIN)
+    if (readable > 0)
     {
         ssize_t local_bytes_read = read(port->handle, buffer, num_bytes);
 
-        if(local_bytes_read == (ssize_t)-1 && errno != EAGAIN)
+        if(local_bytes_read == (ssize_t)-1)
+            return errno == EAGAIN || errno == EINTR;
+
+        // Readable with no data means the device was disconnected.
+        if(local_bytes_read == 0 && num_bytes > 0)
             return false;
-        if(local_bytes_read >= 0)
-            *bytes_read = local_bytes_read;
+
+        *bytes_read = local_bytes_read;
     }
 
 #endif
@@ -274,3 +407,174 @@ bool serial_port_is_open(serial_port *port)
 {
     return port->is_open;
 }
+
+////////////////////////////////////////////////////////////////////////////////
+///@brief Sets how long serial_port_read waits for data to arrive.
+///
+/// The wait ends as soon as any data arrives, so a longer timeout doesn't
+/// delay data. It only determines how soon the read returns with nothing
+/// when the device is silent. The default is 10 ms.
+///
+///@param timeout_ms
+///       Maximum time to wait in milliseconds. 0 returns immediately if no
+///       data is available.
+///
+///@returns False if the port is not open.
+///
+bool serial_port_set_read_timeout(serial_port *port, uint32_t timeout_ms)
+{
+    if(!port->is_open)
+        return false;
+
+#ifdef WIN32 //Windows
+    COMMTIMEOUTS timeouts;
+    if(!GetCommTimeouts(port->handle, &timeouts))
+        return false;
+
+    // Return as soon as any data is available, or after timeout_ms if none.
+    timeouts.ReadIntervalTimeout         = MAXDWORD;
+    timeouts.ReadTotalTimeoutMultiplier  = (timeout_ms > 0) ? MAXDWORD : 0;
+    timeouts.ReadTotalTimeoutConstant    = (timeout_ms < MAXDWORD) ? timeout_ms : MAXDWORD - 1;
+
+    return SetCommTimeouts(port->handle, &timeouts) != 0;
+
+#else //Linux
+    port->read_timeout_ms = (timeout_ms < INT32_MAX) ? (int)timeout_ms : INT32_MAX;
+    return true;
+#endif
+}
+
+////////////////////////////////////////////////////////////////////////////////
+///@brief Enables or disables the driver's low latency mode.
+///
+/// On Linux, this sets ASYNC_LOW_LATENCY via TIOCSSERIAL. USB-serial drivers
+/// such as ftdi_sio then drop their latency timer from 16 ms to 1 ms, so
+/// small packets are delivered without waiting for more data. Other drivers
+/// may deliver received data directly rather than deferring it.
+///
+///@returns False if the port is not open or the driver doesn't support it
+///         (e.g. on Windows, or for pseudo terminals).
+///
+bool serial_port_set_low_latency(serial_port *port, bool enable)
+{
+    if(!port->is_open)
+        return false;
+
+#ifdef __linux__
+    struct serial_struct serial_info;
+    if (ioctl(port->handle, TIOCGSERIAL, &serial_info) < 0)
+        return false;
+
+    if (enable)
+        serial_info.flags |= ASYNC_LOW_LATENCY;
+    else
+        serial_info.flags &= ~ASYNC_LOW_LATENCY;
+
+    return ioctl(port->handle, TIOCSSERIAL, &serial_info) == 0;
+#else
+    (void)enable;
+    return false;
+#endif
+}
+
+////////////////////////////////////////////////////////////////////////////////
+///@brief Sets the termios VMIN and VTIME parameters.
+///
+/// With VTIME=0, the port becomes readable once at least vmin bytes are
+/// available. Use vmin=1 for the lowest latency, or larger values to batch
+/// data into fewer reads at high data rates. With VTIME>0, reads also
+/// complete once the line has been idle for vtime tenths of a second.
+///
+///@returns False if the port is not open or on Windows.
+///
+bool serial_port_set_read_timing(serial_port *port, uint8_t vmin, uint8_t vtime)
+{
+    if(!port->is_open)
+        return false;
+
+#ifdef WIN32
+    (void)vmin;
+    (void)vtime;
+    return false;
+#else
+    struct termios serial_port_settings;
+    if (tcgetattr(port->handle, &serial_port_settings) < 0)
+        return false;
+
+    serial_port_settings.c_cc[VMIN]  = vmin;
+    serial_port_settings.c_cc[VTIME] = vtime;
+
+    return tcsetattr(port->handle, TCSANOW, &serial_port_settings) == 0;
+#endif
+}
+
+////////////////////////////////////////////////////////////////////////////////
+///@brief Makes reads spin for a while before sleeping while waiting for data.
+///
+/// Waking a sleeping thread can take tens of microseconds or more. When
+/// data is expected shortly (e.g. a command reply), spinning avoids this
+/// delay at the cost of using a whole CPU core while waiting.
+///
+///@param busy_poll_us
+///       How long to spin, in microseconds, before falling back to a normal
+///       blocking wait. 0 disables busy polling (the default).
+///
+///@returns False if the port is not open or on Windows.
+///
+bool serial_port_set_busy_poll(serial_port *port, uint32_t busy_poll_us)
+{
+    if(!port->is_open)
+        return false;
+
+#ifdef WIN32
+    (void)busy_poll_us;
+    return false;
+#else
+    port->busy_poll_us = busy_poll_us;
+    return true;
+#endif
+}
+
+#ifndef WIN32
+////////////////////////////////////////////////////////////////////////////////
+///@brief Waits up to the read timeout for the port to become readable.
+///
+/// If busy polling is enabled, the port is first polled without sleeping
+/// for up to the configured time.
+///
+/// A hangup (e.g. an unplugged USB-serial adapter) is reported as readable
+/// while data remains, after which reads return 0 bytes.
+///
+///@returns 1 if data is available, 0 on timeout, or -1 on error or hangup.
+///
+int serial_port_wait_readable(serial_port *port)
+{
+    struct pollfd poll_fd = { .fd = port->handle, .events = POLLIN };
+
+    if (port->busy_poll_us > 0)
+    {
+        struct timespec start, now;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+
+        do
+        {
+            int poll_status = poll(&poll_fd, 1, 0);
+            if (poll_status < 0 && errno == EINTR)
+                return 0;
+            if (poll_status != 0)
+                return (poll_status > 0 && (poll_fd.revents & POLLIN)) ? 1 : -1;
+
+            clock_gettime(CLOCK_MONOTONIC, &now);
+
+        } while ((uint64_t)(now.tv_sec - start.tv_sec) * 1000000 + (now.tv_nsec - start.tv_nsec) / 1000 < port->busy_poll_us);
+    }
+
+    int poll_status = poll(&poll_fd, 1, port->read_timeout_ms);
+    if (poll_status < 0 && errno == EINTR)
+        return 0;
+    if (poll_status <= 0)
+        return poll_status;
+
+    return (poll_fd.revents & POLLIN) ? 1 : -1;
+}
+#endif
@@ -39,17 +39,29 @@ typedef struct serial_port
     HANDLE handle;
 #else //Linux
     int handle;
+    uint32_t busy_poll_us;     ///< See serial_port_set_busy_poll.
+    int      read_timeout_ms;  ///< See serial_port_set_read_timeout.
 #endif
 } serial_port;
 
 
 bool serial_port_open(serial_port *port, const char *port_str, int baudrate);
 bool serial_port_close(serial_port *port);
+bool serial_port_set_baudrate(serial_port *port, int baudrate);
 bool serial_port_write(serial_port *port, const void *buffer, size_t num_bytes, size_t *bytes_written);
 bool serial_port_read(serial_port *port, void *buffer, size_t num_bytes, size_t *bytes_read);
 uint32_t serial_port_read_count(serial_port *port);
 bool serial_port_is_open(serial_port *port);
 
+bool serial_port_set_read_timeout(serial_port *port, uint32_t timeout_ms);
+bool serial_port_set_low_latency(serial_port *port, bool enable);
+bool serial_port_set_read_timing(serial_port *port, uint8_t vmin, uint8_t vtime);
+bool serial_port_set_busy_poll(serial_port *port, uint32_t busy_poll_us);
+
+#ifndef WIN32
+int serial_port_wait_readable(serial_port *port);
+#endif
+
 ///@}
 ///@}
 ////////////////////////////////////////////////////////////////////////////////
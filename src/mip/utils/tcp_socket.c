@@ -4,9 +4,12 @@
 #ifdef WIN32
 #else
 #include <errno.h>
+#include <poll.h>
 #include <unistd.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
 #include <netinet/ip.h>
+#include <netinet/tcp.h>
 #include <netdb.h>
 #include <string.h>
 #include <stdio.h>
@@ -60,6 +63,15 @@ bool tcp_socket_open(tcp_socket* socket_ptr, const char* hostname, uint16_t port
     if( setsockopt(socket_ptr->handle, SOL_SOCKET, SO_SNDTIMEO, &timeout_option, sizeof(timeout_option)) != 0 )
         return false;
 
+    tcp_socket_set_recv_timeout(socket_ptr, timeout_ms);
+
+    socket_ptr->quick_ack     = false;
+    socket_ptr->rx_timestamps = false;
+
+    // MIP packets are small and latency sensitive, so don't let Nagle's
+    // algorithm hold back a command while a previous one is unacknowledged.
+    tcp_socket_set_no_delay(socket_ptr, true);
+
     return true;
 #endif
 }
@@ -102,7 +114,43 @@ bool tcp_socket_recv(tcp_socket* socket_ptr, void* buffer, size_t num_bytes, siz
 #ifdef WIN32
     return false;  // TODO: Windows
 #else
-    ssize_t local_bytes_read = recv(socket_ptr->handle, buffer, num_bytes, MSG_NOSIGNAL);
+    struct iovec iov = { .iov_base = buffer, .iov_len = num_bytes };
+
+    struct msghdr message;
+    memset(&message, 0, sizeof(message));
+    message.msg_iov    = &iov;
+    message.msg_iovlen = 1;
+
+    return tcp_socket_recvmsg(socket_ptr, &message, bytes_read);
+#endif
+}
+
+#ifndef WIN32
+////////////////////////////////////////////////////////////////////////////////
+///@brief Waits up to the receive timeout for data, then receives it with
+///       recvmsg.
+///
+/// This allows receiving into multiple buffers at once and retrieving
+/// ancillary data such as kernel receive timestamps (see
+/// tcp_socket_set_rx_timestamps). The caller provides the buffers and the
+/// control buffer, if any, in message.
+///
+///@param socket_ptr
+///@param message
+///@param bytes_read
+///       Set to the number of bytes received, or 0 on timeout.
+///
+///@returns False if the connection was closed or an error occurred.
+///
+bool tcp_socket_recvmsg(tcp_socket* socket_ptr, struct msghdr* message, size_t* bytes_read)
+{
+    *bytes_read = 0;
+
+    const int wait_status = tcp_socket_wait_readable(socket_ptr);
+    if( wait_status <= 0 )
+        return wait_status == 0;
+
+    ssize_t local_bytes_read = recvmsg(socket_ptr->handle, message, MSG_NOSIGNAL);
 
     if( local_bytes_read == -1 )
     {
@@ -115,7 +163,261 @@ bool tcp_socket_recv(tcp_socket* socket_ptr, void* buffer, size_t num_bytes, siz
     else if( local_bytes_read == 0 )
         return false;
 
+#ifdef TCP_QUICKACK
+    // The kernel may leave quick ack mode at any time, so turn it back on.
+    if( socket_ptr->quick_ack )
+    {
+        int option = 1;
+        setsockopt(socket_ptr->handle, IPPROTO_TCP, TCP_QUICKACK, &option, sizeof(option));
+    }
+#endif
+
     *bytes_read = local_bytes_read;
     return true;
+}
+#endif
+
+////////////////////////////////////////////////////////////////////////////////
+///@brief Sets how long tcp_socket_recv waits for data to arrive.
+///
+/// The wait ends as soon as any data arrives, so a longer timeout doesn't
+/// delay data. It only determines how soon the call returns with nothing
+/// when the device is silent. The default is the timeout given to
+/// tcp_socket_open.
+///
+///@param timeout_ms
+///       Maximum time to wait in milliseconds. 0 returns immediately if no
+///       data is available.
+///
+bool tcp_socket_set_recv_timeout(tcp_socket* socket_ptr, uint32_t timeout_ms)
+{
+    socket_ptr->recv_timeout_ms = (timeout_ms < INT32_MAX) ? (int)timeout_ms : INT32_MAX;
+    return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+///@brief Waits up to the receive timeout for the socket to become readable.
+///
+///@returns 1 if data is available or the connection was closed (which recv
+///         then reports), 0 on timeout, or -1 on error.
+///
+int tcp_socket_wait_readable(tcp_socket* socket_ptr)
+{
+#ifdef WIN32
+    return -1;  // TODO: Windows
+#else
+    struct pollfd poll_fd = { .fd = socket_ptr->handle, .events = POLLIN };
+
+    const int poll_status = poll(&poll_fd, 1, socket_ptr->recv_timeout_ms);
+    if( poll_status < 0 )
+        return (errno == EINTR) ? 0 : -1;
+
+    return poll_status;
+#endif
+}
+
+////////////////////////////////////////////////////////////////////////////////
+///@brief Enables or disables TCP_NODELAY.
+///
+/// With Nagle's algorithm (i.e. TCP_NODELAY disabled), a small packet is held
+/// back until all previously sent data is acknowledged, which can delay
+/// commands by up to the peer's delayed-ack time (often 40 ms or more).
+/// tcp_socket_open enables TCP_NODELAY.
+///
+bool tcp_socket_set_no_delay(tcp_socket* socket_ptr, bool enable)
+{
+#ifdef WIN32
+    (void)socket_ptr;
+    (void)enable;
+    return false;  // TODO: Windows
+#else
+    int option = enable ? 1 : 0;
+    return setsockopt(socket_ptr->handle, IPPROTO_TCP, TCP_NODELAY, &option, sizeof(option)) == 0;
+#endif
+}
+
+////////////////////////////////////////////////////////////////////////////////
+///@brief Sets the kernel receive and send buffer sizes.
+///
+/// A larger receive buffer avoids stalling the device when the application
+/// occasionally falls behind at high data rates. Note that Linux doubles the
+/// requested values for bookkeeping and limits them to net.core.rmem_max
+/// and net.core.wmem_max.
+///
+///@param socket_ptr
+///@param recv_bytes
+///       Size of the receive buffer (SO_RCVBUF). 0 leaves it unchanged.
+///@param send_bytes
+///       Size of the send buffer (SO_SNDBUF). 0 leaves it unchanged.
+///
+bool tcp_socket_set_buffer_sizes(tcp_socket* socket_ptr, uint32_t recv_bytes, uint32_t send_bytes)
+{
+#ifdef WIN32
+    (void)socket_ptr;
+    (void)recv_bytes;
+    (void)send_bytes;
+    return false;  // TODO: Windows
+#else
+    if( recv_bytes > 0 )
+    {
+        int option = (recv_bytes < INT32_MAX) ? (int)recv_bytes : INT32_MAX;
+        if( setsockopt(socket_ptr->handle, SOL_SOCKET, SO_RCVBUF, &option, sizeof(option)) != 0 )
+            return false;
+    }
+
+    if( send_bytes > 0 )
+    {
+        int option = (send_bytes < INT32_MAX) ? (int)send_bytes : INT32_MAX;
+        if( setsockopt(socket_ptr->handle, SOL_SOCKET, SO_SNDBUF, &option, sizeof(option)) != 0 )
+            return false;
+    }
+
+    return true;
+#endif
+}
+
+////////////////////////////////////////////////////////////////////////////////
+///@brief Configures TCP keepalive probes.
+///
+/// Without keepalive, a connection whose peer silently disappeared (e.g. a
+/// serial-to-ethernet bridge lost power) is only detected when sending
+/// fails. Keepalive probes detect it while idle, after which receiving
+/// fails.
+///
+///@param socket_ptr
+///@param enable
+///       Enables or disables keepalive probes (SO_KEEPALIVE).
+///@param idle_s
+///       Idle time in seconds before the first probe. 0 uses the system
+///       default.
+///@param interval_s
+///       Time in seconds between probes. 0 uses the system default.
+///@param count
+///       Number of unanswered probes before the connection is dropped. 0
+///       uses the system default.
+///
+///@returns False if any option couldn't be set. On platforms without
+///         per-socket keepalive timing, nonzero values fail.
+///
+bool tcp_socket_set_keepalive(tcp_socket* socket_ptr, bool enable, uint32_t idle_s, uint32_t interval_s, uint32_t count)
+{
+#ifdef WIN32
+    (void)socket_ptr;
+    (void)enable;
+    (void)idle_s;
+    (void)interval_s;
+    (void)count;
+    return false;  // TODO: Windows
+#else
+    int option = enable ? 1 : 0;
+    if( setsockopt(socket_ptr->handle, SOL_SOCKET, SO_KEEPALIVE, &option, sizeof(option)) != 0 )
+        return false;
+
+    if( !enable )
+        return true;
+
+#if defined(TCP_KEEPIDLE) && defined(TCP_KEEPINTVL) && defined(TCP_KEEPCNT)
+    if( idle_s > 0 )
+    {
+        option = (int)idle_s;
+        if( setsockopt(socket_ptr->handle, IPPROTO_TCP, TCP_KEEPIDLE, &option, sizeof(option)) != 0 )
+            return false;
+    }
+
+    if( interval_s > 0 )
+    {
+        option = (int)interval_s;
+        if( setsockopt(socket_ptr->handle, IPPROTO_TCP, TCP_KEEPINTVL, &option, sizeof(option)) != 0 )
+            return false;
+    }
+
+    if( count > 0 )
+    {
+        option = (int)count;
+        if( setsockopt(socket_ptr->handle, IPPROTO_TCP, TCP_KEEPCNT, &option, sizeof(option)) != 0 )
+            return false;
+    }
+
+    return true;
+#else
+    return idle_s == 0 && interval_s == 0 && count == 0;
+#endif
+#endif
+}
+
+////////////////////////////////////////////////////////////////////////////////
+///@brief Acknowledges received data immediately instead of delaying the ack.
+///
+/// Delayed acks interact badly with devices which don't send the next data
+/// until their previous data is acknowledged. The kernel can leave quick
+/// ack mode by itself, so it's re-enabled after every receive.
+///
+///@returns False if not supported (only Linux supports TCP_QUICKACK).
+///
+bool tcp_socket_set_quick_ack(tcp_socket* socket_ptr, bool enable)
+{
+#if !defined(WIN32) && defined(TCP_QUICKACK)
+    int option = enable ? 1 : 0;
+    if( setsockopt(socket_ptr->handle, IPPROTO_TCP, TCP_QUICKACK, &option, sizeof(option)) != 0 )
+        return false;
+
+    socket_ptr->quick_ack = enable;
+    return true;
+#else
+    (void)socket_ptr;
+    (void)enable;
+    return false;
+#endif
+}
+
+////////////////////////////////////////////////////////////////////////////////
+///@brief Makes the kernel busy poll the network device while waiting for
+///       data (SO_BUSY_POLL).
+///
+/// This reduces receive latency at the cost of CPU time. It requires a
+/// network driver with busy polling support, and values above the
+/// net.core.busy_read sysctl require CAP_NET_ADMIN.
+///
+///@param socket_ptr
+///@param busy_poll_us
+///       How long to busy poll, in microseconds. 0 disables it.
+///
+///@returns False if not supported or not permitted.
+///
+bool tcp_socket_set_busy_poll(tcp_socket* socket_ptr, uint32_t busy_poll_us)
+{
+#if !defined(WIN32) && defined(SO_BUSY_POLL)
+    int option = (busy_poll_us < INT32_MAX) ? (int)busy_poll_us : INT32_MAX;
+    return setsockopt(socket_ptr->handle, SOL_SOCKET, SO_BUSY_POLL, &option, sizeof(option)) == 0;
+#else
+    (void)socket_ptr;
+    (void)busy_poll_us;
+    return false;
+#endif
+}
+
+////////////////////////////////////////////////////////////////////////////////
+///@brief Requests kernel receive timestamps (SO_TIMESTAMPNS).
+///
+/// When enabled, tcp_socket_recvmsg can return the time at which the kernel
+/// received the data as an SCM_TIMESTAMPNS control message, which excludes
+/// any delay in scheduling the receiving thread. The timestamps use
+/// CLOCK_REALTIME. tcp_socket_recv ignores them.
+///
+///@returns False if not supported (only Linux supports SO_TIMESTAMPNS).
+///
+bool tcp_socket_set_rx_timestamps(tcp_socket* socket_ptr, bool enable)
+{
+#if !defined(WIN32) && defined(SO_TIMESTAMPNS)
+    int option = enable ? 1 : 0;
+    if( setsockopt(socket_ptr->handle, SOL_SOCKET, SO_TIMESTAMPNS, &option, sizeof(option)) != 0 )
+        return false;
+
+    socket_ptr->rx_timestamps = enable;
+    return true;
+#else
+    (void)socket_ptr;
+    (void)enable;
+    return false;
 #endif
 }
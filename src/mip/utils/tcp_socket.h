@@ -23,6 +23,9 @@ extern "C" {
 typedef struct tcp_socket
 {
     int handle;
+    int recv_timeout_ms;  ///< See tcp_socket_set_recv_timeout.
+    bool quick_ack;       ///< See tcp_socket_set_quick_ack.
+    bool rx_timestamps;   ///< See tcp_socket_set_rx_timestamps.
 } tcp_socket;
 
 
@@ -31,6 +34,21 @@ bool tcp_socket_close(tcp_socket* socket_ptr);
 bool tcp_socket_send(tcp_socket* socket_ptr, const void* buffer, size_t num_bytes, size_t* bytes_written);
 bool tcp_socket_recv(tcp_socket* socket_ptr, void* buffer, size_t num_bytes, size_t* bytes_read);
 
+bool tcp_socket_set_recv_timeout(tcp_socket* socket_ptr, uint32_t timeout_ms);
+int tcp_socket_wait_readable(tcp_socket* socket_ptr);
+
+bool tcp_socket_set_no_delay(tcp_socket* socket_ptr, bool enable);
+bool tcp_socket_set_buffer_sizes(tcp_socket* socket_ptr, uint32_t recv_bytes, uint32_t send_bytes);
+bool tcp_socket_set_keepalive(tcp_socket* socket_ptr, bool enable, uint32_t idle_s, uint32_t interval_s, uint32_t count);
+bool tcp_socket_set_quick_ack(tcp_socket* socket_ptr, bool enable);
+bool tcp_socket_set_busy_poll(tcp_socket* socket_ptr, uint32_t busy_poll_us);
+bool tcp_socket_set_rx_timestamps(tcp_socket* socket_ptr, bool enable);
+
+#ifndef WIN32
+struct msghdr;
+bool tcp_socket_recvmsg(tcp_socket* socket_ptr, struct msghdr* message, size_t* bytes_read);
+#endif
+
 ///@}
 ///@}
 ////////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,173 @@
+#include <mip/utils/byte_ring.h>
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <string.h>
+
+#define RING_SIZE 16
+
+uint8_t buffer[RING_SIZE];
+
+int num_errors = 0;
+
+bool check(bool condition, const char* fmt, ...)
+{
+    if( condition )
+        return true;
+
+    va_list argptr;
+    va_start(argptr, fmt);
+    vfprintf(stderr, fmt, argptr);
+    va_end(argptr);
+
+    fputc('\n', stderr);
+
+    num_errors++;
+    return false;
+}
+
+bool check_equal(int a, int b, const char* fmt, ...)
+{
+    if( a == b )
+        return true;
+
+    va_list argptr;
+    va_start(argptr, fmt);
+    vfprintf(stderr, fmt, argptr);
+    va_end(argptr);
+
+    fprintf(stderr, " (%d != %d)", a, b);
+
+    fputc('\n', stderr);
+
+    num_errors++;
+    return false;
+}
+
+// Writes count bytes and then removes popped bytes, leaving the head at
+// count and the tail at popped.
+void fill(byte_ring_state* ring, size_t count, size_t popped)
+{
+    uint8_t bytes[RING_SIZE] = {0};
+    const uint8_t* ptr = bytes;
+
+    byte_ring_init(ring, buffer, sizeof(buffer));
+    byte_ring_copy_from_and_update(ring, &ptr, &count);
+    byte_ring_pop(ring, popped);
+}
+
+void test_empty()
+{
+    byte_ring_state ring;
+    fill(&ring, 0, 0);
+
+    byte_ring_iov iov[2];
+    if( check_equal(byte_ring_get_write_iov(&ring, iov), 1, "Empty ring should have one segment") )
+    {
+        check(iov[0].ptr == &buffer[0], "Empty ring segment should start at the buffer");
+        check_equal(iov[0].length, RING_SIZE, "Empty ring segment should cover the buffer");
+    }
+}
+
+void test_full()
+{
+    byte_ring_state ring;
+    fill(&ring, RING_SIZE, 0);
+
+    byte_ring_iov iov[2];
+    check_equal(byte_ring_get_write_iov(&ring, iov), 0, "Full ring should have no segments");
+
+    // Full after wrapping around.
+    fill(&ring, RING_SIZE, 6);
+    size_t count = 6;
+    const uint8_t bytes[6] = {0};
+    const uint8_t* ptr = bytes;
+    byte_ring_copy_from_and_update(&ring, &ptr, &count);
+
+    check_equal(byte_ring_get_write_iov(&ring, iov), 0, "Wrapped full ring should have no segments");
+}
+
+void test_no_wrap()
+{
+    byte_ring_state ring;
+    fill(&ring, 4, 0);
+
+    byte_ring_iov iov[2];
+    if( check_equal(byte_ring_get_write_iov(&ring, iov), 1, "Free space up to the end should be one segment") )
+    {
+        check(iov[0].ptr == &buffer[4], "Segment should start at the head");
+        check_equal(iov[0].length, RING_SIZE-4, "Segment should end at the end of the buffer");
+    }
+}
+
+void test_wrap()
+{
+    byte_ring_state ring;
+    fill(&ring, 10, 4);
+
+    byte_ring_iov iov[2];
+    if( check_equal(byte_ring_get_write_iov(&ring, iov), 2, "Wrapping free space should be two segments") )
+    {
+        check(iov[0].ptr == &buffer[10], "First segment should start at the head");
+        check_equal(iov[0].length, RING_SIZE-10, "First segment should end at the end of the buffer");
+        check(iov[1].ptr == &buffer[0], "Second segment should start at the buffer");
+        check_equal(iov[1].length, 4, "Second segment should end at the tail");
+    }
+
+    // Data written through the segments is read back in order.
+    for(size_t i=0; i<iov[0].length; i++)
+        iov[0].ptr[i] = (uint8_t)i;
+    for(size_t i=0; i<iov[1].length; i++)
+        iov[1].ptr[i] = (uint8_t)(iov[0].length + i);
+
+    byte_ring_notify_written(&ring, iov[0].length + iov[1].length);
+    check_equal(byte_ring_count(&ring), RING_SIZE, "Ring should be full after writing both segments");
+
+    // Drop the bytes which were already there.
+    byte_ring_pop(&ring, 6);
+
+    uint8_t data[RING_SIZE-6];
+    byte_ring_copy_to(&ring, data, sizeof(data));
+
+    for(size_t i=0; i<sizeof(data); i++)
+    {
+        if( !check_equal(data[i], (int)i, "Byte %u is wrong", (unsigned)i) )
+            break;
+    }
+}
+
+void test_head_at_end()
+{
+    byte_ring_state ring;
+    fill(&ring, RING_SIZE, 6);
+
+    byte_ring_iov iov[2];
+    if( check_equal(byte_ring_get_write_iov(&ring, iov), 1, "Free space at the start should be one segment") )
+    {
+        check(iov[0].ptr == &buffer[0], "Segment should start at the buffer");
+        check_equal(iov[0].length, 6, "Segment should end at the tail");
+    }
+
+    fill(&ring, RING_SIZE, RING_SIZE);
+
+    if( check_equal(byte_ring_get_write_iov(&ring, iov), 1, "Emptied ring should have one segment") )
+    {
+        check(iov[0].ptr == &buffer[0], "Emptied ring segment should start at the buffer");
+        check_equal(iov[0].length, RING_SIZE, "Emptied ring segment should cover the buffer");
+    }
+}
+
+int main(int argc, const char* argv[])
+{
+    (void)argc;
+    (void)argv;
+
+    test_empty();
+    test_full();
+    test_no_wrap();
+    test_wrap();
+    test_head_at_end();
+
+    return num_errors;
+}
@@ -0,0 +1,262 @@
+#include <mip/mip_cmdqueue.h>
+#include <mip/mip_packet.h>
+#include <mip/mip_offsets.h>
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+
+#define BASE_TIMEOUT 100
+
+unsigned int num_errors = 0;
+
+bool check(bool condition, const char* fmt, ...)
+{
+    if( condition )
+        return true;
+
+    va_list argptr;
+    va_start(argptr, fmt);
+    vfprintf(stderr, fmt, argptr);
+    va_end(argptr);
+
+    fputc('\n', stderr);
+
+    num_errors++;
+    return false;
+}
+
+void add_reply(struct mip_packet* packet, uint8_t cmd_descriptor, uint8_t ack_code)
+{
+    const uint8_t payload[2] = { cmd_descriptor, ack_code };
+    mip_packet_add_field(packet, 0xF1, payload, sizeof(payload));
+}
+
+void test_multiple_pending()
+{
+    struct mip_cmd_queue queue;
+    mip_cmd_queue_init(&queue, BASE_TIMEOUT);
+
+    uint8_t response_buffer[8];
+
+    struct mip_pending_cmd ping, info, ping2;
+    mip_pending_cmd_init(&ping, 0x01, 0x01);
+    mip_pending_cmd_init_with_response(&info, 0x01, 0x03, 0x81, response_buffer, sizeof(response_buffer));
+    mip_pending_cmd_init(&ping2, 0x01, 0x01);
+
+    mip_cmd_queue_enqueue(&queue, &ping);
+    mip_cmd_queue_enqueue(&queue, &info);
+    mip_cmd_queue_enqueue(&queue, &ping2);
+
+    check(mip_pending_cmd_status(&info) == MIP_STATUS_PENDING, "Second command should be queued, not cancelled");
+    check(mip_pending_cmd_status(&ping2) == MIP_STATUS_PENDING, "Third command should be queued, not cancelled");
+
+    mip_cmd_queue_update(&queue, 0);
+
+    // One packet acks the first ping and the device info query (out of order) with response data.
+    uint8_t buffer[MIP_PACKET_LENGTH_MAX];
+    struct mip_packet packet;
+    mip_packet_create(&packet, buffer, sizeof(buffer), 0x01);
+    add_reply(&packet, 0x03, MIP_ACK_OK);
+    const uint8_t info_data[4] = { 1, 2, 3, 4 };
+    mip_packet_add_field(&packet, 0x81, info_data, sizeof(info_data));
+    add_reply(&packet, 0x01, MIP_NACK_COMMAND_FAILED);
+    mip_packet_finalize(&packet);
+
+    mip_cmd_queue_process_packet(&queue, &packet, 10);
+
+    check(mip_pending_cmd_status(&info) == MIP_ACK_OK, "Info command should be acked (%d)", mip_pending_cmd_status(&info));
+    check(mip_pending_cmd_response_length(&info) == sizeof(info_data), "Info response has wrong length");
+    check(memcmp(response_buffer, info_data, sizeof(info_data)) == 0, "Info response has wrong data");
+    check(mip_pending_cmd_status(&ping) == MIP_NACK_COMMAND_FAILED, "First ping should get the first reply (%d)", mip_pending_cmd_status(&ping));
+    check(mip_pending_cmd_status(&ping2) == MIP_STATUS_WAITING, "Second ping should still be waiting (%d)", mip_pending_cmd_status(&ping2));
+
+    mip_cmd_queue_update(&queue, BASE_TIMEOUT + 1);
+
+    check(mip_pending_cmd_status(&ping2) == MIP_STATUS_TIMEDOUT, "Second ping should time out (%d)", mip_pending_cmd_status(&ping2));
+    check(queue._first_pending_cmd == NULL, "Queue should be empty");
+}
+
+void test_dequeue()
+{
+    struct mip_cmd_queue queue;
+    mip_cmd_queue_init(&queue, BASE_TIMEOUT);
+
+    struct mip_pending_cmd a, b, c;
+    mip_pending_cmd_init(&a, 0x0C, 0x01);
+    mip_pending_cmd_init(&b, 0x0C, 0x02);
+    mip_pending_cmd_init(&c, 0x0C, 0x03);
+
+    mip_cmd_queue_enqueue(&queue, &a);
+    mip_cmd_queue_enqueue(&queue, &b);
+    mip_cmd_queue_enqueue(&queue, &c);
+
+    mip_cmd_queue_dequeue(&queue, &b);
+
+    check(mip_pending_cmd_status(&b) == MIP_STATUS_CANCELLED, "Dequeued command should be cancelled");
+    check(queue._first_pending_cmd == &a && a._next == &c && c._next == NULL, "Dequeue broke the list");
+
+    mip_cmd_queue_clear(&queue);
+
+    check(mip_pending_cmd_status(&a) == MIP_STATUS_ERROR && mip_pending_cmd_status(&c) == MIP_STATUS_ERROR, "Clear should fail all commands");
+}
+
+timestamp_type fake_time = 0;
+
+timestamp_type get_fake_time()
+{
+    return fake_time;
+}
+
+void test_stats()
+{
+    check(mip_cmd_stats_bucket_index(5) == 5, "Small latencies should have exact buckets");
+    check(mip_cmd_stats_bucket_lower_bound(mip_cmd_stats_bucket_index(1000)) <= 1000, "Bucket lower bound too high");
+    check(mip_cmd_stats_bucket_lower_bound(mip_cmd_stats_bucket_index(1000)+1) > 1000, "Next bucket lower bound too low");
+
+    mip_cmd_stats_entry entries[1];
+    struct mip_cmd_stats stats;
+    mip_cmd_stats_init(&stats, entries, 1, &get_fake_time);
+
+    struct mip_cmd_queue queue;
+    mip_cmd_queue_init(&queue, BASE_TIMEOUT);
+    mip_cmd_queue_set_stats(&queue, &stats);
+
+    struct mip_pending_cmd ping, idle, ping2;
+    mip_pending_cmd_init(&ping, 0x01, 0x01);
+    mip_pending_cmd_init(&idle, 0x01, 0x02);
+    mip_pending_cmd_init(&ping2, 0x01, 0x01);
+
+    fake_time = 10;
+    mip_cmd_queue_enqueue(&queue, &ping);
+    mip_cmd_queue_enqueue(&queue, &idle);
+    mip_cmd_queue_update(&queue, 12);
+
+    fake_time = 20;
+    mip_cmd_queue_enqueue(&queue, &ping2);
+
+    uint8_t buffer[MIP_PACKET_LENGTH_MAX];
+    struct mip_packet packet;
+    mip_packet_create(&packet, buffer, sizeof(buffer), 0x01);
+    add_reply(&packet, 0x01, MIP_ACK_OK);
+    add_reply(&packet, 0x01, MIP_NACK_INVALID_PARAM);
+    add_reply(&packet, 0x02, MIP_ACK_OK);
+    mip_packet_finalize(&packet);
+
+    mip_cmd_queue_process_packet(&queue, &packet, 50);
+
+    check(mip_cmd_stats_count(&stats) == 1, "Expected one stats entry");
+    check(mip_cmd_stats_num_untracked(&stats) == 1, "Second command type should be untracked");
+
+    const mip_cmd_stats_entry* entry = mip_cmd_stats_find(&stats, 0x01, 0x01);
+    if( check(entry != NULL, "Missing ping stats") )
+    {
+        check(entry->num_acks == 1 && entry->num_nacks == 1, "Wrong ack/nack counts");
+        check(entry->nack_counts[MIP_NACK_INVALID_PARAM] == 1, "Wrong nack code count");
+        check(entry->min_latency == 30 && entry->max_latency == 40, "Wrong latency range (%d-%d)", (int)entry->min_latency, (int)entry->max_latency);
+        check(mip_cmd_stats_entry_percentile(entry, 100) == 40, "Wrong max percentile");
+        check(mip_cmd_stats_entry_mean(entry) == 35.0f, "Wrong mean latency");
+    }
+}
+
+void test_stats_enabled_late()
+{
+    mip_cmd_stats_entry entries[1];
+    struct mip_cmd_stats stats;
+    mip_cmd_stats_init(&stats, entries, 1, &get_fake_time);
+
+    struct mip_cmd_queue queue;
+    mip_cmd_queue_init(&queue, BASE_TIMEOUT);
+
+    struct mip_pending_cmd ping, ping2;
+    mip_pending_cmd_init(&ping, 0x01, 0x01);
+    mip_pending_cmd_init(&ping2, 0x01, 0x01);
+
+    fake_time = 1000;
+    mip_cmd_queue_enqueue(&queue, &ping);
+    mip_cmd_queue_update(&queue, 1000);
+
+    // Enabled while the first ping is in flight.
+    mip_cmd_queue_set_stats(&queue, &stats);
+    mip_cmd_queue_enqueue(&queue, &ping2);
+    mip_cmd_queue_update(&queue, 1000);
+
+    uint8_t buffer[MIP_PACKET_LENGTH_MAX];
+    struct mip_packet packet;
+    mip_packet_create(&packet, buffer, sizeof(buffer), 0x01);
+    add_reply(&packet, 0x01, MIP_ACK_OK);
+    add_reply(&packet, 0x01, MIP_ACK_OK);
+    mip_packet_finalize(&packet);
+
+    mip_cmd_queue_process_packet(&queue, &packet, 1005);
+
+    const mip_cmd_stats_entry* entry = mip_cmd_stats_find(&stats, 0x01, 0x01);
+    if( check(entry != NULL, "Missing ping stats") )
+    {
+        check(entry->num_acks == 1, "Only the command sent after enabling stats should be counted (%u)", (unsigned)entry->num_acks);
+        check(entry->max_latency == 5, "Wrong latency (%d)", (int)entry->max_latency);
+    }
+}
+
+void test_time_until_deadline()
+{
+    struct mip_cmd_queue queue;
+    mip_cmd_queue_init(&queue, BASE_TIMEOUT);
+
+    timeout_type wait = mip_cmd_queue_time_until_deadline(&queue, 1000, 500);
+    check(wait == 500, "Empty queue should wait the maximum (%d)", (int)wait);
+
+    // Not sent yet, so the timer is assumed to start now.
+    struct mip_pending_cmd slow, ping;
+    mip_pending_cmd_init_with_timeout(&slow, 0x01, 0x03, 50);
+    mip_cmd_queue_enqueue(&queue, &slow);
+
+    wait = mip_cmd_queue_time_until_deadline(&queue, 1000, 500);
+    check(wait == BASE_TIMEOUT+50+1, "Pending command deadline should be measured from now (%d)", (int)wait);
+
+    wait = mip_cmd_queue_time_until_deadline(&queue, 1000, 20);
+    check(wait == 20, "Wait should be limited to the maximum (%d)", (int)wait);
+
+    // Sent at 1000, so it times out after 1150.
+    mip_cmd_queue_update(&queue, 1000);
+    check(mip_pending_cmd_status(&slow) == MIP_STATUS_WAITING, "Command should be waiting after an update");
+
+    wait = mip_cmd_queue_time_until_deadline(&queue, 1100, 500);
+    check(wait == 51, "Waiting command deadline should be measured from the send time (%d)", (int)wait);
+
+    wait = mip_cmd_queue_time_until_deadline(&queue, 1150, 500);
+    check(wait == 1, "Command at its deadline should not be overdue yet (%d)", (int)wait);
+
+    wait = mip_cmd_queue_time_until_deadline(&queue, 1151, 500);
+    check(wait == 0, "Overdue command should not wait (%d)", (int)wait);
+
+    // The later command times out first, at 1140.
+    mip_pending_cmd_init(&ping, 0x01, 0x01);
+    mip_cmd_queue_enqueue(&queue, &ping);
+
+    wait = mip_cmd_queue_time_until_deadline(&queue, 1040, 500);
+    check(wait == BASE_TIMEOUT+1, "Earliest deadline of several commands should be used (%d)", (int)wait);
+
+    wait = mip_cmd_queue_time_until_deadline(&queue, 1151, 500);
+    check(wait == 0, "Any overdue command should end the wait (%d)", (int)wait);
+
+    mip_cmd_queue_dequeue(&queue, &slow);
+    mip_cmd_queue_dequeue(&queue, &ping);
+
+    wait = mip_cmd_queue_time_until_deadline(&queue, 1151, 500);
+    check(wait == 500, "Dequeued commands should be ignored (%d)", (int)wait);
+}
+
+int main(int argc, const char* argv[])
+{
+    (void)argc;
+    (void)argv;
+
+    test_multiple_pending();
+    test_dequeue();
+    test_stats();
+    test_stats_enabled_late();
+    test_time_until_deadline();
+
+    return num_errors;
+}
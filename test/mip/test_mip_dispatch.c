@@ -0,0 +1,96 @@
+#include <mip/mip_dispatch.h>
+#include <mip/mip_packet.h>
+#include <mip/mip_offsets.h>
+
+#include <stdio.h>
+#include <stdarg.h>
+
+unsigned int num_errors = 0;
+
+bool check(bool condition, const char* fmt, ...)
+{
+    if( condition )
+        return true;
+
+    va_list argptr;
+    va_start(argptr, fmt);
+    vfprintf(stderr, fmt, argptr);
+    va_end(argptr);
+
+    fputc('\n', stderr);
+
+    num_errors++;
+    return false;
+}
+
+void count_packet(void* context, const struct mip_packet* packet, timestamp_type timestamp)
+{
+    (void)packet;
+    (void)timestamp;
+
+    (*(unsigned int*)context)++;
+}
+
+void dispatch_one(struct mip_dispatcher* dispatcher)
+{
+    uint8_t buffer[MIP_PACKET_LENGTH_MAX];
+    struct mip_packet packet;
+    mip_packet_create(&packet, buffer, sizeof(buffer), 0x80);
+
+    const uint8_t payload[4] = { 0 };
+    mip_packet_add_field(&packet, 0x04, payload, sizeof(payload));
+    mip_packet_finalize(&packet);
+
+    mip_dispatcher_dispatch_packet(dispatcher, &packet, 0);
+}
+
+void test_remove_handler()
+{
+    struct mip_dispatcher dispatcher;
+    mip_dispatcher_init(&dispatcher);
+
+    unsigned int counts[3] = { 0, 0, 0 };
+    struct mip_dispatch_handler handlers[3];
+
+    for(unsigned int i=0; i<3; i++)
+    {
+        mip_dispatch_handler_init_packet_handler(&handlers[i], 0x80, false, &count_packet, &counts[i]);
+        mip_dispatcher_add_handler(&dispatcher, &handlers[i]);
+    }
+
+    dispatch_one(&dispatcher);
+    check(counts[0] == 1 && counts[1] == 1 && counts[2] == 1, "All handlers should be called (%u %u %u)", counts[0], counts[1], counts[2]);
+
+    // Remove handlers other than the first, starting with the last.
+    mip_dispatcher_remove_handler(&dispatcher, &handlers[2]);
+    check(handlers[1]._next == NULL, "Removed handler should be unlinked from the list");
+
+    dispatch_one(&dispatcher);
+    check(counts[0] == 2 && counts[1] == 2 && counts[2] == 1, "Last handler should not be called after removal (%u %u %u)", counts[0], counts[1], counts[2]);
+
+    mip_dispatcher_remove_handler(&dispatcher, &handlers[1]);
+
+    dispatch_one(&dispatcher);
+    check(counts[0] == 3 && counts[1] == 2 && counts[2] == 1, "Middle handler should not be called after removal (%u %u %u)", counts[0], counts[1], counts[2]);
+
+    // Removing a handler which isn't registered has no effect.
+    mip_dispatcher_remove_handler(&dispatcher, &handlers[2]);
+
+    dispatch_one(&dispatcher);
+    check(counts[0] == 4, "First handler should still be called (%u)", counts[0]);
+
+    mip_dispatcher_remove_handler(&dispatcher, &handlers[0]);
+
+    dispatch_one(&dispatcher);
+    check(counts[0] == 4, "First handler should not be called after removal (%u)", counts[0]);
+}
+
+int main(int argc, const char* argv[])
+{
+    (void)argc;
+    (void)argv;
+
+    test_remove_handler();
+
+    return num_errors;
+}
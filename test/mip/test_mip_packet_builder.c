@@ -152,12 +152,58 @@ void test_short_buffer()
     check_equal( mip_packet_alloc_field(&packet, 0x06, 1, &p), -2, "Wrong remaining size after allocating 3 more bytes" );
 }
 
+void test_cancel_field()
+{
+    struct mip_packet packet;
+
+    mip_packet_create(&packet, buffer, sizeof(buffer), 0x80);
+
+    const uint8_t payload1[] = { 1, 2, 3, 4 };
+    check( mip_packet_add_field(&packet, 0x04, payload1, sizeof(payload1)), "Could not add field" );
+
+    const int total_length = mip_packet_total_length(&packet);
+    const int remaining    = mip_packet_remaining_space(&packet);
+
+    // Allocate then cancel.
+    uint8_t* p;
+    check_equal( mip_packet_alloc_field(&packet, 0x05, 10, &p), remaining-2-10, "Wrong remaining count after allocation" );
+    check_equal( mip_packet_cancel_last_field(&packet, p), remaining, "Wrong remaining count after cancelling allocated field" );
+    check_equal( mip_packet_total_length(&packet), total_length, "Cancelling allocated field didn't restore the length" );
+
+    // Allocate, resize, then cancel.
+    check_equal( mip_packet_alloc_field(&packet, 0x05, 2, &p), remaining-2-2, "Wrong remaining count after allocation" );
+    check_equal( mip_packet_realloc_last_field(&packet, p, 20), remaining-2-20, "Wrong remaining count after reallocation" );
+    check_equal( mip_packet_cancel_last_field(&packet, p), remaining, "Wrong remaining count after cancelling reallocated field" );
+    check_equal( mip_packet_total_length(&packet), total_length, "Cancelling reallocated field didn't restore the length" );
+
+    // Resizing beyond the available space fails and leaves the field as it was.
+    check_equal( mip_packet_alloc_field(&packet, 0x05, 0, &p), remaining-2, "Wrong remaining count after empty allocation" );
+    check( mip_packet_realloc_last_field(&packet, p, MIP_FIELD_PAYLOAD_LENGTH_MAX) < 0, "Reallocation beyond the packet size should fail" );
+    check_equal( mip_packet_total_length(&packet), total_length+2, "Failed reallocation changed the length" );
+    check_equal( mip_packet_cancel_last_field(&packet, p), remaining, "Wrong remaining count after cancelling field" );
+
+    // Empty payload.
+    check_equal( mip_packet_alloc_field(&packet, 0x05, 0, &p), remaining-2, "Wrong remaining count after empty allocation" );
+    check_equal( mip_packet_cancel_last_field(&packet, p), remaining, "Wrong remaining count after cancelling empty field" );
+
+    // The earlier field is intact and the packet can still be completed.
+    check_equal( mip_packet_payload_length(&packet), 2+sizeof(payload1), "Payload length is wrong after cancelling" );
+    check_equal( mip_packet_payload(&packet)[MIP_INDEX_FIELD_DESC], 0x04, "Field descriptor is wrong after cancelling" );
+    check( mip_packet_add_field(&packet, 0x06, payload1, sizeof(payload1)), "Could not add field after cancelling" );
+    check_equal( mip_packet_payload(&packet)[2+sizeof(payload1) + MIP_INDEX_FIELD_DESC], 0x06, "Field descriptor is wrong for field added after cancelling" );
+    check_equal( mip_packet_total_length(&packet), total_length+2+sizeof(payload1), "Total length is wrong for field added after cancelling" );
+
+    mip_packet_finalize(&packet);
+    check(mip_packet_is_sane(&packet), "Packet is not sane after cancelling a field");
+}
+
 int main(int argc, const char* argv[])
 {
     test_init();
     test_create();
     test_add_fields();
     test_short_buffer();
+    test_cancel_field();
 
     return num_errors;
 }
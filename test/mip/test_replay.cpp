@@ -0,0 +1,178 @@
+#include <mip/platform/replay_connection.hpp>
+#include <mip/definitions/commands_base.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include <stdarg.h>
+
+using namespace mip;
+
+unsigned int numErrors = 0;
+
+bool check(bool condition, const char* fmt, ...)
+{
+    if( condition )
+        return true;
+
+    va_list argptr;
+    va_start(argptr, fmt);
+    vfprintf(stderr, fmt, argptr);
+    va_end(argptr);
+
+    fputc('\n', stderr);
+
+    numErrors++;
+    return false;
+}
+
+Timestamp getCurrentTimestamp()
+{
+    using namespace std::chrono;
+    return duration_cast<milliseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+const char* DATA_FILE      = "TestReplay.bin";
+const char* TIMESTAMP_FILE = "TestReplay.ts";
+const size_t READ_SIZE      = 500;
+
+////////////////////////////////////////////////////////////////////////////////
+///@brief Stands in for a device, returning a file in fixed-size reads with
+///       made-up receive times.
+///
+class FileDevice : public Connection
+{
+public:
+    FileDevice(const std::string& filename) : mFile(filename, std::ios::binary) {}
+
+    bool isOpen() const { return mFile.is_open(); }
+
+    bool sendToDevice(const uint8_t* data, size_t length) final { (void)data; (void)length; return true; }
+
+    bool recvFromDevice(uint8_t* buffer, size_t max_length, size_t* length_out, Timestamp* timestamp) final
+    {
+        mFile.read(reinterpret_cast<char*>(buffer), std::streamsize(std::min<size_t>(max_length, READ_SIZE)));
+
+        *length_out = size_t(mFile.gcount());
+        *timestamp  = 1000 + 7 * mReads++;
+
+        return *length_out > 0;
+    }
+
+private:
+    std::ifstream mFile;
+    Timestamp     mReads = 0;
+};
+
+struct PacketLog
+{
+    std::vector<Timestamp> timestamps;
+};
+
+void logPacket(void* context, const Packet& packet, Timestamp timestamp)
+{
+    (void)packet;
+    static_cast<PacketLog*>(context)->timestamps.push_back(timestamp);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+///@brief Records the test data through a RecordingConnection.
+///
+bool record(const char* filename, PacketLog& log, uint64_t* bytesRecorded)
+{
+    FileDevice source(filename);
+    if( !check(source.isOpen(), "Could not open %s", filename) )
+        return false;
+
+    platform::RecordingConnection connection(source, DATA_FILE, TIMESTAMP_FILE);
+
+    uint8_t parseBuffer[1024];
+    DeviceInterface device(&connection, parseBuffer, sizeof(parseBuffer), 1000, 1000);
+
+    DispatchHandler handler;
+    device.registerPacketCallback<&logPacket>(handler, Dispatcher::ANY_DATA_SET, false, &log);
+
+    while( device.update() )
+        ;
+
+    *bytesRecorded = connection.bytesRecorded();
+    return true;
+}
+
+void testRecordAndReplay(const char* filename)
+{
+    PacketLog recorded;
+    uint64_t bytesRecorded = 0;
+
+    if( !record(filename, recorded, &bytesRecorded) )
+        return;
+
+    std::ifstream original(filename, std::ios::binary | std::ios::ate);
+    check(bytesRecorded == uint64_t(original.tellg()), "Recording should contain the whole stream (%u bytes)", (unsigned)bytesRecorded);
+    check(recorded.timestamps.size() > 100, "Recording should contain data packets (%u)", (unsigned)recorded.timestamps.size());
+
+    platform::ReplayConnection connection(DATA_FILE, TIMESTAMP_FILE);
+    connection.setPacing(platform::ReplayConnection::Pacing::AS_FAST_AS_POSSIBLE);
+    connection.setReplyMode(platform::ReplayConnection::ReplyMode::ACK_ALL);
+
+    commands_base::BaseDeviceInfo info = {};
+    std::strcpy(info.model_name, "3DM-TEST");
+
+    commands_base::GetDeviceInfo::Response response;
+    response.device_info = info;
+    connection.setResponse<commands_base::GetDeviceInfo>(response);
+
+    uint8_t parseBuffer[1024];
+    DeviceInterface device(&connection, parseBuffer, sizeof(parseBuffer), 1000, 1000);
+
+    PacketLog replayed;
+    DispatchHandler handler;
+    device.registerPacketCallback<&logPacket>(handler, Dispatcher::ANY_DATA_SET, false, &replayed);
+
+    // Commands complete against the replay while the recording plays.
+    CmdResult result = commands_base::ping(device);
+    check(result == CmdResult::ACK_OK, "Ping should be acknowledged (%s)", result.name());
+
+    commands_base::BaseDeviceInfo readInfo = {};
+    result = commands_base::getDeviceInfo(device, &readInfo);
+    check(result == CmdResult::ACK_OK, "Device info should be replied (%s)", result.name());
+    check(std::strcmp(readInfo.model_name, "3DM-TEST") == 0, "Device info should have the scripted response (%.16s)", readInfo.model_name);
+
+    check(connection.commandsReceived() == 2, "Replay should receive both commands (%u)", (unsigned)connection.commandsReceived());
+
+    while( device.update() )
+        ;
+
+    check(connection.finished(), "Replay should reach the end of the recording");
+    check(connection.bytesReplayed() == bytesRecorded, "Replay should return every recorded byte (%u)", (unsigned)connection.bytesReplayed());
+
+    if( check(replayed.timestamps.size() == recorded.timestamps.size(), "Replay should return every packet (%u != %u)", (unsigned)replayed.timestamps.size(), (unsigned)recorded.timestamps.size()) )
+    {
+        for(size_t i=0; i<recorded.timestamps.size(); i++)
+        {
+            if( !check(replayed.timestamps[i] == recorded.timestamps[i], "Packet %u should have its recorded timestamp (%u != %u)", (unsigned)i, (unsigned)replayed.timestamps[i], (unsigned)recorded.timestamps[i]) )
+                break;
+        }
+    }
+}
+
+int main(int argc, const char* argv[])
+{
+    if( argc != 2 )
+    {
+        fprintf(stderr, "Usage: %s <data file>\n", argv[0]);
+        return 1;
+    }
+
+    testRecordAndReplay(argv[1]);
+
+    std::remove(DATA_FILE);
+    std::remove(TIMESTAMP_FILE);
+
+    return numErrors;
+}
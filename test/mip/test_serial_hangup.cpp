@@ -0,0 +1,178 @@
+#include <mip/extras/resilient_connection.hpp>
+#include <mip/platform/serial_connection.hpp>
+#include <mip/utils/serial_port.h>
+
+#include <chrono>
+#include <memory>
+#include <string>
+
+#include <fcntl.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+using namespace mip;
+
+unsigned int numErrors = 0;
+
+bool check(bool condition, const char* fmt, ...)
+{
+    if( condition )
+        return true;
+
+    va_list argptr;
+    va_start(argptr, fmt);
+    vfprintf(stderr, fmt, argptr);
+    va_end(argptr);
+
+    fputc('\n', stderr);
+
+    numErrors++;
+    return false;
+}
+
+Timestamp getCurrentTimestamp()
+{
+    using namespace std::chrono;
+    return duration_cast<milliseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+///@brief Opens a pseudo-terminal, standing in for a USB-serial adapter.
+///
+/// Closing the returned master end hangs up the port, as unplugging the
+/// adapter does.
+///
+int openPty(std::string* portName)
+{
+    const int master = posix_openpt(O_RDWR | O_NOCTTY);
+
+    if( master < 0 || grantpt(master) != 0 || unlockpt(master) != 0 )
+        return -1;
+
+    *portName = ptsname(master);
+    return master;
+}
+
+void testSerialPortRead()
+{
+    std::string portName;
+    const int master = openPty(&portName);
+    if( !check(master >= 0, "Could not open a pty") )
+        return;
+
+    serial_port port;
+    if( !check(serial_port_open(&port, portName.c_str(), 115200), "Could not open %s", portName.c_str()) )
+        return;
+
+    serial_port_set_read_timeout(&port, 10);
+
+    uint8_t buffer[16];
+    size_t length;
+
+    check(write(master, "\x75\x65", 2) == 2, "Could not write to the pty");
+    check(serial_port_read(&port, buffer, sizeof(buffer), &length) && length == 2, "Read should return the data (%u bytes)", (unsigned)length);
+    check(serial_port_read(&port, buffer, sizeof(buffer), &length) && length == 0, "Read without data should time out (%u bytes)", (unsigned)length);
+
+    close(master);
+
+    check(!serial_port_read(&port, buffer, sizeof(buffer), &length), "Read after hangup should fail");
+    check(length == 0, "Read after hangup should return no data");
+
+    serial_port_close(&port);
+}
+
+void testSerialConnectionRead()
+{
+    std::string portName;
+    const int master = openPty(&portName);
+    if( !check(master >= 0, "Could not open a pty") )
+        return;
+
+    platform::SerialConnection connection(portName, 115200);
+    connection.setReadTimeout(10);
+
+    uint8_t buffer[16];
+    const byte_ring_iov segments[2] = { { &buffer[0], 8 }, { &buffer[8], 8 } };
+    size_t length;
+    Timestamp timestamp;
+
+    check(write(master, "\x75\x65", 2) == 2, "Could not write to the pty");
+    check(connection.recvFromDeviceV(segments, 2, &length, &timestamp) && length == 2, "Vectored read should return the data (%u bytes)", (unsigned)length);
+    check(connection.recvFromDeviceV(segments, 2, &length, &timestamp) && length == 0, "Vectored read without data should time out (%u bytes)", (unsigned)length);
+
+    close(master);
+
+    check(!connection.recvFromDeviceV(segments, 2, &length, &timestamp), "Vectored read after hangup should fail");
+    check(!connection.recvFromDevice(buffer, sizeof(buffer), &length, &timestamp), "Read after hangup should fail");
+}
+
+struct Adapter
+{
+    int          master   = -1;
+    unsigned int connects = 0;
+};
+
+std::unique_ptr<Connection> connectAdapter(void* userData)
+{
+    Adapter* adapter = static_cast<Adapter*>(userData);
+
+    std::string portName;
+    adapter->master = openPty(&portName);
+    if( adapter->master < 0 )
+        return nullptr;
+
+    adapter->connects++;
+    return std::unique_ptr<Connection>(new platform::SerialConnection(portName, 115200));
+}
+
+void countEvent(void* userData, extras::ResilientConnection::Event event, const extras::ResilientConnection::Gap&)
+{
+    if( event == extras::ResilientConnection::Event::DISCONNECTED )
+        (*static_cast<unsigned int*>(userData))++;
+}
+
+void testResilientReconnect()
+{
+    Adapter adapter;
+    unsigned int disconnects = 0;
+
+    extras::ResilientConnection connection(&connectAdapter, &adapter, &getCurrentTimestamp);
+    connection.setReadTimeout(10);
+    connection.setEventCallback(&countEvent, &disconnects);
+
+    uint8_t parseBuffer[1024];
+    DeviceInterface device(&connection, parseBuffer, sizeof(parseBuffer), 1000, 2000);
+    connection.attach(device);
+
+    if( !check(connection.connect(), "Could not connect") )
+        return;
+
+    check(device.update(), "Update should succeed while connected");
+    check(disconnects == 0, "Disconnected without a hangup");
+
+    // Unplug the adapter. The next update must notice and reconnect instead
+    // of reading nothing forever.
+    close(adapter.master);
+
+    for(unsigned int i=0; i<10 && connection.numReconnects() == 0; i++)
+        device.update();
+
+    check(disconnects == 1, "Hangup should be reported once (%u)", disconnects);
+    check(connection.numReconnects() == 1 && adapter.connects == 2, "Connection should be reopened after a hangup (%u)", adapter.connects);
+
+    close(adapter.master);
+}
+
+int main(int argc, const char* argv[])
+{
+    (void)argc;
+    (void)argv;
+
+    testSerialPortRead();
+    testSerialConnectionRead();
+    testResilientReconnect();
+
+    return numErrors;
+}
@@ -0,0 +1,215 @@
+#include <mip/platform/shm_ring.hpp>
+
+#include <chrono>
+#include <memory>
+#include <stdexcept>
+#include <string>
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+using namespace mip;
+
+unsigned int numErrors = 0;
+
+bool check(bool condition, const char* fmt, ...)
+{
+    if( condition )
+        return true;
+
+    va_list argptr;
+    va_start(argptr, fmt);
+    vfprintf(stderr, fmt, argptr);
+    va_end(argptr);
+
+    fputc('\n', stderr);
+
+    numErrors++;
+    return false;
+}
+
+Timestamp getCurrentTimestamp()
+{
+    using namespace std::chrono;
+    return duration_cast<milliseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+std::string ringName()
+{
+    return "/mip_test_ring_" + std::to_string(getpid());
+}
+
+////////////////////////////////////////////////////////////////////////////////
+///@brief Fills a packet-sized buffer with a pattern identifying it.
+///
+void makePacket(uint8_t* packet, uint16_t length, uint8_t id)
+{
+    for(uint16_t i=0; i<length; i++)
+        packet[i] = uint8_t(id + i);
+}
+
+void testPublishAndRead()
+{
+    platform::ShmRingProducer producer(ringName(), 4096);
+    platform::ShmRingConnection connection(ringName());
+    connection.setReadTimeout(0);
+    connection.setProducerTimestamps(true);
+
+    uint8_t packets[3][20];
+    for(uint8_t i=0; i<3; i++)
+    {
+        makePacket(packets[i], sizeof(packets[i]), i);
+        producer.publish(packets[i], sizeof(packets[i]), 100+i);
+    }
+
+    uint8_t buffer[256];
+    size_t length;
+    Timestamp timestamp;
+
+    check(connection.recvFromDevice(buffer, sizeof(buffer), &length, &timestamp), "Read should succeed");
+    check(length == sizeof(packets), "Read should return all packets (%u bytes)", (unsigned)length);
+    check(memcmp(buffer, packets, sizeof(packets)) == 0, "Packets should be read unchanged");
+    check(timestamp == 102, "Timestamp should be the producer's (%u)", (unsigned)timestamp);
+    check(connection.receivedPackets() == 3, "Should count 3 packets (%u)", (unsigned)connection.receivedPackets());
+    check(connection.droppedPackets() == 0, "Should drop no packets (%u)", (unsigned)connection.droppedPackets());
+
+    check(connection.recvFromDevice(buffer, sizeof(buffer), &length, &timestamp) && length == 0, "Read without data should return nothing (%u bytes)", (unsigned)length);
+
+    // Only whole packets are copied into the buffer.
+    producer.publish(packets[0], sizeof(packets[0]), 0);
+    producer.publish(packets[1], sizeof(packets[1]), 0);
+
+    check(connection.recvFromDevice(buffer, 30, &length, &timestamp) && length == 20, "Read should stop before a packet that doesn't fit (%u bytes)", (unsigned)length);
+    check(connection.recvFromDevice(buffer, 30, &length, &timestamp) && length == 20, "Read should return the remaining packet (%u bytes)", (unsigned)length);
+    check(memcmp(buffer, packets[1], sizeof(packets[1])) == 0, "Remaining packet should be read unchanged");
+}
+
+void testOverrun()
+{
+    platform::ShmRingProducer producer(ringName(), 4096);
+    platform::ShmRingConnection connection(ringName());
+    connection.setReadTimeout(0);
+
+    uint8_t packet[40];
+    uint8_t buffer[256];
+    size_t length;
+    Timestamp timestamp;
+
+    makePacket(packet, sizeof(packet), 0);
+    producer.publish(packet, sizeof(packet), 0);
+    check(connection.recvFromDevice(buffer, sizeof(buffer), &length, &timestamp) && length == sizeof(packet), "First packet should be read (%u bytes)", (unsigned)length);
+
+    // Lap the reader: 64-byte records in a 4096-byte ring.
+    const unsigned int LAPPED = 100;
+    for(unsigned int i=0; i<LAPPED; i++)
+        producer.publish(packet, sizeof(packet), 0);
+
+    check(connection.recvFromDevice(buffer, sizeof(buffer), &length, &timestamp), "Read after an overrun should succeed");
+
+    makePacket(packet, sizeof(packet), 7);
+    producer.publish(packet, sizeof(packet), 0);
+
+    check(connection.recvFromDevice(buffer, sizeof(buffer), &length, &timestamp) && length == sizeof(packet), "Reader should resume with new packets (%u bytes)", (unsigned)length);
+    check(memcmp(buffer, packet, sizeof(packet)) == 0, "Resumed packet should be read unchanged");
+    check(connection.droppedPackets() == LAPPED, "Overwritten packets should be counted as dropped (%u)", (unsigned)connection.droppedPackets());
+}
+
+void testProducerDestroyed()
+{
+    std::unique_ptr<platform::ShmRingProducer> producer(new platform::ShmRingProducer(ringName(), 4096));
+    platform::ShmRingConnection connection(ringName());
+    connection.setReadTimeout(10);
+
+    uint8_t buffer[256];
+    size_t length;
+    Timestamp timestamp;
+
+    check(connection.recvFromDevice(buffer, sizeof(buffer), &length, &timestamp), "Read should succeed while the producer exists");
+
+    producer.reset();
+
+    check(!connection.recvFromDevice(buffer, sizeof(buffer), &length, &timestamp), "Read should fail once the producer is destroyed");
+
+    bool opened = true;
+    try
+    {
+        platform::ShmRingConnection reconnect(ringName());
+    }
+    catch(const std::runtime_error&)
+    {
+        opened = false;
+    }
+    check(!opened, "Connecting to a destroyed producer should fail");
+}
+
+void testNameInUse()
+{
+    platform::ShmRingProducer producer(ringName(), 4096);
+    platform::ShmRingConnection connection(ringName());
+    connection.setReadTimeout(0);
+
+    bool replaced = true;
+    try
+    {
+        platform::ShmRingProducer second(ringName(), 4096);
+    }
+    catch(const std::runtime_error&)
+    {
+        replaced = false;
+    }
+    check(!replaced, "A live producer's ring should not be replaced");
+
+    uint8_t packet[20];
+    uint8_t buffer[256];
+    size_t length;
+    Timestamp timestamp;
+
+    makePacket(packet, sizeof(packet), 0);
+    producer.publish(packet, sizeof(packet), 0);
+    check(connection.recvFromDevice(buffer, sizeof(buffer), &length, &timestamp) && length == sizeof(packet), "Original ring should still work (%u bytes)", (unsigned)length);
+}
+
+void testKilledProducer()
+{
+    const std::string name = ringName();
+
+    // A producer in another process which exits without cleaning up.
+    const pid_t child = fork();
+    if( child == 0 )
+    {
+        new platform::ShmRingProducer(name, 4096);
+        _exit(0);
+    }
+
+    int status = 0;
+    if( !check(child > 0 && waitpid(child, &status, 0) == child && WIFEXITED(status), "Producer process failed") )
+        return;
+
+    bool replaced = true;
+    try
+    {
+        platform::ShmRingProducer producer(name, 4096);
+    }
+    catch(const std::runtime_error&)
+    {
+        replaced = false;
+    }
+    check(replaced, "An abandoned ring should be replaced");
+}
+
+int main(int argc, const char* argv[])
+{
+    (void)argc;
+    (void)argv;
+
+    testPublishAndRead();
+    testOverrun();
+    testProducerDestroyed();
+    testNameInUse();
+    testKilledProducer();
+
+    return numErrors;
+}
@@ -0,0 +1,249 @@
+
+////////////////////////////////////////////////////////////////////////////////
+///@file provision.cpp
+///
+///@brief Configures many devices in parallel from a settings snapshot.
+///
+/// Capture a snapshot from a configured ("golden") device:
+///
+///     mip_provision capture golden.mipsnap /dev/ttyUSB0,115200
+///
+/// Then apply it to any number of devices at once:
+///
+///     mip_provision apply golden.mipsnap /dev/ttyUSB0,115200 /dev/ttyUSB1,115200 192.168.1.10,5000
+///
+/// Each device is handled by its own thread, so total time is roughly that of
+/// the slowest device rather than the sum. A result line with the serial
+/// number, outcome, and timing is printed for each device, and the exit code
+/// is nonzero if any device failed.
+///
+////////////////////////////////////////////////////////////////////////////////
+
+#include "example_utils.hpp"
+
+#include <mip/extras/settings_snapshot.hpp>
+#include <mip/definitions/commands_base.hpp>
+
+#include <thread>
+#include <vector>
+#include <string>
+#include <cstring>
+#include <stdexcept>
+#include <stdio.h>
+
+
+struct Options
+{
+    mip::extras::ConfigPlan::Options plan;
+    bool resume = false;  ///< Resume streaming after configuring.
+};
+
+struct DeviceResult
+{
+    std::string                        spec;
+    std::string                        serialNumber;
+    std::string                        error;       ///< Set if the device couldn't be configured at all.
+    mip::extras::ConfigPlan::Report    report;
+    mip::Timeout                       duration = 0;  ///< Total time including opening the port.
+
+    bool ok() const { return error.empty() && report.ok(); }
+};
+
+
+int printUsage(const char* argv[])
+{
+    fprintf(stderr,
+        "Usage: %s capture <snapshot-file> <device>\n"
+        "Usage: %s apply [--no-diff] [--no-save] [--resume] <snapshot-file> <device> [<device> ...]\n"
+        "\n"
+        "  <device> is <portname>,<baudrate> or <hostname>,<port>.\n"
+        "  --no-diff  Write every setting without reading it first.\n"
+        "  --no-save  Don't save the settings as the startup settings.\n"
+        "  --resume   Resume streaming after configuring.\n",
+        argv[0], argv[0]
+    );
+    return 1;
+}
+
+std::unique_ptr<ExampleUtils> openDevice(const std::string& spec)
+{
+    const size_t comma = spec.rfind(',');
+    if( comma == std::string::npos )
+        throw std::runtime_error("Expected <port>,<baudrate> or <host>,<port>");
+
+    return openFromArgs(spec.substr(0, comma), spec.substr(comma+1));
+}
+
+std::string serialNumberOf(const mip::commands_base::BaseDeviceInfo& info)
+{
+    return std::string(info.serial_number, strnlen(info.serial_number, sizeof(info.serial_number)));
+}
+
+////////////////////////////////////////////////////////////////////////////////
+///@brief Configures one device. Runs in its own thread.
+///
+void provision(const mip::extras::SettingsSnapshot& snapshot, const Options& options, DeviceResult& result)
+{
+    const mip::Timestamp startTime = getCurrentTimestamp();
+
+    try
+    {
+        std::unique_ptr<ExampleUtils> utils = openDevice(result.spec);
+        mip::DeviceInterface& device = *utils->device;
+
+        // Stop streaming so data doesn't compete with command replies.
+        mip::CmdResult cmdResult = mip::commands_base::setIdle(device);
+        if( cmdResult != mip::CmdResult::ACK_OK )
+            throw std::runtime_error(std::string("Set to idle failed: ") + cmdResult.name());
+
+        mip::commands_base::BaseDeviceInfo info;
+        if( mip::commands_base::getDeviceInfo(device, &info) == mip::CmdResult::ACK_OK )
+            result.serialNumber = serialNumberOf(info);
+
+        mip::extras::ConfigPlan plan;
+        snapshot.toPlan(plan);
+
+        if( options.resume )
+            plan.add(mip::commands_base::Resume{});
+
+        result.report = plan.apply(device, options.plan, &getCurrentTimestamp);
+    }
+    catch(const std::exception& ex)
+    {
+        result.error = ex.what();
+    }
+
+    result.duration = getCurrentTimestamp() - startTime;
+}
+
+int capture(const std::string& filename, const std::string& spec)
+{
+    std::unique_ptr<ExampleUtils> utils = openDevice(spec);
+    mip::DeviceInterface& device = *utils->device;
+
+    mip::CmdResult result = mip::commands_base::setIdle(device);
+    if( result != mip::CmdResult::ACK_OK )
+        throw std::runtime_error(std::string("Set to idle failed: ") + result.name());
+
+    const mip::Timestamp startTime = getCurrentTimestamp();
+
+    mip::extras::SettingsSnapshot snapshot;
+    if( snapshot.capture(device) == 0 )
+        throw std::runtime_error("No settings could be read from the device");
+
+    const mip::Timeout duration = getCurrentTimestamp() - startTime;
+
+    if( !snapshot.save(filename) )
+        throw std::runtime_error("Unable to write " + filename);
+
+    printf("Captured %zu settings in %u ms to %s.\n", snapshot.size(), (unsigned int)duration, filename.c_str());
+
+    return 0;
+}
+
+int apply(const std::string& filename, const std::vector<std::string>& specs, const Options& options)
+{
+    mip::extras::SettingsSnapshot snapshot;
+    if( !snapshot.load(filename) )
+        throw std::runtime_error("Unable to read snapshot " + filename);
+
+    printf("Applying %zu settings to %zu devices...\n", snapshot.size(), specs.size());
+
+    std::vector<DeviceResult> results(specs.size());
+    std::vector<std::thread> threads;
+    threads.reserve(specs.size());
+
+    const mip::Timestamp startTime = getCurrentTimestamp();
+
+    for(size_t i=0; i<specs.size(); i++)
+    {
+        results[i].spec = specs[i];
+        threads.emplace_back(&provision, std::cref(snapshot), std::cref(options), std::ref(results[i]));
+    }
+
+    for(std::thread& thread : threads)
+        thread.join();
+
+    const mip::Timeout totalDuration = getCurrentTimestamp() - startTime;
+
+    printf("\n%-24s %-16s %-6s %9s %7s %6s %7s %6s %8s\n", "Device", "Serial", "Result", "Unchanged", "Written", "Failed", "Packets", "Saved", "Time(ms)");
+
+    size_t numFailed = 0;
+
+    for(const DeviceResult& result : results)
+    {
+        if( !result.ok() )
+            numFailed++;
+
+        if( !result.error.empty() )
+        {
+            printf("%-24s %-16s %-6s %s\n", result.spec.c_str(), result.serialNumber.c_str(), "ERROR", result.error.c_str());
+            continue;
+        }
+
+        const mip::extras::ConfigPlan::Report& report = result.report;
+
+        printf("%-24s %-16s %-6s %9zu %7zu %6zu %7zu %6s %8u\n",
+            result.spec.c_str(), result.serialNumber.c_str(), result.ok() ? "OK" : "FAIL",
+            report.numUnchanged, report.numWritten, report.numFailed, report.numPackets,
+            report.saved ? (report.saveResult == mip::CmdResult::ACK_OK ? "yes" : report.saveResult.name()) : "no",
+            (unsigned int)result.duration
+        );
+    }
+
+    printf("\n%zu of %zu devices configured successfully in %u ms.\n", results.size() - numFailed, results.size(), (unsigned int)totalDuration);
+
+    return numFailed == 0 ? 0 : 2;
+}
+
+
+int main(int argc, const char* argv[])
+{
+    if( argc < 2 )
+        return printUsage(argv);
+
+    try
+    {
+        const std::string mode = argv[1];
+
+        if( mode == "capture" )
+        {
+            if( argc != 4 )
+                return printUsage(argv);
+
+            return capture(argv[2], argv[3]);
+        }
+        else if( mode == "apply" )
+        {
+            Options options;
+
+            int arg = 2;
+            for(; arg < argc && std::strncmp(argv[arg], "--", 2) == 0; arg++)
+            {
+                if( std::strcmp(argv[arg], "--no-diff") == 0 )
+                    options.plan.diff = false;
+                else if( std::strcmp(argv[arg], "--no-save") == 0 )
+                    options.plan.save = false;
+                else if( std::strcmp(argv[arg], "--resume") == 0 )
+                    options.resume = true;
+                else
+                    return printUsage(argv);
+            }
+
+            if( argc - arg < 2 )
+                return printUsage(argv);
+
+            const std::string filename = argv[arg++];
+            const std::vector<std::string> specs(argv + arg, argv + argc);
+
+            return apply(filename, specs, options);
+        }
+        else
+            return printUsage(argv);
+    }
+    catch(const std::exception& ex)
+    {
+        fprintf(stderr, "Error: %s\n", ex.what());
+        return 1;
+    }
+}
@@ -0,0 +1,182 @@
+
+////////////////////////////////////////////////////////////////////////////////
+///@file relay.cpp
+///
+///@brief Shares one device with many local processes.
+///
+/// The relay opens the device and accepts clients on Unix-domain and/or TCP
+/// sockets. Each client receives the raw MIP stream and may send commands,
+/// whose replies are routed back to it:
+///
+///     mip_relay /dev/ttyACM0 921600 --unix /run/mip.sock --tcp 127.0.0.1:5000
+///
+/// A list of descriptor sets may be appended to a listener to limit what its
+/// clients receive, e.g. only IMU and filter data:
+///
+///     mip_relay /dev/ttyACM0 921600 --unix /run/mip_nav.sock=0x80,0x82
+///
+/// Clients connect like they would to a device over TCP. Processes which only
+/// need data can instead read the packets from shared memory with a
+/// ShmRingConnection, which avoids the socket copies:
+///
+///     mip_relay /dev/ttyACM0 921600 --shm /mip_gq7
+///
+/// The relay runs until interrupted or until the device connection fails, in
+/// which case the exit code is nonzero.
+///
+////////////////////////////////////////////////////////////////////////////////
+
+#include "example_utils.hpp"
+
+#include <mip/platform/relay_server.hpp>
+#include <mip/platform/shm_ring.hpp>
+
+#include <csignal>
+#include <cstdlib>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <stdio.h>
+
+
+mip::platform::RelayServer* relay = nullptr;  ///< For the signal handler.
+
+
+int printUsage(const char* argv[])
+{
+    fprintf(stderr,
+        "Usage: %s <portname> <baudrate> <listener> [<listener> ...]\n"
+        "Usage: %s <hostname> <port> <listener> [<listener> ...]\n"
+        "\n"
+        "  <listener> is one of:\n"
+        "    --unix <path>[=<sets>]             Unix-domain socket.\n"
+        "    --tcp [<address>:]<port>[=<sets>]  TCP port, on all interfaces by default.\n"
+        "    --shm <name>                       Shared memory ring (receive only), e.g. /mip_gq7.\n"
+        "\n"
+        "  <sets> is a comma-separated list of descriptor sets (e.g. 0x80,0x82)\n"
+        "  sent to the listener's clients. By default, all are sent.\n",
+        argv[0], argv[0]
+    );
+    return 1;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+///@brief Splits "<endpoint>=<sets>" into the endpoint and a filter.
+///
+mip::platform::RelayServer::Filter parseFilter(std::string& spec)
+{
+    mip::platform::RelayServer::Filter filter;
+
+    const size_t equals = spec.rfind('=');
+    if( equals == std::string::npos )
+        return filter;
+
+    filter.clear();
+
+    const char* sets = spec.c_str() + equals + 1;
+    while( *sets )
+    {
+        char* end;
+        const unsigned long descriptorSet = std::strtoul(sets, &end, 0);
+
+        if( end == sets || descriptorSet > 0xFF || (*end != ',' && *end != '\0') )
+            throw std::runtime_error("Invalid descriptor set list in '" + spec + "'");
+
+        filter.allow(uint8_t(descriptorSet));
+        sets = (*end == ',') ? end + 1 : end;
+    }
+
+    spec.resize(equals);
+    return filter;
+}
+
+void addListener(mip::platform::RelayServer& server, const std::string& type, std::string spec)
+{
+    const mip::platform::RelayServer::Filter filter = parseFilter(spec);
+
+    bool ok = false;
+
+    if( type == "--unix" )
+    {
+        ok = server.listenUnix(spec, filter);
+    }
+    else if( type == "--tcp" )
+    {
+        const size_t colon = spec.rfind(':');
+        const std::string address = (colon == std::string::npos) ? std::string() : spec.substr(0, colon);
+        const unsigned long port  = std::strtoul(spec.c_str() + (colon == std::string::npos ? 0 : colon + 1), nullptr, 10);
+
+        if( port == 0 || port > 0xFFFF )
+            throw std::runtime_error("Invalid TCP port in '" + spec + "'");
+
+        ok = server.listenTcp(uint16_t(port), address.empty() ? nullptr : address.c_str(), filter);
+    }
+    else
+        throw std::runtime_error("Unknown option '" + type + "'");
+
+    if( !ok )
+        throw std::runtime_error("Unable to listen on '" + spec + "'");
+
+    fprintf(stderr, "Listening on %s\n", spec.c_str());
+}
+
+void handleClient(void* server, unsigned int clientId, bool connected)
+{
+    fprintf(stderr, "Client %u %s (%zu connected)\n", clientId, connected ? "connected" : "disconnected", static_cast<mip::platform::RelayServer*>(server)->numClients());
+}
+
+void handleSignal(int)
+{
+    if( relay )
+        relay->stop();
+}
+
+
+int main(int argc, const char* argv[])
+{
+    if( argc < 5 || (argc - 3) % 2 != 0 )
+        return printUsage(argv);
+
+    try
+    {
+        std::unique_ptr<ExampleUtils> utils = openFromArgs(argv[1], argv[2]);
+
+        mip::platform::RelayServer server(*utils->device);
+        server.setClientCallback(&handleClient, &server);
+
+        std::vector<std::unique_ptr<mip::platform::ShmRingProducer>> producers;
+
+        for(int i=3; i+1<argc; i+=2)
+        {
+            if( std::string(argv[i]) == "--shm" )
+            {
+                producers.emplace_back(new mip::platform::ShmRingProducer(argv[i+1]));
+                producers.back()->attach(*utils->device);
+                fprintf(stderr, "Publishing to %s\n", argv[i+1]);
+            }
+            else
+                addListener(server, argv[i], argv[i+1]);
+        }
+
+        relay = &server;
+        std::signal(SIGINT, &handleSignal);
+        std::signal(SIGTERM, &handleSignal);
+
+        const bool ok = server.run();
+
+        relay = nullptr;
+
+        if( !ok )
+        {
+            fprintf(stderr, "Lost connection to the device.\n");
+            return 1;
+        }
+    }
+    catch(const std::exception& ex)
+    {
+        fprintf(stderr, "Error: %s\n", ex.what());
+        return 1;
+    }
+
+    return 0;
+}